@@ -0,0 +1,284 @@
+#include "Bench.hpp"
+#include "AllocStats.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+
+// Min number of milliseconds of one measured run.
+#ifndef BENCH_MIN_TIME
+#define BENCH_MIN_TIME 200 // Default 200ms.
+#endif // BENCH_MIN_TIME
+
+// Number of measured runs per benchmark; the median is reported.
+#ifndef BENCH_REPEATS
+#define BENCH_REPEATS 5 // Default 5 runs.
+#endif // BENCH_REPEATS
+
+// File the results are written to.
+#ifndef BENCH_OUTPUT
+#define BENCH_OUTPUT "bench_output.txt"
+#endif // BENCH_OUTPUT
+
+namespace {
+
+#ifndef CSR_ALLOC_STATS
+unsigned long allocationCount = 0;
+unsigned long allocationBytes = 0;
+#endif // CSR_ALLOC_STATS
+
+const void* volatile kept = NULL;
+FILE* output = NULL;
+
+/**
+ * Gets the current time of a monotonic clock.
+ *
+ * @return Nanoseconds since an arbitrary point.
+ */
+inline double now() {
+#ifndef _WIN32
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+#else
+    return clock() * (1e9 / CLOCKS_PER_SEC);
+#endif // _WIN32
+}
+
+#ifndef CSR_ALLOC_STATS
+/**
+ * Counts an allocation and makes it.
+ */
+inline void* allocate(size_t size) {
+    allocationCount++;
+    allocationBytes += size;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+/**
+ * Gets the number of allocations so far.
+ */
+inline unsigned long countallocations() {
+    return allocationCount;
+}
+
+/**
+ * Gets the number of bytes allocated so far.
+ */
+inline unsigned long countbytes() {
+    return allocationBytes;
+}
+#else
+// Builds with allocation accounting already replace operator new.
+inline unsigned long countallocations() {
+    return Csr::Http::Message::AllocStats::get().allocations;
+}
+
+inline unsigned long countbytes() {
+    return Csr::Http::Message::AllocStats::get().bytes;
+}
+#endif // CSR_ALLOC_STATS
+
+/**
+ * Sorts a small array of doubles in place.
+ */
+inline void sort(double* values, int count) {
+    for (int i = 1; i < count; i++) {
+        double value = values[i];
+        int j = i - 1;
+        while (j >= 0 && values[j] > value) {
+            values[j + 1] = values[j];
+            j--;
+        }
+        values[j + 1] = value;
+    }
+}
+
+} // namespace
+
+#ifndef CSR_ALLOC_STATS
+/*******************************************************************************
+ * Allocation counting
+ ******************************************************************************/
+void* operator new(size_t size) throw(std::bad_alloc) {
+    return allocate(size);
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+    return allocate(size);
+}
+
+void operator delete(void* p) throw() {
+    free(p);
+}
+
+void operator delete[](void* p) throw() {
+    free(p);
+}
+#endif // CSR_ALLOC_STATS
+
+namespace Bench {
+
+/*******************************************************************************
+ * State
+ ******************************************************************************/
+State::State(long iterations)
+    : iterations(iterations),
+      isTiming(false),
+      startTime(0),
+      elapsed(0),
+      startAllocations(0),
+      startBytes(0),
+      allocations(0),
+      bytes(0) {}
+
+long State::getIterations() {
+    return this->iterations;
+}
+
+void State::startTimer() {
+    if (this->isTiming) return;
+    this->isTiming = true;
+    this->startAllocations = countallocations();
+    this->startBytes = countbytes();
+    this->startTime = now();
+}
+
+void State::stopTimer() {
+    if (!this->isTiming) return;
+    this->elapsed += now() - this->startTime;
+    this->allocations += countallocations() - this->startAllocations;
+    this->bytes += countbytes() - this->startBytes;
+    this->isTiming = false;
+}
+
+void State::resetTimer() {
+    if (this->isTiming) {
+        this->startAllocations = countallocations();
+        this->startBytes = countbytes();
+        this->startTime = now();
+    }
+    this->elapsed = 0;
+    this->allocations = 0;
+    this->bytes = 0;
+}
+
+double State::getElapsed() {
+    return this->elapsed;
+}
+
+unsigned long State::getAllocations() {
+    return this->allocations;
+}
+
+unsigned long State::getBytes() {
+    return this->bytes;
+}
+
+/*******************************************************************************
+ * Runner
+ ******************************************************************************/
+void run(const char* name, Function function) {
+    const double minTime = BENCH_MIN_TIME * 1e6;
+
+    // Grow the iteration count until a run is long enough to measure.
+    long iterations = 1;
+    for (;;) {
+        State state(iterations);
+        state.startTimer();
+        function(state);
+        state.stopTimer();
+
+        double elapsed = state.getElapsed();
+        if (elapsed >= minTime || iterations >= 1000000000L) break;
+
+        // Aim 20% past the target, growing at most 100x at a time.
+        double next = elapsed > 0
+            ? minTime * 1.2 / (elapsed / iterations)
+            : iterations * 100.0;
+        if (next > iterations * 100.0) next = iterations * 100.0;
+        if (next < iterations + 1.0) next = iterations + 1.0;
+        iterations = (long)next;
+    }
+
+    double times[BENCH_REPEATS];
+    unsigned long allocations = 0;
+    unsigned long bytes = 0;
+    for (int i = 0; i < BENCH_REPEATS; i++) {
+        State state(iterations);
+        state.startTimer();
+        function(state);
+        state.stopTimer();
+
+        times[i] = state.getElapsed() / iterations;
+        allocations = state.getAllocations();
+        bytes = state.getBytes();
+    }
+
+    sort(times, BENCH_REPEATS);
+
+    char line[256];
+    snprintf(line,
+             sizeof(line),
+             "%-36s %10ld %14.1f ns/op %10.1f allocs/op %12.1f B/op\n",
+             name,
+             iterations,
+             times[BENCH_REPEATS / 2],
+             (double)allocations / iterations,
+             (double)bytes / iterations);
+
+    fputs(line, stdout);
+    fflush(stdout);
+    if (output) {
+        fputs(line, output);
+        fflush(output);
+    }
+}
+
+void keep(const void* value) {
+    kept = value;
+}
+
+} // Bench
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+void UriBench();
+void MessageBench();
+void StreamBench();
+void ServerRequestBench();
+void HttpParserBench();
+
+}}} // Csr::Http::Message
+
+namespace Cnek {
+
+void CnekBench();
+
+} // Cnek
+
+using Csr::Http::Message::UriBench;
+using Csr::Http::Message::MessageBench;
+using Csr::Http::Message::StreamBench;
+using Csr::Http::Message::ServerRequestBench;
+using Csr::Http::Message::HttpParserBench;
+using Cnek::CnekBench;
+
+int main() {
+    output = fopen(BENCH_OUTPUT, "w");
+    if (!output) perror("Failed to open " BENCH_OUTPUT);
+
+    UriBench();
+    MessageBench();
+    StreamBench();
+    ServerRequestBench();
+    HttpParserBench();
+    CnekBench();
+
+    if (output) fclose(output);
+}
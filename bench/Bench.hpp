@@ -0,0 +1,97 @@
+#ifndef CNEK_BENCH
+
+#include <stddef.h>
+
+namespace Bench {
+
+/**
+ * Timer and iteration count handed to a benchmark function.
+ *
+ * The function MUST run the measured operation getIterations() times. Work
+ * that is not part of the operation, such as building inputs, SHOULD be
+ * excluded with stopTimer() and startTimer().
+ */
+class State {
+    long iterations;
+    bool isTiming;
+    double startTime;
+    double elapsed;
+    unsigned long startAllocations;
+    unsigned long startBytes;
+    unsigned long allocations;
+    unsigned long bytes;
+
+    public:
+    State(long iterations);
+
+    /**
+     * Gets the number of times to run the operation.
+     *
+     * @return Number of iterations.
+     */
+    long getIterations();
+
+    /**
+     * Resumes timing and counting allocations.
+     */
+    void startTimer();
+
+    /**
+     * Pauses timing and counting allocations.
+     */
+    void stopTimer();
+
+    /**
+     * Discards the time and allocations so far, such as those of setup.
+     */
+    void resetTimer();
+
+    /**
+     * Gets the measured time.
+     *
+     * @return Nanoseconds spent while timing.
+     */
+    double getElapsed();
+
+    /**
+     * Gets the number of allocations made while timing.
+     *
+     * @return Number of calls to operator new and new[].
+     */
+    unsigned long getAllocations();
+
+    /**
+     * Gets the number of bytes allocated while timing.
+     *
+     * @return Bytes requested from operator new and new[].
+     */
+    unsigned long getBytes();
+};
+
+/**
+ * Signature of a benchmark function.
+ */
+typedef void (*Function)(State& state);
+
+/**
+ * Runs a benchmark and reports ns/op, allocations/op and bytes/op.
+ *
+ * The iteration count is grown until one run takes at least BENCH_MIN_TIME
+ * milliseconds, then the run is repeated BENCH_REPEATS times and the median
+ * is reported, so results are comparable between builds.
+ *
+ * @param name Name of the benchmark, such as "Uri/parse".
+ * @param function Benchmark to run.
+ */
+void run(const char* name, Function function);
+
+/**
+ * Keeps the compiler from optimizing away a result.
+ *
+ * @param value Result of the measured operation.
+ */
+void keep(const void* value);
+
+} // Bench
+#define CNEK_BENCH
+#endif // CNEK_BENCH
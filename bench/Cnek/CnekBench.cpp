@@ -0,0 +1,53 @@
+#include "Cnek.hpp"
+#include "Bench.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace Cnek {
+
+using Csr::Http::Message::Response;
+
+namespace {
+
+char body[65536];
+FILE* devnull = NULL;
+
+/**
+ * Emits a "200 OK" response with a body of `size` bytes.
+ */
+void benchEmit(Bench::State& state, size_t size) {
+    Cnek cnek;
+
+    for (long i = 0; i < state.getIterations(); i++) {
+        state.stopTimer();
+        Response* response = new Response(200, "OK");
+        response->setHeader("Content-Type", "text/html; charset=utf-8");
+        response->setHeader("Cache-Control", "no-cache");
+        response->getBody()->write(body, size);
+        state.startTimer();
+
+        cnek.emitResponse(response, devnull);
+    }
+}
+
+void benchEmit1KB(Bench::State& state) { benchEmit(state, 1024); }
+void benchEmit64KB(Bench::State& state) { benchEmit(state, 65536); }
+
+} // namespace
+
+void CnekBench() {
+    memset(body, 'x', sizeof(body));
+#ifndef _WIN32
+    devnull = fopen("/dev/null", "wb");
+#else
+    devnull = fopen("NUL", "wb");
+#endif // _WIN32
+
+    Bench::run("Cnek/emitResponse/1KB", benchEmit1KB);
+    Bench::run("Cnek/emitResponse/64KB", benchEmit64KB);
+
+    fclose(devnull);
+}
+
+} // Cnek
@@ -0,0 +1,57 @@
+#include "HttpParser.hpp"
+#include "ServerRequest.hpp"
+#include "Bench.hpp"
+
+#include <string.h>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+/**
+ * Head of a typical browser GET request, as in ServerRequestBench.
+ */
+const char* browserRequest =
+    "GET /reports/2024?page=2&sort=desc HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Cookie: session=4f2a9c; theme=dark\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: https://www.example.com/reports\r\n"
+    "\r\n";
+
+void benchParse(Bench::State& state) {
+    size_t size = strlen(browserRequest);
+    HttpRequestHead head;
+    for (long i = 0; i < state.getIterations(); i++) {
+        Bench::keep(&head);
+        int length = HttpParser::parseRequest(browserRequest, size, &head);
+        Bench::keep(&length);
+    }
+}
+
+void benchConstruct(Bench::State& state) {
+    HttpRequestHead head;
+    HttpParser::parseRequest(browserRequest, strlen(browserRequest), &head);
+    for (long i = 0; i < state.getIterations(); i++) {
+        ServerRequest* request = new ServerRequest(head);
+        Bench::keep(request);
+        delete request;
+    }
+}
+
+} // namespace
+
+void HttpParserBench() {
+    Bench::run(HttpParser::isVectorized()
+        ? "HttpParser/parse/sse2"
+        : "HttpParser/parse/scalar", benchParse);
+    Bench::run("ServerRequest/construct/head", benchConstruct);
+}
+
+}}} // Csr::Http::Message
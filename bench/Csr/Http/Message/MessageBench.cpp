@@ -0,0 +1,70 @@
+#include "Message.hpp"
+#include "Bench.hpp"
+
+#include <stdio.h>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+char names[200][32];
+
+/**
+ * Creates distinct header names such as "X-Header-7".
+ */
+void createNames() {
+    for (int i = 0; i < 200; i++) {
+        snprintf(names[i], sizeof(names[i]), "X-Header-%d", i);
+    }
+}
+
+/**
+ * Adds `count` headers to a new list per iteration.
+ */
+void benchAdd(Bench::State& state, int count) {
+    for (long i = 0; i < state.getIterations(); i++) {
+        HeaderList* headers = new HeaderList();
+        for (int j = 0; j < count; j++) headers->addHeader(names[j], "value");
+        delete headers;
+    }
+}
+
+/**
+ * Gets the last of `count` headers with a differently cased name, the worst
+ * case for a linear search.
+ */
+void benchGet(Bench::State& state, int count) {
+    char name[32];
+    snprintf(name, sizeof(name), "x-header-%d", count - 1);
+
+    HeaderList headers;
+    for (int j = 0; j < count; j++) headers.addHeader(names[j], "value");
+    state.resetTimer();
+
+    for (long i = 0; i < state.getIterations(); i++) {
+        Bench::keep(headers.getHeader(name));
+    }
+}
+
+void benchAdd10(Bench::State& state) { benchAdd(state, 10); }
+void benchAdd50(Bench::State& state) { benchAdd(state, 50); }
+void benchAdd200(Bench::State& state) { benchAdd(state, 200); }
+void benchGet10(Bench::State& state) { benchGet(state, 10); }
+void benchGet50(Bench::State& state) { benchGet(state, 50); }
+void benchGet200(Bench::State& state) { benchGet(state, 200); }
+
+} // namespace
+
+void MessageBench() {
+    createNames();
+    Bench::run("HeaderList/add/10", benchAdd10);
+    Bench::run("HeaderList/add/50", benchAdd50);
+    Bench::run("HeaderList/add/200", benchAdd200);
+    Bench::run("HeaderList/get/10", benchGet10);
+    Bench::run("HeaderList/get/50", benchGet50);
+    Bench::run("HeaderList/get/200", benchGet200);
+}
+
+}}} // Csr::Http::Message
@@ -0,0 +1,160 @@
+#include "ServerRequest.hpp"
+#include "Shared.hpp"
+#include "Bench.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+char requestMethod[] = "REQUEST_METHOD=GET";
+char requestUri[] = "REQUEST_URI=/reports/2024?page=2&sort=desc";
+char serverProtocol[] = "SERVER_PROTOCOL=HTTP/1.1";
+char queryString[] = "QUERY_STRING=page=2&sort=desc";
+char host[] = "HTTP_HOST=www.example.com";
+char userAgent[] =
+    "HTTP_USER_AGENT=Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0";
+char accept[] =
+    "HTTP_ACCEPT=text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8";
+char acceptLanguage[] = "HTTP_ACCEPT_LANGUAGE=en-US,en;q=0.5";
+char acceptEncoding[] = "HTTP_ACCEPT_ENCODING=gzip, deflate, br";
+char cookie[] = "HTTP_COOKIE=session=4f2a9c; theme=dark";
+char connection[] = "HTTP_CONNECTION=keep-alive";
+char referer[] = "HTTP_REFERER=https://www.example.com/reports";
+
+/**
+ * Environment of a typical browser GET request.
+ */
+char* browserEnv[] = {
+    requestMethod, requestUri, serverProtocol, queryString, host, userAgent,
+    accept, acceptLanguage, acceptEncoding, cookie, connection, referer, NULL
+};
+
+/**
+ * Creates a "NAME=a0=v0<separator>a1=v1..." environment variable with
+ * `count` URL-encoded pairs.
+ */
+std::string createPairs(const char* name, const char* separator, int count) {
+    std::string pairs = name;
+    pairs += '=';
+    char pair[64];
+    for (int i = 0; i < count; i++) {
+        snprintf(pair, sizeof(pair), "%sparam%d=Hello%%2C+World%%21", i ? separator : "", i);
+        pairs += pair;
+    }
+    return pairs;
+}
+
+/**
+ * Creates a multipart/form-data body with one file of about `size` bytes.
+ */
+std::string createMultipart(size_t size) {
+    std::string body =
+        "--BOUNDARY\r\n"
+        "Content-Disposition: form-data; name=\"title\"\r\n"
+        "\r\n"
+        "Quarterly report\r\n"
+        "--BOUNDARY\r\n"
+        "Content-Disposition: form-data; name=\"file\"; filename=\"report.csv\"\r\n"
+        "Content-Type: text/csv\r\n"
+        "\r\n";
+
+    const char* line =
+        "2024-01-01,widgets,1024,3.50,shipped,warehouse-7,priority-normal\r\n";
+    size_t lineLength = strlen(line);
+    body.reserve(body.size() + size + 64);
+    for (size_t written = 0; written < size; written += lineLength) {
+        body.append(line, lineLength);
+    }
+
+    body += "\r\n--BOUNDARY--\r\n";
+    return body;
+}
+
+void benchUrldecode(Bench::State& state) {
+    for (long i = 0; i < state.getIterations(); i++) {
+        char* decoded = urldecode("Hello%2C+World%21+caf%C3%A9+%26+more");
+        Bench::keep(decoded);
+        delete[] decoded;
+    }
+}
+
+void benchConstruct(Bench::State& state) {
+    for (long i = 0; i < state.getIterations(); i++) {
+        ServerRequest* request = new ServerRequest(
+            "GET", "/reports/2024?page=2&sort=desc", browserEnv);
+        Bench::keep(request);
+        delete request;
+    }
+}
+
+/**
+ * Constructs a request whose only variable is `variable`.
+ */
+void benchTokenize(Bench::State& state, std::string& variable) {
+    char* env[] = {&variable[0], NULL};
+
+    for (long i = 0; i < state.getIterations(); i++) {
+        ServerRequest* request = new ServerRequest("GET", "/", env);
+        Bench::keep(request);
+        delete request;
+    }
+}
+
+void benchQuery(Bench::State& state) {
+    std::string query = createPairs("QUERY_STRING", "&", 20);
+    benchTokenize(state, query);
+}
+
+void benchCookies(Bench::State& state) {
+    std::string cookies = createPairs("HTTP_COOKIE", "; ", 20);
+    benchTokenize(state, cookies);
+}
+
+/**
+ * Parses a multipart body with a file of `size` bytes.
+ */
+void benchMultipart(Bench::State& state, size_t size) {
+    char method[] = "REQUEST_METHOD=POST";
+    char contentType[] = "CONTENT_TYPE=multipart/form-data; boundary=BOUNDARY";
+    char* env[] = {method, contentType, NULL};
+    std::string body = createMultipart(size);
+
+    for (long i = 0; i < state.getIterations(); i++) {
+        state.stopTimer();
+        ServerRequest* request = new ServerRequest("POST", "/upload", env);
+        request->getBody()->write(body.data(), body.size());
+        state.startTimer();
+
+        Bench::keep(request->getUploadedFile("file"));
+
+        state.stopTimer();
+        delete request;
+        state.startTimer();
+    }
+}
+
+void benchMultipart1KB(Bench::State& state) { benchMultipart(state, 1024); }
+void benchMultipart64KB(Bench::State& state) { benchMultipart(state, 65536); }
+void benchMultipart1MB(Bench::State& state) { benchMultipart(state, 1048576); }
+void benchMultipart50MB(Bench::State& state) { benchMultipart(state, 52428800); }
+
+} // namespace
+
+void ServerRequestBench() {
+    Bench::run("urldecode", benchUrldecode);
+    Bench::run("ServerRequest/construct", benchConstruct);
+    Bench::run("ServerRequest/query/20", benchQuery);
+    Bench::run("ServerRequest/cookies/20", benchCookies);
+    Bench::run("ServerRequest/multipart/1KB", benchMultipart1KB);
+    Bench::run("ServerRequest/multipart/64KB", benchMultipart64KB);
+    Bench::run("ServerRequest/multipart/1MB", benchMultipart1MB);
+    Bench::run("ServerRequest/multipart/50MB", benchMultipart50MB);
+}
+
+}}} // Csr::Http::Message
@@ -0,0 +1,56 @@
+#include "Stream.hpp"
+#include "Bench.hpp"
+
+#include <string.h>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+char chunk[4096];
+
+void benchWrite(Bench::State& state) {
+    Stream stream;
+    state.resetTimer();
+
+    for (long i = 0; i < state.getIterations(); i++) {
+        // Keep the file small so the benchmark measures the write path.
+        if (!(i & 255)) stream.rewind();
+        stream.write(chunk, sizeof(chunk));
+    }
+}
+
+void benchRead(Bench::State& state) {
+    char buffer[sizeof(chunk)];
+    Stream stream;
+    for (int i = 0; i < 256; i++) stream.write(chunk, sizeof(chunk));
+    state.resetTimer();
+
+    for (long i = 0; i < state.getIterations(); i++) {
+        if (!(i & 255)) stream.rewind();
+        Bench::keep((void*)stream.read(buffer, sizeof(buffer)));
+    }
+}
+
+void benchToString(Bench::State& state) {
+    Stream stream;
+    stream.write("name=cnek&version=1&message=Hello%2C+World%21");
+    state.resetTimer();
+
+    for (long i = 0; i < state.getIterations(); i++) {
+        Bench::keep(stream.toString());
+    }
+}
+
+} // namespace
+
+void StreamBench() {
+    memset(chunk, 'x', sizeof(chunk));
+    Bench::run("Stream/write/4KB", benchWrite);
+    Bench::run("Stream/read/4KB", benchRead);
+    Bench::run("Stream/toString", benchToString);
+}
+
+}}} // Csr::Http::Message
@@ -0,0 +1,84 @@
+#ifndef BENCH_HISTOGRAM
+
+#include <stdint.h>
+#include <string.h>
+
+// Number of sub-buckets per power of two in the latency histogram.
+// NOTE: 8 sub-buckets bound the error of a percentile to 12.5%.
+#define HISTOGRAM_SUB_BUCKETS 8
+
+// Number of buckets in the latency histogram, enough for 64-bit values.
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Log-linear histogram of latencies in nanoseconds.
+ *
+ * Values are counted in buckets that split each power of two into
+ * HISTOGRAM_SUB_BUCKETS, so memory is fixed and histograms from several
+ * processes can be merged by adding counts.
+ */
+struct Histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+
+    Histogram() : total(0), max(0) {
+        memset(this->counts, 0, sizeof(this->counts));
+    }
+
+    static int bucket(uint64_t value) {
+        if (value < HISTOGRAM_SUB_BUCKETS) return (int)value;
+
+        int exponent = 63;
+        while (!(value >> exponent)) exponent--;
+
+        // Keep the 3 bits after the leading one as the sub-bucket.
+        int sub = (int)(value >> (exponent - 3)) & (HISTOGRAM_SUB_BUCKETS - 1);
+        return (exponent - 2) * HISTOGRAM_SUB_BUCKETS + sub;
+    }
+
+    static uint64_t upperBound(int bucket) {
+        if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+
+        int exponent = bucket / HISTOGRAM_SUB_BUCKETS + 2;
+        uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+        return ((HISTOGRAM_SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+    }
+
+    void record(uint64_t value) {
+        this->counts[bucket(value)]++;
+        this->total++;
+        if (value > this->max) this->max = value;
+    }
+
+    void merge(const Histogram& other) {
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            this->counts[i] += other.counts[i];
+        }
+        this->total += other.total;
+        if (other.max > this->max) this->max = other.max;
+    }
+
+    /**
+     * Gets the value below which `percent` of the values fall.
+     */
+    uint64_t percentile(double percent) const {
+        if (!this->total) return 0;
+
+        uint64_t rank = (uint64_t)(this->total * percent / 100.0 + 0.5);
+        if (rank < 1) rank = 1;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += this->counts[i];
+            if (seen >= rank) {
+                uint64_t bound = upperBound(i);
+                return bound < this->max ? bound : this->max;
+            }
+        }
+        return this->max;
+    }
+};
+
+#define BENCH_HISTOGRAM
+#endif // BENCH_HISTOGRAM
@@ -0,0 +1,349 @@
+#include "Replay.hpp"
+#include "Cnek.hpp"
+#include "Recorder.hpp"
+#include "Histogram.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+namespace {
+
+/**
+ * Request captured as its environment and raw body.
+ */
+struct CapturedRequest {
+    std::string name;
+    std::vector<char*> environment;
+    std::string body;
+};
+
+/**
+ * Gets the current time of a monotonic clock.
+ *
+ * @return Nanoseconds since an arbitrary point.
+ */
+inline uint64_t now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+/**
+ * Reads a whole file.
+ *
+ * @return True if the file was read, false if it cannot be opened.
+ */
+bool readfile(const std::string& path, std::string& contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    char buffer[4096];
+    size_t bytesRead = 0;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, bytesRead);
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**
+ * Loads a corpus directory.
+ *
+ * Each request is a "NAME.env" file with one NAME=VALUE environment variable
+ * per line, and an optional "NAME.body" file with the raw request body.
+ */
+void loadcorpus(const char* directory, std::vector<CapturedRequest*>& corpus) {
+    DIR* dir = opendir(directory);
+    if (!dir) {
+        perror(directory);
+        exit(1);
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        std::string filename = entry->d_name;
+        size_t length = filename.size();
+        if (length <= 4 || filename.compare(length - 4, 4, ".env")) continue;
+
+        std::string base = std::string(directory) + "/"
+            + filename.substr(0, length - 4);
+        std::string env;
+        if (!readfile(base + ".env", env)) continue;
+
+        CapturedRequest* request = new CapturedRequest();
+        request->name = filename.substr(0, length - 4);
+        readfile(base + ".body", request->body);
+
+        size_t start = 0;
+        while (start < env.size()) {
+            size_t end = env.find('\n', start);
+            if (end == std::string::npos) end = env.size();
+
+            std::string line = env.substr(start, end - start);
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            if (line.find('=') != std::string::npos) {
+                char* variable = new char[line.size() + 1];
+                memcpy(variable, line.c_str(), line.size() + 1);
+                request->environment.push_back(variable);
+            }
+
+            start = end + 1;
+        }
+        request->environment.push_back(NULL);
+
+        corpus.push_back(request);
+    }
+
+    closedir(dir);
+}
+
+/**
+ * Loads the requests of a capture file written by Cnek::Recorder.
+ */
+void loadcapture(const char* path, std::vector<CapturedRequest*>& corpus) {
+    Cnek::Capture capture(path);
+    unsigned long index = 0;
+    while (capture.next()) {
+        CapturedRequest* request = new CapturedRequest();
+        char name[32];
+        snprintf(name, sizeof(name), "#%lu", index++);
+        request->name = name;
+        request->body = capture.getBody();
+
+        for (char** env = capture.getEnvironment(); *env; env++) {
+            size_t length = strlen(*env);
+            char* variable = new char[length + 1];
+            memcpy(variable, *env, length + 1);
+            request->environment.push_back(variable);
+        }
+        request->environment.push_back(NULL);
+
+        corpus.push_back(request);
+    }
+}
+
+/**
+ * Replays every request of the corpus `iterations` times.
+ *
+ * @return Number of requests that threw instead of emitting a response.
+ */
+unsigned long replay(
+    std::vector<CapturedRequest*>& corpus,
+    long iterations,
+    FILE* sink,
+    Histogram& histogram)
+{
+    unsigned long errors = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < corpus.size(); j++) {
+            CapturedRequest* captured = corpus[j];
+
+            // fmemopen() cannot open an empty buffer for reading everywhere.
+            FILE* input = captured->body.empty()
+                ? fopen("/dev/null", "rb")
+                : fmemopen(&captured->body[0], captured->body.size(), "rb");
+
+            uint64_t start = now();
+            try {
+                Cnek::Cnek cnek;
+                ServerRequest* request =
+                    cnek.getServerRequest(&captured->environment[0], input);
+                cnek.emitResponse(Replay::handle(request), sink);
+            } catch (std::exception& e) {
+                if (!errors++) {
+                    fprintf(stderr, "%s: %s\n", captured->name.c_str(), e.what());
+                }
+            }
+            histogram.record(now() - start);
+
+            fclose(input);
+        }
+    }
+
+    return errors;
+}
+
+void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s CORPUS [-n ITERATIONS] [-p PROCESSES] [-o SINK]\n"
+            "\n"
+            "Replays each NAME.env/NAME.body request in the CORPUS directory,\n"
+            "or each request of a CORPUS capture file, through\n"
+            "Cnek::getServerRequest(), the compiled-in handler and\n"
+            "Cnek::emitResponse().\n"
+            "\n"
+            "  -n ITERATIONS  Times each process replays the corpus (100).\n"
+            "  -p PROCESSES   Processes replaying in parallel (1).\n"
+            "  -o SINK        File responses are written to (/dev/null).\n",
+            program);
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* directory = NULL;
+    long iterations = 100;
+    long processes = 1;
+    const char* sinkPath = "/dev/null";
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            processes = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            sinkPath = argv[++i];
+        } else if (*argv[i] != '-' && !directory) {
+            directory = argv[i];
+        } else usage(argv[0]);
+    }
+    if (!directory || iterations < 1 || processes < 1) usage(argv[0]);
+
+    std::vector<CapturedRequest*> corpus;
+    struct stat info;
+    if (!stat(directory, &info) && !S_ISDIR(info.st_mode)) {
+        try {
+            loadcapture(directory, corpus);
+        } catch (std::exception& e) {
+            fprintf(stderr, "%s: %s\n", directory, e.what());
+            return 1;
+        }
+    } else loadcorpus(directory, corpus);
+    if (corpus.empty()) {
+        fprintf(stderr, "%s: No requests found.\n", directory);
+        return 1;
+    }
+
+    // Warm up caches and lazily initialized state outside the measurement.
+    FILE* sink = fopen(sinkPath, "wb");
+    if (!sink) {
+        perror(sinkPath);
+        return 1;
+    }
+    Histogram warmup;
+    replay(corpus, 1, sink, warmup);
+
+    // Forked processes inherit unflushed output, which each would write.
+    fflush(sink);
+
+    // Each process sends its histogram back through a pipe.
+    Histogram histogram;
+    unsigned long errors = 0;
+    uint64_t start = now();
+
+    if (processes == 1) {
+        errors = replay(corpus, iterations, sink, histogram);
+    } else {
+        std::vector<int> pipes;
+        for (long i = 0; i < processes; i++) {
+            int fds[2];
+            if (pipe(fds)) {
+                perror("pipe");
+                return 1;
+            }
+
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                return 1;
+            }
+
+            if (!pid) {
+                close(fds[0]);
+                Histogram child;
+                uint64_t childErrors = replay(corpus, iterations, sink, child);
+                fflush(sink);
+                write(fds[1], &child, sizeof(child));
+                write(fds[1], &childErrors, sizeof(childErrors));
+                _exit(0);
+            }
+
+            close(fds[1]);
+            pipes.push_back(fds[0]);
+        }
+
+        for (size_t i = 0; i < pipes.size(); i++) {
+            Histogram child;
+            uint64_t childErrors = 0;
+            char* p = (char*)&child;
+            size_t remaining = sizeof(child);
+            ssize_t bytesRead = 0;
+            while (remaining && (bytesRead = read(pipes[i], p, remaining)) > 0) {
+                p += bytesRead;
+                remaining -= bytesRead;
+            }
+            if (!remaining
+                && read(pipes[i], &childErrors, sizeof(childErrors))
+                    == sizeof(childErrors))
+            {
+                histogram.merge(child);
+                errors += childErrors;
+            } else {
+                fprintf(stderr, "Process %lu did not report.\n", (unsigned long)i);
+            }
+            close(pipes[i]);
+        }
+
+        while (wait(NULL) > 0) {}
+    }
+
+    double seconds = (now() - start) / 1e9;
+    fclose(sink);
+
+    printf("requests:   %llu (%lu in corpus, %ld iterations, %ld processes)\n",
+           (unsigned long long)histogram.total,
+           (unsigned long)corpus.size(),
+           iterations,
+           processes);
+    printf("errors:     %lu\n", errors);
+    printf("elapsed:    %.3f s\n", seconds);
+    printf("throughput: %.0f req/s (%.0f req/s per process)\n",
+           histogram.total / seconds,
+           histogram.total / seconds / processes);
+    printf("latency:    p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+           "p99.9 %.1f us, max %.1f us\n",
+           histogram.percentile(50) / 1000.0,
+           histogram.percentile(90) / 1000.0,
+           histogram.percentile(99) / 1000.0,
+           histogram.percentile(99.9) / 1000.0,
+           histogram.max / 1000.0);
+
+    // Full distribution, one line per non-empty bucket.
+    printf("\n%14s %12s %8s\n", "<= us", "count", "cum %");
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if (!histogram.counts[i]) continue;
+        seen += histogram.counts[i];
+        printf("%14.3f %12llu %7.3f%%\n",
+               Histogram::upperBound(i) / 1000.0,
+               (unsigned long long)histogram.counts[i],
+               seen * 100.0 / histogram.total);
+    }
+
+    for (size_t i = 0; i < corpus.size(); i++) {
+        for (size_t j = 0; corpus[i]->environment[j]; j++) {
+            delete[] corpus[i]->environment[j];
+        }
+        delete corpus[i];
+    }
+
+    return errors ? 1 : 0;
+}
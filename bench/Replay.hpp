@@ -0,0 +1,25 @@
+#ifndef CNEK_REPLAY
+
+#include "ServerRequest.hpp"
+#include "Response.hpp"
+
+namespace Replay {
+
+/**
+ * Handles a replayed request.
+ *
+ * The replay driver does not define this function; compile it together with
+ * a handler file, such as bench/ReplayHandler.cpp, to choose the workload.
+ * Handlers SHOULD do what the application's handlers do, so the replay
+ * measures the library the way production uses it.
+ *
+ * @param request Server request built by Cnek::getServerRequest().
+ * @return Response to emit; MUST be allocated with new, since emitting
+ *     deletes it.
+ */
+Csr::Http::Message::Response* handle(
+    Csr::Http::Message::ServerRequest* request);
+
+} // Replay
+#define CNEK_REPLAY
+#endif // CNEK_REPLAY
@@ -0,0 +1,34 @@
+#include "Replay.hpp"
+
+#include <string.h>
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+using Csr::Http::Message::Stream;
+
+namespace Replay {
+
+Response* handle(ServerRequest* request) {
+    Response* response = new Response();
+    Stream* body = response->getBody();
+    response->setHeader("Content-Type", "text/html; charset=utf-8");
+
+    // Touch what typical handlers read: a cookie, query and body parameters
+    // and uploaded files.
+    const char* session = request->getCookieParam("session");
+    const char* page = request->getQueryParam("page");
+    const char* name = request->getBodyParam("name");
+    bool hasFile = request->getUploadedFile("file") != NULL;
+
+    body->write("<!DOCTYPE html><html><body><h1>Hello, ");
+    body->write(*name ? name : "World");
+    body->write("!</h1><p>Page ");
+    body->write(*page ? page : "1");
+    if (*session) body->write(", signed in");
+    if (hasFile) body->write(", file received");
+    body->write(".</p></body></html>");
+
+    return response;
+}
+
+} // Replay
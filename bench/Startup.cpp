@@ -0,0 +1,257 @@
+#include "Histogram.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace {
+
+/**
+ * Environment of the default request, a plain GET of "/".
+ */
+const char* defaultEnvironment[] = {
+    "REQUEST_METHOD=GET",
+    "REQUEST_URI=/",
+    "QUERY_STRING=",
+    "SERVER_PROTOCOL=HTTP/1.1",
+    "GATEWAY_INTERFACE=CGI/1.1",
+    NULL
+};
+
+/**
+ * Gets the current time of a monotonic clock.
+ *
+ * @return Nanoseconds since an arbitrary point.
+ */
+inline uint64_t now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+/**
+ * Reads a whole file.
+ *
+ * @return True if the file was read, false if it cannot be opened.
+ */
+bool readfile(const std::string& path, std::string& contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    char buffer[4096];
+    size_t bytesRead = 0;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, bytesRead);
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**
+ * Loads the environment of a "NAME.env" file, one NAME=VALUE per line.
+ */
+void loadenvironment(const std::string& path, std::vector<char*>& environment) {
+    std::string env;
+    if (!readfile(path, env)) {
+        perror(path.c_str());
+        exit(1);
+    }
+
+    size_t start = 0;
+    while (start < env.size()) {
+        size_t end = env.find('\n', start);
+        if (end == std::string::npos) end = env.size();
+
+        std::string line = env.substr(start, end - start);
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line.find('=') != std::string::npos) {
+            char* variable = new char[line.size() + 1];
+            memcpy(variable, line.c_str(), line.size() + 1);
+            environment.push_back(variable);
+        }
+
+        start = end + 1;
+    }
+}
+
+/**
+ * Result of one run of the program.
+ */
+struct Run {
+    uint64_t firstByte;
+    uint64_t total;
+    size_t bytes;
+    int status;
+};
+
+/**
+ * Execs the program once with the request and times its output.
+ *
+ * The clock starts before fork(), so the time includes creating the process,
+ * exec(), dynamic linking, static initializers and main() up to the first
+ * write of the response.
+ *
+ * @param body Descriptor of the request body, rewound for each run.
+ */
+Run run(const char* program, char** environment, int body) {
+    Run result;
+    memset(&result, 0, sizeof(result));
+
+    int fds[2];
+    if (pipe(fds)) {
+        perror("pipe");
+        exit(1);
+    }
+    lseek(body, 0, SEEK_SET);
+
+    uint64_t start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+
+    if (!pid) {
+        dup2(body, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+
+        char* argv[] = {(char*)program, NULL};
+        execve(program, argv, environment);
+        _exit(127);
+    }
+
+    close(fds[1]);
+
+    char buffer[65536];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = read(fds[0], buffer, sizeof(buffer))) != 0) {
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead < 0) break;
+        if (!result.bytes) result.firstByte = now() - start;
+        result.bytes += bytesRead;
+    }
+    close(fds[0]);
+
+    waitpid(pid, &result.status, 0);
+    result.total = now() - start;
+    return result;
+}
+
+void report(const char* label, const Histogram& histogram) {
+    printf("%-12s p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+           label,
+           histogram.percentile(50) / 1000.0,
+           histogram.percentile(90) / 1000.0,
+           histogram.percentile(99) / 1000.0,
+           histogram.max / 1000.0);
+}
+
+void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s PROGRAM [-n ITERATIONS] [-r REQUEST]\n"
+            "\n"
+            "Execs the CGI PROGRAM once per request, as a web server would,\n"
+            "and reports its time to first byte and until it exits.\n"
+            "\n"
+            "  -n ITERATIONS  Times the program is run (200).\n"
+            "  -r REQUEST     REQUEST.env and optional REQUEST.body to send,\n"
+            "                 e.g. bench/corpus/form (a GET of \"/\").\n",
+            program);
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* program = NULL;
+    const char* requestPath = NULL;
+    long iterations = 200;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            requestPath = argv[++i];
+        } else if (*argv[i] != '-' && !program) {
+            program = argv[i];
+        } else usage(argv[0]);
+    }
+    if (!program || iterations < 1) usage(argv[0]);
+
+    std::vector<char*> environment;
+    std::string body;
+    if (requestPath) {
+        loadenvironment(std::string(requestPath) + ".env", environment);
+        readfile(std::string(requestPath) + ".body", body);
+    } else {
+        for (const char** env = defaultEnvironment; *env; env++) {
+            environment.push_back((char*)*env);
+        }
+    }
+    environment.push_back(NULL);
+
+    // Every run reads the body from the start of the same file.
+    FILE* bodyFile = tmpfile();
+    if (!bodyFile
+        || fwrite(body.data(), 1, body.size(), bodyFile) < body.size()
+        || fflush(bodyFile))
+    {
+        perror("tmpfile");
+        return 1;
+    }
+    int bodyFd = fileno(bodyFile);
+
+    // Warm up the page cache and dynamic loader caches.
+    Run first = run(program, &environment[0], bodyFd);
+    if (!WIFEXITED(first.status) || WEXITSTATUS(first.status) || !first.bytes) {
+        fprintf(stderr,
+                "%s: Failed to respond (status %d, %lu bytes).\n",
+                program,
+                first.status,
+                (unsigned long)first.bytes);
+        return 1;
+    }
+
+    Histogram firstByte;
+    Histogram total;
+    unsigned long failures = 0;
+    uint64_t start = now();
+
+    for (long i = 0; i < iterations; i++) {
+        Run result = run(program, &environment[0], bodyFd);
+        if (!WIFEXITED(result.status) || WEXITSTATUS(result.status)) {
+            failures++;
+        }
+        firstByte.record(result.firstByte);
+        total.record(result.total);
+    }
+
+    double seconds = (now() - start) / 1e9;
+
+    printf("runs:        %ld (%lu failed)\n", iterations, failures);
+    printf("response:    %lu bytes\n", (unsigned long)first.bytes);
+    printf("throughput:  %.0f runs/s\n", iterations / seconds);
+    report("first byte:", firstByte);
+    report("exit:", total);
+
+    fclose(bodyFile);
+    if (requestPath) {
+        for (size_t i = 0; environment[i]; i++) delete[] environment[i];
+    }
+
+    return failures ? 1 : 0;
+}
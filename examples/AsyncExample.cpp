@@ -0,0 +1,84 @@
+#include "Cnek.hpp"
+#include "HttpServer.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+namespace {
+
+Cnek::HttpServer* server = NULL;
+
+void stop(int signal) {
+    (void)signal;
+    server->stop();
+}
+
+/**
+ * Waits for ?delay milliseconds, then responds with index.html, read without
+ * holding up other requests.
+ */
+class PageHandler : public Cnek::AsyncHandler {
+    int fd;
+    off_t offset;
+    char buffer[16384];
+    Response* response;
+
+    public:
+    PageHandler() : fd(-1), offset(0), response(NULL) {}
+
+    Response* run(Cnek::Cnek& cnek, ServerRequest* serverRequest) {
+        (void)cnek;
+
+        CNEK_ASYNC_BEGIN;
+        CNEK_AWAIT(this->delay(atol(serverRequest->getQueryParam("delay"))));
+
+        this->fd = open("index.html", O_RDONLY);
+        if (this->fd < 0) return new Response(404, "Not Found");
+
+        this->response = new Response(200, "OK");
+        this->response->setHeader("Content-Type", "text/html");
+        while (true) {
+            CNEK_AWAIT(this->readFile(
+                this->fd, this->buffer, sizeof(this->buffer), this->offset));
+            if (this->getResult() <= 0) break;
+
+            this->response->getBody()->write(this->buffer, this->getResult());
+            this->offset += this->getResult();
+        }
+        return this->response;
+        CNEK_ASYNC_END;
+    }
+
+    ~PageHandler() {
+        if (this->fd >= 0) close(this->fd);
+    }
+};
+
+Cnek::AsyncHandler* create() {
+    return new PageHandler();
+}
+
+} // namespace
+
+int main() {
+    // Setup.
+    Cnek::HttpServer httpServer("127.0.0.1", 8080);
+    httpServer.setIoUring(true);
+    server = &httpServer;
+
+    // Stop on Ctrl+C or `kill`, without SA_RESTART so the wait returns.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Handle requests until stopped.
+    httpServer.serve(create);
+}
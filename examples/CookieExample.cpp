@@ -1,5 +1,9 @@
 #include "Cnek.hpp"
 
+#ifndef _WIN32
+#include <unistd.h> // environ
+#endif // _WIN32
+
 // Settings.
 #define REQUEST_BODY_BUFFER_SIZE 4096
 #define MAX_REQUEST_BODY_SIZE 4194304
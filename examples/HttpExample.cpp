@@ -0,0 +1,52 @@
+#include "Cnek.hpp"
+#include "HttpServer.hpp"
+
+#include <signal.h>
+#include <string.h>
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+using Csr::Http::Message::Stream;
+
+namespace {
+
+Cnek::HttpServer* server = NULL;
+
+void stop(int signal) {
+    (void)signal;
+    server->stop();
+}
+
+Response* handle(Cnek::Cnek& cnek, ServerRequest* serverRequest) {
+    cnek.setAutoETag(true);
+
+    Response* response = new Response(200, "OK");
+    Stream* body = response->getBody();
+    response->setHeader("Content-Type", "text/html");
+
+    const char* name = serverRequest->getQueryParam("name");
+    body->write("Hello, ");
+    body->write(*name ? name : "World");
+    body->write("!");
+
+    return response;
+}
+
+} // namespace
+
+int main() {
+    // Setup.
+    Cnek::HttpServer httpServer("127.0.0.1", 8080);
+    httpServer.setIoUring(true);
+    server = &httpServer;
+
+    // Stop on Ctrl+C or `kill`, without SA_RESTART so the wait returns.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Handle requests until stopped.
+    httpServer.serve(handle);
+}
@@ -0,0 +1,37 @@
+#include "Cnek.hpp"
+#include "Prefork.hpp"
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+using Csr::Http::Message::Stream;
+
+namespace {
+
+Response* handle(Cnek::Cnek& cnek, ServerRequest* serverRequest) {
+    cnek.setAutoETag(true);
+
+    Response* response = new Response(200, "OK");
+    Stream* body = response->getBody();
+    response->setHeader("Content-Type", "text/html");
+
+    const char* name = serverRequest->getQueryParam("name");
+    body->write("Hello, ");
+    body->write(*name ? name : "World");
+    body->write("!");
+
+    return response;
+}
+
+} // namespace
+
+int main() {
+    // Setup: one HTTP worker per CPU, each pinned to its CPU and restarted
+    // after 10000 requests or 256MB of RSS.
+    Cnek::Prefork prefork("127.0.0.1", 8080, Cnek::PREFORK_HTTP, 0);
+    prefork.setMaxRequests(10000);
+    prefork.setMaxRss(256 * 1024 * 1024);
+    prefork.setCpuAffinity(true);
+
+    // Supervise workers until `kill -TERM`; `kill -HUP` restarts them.
+    prefork.run(handle);
+}
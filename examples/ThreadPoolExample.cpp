@@ -0,0 +1,52 @@
+#include "Cnek.hpp"
+#include "ThreadPool.hpp"
+
+#include <signal.h>
+#include <string.h>
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+using Csr::Http::Message::Stream;
+
+namespace {
+
+Cnek::ThreadPool* pool = NULL;
+
+void stop(int signal) {
+    (void)signal;
+    pool->stop();
+}
+
+Response* handle(Cnek::Cnek& cnek, ServerRequest* serverRequest) {
+    cnek.setAutoETag(true);
+
+    // Runs in a worker thread: only state of this request is touched here.
+    Response* response = new Response(200, "OK");
+    Stream* body = response->getBody();
+    response->setHeader("Content-Type", "text/html");
+
+    const char* name = serverRequest->getQueryParam("name");
+    body->write("Hello, ");
+    body->write(*name ? name : "World");
+    body->write("!");
+
+    return response;
+}
+
+} // namespace
+
+int main() {
+    // Setup: one worker thread per CPU.
+    Cnek::ThreadPool threadPool("127.0.0.1", 4000, 0);
+    pool = &threadPool;
+
+    // Stop on Ctrl+C or `kill`.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Handle requests until stopped, then finish those already accepted.
+    threadPool.serve(handle);
+}
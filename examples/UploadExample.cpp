@@ -2,6 +2,10 @@
 
 #include <string.h>
 
+#ifndef _WIN32
+#include <unistd.h> // environ
+#endif // _WIN32
+
 // Settings.
 #define REQUEST_BODY_BUFFER_SIZE 4096
 #define MAX_REQUEST_BODY_SIZE 4194304
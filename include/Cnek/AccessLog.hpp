@@ -0,0 +1,156 @@
+#ifndef CNEK_ACCESSLOG
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+struct AccessRecord;
+
+/**
+ * Access log that requests are appended to without waiting on the disk.
+ *
+ * log() copies a record into a fixed-size ring buffer and returns; it takes
+ * no lock and never writes, so handler threads MAY log at once. The records
+ * are formatted and appended to the file in batches of many lines, each with
+ * a single write, by flush(): either from a background thread, see start(),
+ * or after the response was sent, e.g. in a CGI process:
+ *
+ *     Cnek::AccessLog accessLog("access.log");
+ *     cnek.setAccessLog(&accessLog);
+ *     ...
+ *     cnek.emitResponse(response, stdout);
+ *     fflush(stdout);
+ *     accessLog.flush();
+ *
+ * When the ring is full, records are dropped and counted rather than
+ * blocking the request; see getDropped(). Each line holds the UTC time the
+ * request was logged, method, request-target, status code, body bytes sent
+ * and milliseconds from getServerRequest() to the end of emitting:
+ *
+ *     2026-10-18T09:30:00Z GET /report?page=2 200 5120 1.204
+ *
+ * Control characters and spaces in the request-target are percent-encoded,
+ * so a line cannot be split or forged by a request. Lines are never split
+ * across writes, so processes MAY share a file opened by each of them.
+ * Remaining records are flushed when the log is destroyed.
+ */
+class AccessLog {
+    int file;
+    FILE* stream;
+    AccessRecord* records;
+    size_t capacity;
+
+    /** Position the next record is logged at, taken by producers. */
+    volatile size_t head;
+
+    /** Position of the next record to write. */
+    size_t tail;
+
+    volatile unsigned long dropped;
+    volatile int isFlushing;
+
+#ifndef _WIN32
+    /** Guards `isStopping` for the background thread. */
+    pthread_mutex_t mutex;
+
+    /** Signaled by stop() to wake the background thread. */
+    pthread_cond_t stopping;
+
+    pthread_t thread;
+#endif // _WIN32
+
+    bool isStarted;
+    bool isStopping;
+
+    bool writeBatch(const char* data, size_t length);
+    static void* run(void* accessLog);
+
+    public:
+    /**
+     * Opens an access log for appending, creating it if needed.
+     *
+     * @param path Path of the log file.
+     * @param capacity Number of records the ring buffer holds, rounded up
+     *     to a power of two, or 0 for ACCESS_LOG_CAPACITY.
+     * @throws std::runtime_error The file cannot be opened.
+     */
+    AccessLog(const char* path, size_t capacity = 0);
+
+    /**
+     * Gets the current time of a monotonic clock, to measure durations with.
+     *
+     * @return Milliseconds since an arbitrary point.
+     */
+    static double getTime();
+
+    /**
+     * Adds a request to the ring buffer. Never blocks, and safe to call from
+     * several threads at once.
+     *
+     * @param method Method of the request.
+     * @param target Request-target, truncated to ACCESS_LOG_TARGET_SIZE.
+     * @param statusCode Status code of the response.
+     * @param bytes Number of body bytes sent.
+     * @param milliseconds Time taken to handle the request.
+     * @return True if the record was added, false if the ring was full and
+     *     the record was dropped.
+     */
+    bool log(
+        const char* method,
+        const char* target,
+        int statusCode,
+        uint64_t bytes,
+        double milliseconds);
+
+    /**
+     * Writes every record logged so far to the file, in batches of about
+     * ACCESS_LOG_BATCH_SIZE bytes.
+     *
+     * Returns right away if another thread is already flushing, since it
+     * writes the records as well.
+     *
+     * @return Number of records written.
+     * @throws std::runtime_error Failed to write a batch; it and the records
+     *     after it are dropped.
+     */
+    size_t flush();
+
+    /**
+     * Starts a background thread that flushes every
+     * ACCESS_LOG_FLUSH_INTERVAL milliseconds, until stop().
+     *
+     * Write failures in the background are not reported, apart from the
+     * records being counted as dropped.
+     *
+     * Not supported on Windows, where flush() MUST be called instead.
+     *
+     * @throws std::runtime_error The thread cannot be started.
+     */
+    void start();
+
+    /**
+     * Stops the background thread, after it flushed the remaining records.
+     * Does nothing if it is not running.
+     */
+    void stop();
+
+    /**
+     * Gets how many records were dropped because the ring was full or their
+     * batch failed to write.
+     *
+     * @return Number of dropped records.
+     */
+    unsigned long getDropped();
+
+    ~AccessLog();
+};
+
+} // Cnek
+#define CNEK_ACCESSLOG
+#endif // CNEK_ACCESSLOG
@@ -0,0 +1,147 @@
+#ifndef CNEK_ASYNCHANDLER
+
+#include "Cnek.hpp"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Starts the body of AsyncHandler::run(), before the first statement.
+ */
+#define CNEK_ASYNC_BEGIN switch (this->resumePoint) { case 0:
+
+/**
+ * Waits for an operation, e.g. CNEK_AWAIT(this->delay(100)), and resumes the
+ * handler after it, where getResult() tells how it went.
+ *
+ * Local variables are not kept while waiting, so state that is used after an
+ * await MUST be kept in members. At most one await MAY be written per line,
+ * and awaits MUST NOT be written inside a switch statement of the handler.
+ */
+#define CNEK_AWAIT(operation) \
+    do { \
+        operation; \
+        this->resumePoint = __LINE__; \
+        return NULL; \
+        case __LINE__:; \
+    } while (0)
+
+/**
+ * Ends the body of AsyncHandler::run(), after the last statement.
+ */
+#define CNEK_ASYNC_END } return NULL
+
+namespace Cnek {
+
+class HttpServer;
+
+/**
+ * Operation an AsyncHandler waits for.
+ */
+enum AsyncWait {
+    ASYNC_NONE,
+    ASYNC_DELAY,
+    ASYNC_READ,
+    ASYNC_READABLE,
+    ASYNC_WRITABLE
+};
+
+/**
+ * Handler of one request that waits for timers, file reads and sockets
+ * without blocking the event loop serving it, so one thread MAY keep many
+ * requests in flight.
+ *
+ * run() is written as a stackless coroutine: it returns NULL at each
+ * CNEK_AWAIT() and is called again by the loop once the operation completes,
+ * continuing after the await.
+ *
+ *     class SlowHandler : public Cnek::AsyncHandler {
+ *         public:
+ *         Response* run(Cnek::Cnek& cnek, ServerRequest* request) {
+ *             CNEK_ASYNC_BEGIN;
+ *             CNEK_AWAIT(this->delay(100));
+ *             return new Response(200, "OK");
+ *             CNEK_ASYNC_END;
+ *         }
+ *     };
+ *
+ * Request bodies are received before the handler runs, so reading them
+ * never waits. Handlers are created per request by an AsyncHandlerFactory
+ * and freed by the server once their response is emitted.
+ */
+class AsyncHandler {
+    friend class HttpServer;
+
+    AsyncWait wait;
+    int fd;
+    char* buffer;
+    size_t length;
+    off_t offset;
+    long milliseconds;
+    long result;
+
+    protected:
+    /** Where run() resumes, 0 at first; kept by the CNEK_ASYNC macros. */
+    int resumePoint;
+
+    /**
+     * Waits for a number of milliseconds. getResult() is then 0.
+     */
+    void delay(long milliseconds);
+
+    /**
+     * Reads from a file at an offset, as pread() does. getResult() is then
+     * the number of bytes read, 0 at the end of the file, or -errno.
+     *
+     * @param fd Descriptor of the file, open until the read completes.
+     * @param buffer Buffer to read into, kept until the read completes,
+     *     e.g. a member.
+     * @param length Max number of bytes to read.
+     * @param offset Offset in the file to read from.
+     */
+    void readFile(int fd, char* buffer, size_t length, off_t offset);
+
+    /**
+     * Waits for a socket or pipe to be readable, e.g. for the reply of a
+     * backend. getResult() is then 0, or -errno.
+     */
+    void waitReadable(int fd);
+
+    /**
+     * Waits for a socket or pipe to be writable. getResult() is then 0, or
+     * -errno.
+     */
+    void waitWritable(int fd);
+
+    /**
+     * Gets the result of the operation last waited for.
+     */
+    long getResult();
+
+    public:
+    AsyncHandler();
+
+    /**
+     * Handles the request, or runs until the next await.
+     *
+     * @param cnek Service the request was created with.
+     * @param request Request to handle, owned by `cnek`.
+     * @return Response to emit, which the server frees, or NULL at an await.
+     * @throws std::exception The request failed; the server answers with
+     *     "500 Internal Server Error".
+     */
+    virtual Csr::Http::Message::Response* run(
+        Cnek& cnek,
+        Csr::Http::Message::ServerRequest* request) = 0;
+
+    virtual ~AsyncHandler();
+};
+
+/**
+ * Creates the handler of a request, e.g. `return new SlowHandler();`.
+ */
+typedef AsyncHandler* (*AsyncHandlerFactory)();
+
+} // Cnek
+#define CNEK_ASYNCHANDLER
+#endif // CNEK_ASYNCHANDLER
@@ -2,6 +2,13 @@
 
 #include "ServerRequest.hpp"
 #include "Response.hpp"
+#include "ResponseCache.hpp"
+#include "Timing.hpp"
+#include "Recorder.hpp"
+#include "AccessLog.hpp"
+#include "LatencyStats.hpp"
+
+#include <string>
 
 namespace Cnek {
 
@@ -11,6 +18,45 @@ namespace Cnek {
  */
 class Cnek {
     Csr::Http::Message::ServerRequest* serverRequest;
+    bool isRequestSpare;
+    Csr::Http::Message::Response* response;
+    bool isResponseFree;
+    bool isAutoETag;
+    ResponseCache* responseCache;
+    char* cacheKey;
+    bool isRevalidating;
+    Timing* timing;
+    bool isServerTiming;
+    FILE* statsSink;
+    Recorder* recorder;
+    bool isAllocStatsHeader;
+    bool isHttpResponse;
+    AccessLog* accessLog;
+    double startTime;
+    uint64_t bytesSent;
+    LatencyStats* latencyStats;
+    std::string route;
+
+    /**
+     * Emits a response as emitResponse() does, without timing it.
+     *
+     * @return Status code that was emitted.
+     */
+    int writeResponse(Csr::Http::Message::Response* response, FILE* output);
+
+    /**
+     * Reads `input` into the body of the created server request.
+     *
+     * @param environment Environment the request was created from, to
+     *     record it with, or NULL.
+     */
+    void readBody(FILE* input, char** environment);
+
+    /** Adds the emitted response to the access log, if one is set. */
+    void logAccess(int statusCode);
+
+    /** Adds the timings of the emitted response to the latency stats, if set. */
+    void recordLatency(int statusCode);
 
     public:
     Cnek();
@@ -19,7 +65,7 @@ class Cnek {
      * Retrieves a server request from the CGI environment.
      *
      * The first time this is called, it will create the request. Each call
-     * after will return a pointer to the same request.
+     * after will return a pointer to the same request, until reset().
      *
      * It's expected that `environment` will be the global `environ` variable,
      * so this method MUST NOT modify the data within.
@@ -41,10 +87,46 @@ class Cnek {
         char** environment,
         FILE* input);
 
+    /**
+     * Retrieves a server request from a parsed request head.
+     *
+     * Like getServerRequest(environment, input), for front ends that parse
+     * requests themselves, e.g. HttpServer. Such requests are not recorded
+     * by the recorder, since they have no environment to replay.
+     *
+     * @param head Parsed request head. See HttpParser::parseRequest().
+     * @param serverParams NULL-terminated NAME=VALUE server params the head
+     *     cannot provide, e.g. REMOTE_ADDR, or NULL.
+     * @param input Body of the server request.
+     * @return Server request created from `head` and `input` or previously
+     *     created server request.
+     * @throws std::invalid_argument Invalid method or input.
+     * @throws std::runtime_error Failed to read inputs.
+     */
+    Csr::Http::Message::ServerRequest* getServerRequest(
+        const Csr::Http::Message::HttpRequestHead& head,
+        char** serverParams,
+        FILE* input);
+
     /**
      * Forms an appropriate HTTP response message and sends it.
      *
-     * This method MUST delete/free the response after use.
+     * This method MUST delete/free the response after use, except for the
+     * response of createResponse(), which is kept for the next one.
+     *
+     * If automatic ETags are enabled, see setAutoETag(), a "304 Not Modified"
+     * response without a body MAY be emitted instead.
+     *
+     * If the server request has a Range header and the body is seekable,
+     * "200 OK" responses are emitted as "206 Partial Content" with only the
+     * requested byte ranges read from the body, or as "416 Range Not
+     * Satisfiable". Ranges are not applied if If-Range does not match the
+     * response's ETag or Last-Modified header.
+     *
+     * If a response cache is set, see setResponseCache(), successful GET
+     * responses are stored in it according to their Cache-Control header.
+     * After serveCached() returned CACHE_STALE, the response is only stored
+     * and not written to `output`.
      *
      * It's expected that `output` will be the global file `stdout`, so this
      * method MUST NOT attempt to seek it, since `stdout` is a non-seekable
@@ -56,9 +138,256 @@ class Cnek {
      */
     void emitResponse(Csr::Http::Message::Response* response, FILE* output);
 
+    /**
+     * Creates a response that is reused by each request this object handles,
+     * instead of allocating one per request. See reset().
+     *
+     * The response is owned by this object and MUST NOT be deleted; pass it
+     * to emitResponse() or releaseResponse() when done. If the previous one
+     * was not passed back yet, a new response is allocated instead, which
+     * emitResponse() frees as usual.
+     *
+     * @param code The HTTP status code. Defaults to 200.
+     * @param reasonPhrase The reason phrase to associate with the status code.
+     * @return Emptied response with the given status.
+     */
+    Csr::Http::Message::Response* createResponse(
+        unsigned short code = 200,
+        const char* reasonPhrase = "");
+
+    /**
+     * Frees a response that will not be emitted, e.g. after failing to open
+     * the output. The response of createResponse() is kept for reuse instead.
+     *
+     * @param response Response to free, or NULL.
+     */
+    void releaseResponse(Csr::Http::Message::Response* response);
+
+    /**
+     * Prepares this object for the next request of a long-running process.
+     *
+     * The server request is kept and reset by the next getServerRequest()
+     * call instead of being allocated again, as is the response of
+     * createResponse(), so their lists, strings and body streams are reused.
+     * Per-request state such as the cache key, route and timings is cleared,
+     * while settings such as setAutoETag() and the response cache are kept.
+     *
+     * The previous server request MUST NOT be used after this, and
+     * getServerRequest() MUST be called before the next response is emitted.
+     */
+    void reset();
+
+    /**
+     * Restores every setting to its default, as if this object was new.
+     *
+     * Used with reset() when the same object serves requests whose handlers
+     * change settings, so one request's cache, recorder, timings or sinks
+     * never apply to the next.
+     */
+    void clearSettings();
+
+    /**
+     * Enables or disables automatic ETags.
+     *
+     * When enabled, emitResponse() hashes the body of "200 OK" responses that
+     * have no ETag into a strong ETag. If the ETag matches the server
+     * request's If-None-Match header, "304 Not Modified" is emitted without
+     * the body.
+     *
+     * Disabled by default, since the body has to be read twice.
+     *
+     * @param enabled True to enable automatic ETags, false to disable them.
+     */
+    void setAutoETag(bool enabled);
+
+    /**
+     * Enables or disables the Server-Timing response header.
+     *
+     * When enabled, emitResponse() adds a Server-Timing header with the
+     * wall-clock and CPU time of each phase so far: parsing the environment,
+     * reading the body, parsing the body and running the handler. See
+     * Timing::toHeader().
+     *
+     * Phases are only timed from the moment timing is enabled, so enable it
+     * before calling getServerRequest(). While timing, getServerRequest()
+     * parses form bodies right away instead of when first used, so that
+     * parsing is not counted as handler time.
+     *
+     * Disabled by default, since timings reveal details about the server.
+     *
+     * @param enabled True to enable the header, false to disable it.
+     */
+    void setServerTiming(bool enabled);
+
+    /**
+     * Sets the stream every request's phase timings are appended to.
+     *
+     * After a response is emitted, one line is written with the method,
+     * request-target, status code and the times of all phases, including
+     * emitting. See Timing::writeStats().
+     *
+     * The stream is not owned by this object and MUST outlive it. Open it in
+     * append mode if several processes share it.
+     *
+     * @param sink Stream to append timings to, or NULL to not write them.
+     */
+    void setStatsSink(FILE* sink);
+
+    /**
+     * Sets the recorder that sampled requests are captured with.
+     *
+     * When set, getServerRequest() asks the recorder whether to sample the
+     * request and, if so, records its environment and the raw body as read
+     * from `input`. Failing to record does not fail the request.
+     *
+     * The recorder is not owned by this object and MUST outlive it.
+     *
+     * @param recorder Recorder, or NULL to not record requests.
+     */
+    void setRecorder(Recorder* recorder);
+
+    /**
+     * Sets the access log every emitted response is added to.
+     *
+     * After a response is emitted, its method, request-target, status code,
+     * body bytes and the milliseconds since getServerRequest() are added to
+     * the log's ring buffer, without writing to it. See AccessLog.
+     *
+     * The log is not owned by this object and MUST outlive it. It MAY be set
+     * by a handler, after the request was created.
+     *
+     * @param accessLog Access log, or NULL to not log requests.
+     */
+    void setAccessLog(AccessLog* accessLog);
+
+    /**
+     * Sets the latency stats every emitted response is added to.
+     *
+     * After a response is emitted, the wall-clock time of each phase, see
+     * setServerTiming(), and the total time since getServerRequest() are
+     * added to the histograms of the request's route and status code. See
+     * LatencyStats::recordTiming().
+     *
+     * Phases are only timed from the moment the stats are set, so set them
+     * before calling getServerRequest(); when set later, e.g. by a handler,
+     * only the emitting and total times are recorded.
+     *
+     * The stats are not owned by this object and MUST outlive it.
+     *
+     * @param latencyStats Latency stats, or NULL to not record latencies.
+     */
+    void setLatencyStats(LatencyStats* latencyStats);
+
+    /**
+     * Sets the route the request's latencies are recorded under.
+     *
+     * Routes SHOULD be templates like "/users/:id" rather than paths, so the
+     * number of series stays bounded. Defaults to the SCRIPT_NAME server
+     * param, or "-" without one.
+     *
+     * @param route Route of the request.
+     */
+    void setRoute(const char* route);
+
+    /**
+     * Enables or disables the X-Alloc-Stats response header.
+     *
+     * When enabled in a build with CSR_ALLOC_STATS defined, emitResponse()
+     * adds the allocations, frees, bytes and peak bytes allocated since
+     * getServerRequest(), for example:
+     *
+     *     X-Alloc-Stats: allocations=92, frees=40, bytes=3120, peak=2816
+     *
+     * Has no effect in other builds. See Csr::Http::Message::AllocStats.
+     *
+     * @param enabled True to enable the header, false to disable it.
+     */
+    void setAllocStatsHeader(bool enabled);
+
+    /**
+     * Enables or disables emitting responses as HTTP/1.1 messages.
+     *
+     * By default, responses are emitted in CGI form, with a Status header,
+     * for a web server to turn into HTTP. When enabled, emitResponse() writes
+     * the HTTP/1.1 status line instead (with the standard reason phrase if
+     * the response has none), adds Date and, for seekable bodies,
+     * Content-Length headers, and omits the body of HEAD responses. This is
+     * for front ends that talk HTTP to clients directly, such as HttpServer.
+     *
+     * @param enabled True to emit HTTP/1.1 messages, false to emit CGI.
+     */
+    void setHttpResponse(bool enabled);
+
+    /**
+     * Gets the phase timings of the request.
+     *
+     * @return Timings, or NULL if neither Server-Timing nor a stats sink is
+     *     enabled.
+     */
+    Timing* getTiming();
+
+    /**
+     * Sets the cache to serve and store responses with.
+     *
+     * The cache is not owned by this object and MUST outlive it.
+     *
+     * @param responseCache Response cache, or NULL to disable caching.
+     */
+    void setResponseCache(ResponseCache* responseCache);
+
+    /**
+     * Emits the server request's response from the response cache.
+     *
+     * Call after getServerRequest() and before running the handler. Only GET
+     * requests are served from the cache. Cached responses always have a
+     * Content-Length header. If automatic ETags are enabled, see
+     * setAutoETag(), a "304 Not Modified" response MAY be emitted instead
+     * when If-None-Match matches the cached ETag.
+     *
+     * Responses served from the cache are written to the access log and
+     * latency stats like emitted ones; the refresh after a stale one is not.
+     *
+     * After a stale response was emitted to `stdout`, standard output is
+     * redirected to /dev/null so the web server sees the response end while
+     * the handler refreshes the cache.
+     *
+     *     CacheStatus status = cnek.serveCached(stdout);
+     *     if (status == Cnek::CACHE_HIT) return 0;
+     *
+     *     // Handle the request; on CACHE_STALE emitResponse() only refreshes
+     *     // the cache since a response was already sent.
+     *     cnek.emitResponse(handle(serverRequest), stdout);
+     *
+     * @param output Stream to write the cached response to.
+     * @return CACHE_HIT if a response was emitted and the handler MUST NOT
+     *     run, CACHE_STALE if a stale response was emitted and the handler
+     *     SHOULD run to refresh it, or CACHE_MISS if nothing was emitted.
+     * @throws std::runtime_error Failed to write outputs.
+     */
+    CacheStatus serveCached(FILE* output);
+
     ~Cnek();
 };
 
+/**
+ * Handles one request for a front end that serves many, such as ScgiServer.
+ *
+ * The front end passes the Cnek the request was created with so the handler
+ * MAY configure it (e.g. setAutoETag()) before the response is emitted.
+ * ScgiServer, and so ThreadPool, reuse one Cnek across connections: it is
+ * reset and its settings cleared before each one, so handlers set it up for
+ * every request.
+ *
+ * @param cnek Service the request was created with.
+ * @param request Request to handle, owned by `cnek`.
+ * @return Response to emit, which the front end frees.
+ * @throws std::exception The request failed; the front end answers with
+ *     "500 Internal Server Error".
+ */
+typedef Csr::Http::Message::Response* (*Handler)(
+    Cnek& cnek,
+    Csr::Http::Message::ServerRequest* request);
+
 } // Cnek
 #define CNEK_CNEK
 #endif // CNEK_CNEK
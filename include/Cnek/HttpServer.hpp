@@ -0,0 +1,186 @@
+#ifndef CNEK_HTTPSERVER
+
+#include "Cnek.hpp"
+#include "AsyncHandler.hpp"
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <map>
+#include <vector>
+
+namespace Cnek {
+
+struct HttpConnection;
+struct HttpRing;
+
+/**
+ * Minimal event-driven HTTP/1.1 server that hosts handlers directly.
+ *
+ * One thread serves every connection with epoll and non-blocking sockets.
+ * Connections are kept alive between requests, and pipelined requests are
+ * answered in order. Each request head is parsed with HttpParser and the
+ * ServerRequest is built from it directly, with the same server params a CGI
+ * environment would have (REQUEST_METHOD, REQUEST_URI, QUERY_STRING,
+ * SERVER_PROTOCOL, CONTENT_LENGTH, CONTENT_TYPE and REMOTE_ADDR), and
+ * responses are emitted as HTTP/1.1 messages (see Cnek::setHttpResponse()).
+ *
+ * With setIoUring(), the loop is driven by io_uring instead: accepts,
+ * receives and sends are queued as submissions and handed to the kernel
+ * together, one system call per batch of completions, and requests are
+ * received into buffers registered with the kernel once.
+ *
+ * Served with an AsyncHandlerFactory instead of a Handler, requests are
+ * handled by AsyncHandler coroutines that wait for timers, file reads and
+ * sockets on the loop, so a handler waiting for its disk or backend does not
+ * hold up other connections. Requests pipelined behind one whose handler
+ * waits are handled once it responds.
+ *
+ * Meant for local benchmarking and internal services, not for the open
+ * internet: request bodies MUST have a Content-Length (chunked requests are
+ * answered with "501 Not Implemented"), there is no TLS, and a slow handler
+ * blocks every connection. Run one process per core on the same port with
+ * SO_REUSEPORT for parallelism.
+ *
+ *     Cnek::HttpServer server("127.0.0.1", 8080);
+ *     server.serve(handle);
+ *
+ * Linux only.
+ */
+class HttpServer {
+    int listener;
+    int poller;
+    volatile sig_atomic_t isRunning;
+    FILE* emptyInput;
+    HttpRing* ring;
+    std::vector<HttpConnection*> connections;
+    std::vector<HttpConnection*> closed;
+
+    /** Creates the handler of each request, or NULL to run a Handler. */
+    AsyncHandlerFactory factory;
+
+    /** Number of handlers waiting for an operation. */
+    size_t waiting;
+
+    /** Time after which a stopped server closes connections being received. */
+    time_t drainDeadline;
+
+    /** Connections whose handler waits for a delay, by monotonic deadline. */
+    std::multimap<uint64_t, HttpConnection*> timers;
+
+    void initialize();
+    void run(Handler handler);
+    void serveRing(Handler handler);
+    void acceptRing(int result);
+    void complete(HttpConnection* connection, int result, Handler handler);
+    void arm(HttpConnection* connection);
+    void acceptAll();
+    void receive(HttpConnection* connection, Handler handler);
+    void process(HttpConnection* connection, Handler handler);
+    bool respond(HttpConnection* connection, Handler handler);
+
+    // Handlers run until they respond or wait; resume() and finish() return
+    // whether the next request of the connection MAY be handled, await()
+    // whether the loop resumes the handler once the operation completes.
+    bool resume(HttpConnection* connection);
+    bool await(HttpConnection* connection);
+    void wake(HttpConnection* connection, long result);
+    bool finish(
+        HttpConnection* connection,
+        Csr::Http::Message::Response* response);
+    void flush(HttpConnection* connection);
+    void drop(HttpConnection* connection);
+
+    /**
+     * Closes the connections of a stopped server that have no request to
+     * answer, and those still being received after the drain deadline.
+     *
+     * @return True if no connections are left.
+     */
+    bool closeIdle();
+
+    void expire();
+
+    public:
+    /**
+     * Listens on a TCP address.
+     *
+     * The socket is bound with SO_REUSEPORT, so several processes MAY listen
+     * on the same address and share its connections.
+     *
+     * @param host IPv4 address to bind, e.g. "127.0.0.1".
+     * @param port Port to bind.
+     * @throws std::invalid_argument The host is not an IPv4 address.
+     * @throws std::runtime_error The socket cannot be bound.
+     */
+    HttpServer(const char* host, unsigned short port);
+
+    /**
+     * Serves a socket that is already listening, e.g. one inherited from a
+     * supervisor. The socket is made non-blocking and closed with the server.
+     *
+     * @param listener Descriptor of the listening socket.
+     * @throws std::runtime_error The event loop cannot be created.
+     */
+    HttpServer(int listener);
+
+    /**
+     * Enables or disables serving with io_uring instead of epoll.
+     *
+     * Kernels without io_uring, or that do not allow it, are served with
+     * epoll; see isIoUring(). Built with CNEK_NO_IO_URING defined, io_uring
+     * is never used.
+     *
+     * @param enabled True to use io_uring if available, false to use epoll.
+     */
+    void setIoUring(bool enabled);
+
+    /**
+     * Checks whether or not serve() uses io_uring.
+     *
+     * @return True if io_uring is enabled and available, false if not.
+     */
+    bool isIoUring();
+
+    /**
+     * Accepts connections and handles their requests until stop() is called.
+     *
+     * Connections idle for HTTP_IDLE_TIMEOUT seconds are closed.
+     *
+     * @param handler Handler of each request.
+     * @throws std::runtime_error Waiting for events failed.
+     */
+    void serve(Handler handler);
+
+    /**
+     * Accepts connections and handles their requests with a coroutine each,
+     * created by a factory, until stop() is called. Handlers still waiting
+     * then are resumed until they respond before this returns.
+     *
+     * Connections idle for HTTP_IDLE_TIMEOUT seconds are closed, except
+     * while their handler waits. With epoll, file reads are done when they
+     * are awaited; io_uring reads them without blocking the loop.
+     *
+     * @param factory Creates the handler of each request.
+     * @throws std::runtime_error Waiting for events failed.
+     */
+    void serve(AsyncHandlerFactory factory);
+
+    /**
+     * Stops serve() after the current batch of events.
+     *
+     * The server stops accepting connections, answers the requests it
+     * already received and closes each connection once it is idle. Requests
+     * still being received after HTTP_DRAIN_TIMEOUT seconds are dropped.
+     *
+     * Safe to call from a signal handler or from a handler.
+     */
+    void stop();
+
+    ~HttpServer();
+};
+
+} // Cnek
+#define CNEK_HTTPSERVER
+#endif // CNEK_HTTPSERVER
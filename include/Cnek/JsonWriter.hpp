@@ -0,0 +1,204 @@
+#ifndef CNEK_JSONWRITER
+
+#include "Stream.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Cnek {
+
+/**
+ * Writes a JSON document straight into a stream, such as a response body.
+ *
+ * Values are formatted into a small buffer that is written to the stream
+ * when full and when the document is complete, so large arrays are
+ * streamed without building a string or a tree first. Nesting is tracked
+ * on a fixed stack, and writing a value where JSON does not allow one
+ * throws.
+ *
+ *     JsonWriter json(response->getBody());
+ *     json.beginObject();
+ *     json.writeKey("id");
+ *     json.writeInteger(7);
+ *     json.writeKey("tags");
+ *     json.beginArray();
+ *     json.writeString("new");
+ *     json.endArray();
+ *     json.endObject();
+ *
+ * Strings MUST be UTF-8; they are escaped but not validated.
+ */
+class JsonWriter {
+    public:
+    enum {
+        /** Max number of objects and arrays nested in one another. */
+        MAX_DEPTH = 64,
+
+        /** Number of bytes buffered before writing to the stream. */
+        BUFFER_SIZE = 4096
+    };
+
+    private:
+    Csr::Http::Message::Stream* stream;
+    char buffer[BUFFER_SIZE];
+    size_t length;
+
+    /** Whether each open container is an object rather than an array. */
+    bool isObject[MAX_DEPTH];
+    size_t depth;
+
+    /** The innermost container has no values yet. */
+    bool isFirst;
+
+    /** A key was written and its value is expected. */
+    bool isKeyed;
+
+    /** The top-level value is complete. */
+    bool isComplete;
+
+    void append(const char* data, size_t length);
+    void appendString(const char* value, size_t length);
+    void beginValue();
+    void endValue();
+
+    public:
+    /**
+     * Creates a writer.
+     *
+     * @param stream Stream to append the document to.
+     */
+    JsonWriter(Csr::Http::Message::Stream* stream);
+
+    /**
+     * Starts an object.
+     *
+     * @throws std::runtime_error No value is allowed here, or objects and
+     *     arrays are nested deeper than MAX_DEPTH.
+     */
+    void beginObject();
+
+    /**
+     * Ends the innermost object.
+     *
+     * @throws std::runtime_error The innermost container is not an object,
+     *     or its last key has no value.
+     */
+    void endObject();
+
+    /**
+     * Starts an array.
+     *
+     * @throws std::runtime_error No value is allowed here, or objects and
+     *     arrays are nested deeper than MAX_DEPTH.
+     */
+    void beginArray();
+
+    /**
+     * Ends the innermost array.
+     *
+     * @throws std::runtime_error The innermost container is not an array.
+     */
+    void endArray();
+
+    /**
+     * Writes the key of the next value of the innermost object.
+     *
+     * @param name Key, escaped as a string.
+     * @throws std::runtime_error The innermost container is not an object,
+     *     or a key is already waiting for its value.
+     */
+    void writeKey(const char* name);
+
+    /**
+     * Writes a string value.
+     *
+     * @param value String to escape, or NULL for null.
+     * @throws std::runtime_error No value is allowed here.
+     */
+    void writeString(const char* value);
+
+    /**
+     * Writes a string value that MAY contain null bytes.
+     *
+     * @param value Bytes to escape.
+     * @param length Number of bytes of `value`.
+     * @throws std::runtime_error No value is allowed here.
+     */
+    void writeString(const char* value, size_t length);
+
+    /**
+     * Writes a signed integer value.
+     *
+     * @param value Integer to write.
+     * @throws std::runtime_error No value is allowed here.
+     */
+    void writeInteger(int64_t value);
+
+    /**
+     * Writes an unsigned integer value.
+     *
+     * @param value Integer to write.
+     * @throws std::runtime_error No value is allowed here.
+     */
+    void writeUnsigned(uint64_t value);
+
+    /**
+     * Writes a number value with the fewest digits that read back as the
+     * same double.
+     *
+     * NaN and infinities have no JSON representation and are written as
+     * null.
+     *
+     * @param value Number to write.
+     * @throws std::runtime_error No value is allowed here.
+     */
+    void writeNumber(double value);
+
+    /**
+     * Writes true or false.
+     *
+     * @param value Boolean to write.
+     * @throws std::runtime_error No value is allowed here.
+     */
+    void writeBool(bool value);
+
+    /**
+     * Writes null.
+     *
+     * @throws std::runtime_error No value is allowed here.
+     */
+    void writeNull();
+
+    /**
+     * Writes the buffered bytes to the stream.
+     *
+     * This is done when the top-level value is complete, so it is only
+     * needed to send part of a document early.
+     *
+     * @throws std::runtime_error The stream cannot be written to.
+     */
+    void flush();
+
+    /**
+     * Checks whether the top-level value is complete.
+     *
+     * @return True once the document is complete.
+     */
+    bool isDone();
+
+    /**
+     * Checks whether strings are escaped with SSE2.
+     *
+     * @return True if built with SSE2 and without CSR_NO_SIMD.
+     */
+    static bool isVectorized();
+
+    /**
+     * Flushes the buffered bytes, ignoring errors.
+     */
+    ~JsonWriter();
+};
+
+} // Cnek
+#define CNEK_JSONWRITER
+#endif // CNEK_JSONWRITER
@@ -0,0 +1,234 @@
+#ifndef CNEK_LATENCYSTATS
+
+#include "Response.hpp"
+#include "Timing.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace Cnek {
+
+class LatencyStats;
+
+/**
+ * Histogram of latencies in microseconds, in the style of HdrHistogram.
+ *
+ * Values below 32 have a bucket each; above, every power of two is split
+ * into 32 buckets, so any value is kept within about 3% while the histogram
+ * stays a fixed size. Recording is constant time, and histograms of the same
+ * layout are merged by adding their buckets, e.g. to combine processes,
+ * statuses or snapshots taken at different times.
+ *
+ * Values of more than 2^32 microseconds, about 71 minutes, are counted in
+ * the last bucket.
+ */
+class LatencyHistogram {
+    friend class LatencyStats;
+
+    public:
+    enum {
+        /** Buckets per power of two. */
+        SUB_BUCKET_COUNT = 32,
+
+        /** Buckets of a histogram. */
+        BUCKET_COUNT = 896
+    };
+
+    private:
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    public:
+    LatencyHistogram();
+
+    /**
+     * Gets the bucket a value is counted in.
+     *
+     * @param microseconds Value to count.
+     * @return Index of the bucket.
+     */
+    static size_t getBucket(uint64_t microseconds);
+
+    /**
+     * Gets the highest value counted in a bucket.
+     *
+     * @param bucket Index of the bucket.
+     * @return Microseconds.
+     */
+    static uint64_t getBucketValue(size_t bucket);
+
+    /**
+     * Counts a value.
+     *
+     * @param microseconds Value to count.
+     */
+    void record(uint64_t microseconds);
+
+    /**
+     * Adds the values of another histogram to this one.
+     *
+     * @param other Histogram to add.
+     */
+    void merge(const LatencyHistogram& other);
+
+    /**
+     * Gets the value below which a percentage of values fall.
+     *
+     * @param percentile Percentage from 0 to 100, e.g. 99.
+     * @return Highest value of the bucket the percentile falls in, capped
+     *     by the largest value counted, or 0 if nothing was counted.
+     */
+    uint64_t getPercentile(double percentile) const;
+
+    /**
+     * Gets the number of values counted.
+     */
+    uint64_t getCount() const;
+
+    /**
+     * Gets the sum of the values counted, in microseconds.
+     */
+    uint64_t getSum() const;
+
+    /**
+     * Gets the largest value counted, in microseconds.
+     */
+    uint64_t getMax() const;
+};
+
+/**
+ * Latency histograms per route, status code and phase, shared between
+ * processes.
+ *
+ * Since every CGI request runs in a fresh process, histograms live in a
+ * memory-mapped file that all processes map, like ResponseCache. Each series
+ * of route, status code and phase gets a LatencyHistogram in the file the
+ * first time it is recorded, and values are added to it with atomic
+ * increments, so recording takes no lock. When the file has no room for a
+ * new series, its values are dropped and counted.
+ *
+ * Routes SHOULD be templates like "/users/:id" rather than paths, so the
+ * number of series stays bounded; see Cnek::setRoute().
+ *
+ * Snapshots are copied without stopping writers, so a snapshot MAY miss
+ * values recorded while it was taken, but never counts one twice.
+ *
+ * Not supported on Windows.
+ */
+class LatencyStats {
+    int file;
+    char* memory;
+    size_t mappedSize;
+    size_t seriesCount;
+
+    char* getSeries(
+        const char* route,
+        int statusCode,
+        const char* phase,
+        bool isCreating);
+    void copySeries(char* series, LatencyHistogram& histogram);
+
+    public:
+    /**
+     * Opens or creates a latency stats file.
+     *
+     * If the file exists with a different layout, it is reinitialized.
+     *
+     * @param path Path of the stats file; every process MUST use the same
+     *     path and series count.
+     * @param seriesCount Number of series the file can hold, or 0 for
+     *     LATENCY_STATS_SERIES_COUNT.
+     * @throws std::runtime_error The file cannot be opened or mapped.
+     */
+    LatencyStats(const char* path, size_t seriesCount = 0);
+
+    /**
+     * Adds a latency to a series.
+     *
+     * @param route Route of the request, truncated to
+     *     LATENCY_STATS_ROUTE_SIZE.
+     * @param statusCode Status code of the response.
+     * @param phase Phase that was timed, e.g. "handler" or "total".
+     * @param microseconds Latency to add.
+     * @return True if the latency was added, false if there was no room
+     *     for a new series.
+     */
+    bool record(
+        const char* route,
+        int statusCode,
+        const char* phase,
+        uint64_t microseconds);
+
+    /**
+     * Adds the wall-clock time of every timed phase of a request, and its
+     * total time, to the series of a route and status code.
+     *
+     * Phases are named as by Timing::getName(), so the body parsing phases
+     * "urlencoded", "multipart" and "json" are kept apart from "handler".
+     *
+     * @param route Route of the request.
+     * @param statusCode Status code of the response.
+     * @param timing Phase timings of the request.
+     * @param totalMilliseconds Time from creating the request to emitting
+     *     the response, recorded as phase "total".
+     */
+    void recordTiming(
+        const char* route,
+        int statusCode,
+        Timing& timing,
+        double totalMilliseconds);
+
+    /**
+     * Takes a snapshot of the histogram of a series.
+     *
+     * @param route Route of the series.
+     * @param statusCode Status code of the series, or 0 to merge the series
+     *     of every status code.
+     * @param phase Phase of the series.
+     * @return Copy of the histogram, empty if nothing was recorded.
+     */
+    LatencyHistogram getSnapshot(
+        const char* route,
+        int statusCode,
+        const char* phase);
+
+    /**
+     * Renders every series in the Prometheus text format, as summaries with
+     * the 50th, 90th, 99th and 99.9th percentiles in seconds:
+     *
+     *     cnek_request_duration_seconds{route="/report",status="200",
+     *         phase="handler",quantile="0.99"} 0.012543
+     *
+     * @see https://prometheus.io/docs/instrumenting/exposition_formats/
+     * @return Metrics text.
+     */
+    std::string toPrometheus();
+
+    /**
+     * Creates a "200 OK" response with toPrometheus() as its body, for a
+     * stats route that a handler opts into serving.
+     *
+     * The stats reveal the routes and load of the server, so the route
+     * SHOULD NOT be public.
+     *
+     * @return Response to emit.
+     */
+    Csr::Http::Message::Response* createResponse();
+
+    /**
+     * Gets how many latencies were dropped because there was no room for
+     * their series.
+     *
+     * @return Number of dropped latencies, of every process.
+     */
+    uint64_t getDropped();
+
+    ~LatencyStats();
+};
+
+} // Cnek
+#define CNEK_LATENCYSTATS
+#endif // CNEK_LATENCYSTATS
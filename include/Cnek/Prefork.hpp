@@ -0,0 +1,142 @@
+#ifndef CNEK_PREFORK
+
+#include "Cnek.hpp"
+
+#include <signal.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace Cnek {
+
+/**
+ * Protocol pre-forked workers serve.
+ */
+enum PreforkProtocol {
+    /** Workers run a ScgiServer, behind a web server. */
+    PREFORK_SCGI,
+
+    /** Workers run an HttpServer. */
+    PREFORK_HTTP
+};
+
+/**
+ * Pre-forking supervisor of worker processes.
+ *
+ * The master process binds the listening socket once and forks workers that
+ * each accept connections on it and run the handler, so the cost of starting
+ * a process is paid once per worker instead of once per request, and a
+ * crashing handler only takes down its own worker. The master restarts
+ * workers that exit, serve a number of requests or grow past an RSS limit.
+ *
+ * Signals to the master:
+ *
+ * - SIGHUP starts a new set of workers, then stops the old ones once their
+ *   current request is done, without refusing connections meanwhile. Each
+ *   new worker runs the init function again, e.g. to reload configuration.
+ * - SIGTERM or SIGINT stops the workers the same way and returns from run().
+ *
+ *     Cnek::Prefork prefork("127.0.0.1", 4000, Cnek::PREFORK_SCGI, 0);
+ *     prefork.setMaxRequests(10000);
+ *     prefork.run(handle);
+ *
+ * Linux only.
+ */
+class Prefork {
+    int listener;
+    PreforkProtocol protocol;
+    int workerCount;
+    unsigned long maxRequests;
+    size_t maxRss;
+    bool isCpuAffinity;
+    void (*init)();
+
+    /** Process ID of each worker slot, or 0 if the slot is empty. */
+    std::vector<pid_t> workers;
+
+    /** When each worker slot was last forked. */
+    std::vector<time_t> started;
+
+    /** Workers of previous generations, stopping. */
+    std::vector<pid_t> retiring;
+
+    pid_t spawn(int slot, Handler handler);
+    void reap(Handler handler, bool isRunning);
+
+    public:
+    /**
+     * Listens on a TCP address.
+     *
+     * @param host IPv4 address to bind, e.g. "127.0.0.1".
+     * @param port Port to bind.
+     * @param protocol Protocol the workers serve.
+     * @param workers Number of workers, or 0 for one per online CPU.
+     * @throws std::invalid_argument The host is not an IPv4 address.
+     * @throws std::runtime_error The socket cannot be bound.
+     */
+    Prefork(
+        const char* host,
+        unsigned short port,
+        PreforkProtocol protocol,
+        int workers);
+
+    /**
+     * Supervises workers on a socket that is already listening, e.g. a Unix
+     * socket bound for SCGI. The socket is closed with the supervisor.
+     *
+     * @param listener Descriptor of the listening socket.
+     * @param protocol Protocol the workers serve.
+     * @param workers Number of workers, or 0 for one per online CPU.
+     */
+    Prefork(int listener, PreforkProtocol protocol, int workers);
+
+    /**
+     * Sets the number of requests after which a worker is restarted, e.g. to
+     * bound the effect of leaks.
+     *
+     * @param maxRequests Number of requests, or 0 for no limit.
+     */
+    void setMaxRequests(unsigned long maxRequests);
+
+    /**
+     * Sets the peak resident set size after which a worker is restarted.
+     * Checked after each request.
+     *
+     * @param maxRss Number of bytes, or 0 for no limit.
+     */
+    void setMaxRss(size_t maxRss);
+
+    /**
+     * Enables or disables pinning each worker to one CPU, round-robin over
+     * the online CPUs, to keep its caches warm.
+     *
+     * @param enabled True to pin workers, false to let them migrate.
+     */
+    void setCpuAffinity(bool enabled);
+
+    /**
+     * Sets a function each worker runs after it is forked and before it
+     * serves, e.g. to open connections or load configuration.
+     *
+     * @param init Function to run, or NULL.
+     */
+    void setWorkerInit(void (*init)());
+
+    /**
+     * Forks the workers and supervises them until SIGTERM or SIGINT.
+     *
+     * SIGHUP, SIGTERM, SIGINT and SIGCHLD are blocked in the calling process
+     * while it supervises.
+     *
+     * @param handler Handler of each request, run in the workers.
+     * @throws std::runtime_error Workers cannot be forked.
+     */
+    void run(Handler handler);
+
+    ~Prefork();
+};
+
+} // Cnek
+#define CNEK_PREFORK
+#endif // CNEK_PREFORK
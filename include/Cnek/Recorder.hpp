@@ -0,0 +1,145 @@
+#ifndef CNEK_RECORDER
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+namespace Cnek {
+
+/**
+ * Records sampled requests to a capture file for offline profiling.
+ *
+ * Each sampled request is written as one record holding its full CGI
+ * environment and raw body, so it can be rebuilt with Capture and replayed
+ * exactly. A record is assembled in memory and appended with a single write,
+ * so processes MAY share a capture file.
+ *
+ * Captures hold cookies, credentials and anything else in the environment,
+ * so the file is created readable by its owner only and MUST be protected
+ * like the requests themselves.
+ *
+ * Record layout, all integers little-endian:
+ *
+ *     "CREC"             Magic.
+ *     uint32 length      Bytes of the record after this field.
+ *     uint64 time        Unix time the request was recorded at.
+ *     uint32 count       Number of environment variables.
+ *     uint32 bodyLength  Bytes of the body.
+ *     count times:
+ *         uint32 length  Bytes of the variable.
+ *         bytes          NAME=VALUE, without a null-terminator.
+ *     bytes              Body.
+ */
+class Recorder {
+    int file;
+    FILE* stream;
+    unsigned long sampleRate;
+    uint64_t state;
+
+    public:
+    /**
+     * Opens a capture file for appending, creating it if needed.
+     *
+     * @param path Path of the capture file.
+     * @param sampleRate Record 1 in `sampleRate` requests; 1 records all.
+     * @throws std::runtime_error The file cannot be opened.
+     */
+    Recorder(const char* path, unsigned long sampleRate = 1);
+
+    /**
+     * Decides whether or not to record the current request.
+     *
+     * Sampling is random instead of counting, since every CGI request MAY
+     * run in a fresh process.
+     *
+     * @return True if the request SHOULD be recorded.
+     */
+    bool isSampled();
+
+    /**
+     * Appends a request to the capture file.
+     *
+     * @param environment Null-terminated CGI environment of the request.
+     * @param body Raw body of the request.
+     * @param length Number of bytes of the body.
+     * @throws std::runtime_error Failed to write the record.
+     */
+    void record(char** environment, const char* body, size_t length);
+
+    ~Recorder();
+};
+
+/**
+ * Reads the requests of a capture file written by Recorder.
+ *
+ *     Cnek::Capture capture("requests.cap");
+ *     while (capture.next()) {
+ *         Cnek::Cnek cnek;
+ *         cnek.getServerRequest(capture.getEnvironment(), capture.getInput());
+ *         ...
+ *     }
+ */
+class Capture {
+    FILE* file;
+    char** environment;
+    std::string body;
+    FILE* input;
+    uint64_t time;
+
+    void clear();
+
+    public:
+    /**
+     * Opens a capture file for reading.
+     *
+     * @param path Path of the capture file.
+     * @throws std::runtime_error The file cannot be opened.
+     */
+    Capture(const char* path);
+
+    /**
+     * Reads the next request.
+     *
+     * The environment and input of the previous request are freed.
+     *
+     * @return True if a request was read, false at the end of the file.
+     * @throws std::runtime_error The record is truncated or corrupt.
+     */
+    bool next();
+
+    /**
+     * Gets the environment of the current request.
+     *
+     * @return Null-terminated array of NAME=VALUE strings, owned by this
+     *     object until the next call to next().
+     */
+    char** getEnvironment();
+
+    /**
+     * Gets the body of the current request as a stream.
+     *
+     * @return Stream positioned at the start of the body, owned by this
+     *     object until the next call to next().
+     */
+    FILE* getInput();
+
+    /**
+     * Gets the raw body of the current request.
+     *
+     * @return Body bytes, which MAY contain null bytes.
+     */
+    const std::string& getBody();
+
+    /**
+     * Gets when the current request was recorded.
+     *
+     * @return Unix time in seconds.
+     */
+    uint64_t getTime();
+
+    ~Capture();
+};
+
+} // Cnek
+#define CNEK_RECORDER
+#endif // CNEK_RECORDER
@@ -0,0 +1,176 @@
+#ifndef CNEK_RESPONSECACHE
+
+#include "ServerRequest.hpp"
+
+namespace Cnek {
+
+/**
+ * Results of looking up a response in the cache.
+ */
+enum CacheStatus {
+    /** No usable response is cached. */
+    CACHE_MISS = 0,
+
+    /** A response that can be served as-is is cached. */
+    CACHE_HIT = 1,
+
+    /**
+     * A stale response is cached and the caller has been chosen to
+     * revalidate it; serve it, then run the handler to refresh the entry.
+     */
+    CACHE_STALE = 2
+};
+
+/**
+ * Response cache shared between processes.
+ *
+ * Since every CGI request runs in a fresh process, responses are cached in a
+ * memory-mapped file that all processes map. Entries are keyed by method,
+ * Host, request-target and the values of selected headers (see
+ * addVaryHeader()), and hold the response exactly as it is emitted.
+ *
+ * The file is split into fixed-size slots. A key may live in any of a small
+ * window of slots following its hash, and when the window is full the least
+ * recently used entry is evicted using the CLOCK algorithm.
+ *
+ * Reads are lock-free: each slot carries a sequence number that writers
+ * make odd while writing, and readers retry if it changed while copying.
+ * Writers serialize on a file lock, and threads writing through the same
+ * instance on a spinlock, since file locks do not exclude threads of one
+ * process.
+ *
+ * Not supported on Windows.
+ */
+class ResponseCache {
+    int file;
+    char* memory;
+    size_t mappedSize;
+    size_t slotCount;
+    size_t slotSize;
+    long defaultTtl;
+    long defaultStale;
+    Csr::Http::Message::ValueList* varyHeaders;
+    volatile int isLocked;
+
+    void lock();
+    void unlock();
+    char* getSlot(size_t index);
+
+    public:
+    /**
+     * Opens or creates a response cache file.
+     *
+     * If the file exists with a different layout, it is reinitialized.
+     *
+     * @param path Path of the cache file; every process MUST use the same
+     *     path, slot count and slot size.
+     * @param slotCount Number of entries the cache can hold.
+     * @param slotSize Max number of bytes per entry, including its key.
+     * @throws std::runtime_error The file cannot be opened or mapped.
+     */
+    ResponseCache(
+        const char* path,
+        size_t slotCount = 0,
+        size_t slotSize = 0);
+
+    /**
+     * Adds a request header whose value is part of the cache key.
+     *
+     * Add every header the cached responses vary on, such as
+     * Accept-Encoding.
+     *
+     * @param name Case-insensitive header name.
+     */
+    void addVaryHeader(const char* name);
+
+    /**
+     * Checks whether or not the cache key covers a response's Vary header.
+     *
+     * Responses that vary on headers outside the key MUST NOT be stored, or
+     * they would be served to requests they do not match.
+     *
+     * @param vary Value of the Vary header, or an empty string.
+     * @return True if every header it names was added with addVaryHeader(),
+     *     false if not or if it is "*".
+     */
+    bool isVaryKeyed(const char* vary);
+
+    /**
+     * Sets the lifetime of responses without Cache-Control max-age.
+     *
+     * @param ttl Seconds a response is fresh for; 0 to not cache such
+     *     responses.
+     * @param staleWhileRevalidate Seconds after expiring that a response MAY
+     *     still be served while it is revalidated.
+     */
+    void setDefaultTtl(long ttl, long staleWhileRevalidate = 0);
+
+    /**
+     * Gets the lifetime of responses without Cache-Control max-age.
+     *
+     * @return Seconds a response is fresh for.
+     */
+    long getDefaultTtl();
+
+    /**
+     * Gets the stale-while-revalidate window of responses without
+     * Cache-Control stale-while-revalidate.
+     *
+     * @return Seconds a response MAY be served stale for.
+     */
+    long getDefaultStale();
+
+    /**
+     * Creates the cache key of a server request.
+     *
+     * @param request Request to create the key for.
+     * @return Allocated key; free with delete[].
+     */
+    char* createKey(Csr::Http::Message::ServerRequest* request);
+
+    /**
+     * Looks up a cached response.
+     *
+     * At most one caller gets CACHE_STALE for an expired entry; the others
+     * get CACHE_HIT for the stale entry until it is refreshed or the
+     * revalidation times out.
+     *
+     * @param key Key created with createKey().
+     * @param data Set to the allocated response bytes on a hit; free with
+     *     free().
+     * @param length Set to the number of response bytes on a hit.
+     * @return Whether the response is missing, fresh or stale.
+     */
+    CacheStatus lookup(const char* key, char** data, size_t* length);
+
+    /**
+     * Stores a response.
+     *
+     * @param key Key created with createKey().
+     * @param data Response bytes, exactly as they are emitted.
+     * @param length Number of response bytes.
+     * @param ttl Seconds the response is fresh for.
+     * @param staleWhileRevalidate Seconds after expiring that the response MAY
+     *     still be served while it is revalidated.
+     * @return True if stored, false if the entry does not fit in a slot.
+     */
+    bool store(
+        const char* key,
+        const char* data,
+        size_t length,
+        long ttl,
+        long staleWhileRevalidate = 0);
+
+    /**
+     * Gets the max number of bytes of a key and response in one entry.
+     *
+     * @return Capacity of a slot in bytes.
+     */
+    size_t getCapacity();
+
+    ~ResponseCache();
+};
+
+} // Cnek
+#define CNEK_RESPONSECACHE
+#endif // CNEK_RESPONSECACHE
@@ -0,0 +1,117 @@
+#ifndef CNEK_SCGISERVER
+
+#include "Cnek.hpp"
+
+#include <signal.h>
+#include <stddef.h>
+#include <vector>
+
+namespace Cnek {
+
+/**
+ * Serves requests over SCGI in a persistent process.
+ *
+ * SCGI sends each request on its own connection as a netstring of
+ * null-terminated header names and values, followed by the body. With <0>
+ * for a null byte:
+ *
+ *     44:CONTENT_LENGTH<0>3<0>SCGI<0>1<0>REQUEST_METHOD<0>POST<0>,abc
+ *
+ * The netstring is parsed in place: the null between each name and value is
+ * replaced with '=', so the block itself holds the NAME=VALUE strings handed
+ * to ServerRequest as its environment, without copying them. The response is
+ * written in CGI form, which is what SCGI expects, and the connection is
+ * closed.
+ *
+ * Connections are handled one at a time; run several processes on the same
+ * socket to handle requests in parallel. With nginx:
+ *
+ *     location / {
+ *         include scgi_params;
+ *         scgi_pass 127.0.0.1:4000;
+ *     }
+ *
+ * Not supported on Windows.
+ *
+ * @see https://python.ca/scgi/protocol.txt
+ */
+class ScgiServer {
+    int listener;
+    volatile sig_atomic_t isRunning;
+    char* buffer;
+    size_t capacity;
+    std::vector<char*> environment;
+    Cnek cnek;
+
+    bool receive(int client, size_t* size, size_t needed);
+
+    public:
+    /**
+     * Listens on a TCP address.
+     *
+     * @param host IPv4 address to bind, e.g. "127.0.0.1".
+     * @param port Port to bind.
+     * @throws std::runtime_error The socket cannot be bound.
+     */
+    ScgiServer(const char* host, unsigned short port);
+
+    /**
+     * Listens on a Unix domain socket.
+     *
+     * A stale socket file at the path is replaced.
+     *
+     * @param path Path of the socket file.
+     * @throws std::runtime_error The socket cannot be bound.
+     */
+    ScgiServer(const char* path);
+
+    /**
+     * Serves a socket that is already listening, e.g. one inherited from a
+     * supervisor. The socket is closed with the server.
+     *
+     * @param listener Descriptor of the listening socket.
+     */
+    ScgiServer(int listener);
+
+    /**
+     * Accepts and handles connections until stop() is called.
+     *
+     * SIGPIPE is ignored, so clients that disconnect early fail the write
+     * instead of killing the process.
+     *
+     * @param handler Handler of each request.
+     * @throws std::runtime_error Accepting connections failed.
+     */
+    void serve(Handler handler);
+
+    /**
+     * Stops serve() after the current connection.
+     *
+     * Safe to call from a signal handler. Install the handler without
+     * SA_RESTART so a waiting accept() returns.
+     */
+    void stop();
+
+    /**
+     * Handles one request on an accepted connection, then closes it.
+     *
+     * Malformed requests are closed without a response. Requests the handler
+     * fails are answered with "500 Internal Server Error", and errors are
+     * written to stderr.
+     *
+     * The Cnek passed to the handler, with its server request and response,
+     * is reused across connections; it is reset and its settings cleared
+     * before each one, so handlers set it up for every request.
+     *
+     * @param client Descriptor of the connection.
+     * @param handler Handler of the request.
+     * @return True if a response was emitted, false if not.
+     */
+    bool handle(int client, Handler handler);
+
+    ~ScgiServer();
+};
+
+} // Cnek
+#define CNEK_SCGISERVER
+#endif // CNEK_SCGISERVER
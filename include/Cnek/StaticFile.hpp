@@ -0,0 +1,146 @@
+#ifndef CNEK_STATICFILE
+
+#include "ServerRequest.hpp"
+#include "Response.hpp"
+
+namespace Cnek {
+
+/**
+ * Content codings a static file variant can be stored in.
+ */
+enum Encoding {
+    /** No content coding, the original file. */
+    ENCODING_IDENTITY = 0,
+
+    /** Brotli, stored with a ".br" extension. */
+    ENCODING_BR = 1,
+
+    /** Zstandard, stored with a ".zst" extension. */
+    ENCODING_ZSTD = 2,
+
+    /** Gzip, stored with a ".gz" extension. */
+    ENCODING_GZIP = 3
+};
+
+/**
+ * When missing precompressed variants are generated.
+ */
+enum GenerateMode {
+    /** Never generate variants, only serve the ones that exist. */
+    GENERATE_NONE = 0,
+
+    /**
+     * Generate the variant while handling the request that first asks for
+     * it, then serve it.
+     */
+    GENERATE_FIRST_HIT = 1,
+
+    /**
+     * Serve the original file and generate the variant in a detached
+     * process so a later request can use it. Requests for a variant that is
+     * already being generated do not start another process. While a
+     * ThreadPool is serving, a detached thread generates it instead.
+     */
+    GENERATE_BACKGROUND = 2
+};
+
+/**
+ * Serves static files, preferring precompressed variants.
+ *
+ * Given a file such as "app.css", variants stored next to it ("app.css.br",
+ * "app.css.zst" or "app.css.gz") are negotiated against the request's
+ * Accept-Encoding header and served directly, so assets are never compressed
+ * while handling a request.
+ *
+ * Variants that are missing next to the original MAY be looked up in, and
+ * generated into, a cache directory. Cached variants are keyed by the
+ * original file's path, size and modification time, so each version of an
+ * asset is compressed only once. Variants of old versions are removed as
+ * new ones are generated, and the oldest ones once the directory holds more
+ * than MAX_STATIC_CACHE_SIZE bytes.
+ *
+ * Generating variants requires building with CNEK_USE_ZLIB (gzip),
+ * CNEK_USE_BROTLI (br) and/or CNEK_USE_ZSTD (zstd) defined and linking the
+ * matching library.
+ */
+class StaticFile {
+    char* cacheDirectory;
+    GenerateMode generateMode;
+
+    /**
+     * Finds an up-to-date variant of a file for the given encoding.
+     *
+     * @param filename Original file.
+     * @param encoding Encoding of the variant to find.
+     * @return Allocated path to the variant or NULL if there is none.
+     */
+    char* findVariant(const char* filename, Encoding encoding);
+
+    public:
+    /**
+     * Creates a static file service.
+     *
+     * @param cacheDirectory Directory to look up and store generated variants
+     *     in, or NULL to only use variants stored next to the original.
+     * @param generateMode When to generate missing variants into
+     *     `cacheDirectory`.
+     */
+    StaticFile(
+        const char* cacheDirectory = NULL,
+        GenerateMode generateMode = GENERATE_NONE);
+
+    /**
+     * Sets a file as the body of a response.
+     *
+     * The best variant accepted by the request is opened as the response
+     * body, and the Content-Encoding and Vary headers are set accordingly.
+     *
+     * @param request Request to negotiate the encoding with.
+     * @param response Response to set the body and headers of.
+     * @param filename File to serve.
+     * @throws std::runtime_error The file cannot be opened.
+     */
+    void serve(
+        Csr::Http::Message::ServerRequest* request,
+        Csr::Http::Message::Response* response,
+        const char* filename);
+
+    /**
+     * Picks the preferred encoding accepted by an Accept-Encoding header.
+     *
+     * Only encodings listed in `available` are considered; the server
+     * prefers br, then zstd, then gzip.
+     *
+     * @param acceptEncoding Value of the Accept-Encoding header.
+     * @param available Encodings to choose from.
+     * @param count Number of encodings in `available`.
+     * @return The preferred encoding or ENCODING_IDENTITY if none is accepted.
+     */
+    static Encoding negotiate(
+        const char* acceptEncoding,
+        const Encoding* available,
+        size_t count);
+
+    /**
+     * Generates a compressed variant of a file.
+     *
+     * The variant is written to a temporary file and renamed into place, so
+     * concurrent requests never see a partial variant.
+     *
+     * @param filename Original file.
+     * @param target Path to write the variant to.
+     * @param encoding Encoding to compress with.
+     * @return True if the variant was generated, false if the encoding is not
+     *     supported by this build or compression failed.
+     */
+    static bool generate(
+        const char* filename,
+        const char* target,
+        Encoding encoding);
+
+    ~StaticFile();
+};
+
+} // Cnek
+#define CNEK_STATICFILE
+#endif // CNEK_STATICFILE
@@ -0,0 +1,145 @@
+#ifndef CNEK_TEMPLATE
+
+#include "Stream.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Cnek {
+
+struct TemplateValue;
+
+/**
+ * Values a template is rendered with.
+ *
+ * Each name holds a string, a list of nested values, or both. Names not
+ * found in a list item are looked up in the values around it.
+ */
+class TemplateData {
+    friend class Template;
+
+    std::vector<TemplateValue*> values;
+
+    TemplateValue* find(const char* name, uint32_t hash);
+    TemplateValue* create(const char* name);
+
+    public:
+    TemplateData();
+
+    /**
+     * Sets a string value, replacing any previous one.
+     *
+     * @param name Name of the value.
+     * @param value String to copy.
+     */
+    void set(const char* name, const char* value);
+
+    /**
+     * Appends an item to a list.
+     *
+     * @param name Name of the list.
+     * @return Values of the new item, owned by this object.
+     */
+    TemplateData* add(const char* name);
+
+    /**
+     * Gets a string value.
+     *
+     * @param name Name of the value.
+     * @return The value, or NULL if not set.
+     */
+    const char* get(const char* name);
+
+    ~TemplateData();
+};
+
+/**
+ * HTML template compiled into a flat program.
+ *
+ * Templates use a subset of Mustache:
+ *
+ *     {{name}}              Value of name, HTML-escaped.
+ *     {{#items}}...{{/items}}  Once per item of the list items.
+ *     {{?name}}...{{/name}}  If name is a non-empty string or list.
+ *     {{^name}}...{{/name}}  If name is not.
+ *
+ * A template is compiled once into an array of instructions followed by
+ * the literal text and names they refer to. Rendering runs the
+ * instructions, writing literal spans by pointer and length straight into
+ * the body stream, and never parses the template again.
+ *
+ * The program holds no pointers, so it MAY be saved to a cache file by
+ * load() and mapped read-only by later processes, which then share its
+ * pages instead of compiling the template each.
+ */
+class Template {
+    char* program;
+    size_t programSize;
+    bool isMapped;
+
+    void release();
+    bool map(const char* cachePath, uint64_t sourceSize, int64_t sourceTime);
+    void save(const char* cachePath);
+    size_t renderRange(
+        size_t begin,
+        size_t end,
+        std::vector<TemplateData*>& scopes,
+        Csr::Http::Message::Stream* stream);
+
+    public:
+    /**
+     * Creates an empty template, which renders nothing.
+     */
+    Template();
+
+    /**
+     * Compiles a template, replacing the current program.
+     *
+     * @param source Template text.
+     * @param length Number of bytes of `source`.
+     * @throws std::invalid_argument The template has a malformed tag, an
+     *     unbalanced section, or is nested deeper than TEMPLATE_MAX_DEPTH.
+     */
+    void compile(const char* source, size_t length);
+
+    /**
+     * Compiles a template file, replacing the current program.
+     *
+     * If `cachePath` holds the program of the file at its current size and
+     * modification time, it is mapped instead; otherwise the file is
+     * compiled and its program is written to `cachePath` for the next
+     * process. Failing to write the cache is not an error, and the cache is
+     * not used on Windows.
+     *
+     * @param path Template file.
+     * @param cachePath Compiled program cache, or NULL to always compile.
+     * @throws std::runtime_error The file cannot be read or is larger than
+     *     MAX_TEMPLATE_SIZE.
+     * @throws std::invalid_argument The template is malformed.
+     */
+    void load(const char* path, const char* cachePath = NULL);
+
+    /**
+     * Renders the template.
+     *
+     * @param data Values to render with.
+     * @param stream Stream to append to, e.g. a response body.
+     * @return Number of bytes written.
+     * @throws std::runtime_error The stream cannot be written to.
+     */
+    size_t render(TemplateData& data, Csr::Http::Message::Stream* stream);
+
+    /**
+     * Gets the size of the compiled program.
+     *
+     * @return Number of bytes.
+     */
+    size_t getProgramSize();
+
+    ~Template();
+};
+
+} // Cnek
+#define CNEK_TEMPLATE
+#endif // CNEK_TEMPLATE
@@ -0,0 +1,121 @@
+#ifndef CNEK_THREADPOOL
+
+#include "Cnek.hpp"
+
+#include <stddef.h>
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+struct ThreadWorker;
+
+/**
+ * Serves requests over SCGI with a pool of handler threads in one process.
+ *
+ * The thread calling serve() accepts connections and queues each on one
+ * worker thread, round-robin. Workers handle the connections of their own
+ * queue in order and, when it is empty, steal the newest connection of
+ * another worker's queue, so a slow request does not hold up the ones queued
+ * behind it while other workers are idle.
+ *
+ * Each worker owns a ScgiServer whose buffer and environment are reused for
+ * every connection it handles. Unlike pre-forked workers, threads share the
+ * memory of the process: caches, connection pools and configuration loaded
+ * once are used by every worker without copying. Handlers MUST therefore be
+ * safe to run in several threads at once, and a crashing handler takes down
+ * every worker.
+ *
+ *     Cnek::ThreadPool pool("127.0.0.1", 4000, 0);
+ *     pool.serve(handle);
+ *
+ * Not supported on Windows.
+ */
+class ThreadPool {
+    int listener;
+    int threadCount;
+
+    /** Pipe written by stop() to wake and stop the accepting thread. */
+    int wakeup[2];
+
+    Handler handler;
+    std::vector<ThreadWorker*> workers;
+
+#ifndef _WIN32
+    /** Guards `queued` and `isDraining`. */
+    pthread_mutex_t mutex;
+
+    /** Signaled when a connection is queued or the pool drains. */
+    pthread_cond_t ready;
+#endif // _WIN32
+
+    /** Number of connections queued on any worker, not yet taken. */
+    size_t queued;
+    bool isDraining;
+
+    void initialize();
+    void dispatch(int client, size_t* next);
+    int take(ThreadWorker* worker);
+    void drain();
+    static void* work(void* worker);
+
+    public:
+    /**
+     * Listens on a TCP address.
+     *
+     * @param host IPv4 address to bind, e.g. "127.0.0.1".
+     * @param port Port to bind.
+     * @param threads Number of worker threads, or 0 for one per online CPU.
+     * @throws std::invalid_argument The host is not an IPv4 address.
+     * @throws std::runtime_error The socket cannot be bound.
+     */
+    ThreadPool(const char* host, unsigned short port, int threads);
+
+    /**
+     * Serves a socket that is already listening, e.g. a Unix socket or one
+     * inherited from a supervisor. The socket is closed with the pool.
+     *
+     * @param listener Descriptor of the listening socket.
+     * @param threads Number of worker threads, or 0 for one per online CPU.
+     * @throws std::runtime_error The pool cannot be created.
+     */
+    ThreadPool(int listener, int threads);
+
+    /**
+     * Starts the worker threads, then accepts connections until stop() is
+     * called. Connections already accepted are handled before it returns.
+     *
+     * SIGPIPE is ignored, so clients that disconnect early fail the write
+     * instead of killing the process.
+     *
+     * @param handler Handler of each request, run in the worker threads.
+     * @throws std::runtime_error Threads cannot be started or accepting
+     *     connections failed.
+     */
+    void serve(Handler handler);
+
+    /**
+     * Stops accepting connections. If serve() is not running, the next call
+     * returns as soon as its workers have started.
+     *
+     * Safe to call from a signal handler or from a handler, in any thread.
+     */
+    void stop();
+
+    /**
+     * Checks whether or not a pool is serving in this process, so code that
+     * would fork can avoid it while other threads hold locks.
+     *
+     * @return True if serve() is running in any pool, false if not.
+     */
+    static bool isServing();
+
+    ~ThreadPool();
+};
+
+} // Cnek
+#define CNEK_THREADPOOL
+#endif // CNEK_THREADPOOL
@@ -0,0 +1,147 @@
+#ifndef CNEK_TIMING
+
+#include <stdio.h>
+
+namespace Cnek {
+
+/**
+ * Phases of handling a request that are timed.
+ */
+enum TimingPhase {
+    /** Parsing the environment and headers into a server request. */
+    TIMING_ENV = 0,
+
+    /** Reading the request body from the input. */
+    TIMING_BODY = 1,
+
+    /** Parsing an application/x-www-form-urlencoded body. */
+    TIMING_URLENCODED = 2,
+
+    /** Parsing a multipart/form-data body. */
+    TIMING_MULTIPART = 3,
+
+    /** Indexing a JSON body. */
+    TIMING_JSON = 4,
+
+    /** Running the handler, from the server request to emitting. */
+    TIMING_HANDLER = 5,
+
+    /** Emitting the response. */
+    TIMING_EMIT = 6,
+
+    /** Number of phases. */
+    TIMING_PHASE_COUNT = 7
+};
+
+/**
+ * Wall-clock and CPU timers for the phases of a request.
+ *
+ * Wall-clock time is read from a monotonic clock, and CPU time is the user
+ * and system time of the calling thread, so the difference between the two
+ * shows time spent waiting on I/O, even with other threads serving requests
+ * in the same process. Where per-thread CPU time is not available, the time
+ * of the whole process is used.
+ */
+class Timing {
+    double wallStart[TIMING_PHASE_COUNT];
+    double cpuStart[TIMING_PHASE_COUNT];
+    double wall[TIMING_PHASE_COUNT];
+    double cpu[TIMING_PHASE_COUNT];
+    bool running[TIMING_PHASE_COUNT];
+    bool recorded[TIMING_PHASE_COUNT];
+
+    public:
+    Timing();
+
+    /**
+     * Starts timing a phase.
+     *
+     * @param phase Phase to time.
+     */
+    void start(TimingPhase phase);
+
+    /**
+     * Stops timing a phase and adds the time since start() to it.
+     *
+     * Does nothing if the phase was not started.
+     *
+     * @param phase Phase to stop timing.
+     */
+    void stop(TimingPhase phase);
+
+    /**
+     * Checks whether or not a phase was timed.
+     *
+     * @param phase Phase to check.
+     * @return True if the phase was started and stopped, false if not.
+     */
+    bool isRecorded(TimingPhase phase);
+
+    /**
+     * Clears every phase, e.g. before timing the next request.
+     */
+    void reset();
+
+    /**
+     * Gets the wall-clock time of a phase.
+     *
+     * @param phase Phase to get the time of.
+     * @return Milliseconds, or 0 if the phase was not timed.
+     */
+    double getWallTime(TimingPhase phase);
+
+    /**
+     * Gets the CPU time of a phase.
+     *
+     * @param phase Phase to get the time of.
+     * @return Milliseconds, or 0 if the phase was not timed.
+     */
+    double getCpuTime(TimingPhase phase);
+
+    /**
+     * Gets the name of a phase as used in outputs.
+     *
+     * @param phase Phase to get the name of.
+     * @return Name such as "env" or "handler".
+     */
+    static const char* getName(TimingPhase phase);
+
+    /**
+     * Formats the timed phases as a Server-Timing header value.
+     *
+     * Each phase is a metric with its wall-clock time as the duration and
+     * its CPU time as the description, for example:
+     *
+     *     env;dur=0.031;desc="cpu=0.030", handler;dur=1.204;desc="cpu=0.950"
+     *
+     * @see https://www.w3.org/TR/server-timing/
+     * @param buffer Buffer to write the value to.
+     * @param size Size of `buffer` in bytes.
+     * @return The value in `buffer`, truncated to fit.
+     */
+    const char* toHeader(char* buffer, size_t size);
+
+    /**
+     * Appends the timed phases as one line to a stats sink.
+     *
+     * The line is written with a single call, so processes MAY share a sink
+     * opened in append mode. Each phase is written as "name=wall/cpu" in
+     * milliseconds:
+     *
+     *     GET /report 200 env=0.031/0.030 body=0.004/0.004 handler=1.204/0.950
+     *
+     * @param sink Stream to append to.
+     * @param method Method of the request.
+     * @param target Request-target of the request.
+     * @param statusCode Status code of the response.
+     */
+    void writeStats(
+        FILE* sink,
+        const char* method,
+        const char* target,
+        int statusCode);
+};
+
+} // Cnek
+#define CNEK_TIMING
+#endif // CNEK_TIMING
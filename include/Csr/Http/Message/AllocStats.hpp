@@ -0,0 +1,94 @@
+#ifndef CSR_HTTP_MESSAGE_ALLOCSTATS
+
+#include <stddef.h>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+/**
+ * Snapshot of the allocation counters.
+ */
+struct AllocCounters {
+    /** Number of allocations since the last reset. */
+    unsigned long allocations;
+
+    /** Number of frees since the last reset. */
+    unsigned long frees;
+
+    /** Number of bytes allocated since the last reset. */
+    unsigned long bytes;
+
+    /** Number of bytes currently allocated. */
+    unsigned long current;
+
+    /** Most bytes allocated at once since the last reset. */
+    unsigned long peak;
+};
+
+/**
+ * Allocation accounting, enabled by building with CSR_ALLOC_STATS defined.
+ *
+ * When enabled, the global operator new and delete are replaced with
+ * counting versions, so every node, string copy (copystr(), urldecode(),
+ * etc.) and object is counted, along with the buffers Stream and the
+ * multipart parser allocate with malloc(). Every translation unit MUST be
+ * built with the same setting.
+ *
+ * Counters are process-wide. Cnek::getServerRequest() resets them, so they
+ * cover one request at a time.
+ *
+ * When disabled, the counters stay at zero and allocate(), reallocate() and
+ * release() are plain malloc(), realloc() and free().
+ */
+class AllocStats {
+    public:
+    /**
+     * Checks whether or not allocations are counted.
+     *
+     * @return True if built with CSR_ALLOC_STATS, false if not.
+     */
+    static bool isEnabled();
+
+    /**
+     * Gets the counters.
+     *
+     * @return Snapshot of the counters.
+     */
+    static AllocCounters get();
+
+    /**
+     * Resets the counters, keeping the bytes currently allocated as the new
+     * high-water mark.
+     */
+    static void reset();
+
+    /**
+     * Allocates counted memory.
+     *
+     * @param size Number of bytes to allocate.
+     * @return Allocated memory, or NULL if out of memory.
+     */
+    static void* allocate(size_t size);
+
+    /**
+     * Resizes memory from allocate().
+     *
+     * @param memory Memory to resize, or NULL to allocate.
+     * @param size New number of bytes.
+     * @return Resized memory, or NULL if out of memory; `memory` is then
+     *     left as-is.
+     */
+    static void* reallocate(void* memory, size_t size);
+
+    /**
+     * Frees memory from allocate() or reallocate().
+     *
+     * @param memory Memory to free, or NULL.
+     */
+    static void release(void* memory);
+};
+
+}}} // Csr::Http::Message
+#define CSR_HTTP_MESSAGE_ALLOCSTATS
+#endif // CSR_HTTP_MESSAGE_ALLOCSTATS
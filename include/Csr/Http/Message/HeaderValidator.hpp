@@ -0,0 +1,69 @@
+#ifndef CSR_HTTP_MESSAGE_HEADERVALIDATOR
+
+#include <stddef.h>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+/**
+ * Guards header fields against CRLF injection.
+ *
+ * A CR, LF or NUL in a header value would end the field, or the whole head,
+ * early, letting whoever controls the value add headers or a body of their
+ * own. Values are scanned for these bytes 16 at a time with SSE2 on x86,
+ * unless built with CSR_NO_SIMD defined, so even large heads are checked at
+ * close to the speed of memchr().
+ *
+ * Message::setHeader() rejects unsafe fields, requests strip them as they
+ * are ingested, and Cnek strips them again as a response head is written.
+ */
+class HeaderValidator {
+    public:
+    /**
+     * Checks whether or not scanning is vectorized.
+     *
+     * @return True if built with SSE2 and without CSR_NO_SIMD, false if not.
+     */
+    static bool isVectorized();
+
+    /**
+     * Finds the first CR, LF or NUL.
+     *
+     * @param data Bytes to scan.
+     * @param length Number of bytes of `data`.
+     * @return Offset of the byte, or `length` if there is none.
+     */
+    static size_t scan(const char* data, size_t length);
+
+    /**
+     * Checks whether or not a header name is a token, per RFC 9110.
+     *
+     * @param name Null-terminated name to check.
+     * @return True if the name is not empty and only has token characters,
+     *     false if not.
+     */
+    static bool isValidName(const char* name);
+
+    /**
+     * Checks whether or not a header value is free of CR, LF and NUL.
+     *
+     * @param value Bytes of the value.
+     * @param length Number of bytes of `value`.
+     * @return True if the value is safe to write, false if not.
+     */
+    static bool isValidValue(const char* value, size_t length);
+
+    /**
+     * Removes every CR, LF and NUL from a header value, in place.
+     *
+     * @param value Bytes of the value.
+     * @param length Number of bytes of `value`.
+     * @return Number of bytes left.
+     */
+    static size_t strip(char* value, size_t length);
+};
+
+}}} // Csr::Http::Message
+#define CSR_HTTP_MESSAGE_HEADERVALIDATOR
+#endif // CSR_HTTP_MESSAGE_HEADERVALIDATOR
@@ -0,0 +1,113 @@
+#ifndef CSR_HTTP_MESSAGE_HTTPPARSER
+
+#include <stddef.h>
+
+// Max number of header fields a request head may have.
+// NOTE: Prevents DoS attacks; requests with more fields are malformed.
+#ifndef MAX_HTTP_PARSER_HEADERS
+#define MAX_HTTP_PARSER_HEADERS 64 // Default 64 headers.
+#endif // MAX_HTTP_PARSER_HEADERS
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+/**
+ * Bytes of a parsed request, pointing into the buffer that was parsed.
+ *
+ * Slices are NOT null-terminated.
+ */
+struct HttpSlice {
+    const char* data;
+    size_t length;
+};
+
+/**
+ * Header field of a parsed request.
+ */
+struct HttpHeaderSlice {
+    HttpSlice name;
+
+    /** Value without leading or trailing whitespace. */
+    HttpSlice value;
+};
+
+/**
+ * Request line and header fields of a parsed request.
+ *
+ * Every slice points into the parsed buffer, which MUST outlive the head
+ * and everything built from it without copying.
+ */
+struct HttpRequestHead {
+    /** Method, e.g. "GET". */
+    HttpSlice method;
+
+    /** Request-target as sent, e.g. "/search?q=cnek". */
+    HttpSlice target;
+
+    /** Path of the request-target, up to '?'. */
+    HttpSlice path;
+
+    /** Query of the request-target, after '?', or empty. */
+    HttpSlice query;
+
+    /** Protocol as sent, e.g. "HTTP/1.1". */
+    HttpSlice protocol;
+
+    /** Major and minor version of the protocol. */
+    int majorVersion;
+    int minorVersion;
+
+    /** Header fields in the order they were sent. */
+    HttpHeaderSlice headers[MAX_HTTP_PARSER_HEADERS];
+    size_t headerCount;
+};
+
+/**
+ * Parser of raw HTTP/1.x request heads.
+ *
+ * Parsing never allocates or copies: the head is a set of slices into the
+ * parsed bytes. Scanning for the end of the request-target and of header
+ * values uses SSE2 on x86, 16 bytes at a time, and falls back to a scalar
+ * loop elsewhere or when built with CSR_NO_SIMD defined.
+ *
+ * The grammar is that of RFC 9112, strictly: lines MUST end in CRLF,
+ * methods and header names MUST be tokens, values MUST NOT hold control
+ * characters other than HTAB, and obsolete line folding is rejected.
+ * Empty lines before the request line are skipped.
+ *
+ *     HttpRequestHead head;
+ *     int length = HttpParser::parseRequest(data, size, &head);
+ *     if (length > 0) {
+ *         // Body, if any, starts at data + length.
+ *     } else if (!length) {
+ *         // Read more and parse again.
+ *     } else {
+ *         // Answer "400 Bad Request".
+ *     }
+ */
+class HttpParser {
+    public:
+    /**
+     * Checks whether or not scanning is vectorized.
+     *
+     * @return True if built with SSE2 and without CSR_NO_SIMD, false if not.
+     */
+    static bool isVectorized();
+
+    /**
+     * Parses a request line and header fields.
+     *
+     * @param data Received bytes, starting at a request.
+     * @param size Number of received bytes.
+     * @param head Set to slices of `data`. Only valid if the head is parsed.
+     * @return Number of bytes of the head, up to and including the empty
+     *     line that ends it; 0 if the head is incomplete; or -1 if it is
+     *     malformed or has more than MAX_HTTP_PARSER_HEADERS fields.
+     */
+    static int parseRequest(const char* data, size_t size, HttpRequestHead* head);
+};
+
+}}} // Csr::Http::Message
+#define CSR_HTTP_MESSAGE_HTTPPARSER
+#endif // CSR_HTTP_MESSAGE_HTTPPARSER
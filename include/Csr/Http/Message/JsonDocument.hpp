@@ -0,0 +1,283 @@
+#ifndef CSR_HTTP_MESSAGE_JSONDOCUMENT
+
+#include "Stream.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+class JsonDocument;
+
+/**
+ * Types of JSON values.
+ */
+enum JsonType {
+    /** No value, e.g. a missing object member. */
+    JSON_MISSING = 0,
+
+    JSON_NULL = 1,
+    JSON_BOOL = 2,
+    JSON_NUMBER = 3,
+    JSON_STRING = 4,
+    JSON_ARRAY = 5,
+    JSON_OBJECT = 6
+};
+
+/**
+ * Cursor to a value of a parsed JSON document.
+ *
+ * Values are only read when they are asked for: looking up a member skips
+ * the values before it without reading them, and a number or string is
+ * only converted by its getter. A value is valid as long as its document
+ * is not parsed again or destroyed.
+ *
+ * Looking up what does not exist, such as a member of an array, returns a
+ * missing value, whose getters all fail, so lookups MAY be chained:
+ *
+ *     int64_t id = 0;
+ *     if (!root.get("user").get("id").getInteger(&id)) return badrequest();
+ */
+class JsonValue {
+    JsonDocument* document;
+
+    /** Position of the value in the document's structural index. */
+    size_t index;
+
+    char getStart();
+    size_t skip(size_t index);
+
+    public:
+    /**
+     * Creates a missing value.
+     */
+    JsonValue();
+
+    JsonValue(JsonDocument* document, size_t index);
+
+    /**
+     * Gets the type of the value.
+     *
+     * @return Type, or JSON_MISSING for a missing value.
+     */
+    JsonType getType();
+
+    /**
+     * Checks whether the value is missing.
+     *
+     * @return True if the value does not exist.
+     */
+    bool isMissing();
+
+    /**
+     * Checks whether the value is null.
+     *
+     * @return True if the value is the literal null.
+     */
+    bool isNull();
+
+    /**
+     * Gets a member of an object.
+     *
+     * If the object has several members with the name, the first is
+     * returned.
+     *
+     * @param name Name of the member, compared after unescaping.
+     * @return The member's value, or a missing value if this is not an
+     *     object or has no such member.
+     */
+    JsonValue get(const char* name);
+
+    /**
+     * Gets an element of an array.
+     *
+     * Elements are found by skipping the ones before, so iterate with
+     * getFirst() and getNext() rather than calling this in a loop.
+     *
+     * @param position Zero-based position of the element.
+     * @return The element, or a missing value if this is not an array or is
+     *     too short.
+     */
+    JsonValue at(size_t position);
+
+    /**
+     * Gets the first element of an array or member value of an object.
+     *
+     * @return The first element or member value, or a missing value if this
+     *     is empty or not an array or object.
+     */
+    JsonValue getFirst();
+
+    /**
+     * Gets the element or member value after this one in its array or
+     * object.
+     *
+     * @return The next element or member value, or a missing value if this
+     *     is the last.
+     */
+    JsonValue getNext();
+
+    /**
+     * Gets the name of the member this is the value of.
+     *
+     * @param data Set to the name, which is NOT null-terminated.
+     * @param length Set to the number of bytes of the name.
+     * @return False if this is not a member value or the name is malformed.
+     */
+    bool getKey(const char** data, size_t* length);
+
+    /**
+     * Counts the elements of an array or members of an object.
+     *
+     * @return Number of elements or members, or 0 for other values.
+     */
+    size_t getSize();
+
+    /**
+     * Gets the value of a string.
+     *
+     * Strings without escapes point into the document's copy of the body;
+     * others are unescaped into a buffer owned by the document.
+     *
+     * @param data Set to the string, which is NOT null-terminated and MAY
+     *     contain null bytes.
+     * @param length Set to the number of bytes of the string.
+     * @return False if this is not a string or the string is malformed.
+     */
+    bool getString(const char** data, size_t* length);
+
+    /**
+     * Gets the value of an integer number.
+     *
+     * @param value Set to the number.
+     * @return False if this is not a number, has a fraction or exponent, or
+     *     does not fit.
+     */
+    bool getInteger(int64_t* value);
+
+    /**
+     * Gets the value of a number.
+     *
+     * @param value Set to the nearest double.
+     * @return False if this is not a number or is malformed.
+     */
+    bool getNumber(double* value);
+
+    /**
+     * Gets the value of true or false.
+     *
+     * @param value Set to the boolean.
+     * @return False if this is not a boolean.
+     */
+    bool getBool(bool* value);
+};
+
+/**
+ * JSON text indexed for on-demand reading, in the style of simdjson.
+ *
+ * Parsing copies the text and makes one pass over it, 64 bytes at a time,
+ * to find every structural character ({}[]:,) and the start of every value
+ * outside strings, using SSE2 on x86 and a scalar loop elsewhere or when
+ * built with CSR_NO_SIMD defined. A second pass over the index checks the
+ * grammar and records where each array and object ends, so values can be
+ * skipped without reading them. Numbers and strings are only converted when
+ * a JsonValue getter asks for them, and are checked then.
+ */
+class JsonDocument {
+    friend class JsonValue;
+
+    char* data;
+    size_t length;
+    size_t capacity;
+
+    /** Offsets of the structural characters and value starts. */
+    std::vector<uint32_t> structurals;
+
+    /** For each '{' or '[', the position of its closing structural. */
+    std::vector<uint32_t> ends;
+
+    /** Unescaped strings handed out by JsonValue::getString(). */
+    std::vector<char*> strings;
+
+    std::string error;
+
+    /** Whether every byte of the text is ASCII. */
+    bool isAsciiText;
+
+    void reserve(size_t length);
+    void index();
+    void validate();
+    void fail(const std::string& message);
+
+    public:
+    JsonDocument();
+
+    /**
+     * Parses a JSON text, replacing the previous one.
+     *
+     * @param json Text to copy and index.
+     * @param length Number of bytes of `json`.
+     * @throws std::invalid_argument The text is malformed or larger than
+     *     MAX_JSON_BODY_SIZE; the document is then empty.
+     */
+    void parse(const char* json, size_t length);
+
+    /**
+     * Parses the whole contents of a stream, e.g. a request body.
+     *
+     * The stream is rewound and read in chunks, so the text is not limited
+     * to MAX_STREAM_READ_SIZE.
+     *
+     * @param stream Stream to read.
+     * @throws std::invalid_argument The text is malformed or larger than
+     *     MAX_JSON_BODY_SIZE; the document is then empty.
+     * @throws std::runtime_error The stream cannot be read.
+     */
+    void parse(Stream* stream);
+
+    /**
+     * Empties the document, keeping its buffers.
+     */
+    void clear();
+
+    /**
+     * Gets the top-level value.
+     *
+     * @return The value, or a missing value if the document is empty.
+     */
+    JsonValue getRoot();
+
+    /**
+     * Gets why the last parse failed.
+     *
+     * @return The message, or NULL if it succeeded.
+     */
+    const char* getError();
+
+    /**
+     * Checks whether or not the text is valid UTF-8.
+     *
+     * Bytes that are not ASCII are found while indexing, so only a text
+     * with some is validated again.
+     *
+     * @return True if the text is valid UTF-8, false if not.
+     */
+    bool isUtf8();
+
+    /**
+     * Checks whether texts are indexed with SSE2.
+     *
+     * @return True if built with SSE2 and without CSR_NO_SIMD.
+     */
+    static bool isVectorized();
+
+    ~JsonDocument();
+};
+
+}}} // Csr::Http::Message
+#define CSR_HTTP_MESSAGE_JSONDOCUMENT
+#endif // CSR_HTTP_MESSAGE_JSONDOCUMENT
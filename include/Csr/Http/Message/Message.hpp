@@ -25,11 +25,20 @@ struct ValueNode {
 
 /**
  * Header value linked list.
+ *
+ * The comma-separated line is kept up to date as values are appended, so
+ * reading it never writes: a list that is no longer appended to MAY be read
+ * by several threads at once.
  */
 struct ValueList {
     ValueNode* head;
     ValueNode* tail;
-    char* line;
+
+    /** Comma-separated values: the only value, or `joined`. */
+    const char* line;
+
+    /** Values joined with commas, once there is more than one. */
+    char* joined;
 
     ValueList();
 
@@ -41,9 +50,10 @@ struct ValueList {
     void addValue(const char* value);
 
     /**
-     * Creates a comma-separated string of the list's values.
+     * Gets a comma-separated string of the list's values.
      *
-     * @return The comma-separated string of values.
+     * @return The comma-separated string of values, valid until a value is
+     *     appended.
      */
     const char* getLine();
 
@@ -158,6 +168,11 @@ struct HeaderList {
      */
     void removeHeader(const char* name);
 
+    /**
+     * Deletes every header, keeping the list for reuse.
+     */
+    void reset();
+
     ~HeaderList();
 };
 
@@ -338,7 +353,8 @@ class Message {
      *
      * @param name Case-insensitive header field name.
      * @param value Header value.
-     * @throws std::runtime_error Invalid header names or values.
+     * @throws std::runtime_error The name is not a token, or the value has a
+     *     CR or LF, which could inject other fields; see HeaderValidator.
      */
     void setHeader(const char* name, const char* value);
 
@@ -351,7 +367,8 @@ class Message {
      *
      * @param name Case-insensitive header field name to add.
      * @param value Header value.
-     * @throws std::runtime_error Invalid header names or values.
+     * @throws std::runtime_error The name is not a token, or the value has a
+     *     CR or LF, which could inject other fields; see HeaderValidator.
      */
     void setAddedHeader(const char* name, const char* value);
 
@@ -367,6 +384,9 @@ class Message {
     /**
      * Gets the body of the message.
      *
+     * The body is created on the first call, so messages that never use it
+     * cost no stream.
+     *
      * @return The body as a stream.
      */
     Stream* getBody();
@@ -381,6 +401,14 @@ class Message {
      */
     void setBody(Stream* body);
 
+    /**
+     * Clears the protocol version, headers and body, e.g. to reuse the
+     * message for the next request of a long-running process.
+     *
+     * The body stream is kept and emptied; see Stream::reset().
+     */
+    void reset();
+
     ~Message();
 };
 
@@ -138,6 +138,17 @@ class Request : public Message {
      */
     void setUri(Uri* uri, bool preserveHost = false);
 
+    /**
+     * Resets the request for reuse as if it were created anew, keeping its
+     * body stream; see Message::reset().
+     *
+     * @param method The HTTP method associated with the request.
+     * @param uri The URI string associated with the request.
+     * @throws std::invalid_argument Invalid HTTP method or URI; the request
+     *     is left unchanged.
+     */
+    void reset(const char* method, const char* uri);
+
     ~Request();
 };
 
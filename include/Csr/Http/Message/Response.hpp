@@ -74,6 +74,15 @@ class Response : public Message {
      */
     const char* getReasonPhrase();
 
+    /**
+     * Resets the response for reuse as if it were created anew, keeping its
+     * body stream; see Message::reset().
+     *
+     * @param code The HTTP status code. Defaults to 200.
+     * @param reasonPhrase The reason phrase to associate with the status code.
+     */
+    void reset(unsigned short code = 200, const char* reasonPhrase = "");
+
     ~Response();
 };
 
@@ -2,6 +2,8 @@
 
 #include "Request.hpp"
 #include "UploadedFile.hpp"
+#include "HttpParser.hpp"
+#include "JsonDocument.hpp"
 
 namespace Csr {
 namespace Http {
@@ -44,6 +46,11 @@ struct ServerParamList {
      */
     const char* getServerParam(const char* name);
 
+    /**
+     * Deletes every server param, keeping the list for reuse.
+     */
+    void reset();
+
     ~ServerParamList();
 };
 
@@ -55,6 +62,9 @@ struct CookieNode {
     char* value;
     CookieNode* next;
 
+    /** Whether or not the name and value are valid UTF-8. */
+    bool isUtf8;
+
     CookieNode(const char* name, const char* value);
     ~CookieNode();
 };
@@ -84,6 +94,20 @@ struct CookieList {
      */
     const char* getCookie(const char* name);
 
+    /**
+     * Checks whether or not a cookie is valid UTF-8.
+     *
+     * @param name Cookie to check.
+     * @return False if its name or value is not valid UTF-8, true if both
+     *     are or it cannot be found.
+     */
+    bool isUtf8(const char* name);
+
+    /**
+     * Deletes every cookie, keeping the list for reuse.
+     */
+    void reset();
+
     ~CookieList();
 };
 
@@ -95,6 +119,9 @@ struct QueryParamNode {
     char* value;
     QueryParamNode* next;
 
+    /** Whether or not the decoded name and value are valid UTF-8. */
+    bool isUtf8;
+
     QueryParamNode(const char* name, const char* value);
     ~QueryParamNode();
 };
@@ -124,6 +151,20 @@ struct QueryParamList {
      */
     const char* getQueryParam(const char* name);
 
+    /**
+     * Checks whether or not a query param is valid UTF-8.
+     *
+     * @param name Query param to check.
+     * @return False if its name or value is not valid UTF-8, true if both
+     *     are or it cannot be found.
+     */
+    bool isUtf8(const char* name);
+
+    /**
+     * Deletes every query param, keeping the list for reuse.
+     */
+    void reset();
+
     ~QueryParamList();
 };
 
@@ -164,6 +205,11 @@ struct UploadedFileList {
      */
     UploadedFile* getUploadedFile(const char* name);
 
+    /**
+     * Deletes every uploaded file, keeping the list for reuse.
+     */
+    void reset();
+
     ~UploadedFileList();
 };
 
@@ -175,6 +221,9 @@ struct BodyParamNode {
     char* value;
     BodyParamNode* next;
 
+    /** Whether or not the decoded name and value are valid UTF-8. */
+    bool isUtf8;
+
     /**
      * Stores a copy of body param name and value.
      *
@@ -214,6 +263,20 @@ struct BodyParamList {
      */
     const char* getBodyParam(const char* name);
 
+    /**
+     * Checks whether or not a body param is valid UTF-8.
+     *
+     * @param name Body param to check.
+     * @return False if its name or value is not valid UTF-8, true if both
+     *     are or it cannot be found.
+     */
+    bool isUtf8(const char* name);
+
+    /**
+     * Deletes every body param, keeping the list for reuse.
+     */
+    void reset();
+
     ~BodyParamList();
 };
 
@@ -263,6 +326,11 @@ struct AttributeList {
      */
     void removeAttribute(const char* name);
 
+    /**
+     * Deletes every attribute, keeping the list for reuse.
+     */
+    void reset();
+
     ~AttributeList();
 };
 
@@ -302,8 +370,16 @@ class ServerRequest : public Request {
     BodyParamList* bodyParams;
     AttributeList* attributes;
     bool isBodyParsed;
-
+    JsonDocument* jsonBody;
+    bool isJsonParsed;
+    bool isBodyUtf8Checked;
+    bool isBodyUtf8Valid;
+
+    void parseEnvironment();
+    void parseHead(const HttpRequestHead& head);
+    void parseParams();
     void parseBody();
+    void resetParams();
 
     public:
     /**
@@ -320,6 +396,46 @@ class ServerRequest : public Request {
      */
     ServerRequest(const char* method, const char* uri, char** serverParams);
 
+    /**
+     * Create a new server request from a parsed request head, e.g. one read
+     * from a socket, without a CGI environment.
+     *
+     * Headers, the URI, cookies and query params are built from the slices
+     * of the head directly. The server params REQUEST_METHOD, REQUEST_URI,
+     * QUERY_STRING, SERVER_PROTOCOL, CONTENT_TYPE and CONTENT_LENGTH are
+     * derived from the head; any other is looked up in `serverParams`.
+     *
+     * Slices are copied, so the parsed bytes MAY be freed after.
+     *
+     * @param head Parsed request head. See HttpParser::parseRequest().
+     * @param serverParams NULL-terminated NAME=VALUE server params the head
+     *     cannot provide, e.g. REMOTE_ADDR, or NULL.
+     * @throws std::invalid_argument Invalid method.
+     */
+    ServerRequest(const HttpRequestHead& head, char** serverParams = NULL);
+
+    /**
+     * Resets the request for reuse as if it were created anew by the
+     * matching constructor, keeping its lists and body stream, e.g. for a
+     * long-running process that handles one request after another.
+     *
+     * Headers, params, cookies, uploaded files and attributes of the previous
+     * request are deleted and the body is emptied; see Message::reset().
+     *
+     * @throws std::invalid_argument Invalid method or URI; the request is
+     *     left unchanged.
+     */
+    void reset(const char* method, const char* uri, char** serverParams);
+
+    /**
+     * Replaces this request with one from a parsed request head.
+     *
+     * @see reset(const char*, const char*, char**)
+     * @throws std::invalid_argument Invalid method or URI; the request is
+     *     left unchanged.
+     */
+    void reset(const HttpRequestHead& head, char** serverParams = NULL);
+
     /**
      * Retrieve server parameter.
      *
@@ -390,6 +506,87 @@ class ServerRequest : public Request {
      */
     const char* getBodyParam(const char* name);
 
+    /**
+     * Checks whether the request body is JSON.
+     *
+     * @return True if the media type of the Content-Type is application/json
+     *     or ends with +json, e.g. application/problem+json.
+     */
+    bool isJson();
+
+    /**
+     * Retrieve the JSON request body.
+     *
+     * The body is indexed on the first call, for any request method, and
+     * values are only read when asked for; see JsonDocument. The document is
+     * kept across reset() so its buffers are reused.
+     *
+     *     int64_t id = 0;
+     *     if (!request->getJsonBody().get("id").getInteger(&id)) {
+     *         // Respond with 400 Bad Request.
+     *     }
+     *
+     * @return The top-level value of the body, valid until the request is
+     *     reset or destroyed, or a missing value if the body is not JSON.
+     * @throws std::invalid_argument The body is malformed or larger than
+     *     MAX_JSON_BODY_SIZE; thrown again on every call.
+     */
+    JsonValue getJsonBody();
+
+    /**
+     * Checks whether or not a cookie is valid UTF-8.
+     *
+     * Cookies, query params and body params are checked as they are parsed,
+     * and only those with bytes that are not ASCII are validated again, so
+     * handlers MAY reject malformed text early at little cost.
+     *
+     * @param name The cookie name.
+     * @return False if the cookie's name or value is not valid UTF-8, true
+     *     if both are or it cannot be found.
+     */
+    bool isCookieParamUtf8(const char* name);
+
+    /**
+     * Checks whether or not a query param is valid UTF-8 once urldecoded.
+     *
+     * @see isCookieParamUtf8()
+     * @param name The query param name.
+     * @return False if the param's name or value is not valid UTF-8, true
+     *     if both are or it cannot be found.
+     */
+    bool isQueryParamUtf8(const char* name);
+
+    /**
+     * Checks whether or not a body param is valid UTF-8 once urldecoded.
+     *
+     * @see isCookieParamUtf8()
+     * @param name The body param name.
+     * @return False if the param's name or value is not valid UTF-8, true
+     *     if both are or it cannot be found.
+     */
+    bool isBodyParamUtf8(const char* name);
+
+    /**
+     * Checks whether or not the whole request body is valid UTF-8.
+     *
+     * The body is validated once, in chunks, so it is not limited to
+     * MAX_STREAM_READ_SIZE. A JSON body that getJsonBody() indexed as
+     * ASCII is not read again.
+     *
+     * @return True if the body is valid UTF-8 or empty, false if not.
+     */
+    bool isBodyUtf8();
+
+    /**
+     * Checks whether or not every cookie, query param and body param is
+     * valid UTF-8, and the body too if it is JSON or any text type.
+     *
+     * Uploaded files are not checked.
+     *
+     * @return True if every field is valid UTF-8, false if not.
+     */
+    bool isUtf8();
+
     /**
      * Retrieve a single derived request attribute.
      *
@@ -12,12 +12,34 @@ namespace Message {
  * Typically, an instance will wrap a FILE*; this interface provides
  * a wrapper around the most common operations, including serialization of
  * the entire stream to a string.
+ *
+ * Strings returned by read(size_t), toString() and getContents() are owned
+ * by the stream. Reading on never overwrites or frees a string handed out
+ * before, but moving the position with seek(), rewind() or toString() frees
+ * them, as does reset() or destroying the stream, so memory is bounded by
+ * what a single pass over the stream reads. A stream MUST NOT be used by
+ * several threads at once, but strings read from it MAY be.
  */
 class Stream {
     FILE* resource;
+
+    /** Last string read, linked to the ones read since the last seek. */
     char* readBuffer;
     bool writable;
     bool readable;
+    bool isDeferred;
+
+    /** The resource is the temporary file created by create(). */
+    bool isTemporary;
+
+    void create();
+
+    /**
+     * Sets the position indicator without freeing strings read before.
+     *
+     * @throws std::runtime_error Unexpected error.
+     */
+    void position(long offset, int whence);
 
     public:
 
@@ -26,7 +48,12 @@ class Stream {
      *
      * The stream SHOULD be created with a temporary resource.
      *
-     * @throws std::runtime_error The temporary resource could not be created.
+     * The temporary resource is only created on the first write() or
+     * detach(), so unused bodies cost no file. Until then, the stream
+     * behaves as an empty, seekable stream.
+     *
+     * @throws std::runtime_error The temporary resource could not be created
+     *     (from write() or detach()).
      */
     Stream();
 
@@ -60,7 +87,9 @@ class Stream {
      * This method MUST attempt to seek to the beginning of the stream before
      * reading data and read the stream until the end is reached.
      *
-     * Warning: This could attempt to load a large amount of data into memory.
+     * Warning: This could attempt to load a large amount of data into memory,
+     * which is kept until the position is moved again or the stream is
+     * destroyed. Strings read before are freed.
      *
      * This method MUST NOT raise an exception.
      *
@@ -121,6 +150,7 @@ class Stream {
      *     origin values for `fseek()`. SEEK_SET: Set position equal to offset
      *     bytes. SEEK_CUR: Set position to current location plus offset.
      *     SEEK_END: Set position to end-of-stream plus offset.
+     * Strings read before are freed.
      * @throws std::runtime_error Unexpected error.
      */
     void seek(long offset, int whence = SEEK_SET);
@@ -128,6 +158,8 @@ class Stream {
     /**
      * Moves position indicator to the beginning of the stream.
      *
+     * Strings read before are freed.
+     *
      * @see https://en.cppreference.com/w/c/io/rewind
      */
     void rewind();
@@ -148,6 +180,19 @@ class Stream {
      */
     size_t write(const char* string);
 
+    /**
+     * Write a fixed number of bytes to the stream.
+     *
+     * Unlike write(const char*), the data MAY contain null bytes, so this
+     * method is safe to use for binary content.
+     *
+     * @param data The bytes that are to be written.
+     * @param length Number of bytes to write from `data`.
+     * @return The number of bytes written to the stream.
+     * @throws std::runtime_error Unexpected error.
+     */
+    size_t write(const char* data, size_t length);
+
     /**
      * Checks whether or not the stream is readable.
      *
@@ -161,12 +206,41 @@ class Stream {
      * @param length Read up to `length` bytes from the object and return
      *     them. Fewer than `length` bytes may be returned if underlying stream
      *     call returns fewer bytes.
+     * Each call allocates a new string that stays valid until the second
+     * read after it, the position is moved or the stream is destroyed; use
+     * read(char*, size_t) to read large streams in chunks.
+     *
      * @return The data read from the stream, or an empty string if no bytes
      *     are available.
      * @throws std::runtime_error Unexpected error.
      */
     const char* read(size_t length);
 
+    /**
+     * Read data from the stream into a caller-provided buffer.
+     *
+     * Unlike read(size_t), no null-terminator is appended and the number of
+     * bytes read is returned, so this method is safe to use for binary
+     * content.
+     *
+     * @param buffer Buffer to read into; MUST hold at least `length` bytes.
+     * @param length Read up to `length` bytes from the stream.
+     * @return The number of bytes read, or 0 if no bytes are available.
+     * @throws std::runtime_error Unexpected error.
+     */
+    size_t read(char* buffer, size_t length);
+
+    /**
+     * Empties the stream for reuse, e.g. by the next request of a
+     * long-running process.
+     *
+     * A default stream keeps its temporary resource, truncated, so it is not
+     * created again. A stream over a file or resource given to it is closed
+     * and becomes an empty default stream. Strings read before are freed.
+     * Closed and detached streams become empty default streams as well.
+     */
+    void reset();
+
     /**
      * Returns the remaining contents from the current position.
      *
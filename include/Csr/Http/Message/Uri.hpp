@@ -19,6 +19,11 @@ namespace Message {
  * For server-side requests, the scheme will typically be discoverable in the
  * server parameters.
  *
+ * The authority and string forms are rebuilt whenever a component is set,
+ * so every getter only reads: a Uri that is no longer modified MAY be read
+ * by several threads at once, and returned strings stay valid until the
+ * next setter call.
+ *
  * @see http://tools.ietf.org/html/rfc3986 (the URI specification)
  */
 class Uri {
@@ -32,6 +37,8 @@ class Uri {
     char* fragment;
     char* string;
 
+    void update();
+
     public:
     /**
      * Create a new URI.
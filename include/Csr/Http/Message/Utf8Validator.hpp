@@ -0,0 +1,51 @@
+#ifndef CSR_HTTP_MESSAGE_UTF8VALIDATOR
+
+#include <stddef.h>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+/**
+ * Validates UTF-8 per RFC 3629.
+ *
+ * Runs of ASCII are skipped 16 bytes at a time with SSE2 on x86, unless
+ * built with CSR_NO_SIMD defined, and multi-byte sequences are checked one
+ * at a time, rejecting overlong forms, surrogates and code points above
+ * U+10FFFF. Text that is mostly ASCII, such as params and JSON, is thus
+ * validated at close to the speed of memchr().
+ *
+ * Data MAY be validated in chunks, e.g. while reading a stream, by carrying
+ * a sequence cut off at the end of one chunk over to the next:
+ *
+ *     size_t truncated = 0;
+ *     if (!Utf8Validator::isValid(chunk, length, &truncated)) {
+ *         // Answer "400 Bad Request".
+ *     }
+ *     memmove(chunk, chunk + length - truncated, truncated);
+ */
+class Utf8Validator {
+    public:
+    /**
+     * Checks whether or not ASCII is skipped with SSE2.
+     *
+     * @return True if built with SSE2 and without CSR_NO_SIMD, false if not.
+     */
+    static bool isVectorized();
+
+    /**
+     * Checks whether or not data is valid UTF-8.
+     *
+     * @param data Bytes to check, which MAY contain null bytes.
+     * @param length Number of bytes of `data`.
+     * @param truncated If not NULL, a sequence cut off by the end of the
+     *     data is allowed, and this is set to its number of bytes, or 0.
+     * @return True if the data is valid, false if not.
+     */
+    static bool isValid(const char* data, size_t length,
+                        size_t* truncated = NULL);
+};
+
+}}} // Csr::Http::Message
+#define CSR_HTTP_MESSAGE_UTF8VALIDATOR
+#endif // CSR_HTTP_MESSAGE_UTF8VALIDATOR
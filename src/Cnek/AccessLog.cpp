@@ -0,0 +1,403 @@
+#include "AccessLog.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif // _WIN32
+
+// Default number of records the ring buffer of an access log holds.
+#ifndef ACCESS_LOG_CAPACITY
+#define ACCESS_LOG_CAPACITY 4096 // Default 4096 records.
+#endif // ACCESS_LOG_CAPACITY
+
+// Max number of bytes of the request-target kept per record.
+#ifndef ACCESS_LOG_TARGET_SIZE
+#define ACCESS_LOG_TARGET_SIZE 256 // Default 256B.
+#endif // ACCESS_LOG_TARGET_SIZE
+
+// Number of bytes of access log lines written at once.
+#ifndef ACCESS_LOG_BATCH_SIZE
+#define ACCESS_LOG_BATCH_SIZE 65536 // Default 64KB.
+#endif // ACCESS_LOG_BATCH_SIZE
+
+// Milliseconds between flushes of the access log's background thread.
+#ifndef ACCESS_LOG_FLUSH_INTERVAL
+#define ACCESS_LOG_FLUSH_INTERVAL 100 // Default 100 milliseconds.
+#endif // ACCESS_LOG_FLUSH_INTERVAL
+
+namespace Cnek {
+
+using std::runtime_error;
+using std::strerror;
+using std::string;
+
+/**
+ * Slot of the ring buffer of an access log.
+ *
+ * A slot is free for the record at position `sequence`, and holds a written
+ * record at position `sequence - 1`, so producers claim slots with a
+ * compare-and-swap on the head and publish them without a lock.
+ */
+struct AccessRecord {
+    volatile size_t sequence;
+    time_t time;
+    char method[8];
+    char target[ACCESS_LOG_TARGET_SIZE];
+    int statusCode;
+    uint64_t bytes;
+    double milliseconds;
+};
+
+namespace {
+
+/**
+ * Full memory barrier, so a record is written before it is published.
+ */
+inline void barrier() {
+#ifndef _WIN32
+    __sync_synchronize();
+#endif // _WIN32
+}
+
+/**
+ * Atomically replaces a value if it still holds the expected value.
+ *
+ * @return True if the value was replaced.
+ */
+inline bool compareandswap(
+    volatile size_t* value,
+    size_t expected,
+    size_t desired)
+{
+#ifndef _WIN32
+    return __sync_bool_compare_and_swap(value, expected, desired);
+#else
+    if (*value != expected) return false;
+    *value = desired;
+    return true;
+#endif // _WIN32
+}
+
+/**
+ * Atomically adds to a counter.
+ */
+inline void add(volatile unsigned long* counter, unsigned long value) {
+#ifndef _WIN32
+    __sync_fetch_and_add(counter, value);
+#else
+    *counter += value;
+#endif // _WIN32
+}
+
+/**
+ * Copies a string, truncated to fit a buffer.
+ */
+inline void copytruncated(char* buffer, size_t size, const char* value) {
+    size_t length = value ? strlen(value) : 0;
+    if (length >= size) length = size - 1;
+    memcpy(buffer, value, length);
+    buffer[length] = '\0';
+}
+
+/**
+ * Appends a request-target, percent-encoding control characters and spaces
+ * so it stays one field of one line.
+ */
+inline void appendtarget(string& line, const char* target) {
+    const char* hex = "0123456789ABCDEF";
+    for (const unsigned char* c = (const unsigned char*)target; *c; c++) {
+        if (*c > ' ' && *c != 0x7f) {
+            line += (char)*c;
+            continue;
+        }
+        line += '%';
+        line += hex[*c >> 4];
+        line += hex[*c & 0x0f];
+    }
+}
+
+/**
+ * Appends a record as one line.
+ */
+inline void appendrecord(string& batch, const AccessRecord& record) {
+    char time[32];
+    struct tm utc;
+#ifndef _WIN32
+    gmtime_r(&record.time, &utc);
+#else
+    gmtime_s(&utc, &record.time);
+#endif // _WIN32
+    strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%SZ", &utc);
+
+    char fields[96];
+    snprintf(fields,
+             sizeof(fields),
+             " %d %llu %.3f\n",
+             record.statusCode,
+             (unsigned long long)record.bytes,
+             record.milliseconds);
+
+    batch += time;
+    batch += ' ';
+    batch += *record.method ? record.method : "-";
+    batch += ' ';
+    if (*record.target) appendtarget(batch, record.target);
+    else batch += '-';
+    batch += fields;
+}
+
+} // namespace
+
+AccessLog::AccessLog(const char* path, size_t capacity)
+    : file(-1),
+      stream(NULL),
+      records(NULL),
+      capacity(1),
+      head(0),
+      tail(0),
+      dropped(0),
+      isFlushing(0),
+      isStarted(false),
+      isStopping(false)
+{
+    errno = 0;
+#ifndef _WIN32
+    this->file = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    bool isOpen = this->file >= 0;
+#else
+    this->stream = fopen(path, "ab");
+    bool isOpen = this->stream != NULL;
+#endif // _WIN32
+
+    if (!isOpen) {
+        string error = strerror(errno);
+        string message = "Failed to open access log '" + string(path)
+            + "': " + error + ".";
+        throw runtime_error(message);
+    }
+
+    // Positions are masked into the ring, so its size is a power of two.
+    if (!capacity) capacity = ACCESS_LOG_CAPACITY;
+    while (this->capacity < capacity) this->capacity <<= 1;
+    this->records = new AccessRecord[this->capacity];
+    for (size_t i = 0; i < this->capacity; i++) {
+        this->records[i].sequence = i;
+    }
+
+#ifndef _WIN32
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->stopping, NULL);
+#endif // _WIN32
+}
+
+double AccessLog::getTime() {
+#ifndef _WIN32
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#else
+    return clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif // _WIN32
+}
+
+bool AccessLog::log(
+    const char* method,
+    const char* target,
+    int statusCode,
+    uint64_t bytes,
+    double milliseconds)
+{
+    // Claim the slot at the head, unless the writer has yet to free it.
+    AccessRecord* record = NULL;
+    size_t position = this->head;
+    while (true) {
+        record = &this->records[position & (this->capacity - 1)];
+        intptr_t difference = (intptr_t)(record->sequence - position);
+        barrier();
+
+        if (!difference) {
+            if (compareandswap(&this->head, position, position + 1)) break;
+        } else if (difference < 0) {
+            add(&this->dropped, 1);
+            return false;
+        }
+        position = this->head;
+    }
+
+    record->time = time(NULL);
+    copytruncated(record->method, sizeof(record->method), method);
+    copytruncated(record->target, sizeof(record->target), target);
+    record->statusCode = statusCode;
+    record->bytes = bytes;
+    record->milliseconds = milliseconds;
+
+    // Publish the record to the writer.
+    barrier();
+    record->sequence = position + 1;
+    return true;
+}
+
+size_t AccessLog::flush() {
+#ifndef _WIN32
+    if (__sync_lock_test_and_set(&this->isFlushing, 1)) return 0;
+#endif // _WIN32
+
+    string batch;
+    batch.reserve(ACCESS_LOG_BATCH_SIZE);
+    size_t batchCount = 0;
+    size_t count = 0;
+    bool isWritten = true;
+    int error = 0;
+
+    while (true) {
+        AccessRecord* record =
+            &this->records[this->tail & (this->capacity - 1)];
+        bool isReady = record->sequence == this->tail + 1;
+        barrier();
+
+        // Write the batch once full, or once every record is taken.
+        if (!isReady || batch.size() >= ACCESS_LOG_BATCH_SIZE) {
+            if (!batch.empty() && isWritten) {
+                isWritten = this->writeBatch(batch.data(), batch.size());
+                if (!isWritten) error = errno;
+            }
+            if (!isWritten) add(&this->dropped, batchCount);
+            else count += batchCount;
+            batch.clear();
+            batchCount = 0;
+        }
+        if (!isReady) break;
+
+        appendrecord(batch, *record);
+        batchCount++;
+
+        // Free the slot for the record one lap later.
+        barrier();
+        record->sequence = this->tail + this->capacity;
+        this->tail++;
+    }
+
+#ifndef _WIN32
+    __sync_lock_release(&this->isFlushing);
+#endif // _WIN32
+
+    if (!isWritten) {
+        string message =
+            "Failed to write access log: " + string(strerror(error)) + ".";
+        throw runtime_error(message);
+    }
+    return count;
+}
+
+bool AccessLog::writeBatch(const char* data, size_t length) {
+    errno = 0;
+#ifndef _WIN32
+    while (length) {
+        ssize_t bytesWritten = write(this->file, data, length);
+        if (bytesWritten < 0 && errno == EINTR) continue;
+        if (bytesWritten <= 0) break;
+        data += bytesWritten;
+        length -= bytesWritten;
+    }
+    return !length;
+#else
+    return fwrite(data, 1, length, this->stream) == length
+        && !fflush(this->stream);
+#endif // _WIN32
+}
+
+void AccessLog::start() {
+#ifndef _WIN32
+    if (this->isStarted) return;
+
+    this->isStopping = false;
+    int error = pthread_create(&this->thread, NULL, AccessLog::run, this);
+    if (error) {
+        string message =
+            "Failed to start access log thread: " + string(strerror(error))
+            + ".";
+        throw runtime_error(message);
+    }
+    this->isStarted = true;
+#else
+    throw runtime_error("Access log threads are not supported on Windows.");
+#endif // _WIN32
+}
+
+void* AccessLog::run(void* accessLog) {
+#ifndef _WIN32
+    AccessLog* self = (AccessLog*)accessLog;
+
+    pthread_mutex_lock(&self->mutex);
+    while (true) {
+        bool isStopping = self->isStopping;
+        pthread_mutex_unlock(&self->mutex);
+
+        try {
+            self->flush();
+        } catch (runtime_error&) {}
+        if (isStopping) break;
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        long nanoseconds =
+            now.tv_usec * 1000L + ACCESS_LOG_FLUSH_INTERVAL % 1000 * 1000000L;
+        struct timespec deadline;
+        deadline.tv_sec = now.tv_sec + ACCESS_LOG_FLUSH_INTERVAL / 1000
+            + nanoseconds / 1000000000L;
+        deadline.tv_nsec = nanoseconds % 1000000000L;
+
+        pthread_mutex_lock(&self->mutex);
+        if (!self->isStopping) {
+            pthread_cond_timedwait(&self->stopping, &self->mutex, &deadline);
+        }
+    }
+#else
+    (void)accessLog;
+#endif // _WIN32
+    return NULL;
+}
+
+void AccessLog::stop() {
+#ifndef _WIN32
+    if (!this->isStarted) return;
+
+    pthread_mutex_lock(&this->mutex);
+    this->isStopping = true;
+    pthread_cond_signal(&this->stopping);
+    pthread_mutex_unlock(&this->mutex);
+
+    pthread_join(this->thread, NULL);
+    this->isStarted = false;
+#endif // _WIN32
+}
+
+unsigned long AccessLog::getDropped() {
+    return this->dropped;
+}
+
+AccessLog::~AccessLog() {
+    this->stop();
+    try {
+        this->flush();
+    } catch (runtime_error&) {}
+
+#ifndef _WIN32
+    pthread_mutex_destroy(&this->mutex);
+    pthread_cond_destroy(&this->stopping);
+    if (this->file >= 0) close(this->file);
+#endif // _WIN32
+    if (this->stream) fclose(this->stream);
+    delete[] this->records;
+}
+
+} // Cnek
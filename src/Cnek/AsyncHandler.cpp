@@ -0,0 +1,45 @@
+#include "AsyncHandler.hpp"
+
+namespace Cnek {
+
+AsyncHandler::AsyncHandler()
+    : wait(ASYNC_NONE),
+      fd(-1),
+      buffer(NULL),
+      length(0),
+      offset(0),
+      milliseconds(0),
+      result(0),
+      resumePoint(0)
+{}
+
+void AsyncHandler::delay(long milliseconds) {
+    this->wait = ASYNC_DELAY;
+    this->milliseconds = milliseconds < 0 ? 0 : milliseconds;
+}
+
+void AsyncHandler::readFile(int fd, char* buffer, size_t length, off_t offset) {
+    this->wait = ASYNC_READ;
+    this->fd = fd;
+    this->buffer = buffer;
+    this->length = length;
+    this->offset = offset;
+}
+
+void AsyncHandler::waitReadable(int fd) {
+    this->wait = ASYNC_READABLE;
+    this->fd = fd;
+}
+
+void AsyncHandler::waitWritable(int fd) {
+    this->wait = ASYNC_WRITABLE;
+    this->fd = fd;
+}
+
+long AsyncHandler::getResult() {
+    return this->result;
+}
+
+AsyncHandler::~AsyncHandler() {}
+
+} // Cnek
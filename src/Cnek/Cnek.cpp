@@ -1,11 +1,23 @@
 #include "Cnek.hpp"
 #include "Message.hpp"
+#include "HeaderValidator.hpp"
+#include "AllocStats.hpp"
+#include "Hash.hpp"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
 #include <stdexcept>
 #include <cstring>
 #include <string>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
 // Size of buffer used to read the request body.
 // NOTE: Saves on memory.
 #ifndef REQUEST_BODY_BUFFER_SIZE
@@ -18,28 +30,603 @@
 #define MAX_REQUEST_BODY_SIZE 4194304 // Default 4MB.
 #endif // MAX_REQUEST_BODY_SIZE
 
+// Size of buffer used to write the response body.
+// NOTE: Saves on memory.
+#ifndef RESPONSE_BODY_BUFFER_SIZE
+#define RESPONSE_BODY_BUFFER_SIZE 4096 // Default 4KB.
+#endif // RESPONSE_BODY_BUFFER_SIZE
+
+// Max number of byte ranges to serve for one request.
+// NOTE: Prevents DoS attacks; requests for more ranges get the whole body.
+#ifndef MAX_RESPONSE_RANGES
+#define MAX_RESPONSE_RANGES 16 // Default 16 ranges.
+#endif // MAX_RESPONSE_RANGES
+
+// Max number of bytes of the Server-Timing header.
+#ifndef SERVER_TIMING_HEADER_SIZE
+#define SERVER_TIMING_HEADER_SIZE 512 // Default 512B.
+#endif // SERVER_TIMING_HEADER_SIZE
+
 namespace Cnek {
 
 using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::HttpRequestHead;
 using Csr::Http::Message::Response;
 using Csr::Http::Message::Stream;
 using Csr::Http::Message::HeaderIterator;
+using Csr::Http::Message::HeaderValidator;
 using Csr::Http::Message::ValueIterator;
+using Csr::Http::Message::AllocStats;
+using Csr::Http::Message::AllocCounters;
 
 using std::runtime_error;
 using std::invalid_argument;
 using std::strerror;
 using std::string;
 
-Cnek::Cnek() : serverRequest(NULL) {}
+namespace {
+
+/**
+ * Checks if an ETag matches any entity-tag of an If-None-Match header.
+ *
+ * Uses the weak comparison, so "W/" prefixes are ignored.
+ *
+ * @see https://www.rfc-editor.org/rfc/rfc9110#section-13.1.2
+ * @param ifNoneMatch Value of the If-None-Match header.
+ * @param etag ETag of the response.
+ * @return True if the ETag matches.
+ */
+inline bool etagmatches(const char* ifNoneMatch, const char* etag) {
+    if (!strncmp(etag, "W/", 2)) etag += 2;
+    size_t etagLen = strlen(etag);
+
+    const char* p = ifNoneMatch;
+    while (*p) {
+        while (*p == ',' || *p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        const char* start = p;
+        while (*p && *p != ',' && *p != ' ' && *p != '\t') p++;
+        size_t length = p - start;
+
+        if (length == 1 && *start == '*') return true;
+
+        if (length > 2 && !strncmp(start, "W/", 2)) {
+            start += 2;
+            length -= 2;
+        }
+
+        if (length == etagLen && !strncmp(start, etag, length)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * Sets a strong ETag from the hash of a response's body.
+ *
+ * @param response Response to set the ETag of.
+ * @return True if the ETag was set, false if the body cannot be reread.
+ */
+inline bool setetag(Response* response) {
+    Stream* body = response->getBody();
+    if (!body->isSeekable()) return false;
+
+    body->rewind();
+
+    char buffer[RESPONSE_BODY_BUFFER_SIZE];
+    size_t bytesRead = 0;
+    Hash hash;
+    while ((bytesRead = body->read(buffer, sizeof(buffer))) > 0) {
+        hash.update(buffer, bytesRead);
+    }
+
+    uint64_t digest = hash.digest();
+    char etag[20]; // Quotes, 16 hex digits and '\0'.
+    snprintf(etag,
+             sizeof(etag),
+             "\"%08lx%08lx\"",
+             (unsigned long)(digest >> 32),
+             (unsigned long)(digest & 0xffffffffUL));
+    response->setHeader("ETag", etag);
+    return true;
+}
+
+/**
+ * Case-insensitive comparison of the first `len` bytes of two strings.
+ */
+inline bool strnieq(const char* a, const char* b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Looks up a Cache-Control directive.
+ *
+ * @param cacheControl Value of the Cache-Control header.
+ * @param name Case-insensitive directive name.
+ * @return Value of the directive, 0 if it has no value, or -1 if it is not
+ *     present.
+ */
+inline long directive(const char* cacheControl, const char* name) {
+    size_t nameLen = strlen(name);
+    const char* p = cacheControl;
+    while (*p) {
+        while (*p == ',' || *p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        const char* start = p;
+        while (*p && *p != ',' && *p != '=' && *p != ' ') p++;
+
+        bool isMatch = (size_t)(p - start) == nameLen
+            && strnieq(start, name, nameLen);
+
+        long value = 0;
+        if (*p == '=') {
+            p++;
+            if (*p == '"') p++;
+            value = strtol(p, NULL, 10);
+        }
+        while (*p && *p != ',') p++;
+
+        if (isMatch) return value;
+    }
+
+    return -1;
+}
+
+/**
+ * Gets how long a response may be stored in a shared cache for.
+ *
+ * @see https://www.rfc-editor.org/rfc/rfc9111#section-3
+ * @param request Request the response answers.
+ * @param response Response to check.
+ * @param cache Cache to store the response in, which gives the lifetime
+ *     if Cache-Control does not and the headers keys vary on.
+ * @param ttl Set to the number of seconds the response is fresh for.
+ * @param stale Set to the number of seconds it MAY be served stale for.
+ * @return True if the response may be cached.
+ */
+inline bool cachelifetime(
+    ServerRequest* request,
+    Response* response,
+    ResponseCache* cache,
+    long* ttl,
+    long* stale)
+{
+    // Never share responses that set cookies.
+    if (response->getStatusCode() != 200 || response->hasHeader("Set-Cookie")) {
+        return false;
+    }
+
+    const char* cacheControl = response->getHeaderLine("Cache-Control");
+    if (directive(cacheControl, "no-store") >= 0
+        || directive(cacheControl, "no-cache") >= 0
+        || directive(cacheControl, "private") >= 0)
+    {
+        return false;
+    }
+
+    // Responses to authenticated requests are only shared if they say so.
+    if (request->hasHeader("Authorization")
+        && directive(cacheControl, "public") < 0
+        && directive(cacheControl, "s-maxage") < 0
+        && directive(cacheControl, "must-revalidate") < 0)
+    {
+        return false;
+    }
+
+    // Responses that vary on headers outside the key would be served to
+    // requests they do not match.
+    if (!cache->isVaryKeyed(response->getHeaderLine("Vary"))) return false;
+
+    *ttl = directive(cacheControl, "s-maxage");
+    if (*ttl < 0) *ttl = directive(cacheControl, "max-age");
+    if (*ttl < 0) *ttl = cache->getDefaultTtl();
+
+    *stale = directive(cacheControl, "stale-while-revalidate");
+    if (*stale < 0) *stale = cache->getDefaultStale();
+
+    return *ttl > 0;
+}
+
+/**
+ * Byte range of a body; both ends are inclusive.
+ */
+struct ByteRange {
+    long first;
+    long last;
+};
+
+/**
+ * Parses a non-negative decimal number.
+ *
+ * @param p Start of the digits; set to the first byte after them.
+ * @return Parsed number, or -1 if there are no digits or it overflows.
+ */
+inline long parsepos(const char** p) {
+    if (!isdigit((unsigned char)**p)) return -1;
+
+    errno = 0;
+    char* end = NULL;
+    long value = strtol(*p, &end, 10);
+    *p = end;
+    return errno ? -1 : value;
+}
+
+/**
+ * Parses the byte ranges of a Range header that are satisfiable for a body.
+ *
+ * @see https://www.rfc-editor.org/rfc/rfc9110#section-14.1.2
+ * @param range Value of the Range header.
+ * @param size Size of the body in bytes.
+ * @param ranges Set to the satisfiable ranges, clamped to the body.
+ * @param max Max number of ranges to accept.
+ * @return Number of satisfiable ranges, 0 if none are, or -1 if the header
+ *     is invalid or asks for more than `max` ranges and MUST be ignored.
+ */
+inline int parseranges(
+    const char* range,
+    long size,
+    ByteRange* ranges,
+    int max)
+{
+    if (!strnieq(range, "bytes=", 6)) return -1;
+
+    const char* p = range + 6;
+    int specs = 0;
+    int count = 0;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+
+        long first = -1;
+        long last = size - 1;
+        if (*p == '-') {
+            // Suffix range of the last N bytes.
+            p++;
+            long suffix = parsepos(&p);
+            if (suffix < 0) return -1;
+            first = suffix < size ? size - suffix : 0;
+            if (!suffix) first = size;
+        } else {
+            first = parsepos(&p);
+            if (first < 0 || *p++ != '-') return -1;
+            if (isdigit((unsigned char)*p)) {
+                last = parsepos(&p);
+                if (last < first) return -1;
+                if (last >= size) last = size - 1;
+            }
+        }
+
+        if (++specs > max) return -1;
+
+        // Ranges starting past the end are unsatisfiable, but others MAY be.
+        if (first < size) {
+            ranges[count].first = first;
+            ranges[count].last = last;
+            count++;
+        }
+
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p && *p++ != ',') return -1;
+    }
+
+    return specs ? count : -1;
+}
+
+/**
+ * Checks if a response is the representation an If-Range header was
+ * validated against.
+ *
+ * Entity-tags are compared strongly and dates MUST match Last-Modified
+ * exactly.
+ *
+ * @see https://www.rfc-editor.org/rfc/rfc9110#section-13.1.5
+ * @param ifRange Value of the If-Range header.
+ * @param response Response to check.
+ * @return True if a Range header MAY be applied to the response.
+ */
+inline bool ifrangematches(const char* ifRange, Response* response) {
+    if (!*ifRange) return true;
+
+    if (*ifRange == '"') {
+        return !strcmp(ifRange, response->getHeaderLine("ETag"));
+    }
+
+    // Weak entity-tags never match.
+    if (!strncmp(ifRange, "W/", 2)) return false;
+
+    const char* lastModified = response->getHeaderLine("Last-Modified");
+    return *lastModified && !strcmp(ifRange, lastModified);
+}
+
+/**
+ * Appends a header value or reason phrase to a head, without the bytes
+ * that could end it early: CR, LF and NUL.
+ */
+inline void appendfield(string& head, const char* value) {
+    size_t start = head.size();
+    head += value;
+    if (head.size() > start) {
+        size_t length = head.size() - start;
+        head.resize(start + HeaderValidator::strip(&head[start], length));
+    }
+}
+
+/**
+ * Creates the headers of one part of a multipart/byteranges body.
+ *
+ * @param boundary Boundary between parts.
+ * @param contentType Content-Type of the whole body, or an empty string.
+ * @param range Byte range of the part.
+ * @param size Size of the whole body in bytes.
+ * @return Delimiter and headers of the part.
+ */
+inline string parthead(
+    const char* boundary,
+    const char* contentType,
+    const ByteRange& range,
+    long size)
+{
+    char contentRange[80];
+    snprintf(contentRange,
+             sizeof(contentRange),
+             "Content-Range: bytes %ld-%ld/%ld\r\n",
+             range.first,
+             range.last,
+             size);
+
+    string head = "\r\n--";
+    head += boundary;
+    head += "\r\n";
+    if (*contentType) {
+        head += "Content-Type: ";
+        head += contentType;
+        head += "\r\n";
+    }
+    head += contentRange;
+    head += "\r\n";
+    return head;
+}
+
+/**
+ * Writes a byte range of a body, reading only that range.
+ *
+ * @param body Seekable body to read from.
+ * @param range Byte range to write.
+ * @param output Stream to write to.
+ * @return Number of bytes written.
+ * @throws std::runtime_error Failed to write outputs.
+ */
+inline size_t emitrange(Stream* body, const ByteRange& range, FILE* output) {
+    body->seek(range.first);
+
+    char buffer[RESPONSE_BODY_BUFFER_SIZE];
+    size_t remaining = range.last - range.first + 1;
+    size_t bytesRead = 0;
+    size_t totalBytes = 0;
+    errno = 0;
+
+    while (remaining > 0) {
+        size_t length = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        if (!(bytesRead = body->read(buffer, length))) break;
+        remaining -= bytesRead;
+
+        size_t bytesWritten = fwrite(buffer, 1, bytesRead, output);
+        if (bytesWritten < bytesRead || ferror(output)) {
+            string error = strerror(errno);
+            string message =
+                "Failed to emit response while writing: " + error + ".";
+            throw runtime_error(message);
+        }
+        totalBytes += bytesWritten;
+    }
+    return totalBytes;
+}
+
+/**
+ * Gets the standard reason phrase of a status code.
+ *
+ * @return Reason phrase, or "" for unknown codes.
+ */
+const char* reasonphrase(int code) {
+    switch (code) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 203: return "Non-Authoritative Information";
+        case 204: return "No Content";
+        case 205: return "Reset Content";
+        case 206: return "Partial Content";
+        case 300: return "Multiple Choices";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 406: return "Not Acceptable";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 410: return "Gone";
+        case 411: return "Length Required";
+        case 412: return "Precondition Failed";
+        case 413: return "Content Too Large";
+        case 414: return "URI Too Long";
+        case 415: return "Unsupported Media Type";
+        case 416: return "Range Not Satisfiable";
+        case 417: return "Expectation Failed";
+        case 422: return "Unprocessable Content";
+        case 426: return "Upgrade Required";
+        case 428: return "Precondition Required";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        case 505: return "HTTP Version Not Supported";
+        default: return "";
+    }
+}
+
+/**
+ * Gets the length of the head of a serialized response, including the empty
+ * line that ends it.
+ *
+ * @return Length of the head, or `length` if it does not end.
+ */
+inline size_t headlength(const char* data, size_t length) {
+    for (size_t i = 0; i + 4 <= length; i++) {
+        if (!memcmp(data + i, "\r\n\r\n", 4)) return i + 4;
+    }
+    return length;
+}
+
+/**
+ * Checks whether or not a line of a serialized head is a field.
+ *
+ * @param head Serialized head.
+ * @param start Offset of the line.
+ * @param end Offset of the CRLF ending the line.
+ * @param name Case-insensitive field name.
+ * @return True if the line is a field named `name`.
+ */
+inline bool isfield(
+    const string& head,
+    size_t start,
+    size_t end,
+    const char* name)
+{
+    size_t nameLen = strlen(name);
+    return end - start > nameLen
+        && head[start + nameLen] == ':'
+        && strnieq(head.data() + start, name, nameLen);
+}
+
+/**
+ * Finds a field of a serialized head.
+ *
+ * @param head Serialized head, ending with an empty line.
+ * @param name Case-insensitive field name.
+ * @return Value of the first field named `name`, or an empty string.
+ */
+inline string headfield(const string& head, const char* name) {
+    size_t start = 0;
+    size_t end;
+    while ((end = head.find("\r\n", start)) != string::npos && end > start) {
+        if (isfield(head, start, end, name)) {
+            size_t value = start + strlen(name) + 1;
+            while (value < end && head[value] == ' ') value++;
+            return head.substr(value, end - value);
+        }
+        start = end + 2;
+    }
+    return "";
+}
+
+/**
+ * Gets the status code of a serialized head, from its HTTP status line or
+ * its Status field.
+ *
+ * @param head Serialized head, ending with an empty line.
+ * @return Status code, or 200 if the head has none.
+ */
+inline int headstatus(const string& head) {
+    string status = head.compare(0, 5, "HTTP/")
+        ? headfield(head, "Status")
+        : head.substr(head.find(' ') + 1);
+    int code = atoi(status.c_str());
+    return code ? code : 200;
+}
+
+/**
+ * Creates the head of a "304 Not Modified" response from a cached one,
+ * keeping only the fields a 304 response SHOULD have.
+ *
+ * @see https://www.rfc-editor.org/rfc/rfc9110#section-15.4.5
+ * @param head Cached head, ending with an empty line.
+ * @param isHttpResponse Whether to write an HTTP status line instead of a
+ *     Status field.
+ * @return Head of the 304 response.
+ */
+inline string notmodifiedhead(const string& head, bool isHttpResponse) {
+    static const char* const fields[] = {
+        "Cache-Control",
+        "Content-Location",
+        "Date",
+        "ETag",
+        "Expires",
+        "Vary"
+    };
+
+    string result;
+    if (isHttpResponse) result += "HTTP/1.1 304 Not Modified\r\n";
+
+    size_t start = 0;
+    size_t end;
+    while ((end = head.find("\r\n", start)) != string::npos && end > start) {
+        for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+            if (isfield(head, start, end, fields[i])) {
+                result.append(head, start, end + 2 - start);
+                break;
+            }
+        }
+        start = end + 2;
+    }
+
+    if (!isHttpResponse) result += "Status: 304 Not Modified\r\n";
+    result += "\r\n";
+    return result;
+}
+
+} // namespace
+
+Cnek::Cnek()
+    : serverRequest(NULL),
+      isRequestSpare(false),
+      response(NULL),
+      isResponseFree(true),
+      isAutoETag(false),
+      responseCache(NULL),
+      cacheKey(NULL),
+      isRevalidating(false),
+      timing(NULL),
+      isServerTiming(false),
+      statsSink(NULL),
+      recorder(NULL),
+      isAllocStatsHeader(false),
+      isHttpResponse(false),
+      accessLog(NULL),
+      startTime(0),
+      bytesSent(0),
+      latencyStats(NULL) {}
 
 ServerRequest* Cnek::getServerRequest(char** environment, FILE* input) {
-    if (this->serverRequest) return this->serverRequest;
+    if (this->serverRequest && !this->isRequestSpare) {
+        return this->serverRequest;
+    }
 
     if (!environment || !input) {
         throw invalid_argument("Failed to create server request.");
     }
 
+    // Count allocations per request.
+    AllocStats::reset();
+    this->startTime = AccessLog::getTime();
+
     // Gather method and uri from environment variables.
     char* method = NULL;
     char* uri = NULL;
@@ -65,7 +652,51 @@ ServerRequest* Cnek::getServerRequest(char** environment, FILE* input) {
             "Missing required environment variable 'REQUEST_URI'.");
     }
 
-    this->serverRequest = new ServerRequest(method, uri, environment);
+    if (this->timing) this->timing->start(TIMING_ENV);
+    if (this->serverRequest) {
+        this->serverRequest->reset(method, uri, environment);
+    } else {
+        this->serverRequest = new ServerRequest(method, uri, environment);
+    }
+    this->isRequestSpare = false;
+    if (this->timing) this->timing->stop(TIMING_ENV);
+
+    this->readBody(input, environment);
+    return this->serverRequest;
+}
+
+ServerRequest* Cnek::getServerRequest(
+    const HttpRequestHead& head,
+    char** serverParams,
+    FILE* input)
+{
+    if (this->serverRequest && !this->isRequestSpare) {
+        return this->serverRequest;
+    }
+
+    if (!input) {
+        throw invalid_argument("Failed to create server request.");
+    }
+
+    // Count allocations per request.
+    AllocStats::reset();
+    this->startTime = AccessLog::getTime();
+
+    if (this->timing) this->timing->start(TIMING_ENV);
+    if (this->serverRequest) {
+        this->serverRequest->reset(head, serverParams);
+    } else {
+        this->serverRequest = new ServerRequest(head, serverParams);
+    }
+    this->isRequestSpare = false;
+    if (this->timing) this->timing->stop(TIMING_ENV);
+
+    this->readBody(input, NULL);
+    return this->serverRequest;
+}
+
+void Cnek::readBody(FILE* input, char** environment) {
+    if (this->timing) this->timing->start(TIMING_BODY);
     Stream* body = this->serverRequest->getBody();
 
     // Write input to server request body.
@@ -75,9 +706,16 @@ ServerRequest* Cnek::getServerRequest(char** environment, FILE* input) {
     size_t bytesRead = 0;
     size_t totalBytes = 0;
 
+    // Keep a copy of the raw body of sampled requests to record. Requests
+    // without an environment cannot be replayed, so are not recorded.
+    bool isRecording =
+        environment && this->recorder && this->recorder->isSampled();
+    string recorded;
+
     errno = 0;
     while ((bytesRead = fread(buffer, 1, bufferSize, input)) > 0) {
         totalBytes += bytesRead;
+        if (isRecording) recorded.append(buffer, bytesRead);
 
         // If we are approaching the max request body size then read the
         // remaining bytes on the next iteration.
@@ -85,7 +723,7 @@ ServerRequest* Cnek::getServerRequest(char** environment, FILE* input) {
             bufferSize = MAX_REQUEST_BODY_SIZE - totalBytes;
         }
 
-        size_t bytesWritten = body->write(buffer);
+        size_t bytesWritten = body->write(buffer, bytesRead);
         if (bytesWritten != bytesRead && errno) {
             string error = strerror(errno);
             string message =
@@ -104,57 +742,582 @@ ServerRequest* Cnek::getServerRequest(char** environment, FILE* input) {
         throw runtime_error(message);
     }
 
-    return this->serverRequest;
+    if (isRecording) {
+        // Recording is best-effort; never fail the request over it.
+        try {
+            this->recorder->record(
+                environment, recorded.data(), recorded.size());
+        } catch (runtime_error&) {}
+    }
+
+    if (this->timing) {
+        this->timing->stop(TIMING_BODY);
+
+        // Parse the body now so parsing is timed apart from the handler.
+        const char* contentType =
+            this->serverRequest->getServerParam("CONTENT_TYPE");
+        TimingPhase phase = strstr(contentType, "multipart/form-data")
+            ? TIMING_MULTIPART
+            : TIMING_URLENCODED;
+        if (!strcmp(this->serverRequest->getMethod(), "POST")
+            && (phase == TIMING_MULTIPART
+                || strstr(contentType, "application/x-www-form-urlencoded")))
+        {
+            this->timing->start(phase);
+            this->serverRequest->getBodyParam("");
+            this->timing->stop(phase);
+        } else if (this->serverRequest->isJson()) {
+            // A malformed body is left for the handler to reject.
+            this->timing->start(TIMING_JSON);
+            try {
+                this->serverRequest->getJsonBody();
+            } catch (invalid_argument&) {}
+            this->timing->stop(TIMING_JSON);
+        }
+
+        this->timing->start(TIMING_HANDLER);
+    }
 }
 
 void Cnek::emitResponse(Response* response, FILE* output) {
-    // Output headers.
+    if (!this->timing) {
+        this->logAccess(this->writeResponse(response, output));
+        return;
+    }
+
+    this->timing->stop(TIMING_HANDLER);
+
+    // Emitting cannot time itself in a header that is part of its output.
+    if (this->isServerTiming) {
+        char serverTiming[SERVER_TIMING_HEADER_SIZE];
+        response->setHeader(
+            "Server-Timing",
+            this->timing->toHeader(serverTiming, sizeof(serverTiming)));
+    }
+
+    this->timing->start(TIMING_EMIT);
+    int statusCode = this->writeResponse(response, output);
+    this->timing->stop(TIMING_EMIT);
+
+    if (this->statsSink) {
+        this->timing->writeStats(
+            this->statsSink,
+            this->serverRequest ? this->serverRequest->getMethod() : "-",
+            this->serverRequest
+                ? this->serverRequest->getRequestTarget()
+                : "-",
+            statusCode);
+    }
+    this->recordLatency(statusCode);
+    this->logAccess(statusCode);
+}
+
+void Cnek::logAccess(int statusCode) {
+    if (!this->accessLog || this->isRevalidating) return;
+
+    double milliseconds =
+        this->startTime ? AccessLog::getTime() - this->startTime : 0;
+    this->accessLog->log(
+        this->serverRequest ? this->serverRequest->getMethod() : "-",
+        this->serverRequest ? this->serverRequest->getRequestTarget() : "-",
+        statusCode,
+        this->bytesSent,
+        milliseconds);
+}
+
+void Cnek::recordLatency(int statusCode) {
+    if (!this->latencyStats || this->isRevalidating) return;
+
+    const char* route = this->route.c_str();
+    if (!*route && this->serverRequest) {
+        route = this->serverRequest->getServerParam("SCRIPT_NAME");
+    }
+    if (!*route) route = "-";
+
+    double milliseconds =
+        this->startTime ? AccessLog::getTime() - this->startTime : 0;
+    this->latencyStats->recordTiming(
+        route, statusCode, *this->timing, milliseconds);
+}
+
+int Cnek::writeResponse(Response* response, FILE* output) {
+    this->bytesSent = 0;
+
+    if (this->isAllocStatsHeader && AllocStats::isEnabled()) {
+        AllocCounters counters = AllocStats::get();
+        char allocStats[128];
+        snprintf(allocStats,
+                 sizeof(allocStats),
+                 "allocations=%lu, frees=%lu, bytes=%lu, peak=%lu",
+                 counters.allocations,
+                 counters.frees,
+                 counters.bytes,
+                 counters.peak);
+        response->setHeader("X-Alloc-Stats", allocStats);
+    }
+
+    // Only successful GET and HEAD requests can be answered with
+    // "304 Not Modified", so only their bodies are hashed.
+    bool isNotModified = false;
+    if (this->isAutoETag
+        && response->getStatusCode() == 200
+        && this->serverRequest
+        && (!strcmp(this->serverRequest->getMethod(), "GET")
+            || !strcmp(this->serverRequest->getMethod(), "HEAD"))
+        && (response->hasHeader("ETag") || setetag(response)))
+    {
+        const char* ifNoneMatch =
+            this->serverRequest->getHeaderLine("If-None-Match");
+        if (*ifNoneMatch
+            && etagmatches(ifNoneMatch, response->getHeaderLine("ETag")))
+        {
+            response->setStatus(304, "Not Modified");
+            isNotModified = true;
+        }
+    }
+
+    // A stale cached response was already emitted, so only refresh the cache.
+    bool isWriting = !this->isRevalidating;
+
+    // Answer GET requests for parts of seekable bodies with only those
+    // parts, so resumed downloads and media seeks do not reread everything.
+    Stream* body = response->getBody();
+    ByteRange ranges[MAX_RESPONSE_RANGES];
+    int rangeCount = -1;
+    long size = 0;
+    char boundary[20];
+    string contentType;
+    if (isWriting
+        && response->getStatusCode() == 200
+        && this->serverRequest
+        && (!strcmp(this->serverRequest->getMethod(), "GET")
+            || !strcmp(this->serverRequest->getMethod(), "HEAD"))
+        && body->isSeekable()
+        && (size = body->getSize()) >= 0)
+    {
+        response->setHeader("Accept-Ranges", "bytes");
+
+        const char* range = this->serverRequest->getHeaderLine("Range");
+        if (*range
+            && !strcmp(this->serverRequest->getMethod(), "GET")
+            && ifrangematches(
+                this->serverRequest->getHeaderLine("If-Range"), response))
+        {
+            rangeCount =
+                parseranges(range, size, ranges, MAX_RESPONSE_RANGES);
+        }
+    }
+
+    char value[80];
+    if (rangeCount == 0) {
+        response->setStatus(416, "Range Not Satisfiable");
+        snprintf(value, sizeof(value), "bytes */%ld", size);
+        response->setHeader("Content-Range", value);
+        response->setHeader("Content-Length", "0");
+    } else if (rangeCount == 1) {
+        response->setStatus(206, "Partial Content");
+        snprintf(value,
+                 sizeof(value),
+                 "bytes %ld-%ld/%ld",
+                 ranges[0].first,
+                 ranges[0].last,
+                 size);
+        response->setHeader("Content-Range", value);
+        snprintf(value,
+                 sizeof(value),
+                 "%ld",
+                 ranges[0].last - ranges[0].first + 1);
+        response->setHeader("Content-Length", value);
+    } else if (rangeCount > 1) {
+        // The boundary only has to be unlikely to appear in the body.
+        unsigned long seed[3] = {
+            (unsigned long)time(NULL),
+            (unsigned long)clock(),
+            (unsigned long)size
+        };
+        uint64_t digest = hashbytes(seed, sizeof(seed), (uintptr_t)response);
+        snprintf(boundary,
+                 sizeof(boundary),
+                 "%08lx%08lx",
+                 (unsigned long)(digest >> 32),
+                 (unsigned long)(digest & 0xffffffffUL));
+
+        contentType = response->getHeaderLine("Content-Type");
+        long length = strlen(boundary) + 8; // "\r\n--" boundary "--\r\n"
+        for (int i = 0; i < rangeCount; i++) {
+            length += parthead(
+                boundary, contentType.c_str(), ranges[i], size).size();
+            length += ranges[i].last - ranges[i].first + 1;
+        }
+
+        response->setStatus(206, "Partial Content");
+        string multipart = "multipart/byteranges; boundary=";
+        multipart += boundary;
+        response->setHeader("Content-Type", multipart.c_str());
+        snprintf(value, sizeof(value), "%ld", length);
+        response->setHeader("Content-Length", value);
+    }
+
+    // Cache successful GET responses that allow it. Partial responses are
+    // not cached.
+    long ttl = 0;
+    long stale = 0;
+    bool isCaching = this->responseCache
+        && rangeCount < 0
+        && this->serverRequest
+        && !strcmp(this->serverRequest->getMethod(), "GET")
+        && cachelifetime(this->serverRequest,
+                         response,
+                         this->responseCache,
+                         &ttl,
+                         &stale);
+
+    // HTTP clients need the length to reuse the connection, and a Date.
+    int statusCode = response->getStatusCode();
+    if (this->isHttpResponse) {
+        if (!response->hasHeader("Date")) {
+            char date[32];
+            time_t now = time(NULL);
+            struct tm utc;
+#ifndef _WIN32
+            gmtime_r(&now, &utc);
+#else
+            gmtime_s(&utc, &now);
+#endif // _WIN32
+            strftime(date,
+                     sizeof(date),
+                     "%a, %d %b %Y %H:%M:%S GMT",
+                     &utc);
+            response->setHeader("Date", date);
+        }
+
+        if (rangeCount < 0
+            && !isNotModified
+            && statusCode >= 200
+            && statusCode != 204
+            && !response->hasHeader("Content-Length")
+            && body->isSeekable()
+            && (size = body->getSize()) >= 0)
+        {
+            snprintf(value, sizeof(value), "%ld", size);
+            response->setHeader("Content-Length", value);
+        }
+    }
+
+    // Serialize headers so they are written at once.
+    string head;
+    char status[16];
+    snprintf(status, sizeof(status), "%d", statusCode);
+    if (this->isHttpResponse) {
+        const char* reasonPhrase = response->getReasonPhrase();
+        head += "HTTP/1.1 ";
+        head += status;
+        head += ' ';
+        appendfield(head,
+                    *reasonPhrase ? reasonPhrase : reasonphrase(statusCode));
+        head += "\r\n";
+    }
+
+    // Fields are checked as they are set, but are stripped again so no
+    // value can ever end the head early.
     HeaderIterator headers = response->getHeaders();
     while (headers.next()) {
+        const char* name = headers.getName();
+        if (!HeaderValidator::isValidName(name)) continue;
+
         ValueIterator values = headers.getValues();
         while (values.next()) {
-            fprintf(output,
-                    "%s: %s\r\n",
-                    headers.getName(),
-                    values.getValue());
+            head += name;
+            head += ": ";
+            appendfield(head, values.getValue());
+            head += "\r\n";
         }
     }
 
     // Output status.
-    fprintf(output,
-            "Status: %d %s\r\n",
-            response->getStatusCode(),
-            response->getReasonPhrase());
+    if (!this->isHttpResponse) {
+        head += "Status: ";
+        head += status;
+        head += ' ';
+        appendfield(head, response->getReasonPhrase());
+        head += "\r\n";
+    }
 
     // Header and body separator.
-    fprintf(output, "\r\n");
+    head += "\r\n";
 
-    // Output body.
-    Stream* body = response->getBody();
+    errno = 0;
+    if (isWriting && fwrite(head.data(), 1, head.size(), output) < head.size()) {
+        string error = strerror(errno);
+        string message =
+            "Failed to emit response while writing: " + error + ".";
+        throw runtime_error(message);
+    }
+
+    // "304 Not Modified" and "416 Range Not Satisfiable" responses never
+    // have a body, and neither do HEAD responses in HTTP.
+    bool isHead = this->isHttpResponse
+        && this->serverRequest
+        && !strcmp(this->serverRequest->getMethod(), "HEAD");
+    if (isNotModified || rangeCount == 0 || isHead) {
+        this->releaseResponse(response);
+        return statusCode;
+    }
 
+    if (rangeCount == 1) {
+        this->bytesSent = emitrange(body, ranges[0], output);
+        this->releaseResponse(response);
+        return statusCode;
+    }
+
+    if (rangeCount > 1) {
+        for (int i = 0; i < rangeCount; i++) {
+            string part = parthead(
+                boundary, contentType.c_str(), ranges[i], size);
+            errno = 0;
+            if (fwrite(part.data(), 1, part.size(), output) < part.size()) {
+                string error = strerror(errno);
+                string message =
+                    "Failed to emit response while writing: " + error + ".";
+                throw runtime_error(message);
+            }
+            this->bytesSent += emitrange(body, ranges[i], output);
+        }
+
+        string end = "\r\n--";
+        end += boundary;
+        end += "--\r\n";
+        errno = 0;
+        if (fwrite(end.data(), 1, end.size(), output) < end.size()) {
+            string error = strerror(errno);
+            string message =
+                "Failed to emit response while writing: " + error + ".";
+            throw runtime_error(message);
+        }
+
+        this->releaseResponse(response);
+        return statusCode;
+    }
+
+    if (isCaching && !this->cacheKey) {
+        this->cacheKey = this->responseCache->createKey(this->serverRequest);
+    }
+
+    // Entries larger than a cache slot are not cached.
+    string entry;
+    size_t entryCapacity = 0;
+    if (isCaching) {
+        entryCapacity =
+            this->responseCache->getCapacity() - strlen(this->cacheKey);
+        isCaching = head.size() <= entryCapacity;
+        if (isCaching) entry = head;
+    }
+
+    // Output body.
     // If the body was previous written to, it'll be at the end. Rewind
     // before reading.
     if (body->isSeekable()) body->rewind();
 
-    const unsigned short bufferSize = 4069;
+    // NOTE: Bodies MAY be binary (e.g. precompressed files), so copy them
+    // byte-for-byte instead of as null-terminated strings.
+    char buffer[RESPONSE_BODY_BUFFER_SIZE];
+    size_t bytesRead = 0;
     errno = 0;
 
-    while (!body->eof()) {
-        const char* data = body->read(bufferSize);
-        size_t bytesWritten = fprintf(output, "%s", data);
-        if (bytesWritten < 0 || errno || ferror(output)) {
+    while ((bytesRead = body->read(buffer, sizeof(buffer))) > 0) {
+        if (isCaching) {
+            isCaching = entry.size() + bytesRead <= entryCapacity;
+            if (isCaching) entry.append(buffer, bytesRead);
+        }
+
+        if (!isWriting) continue;
+
+        size_t bytesWritten = fwrite(buffer, 1, bytesRead, output);
+        if (bytesWritten < bytesRead || ferror(output)) {
             string error = strerror(errno);
             string message =
                 "Failed to emit response while writing: " + error + ".";
             throw runtime_error(message);
         }
+        this->bytesSent += bytesWritten;
+    }
+
+    // Cached responses are served without running the handler, so they
+    // need their length for clients to tell where they end.
+    if (isCaching && !response->hasHeader("Content-Length")) {
+        snprintf(value,
+                 sizeof(value),
+                 "Content-Length: %lu\r\n",
+                 (unsigned long)(entry.size() - head.size()));
+        isCaching = entry.size() + strlen(value) <= entryCapacity;
+        if (isCaching) entry.insert(head.size() - 2, value);
+    }
+
+    if (isCaching) {
+        this->responseCache->store(
+            this->cacheKey, entry.data(), entry.size(), ttl, stale);
+    }
+
+    this->releaseResponse(response);
+    return statusCode;
+}
+
+Response* Cnek::createResponse(unsigned short code, const char* reasonPhrase) {
+    if (!this->isResponseFree) return new Response(code, reasonPhrase);
+
+    if (this->response) this->response->reset(code, reasonPhrase);
+    else this->response = new Response(code, reasonPhrase);
+    this->isResponseFree = false;
+    return this->response;
+}
+
+void Cnek::releaseResponse(Response* response) {
+    if (response && response == this->response) this->isResponseFree = true;
+    else delete response;
+}
+
+void Cnek::reset() {
+    this->isRequestSpare = true;
+    delete[] this->cacheKey;
+    this->cacheKey = NULL;
+    this->isRevalidating = false;
+    this->route.clear();
+    if (this->timing) this->timing->reset();
+}
+
+void Cnek::clearSettings() {
+    this->isAutoETag = false;
+    this->responseCache = NULL;
+    delete this->timing;
+    this->timing = NULL;
+    this->isServerTiming = false;
+    this->statsSink = NULL;
+    this->recorder = NULL;
+    this->isAllocStatsHeader = false;
+    this->isHttpResponse = false;
+    this->accessLog = NULL;
+    this->latencyStats = NULL;
+    this->route.clear();
+}
+
+void Cnek::setServerTiming(bool enabled) {
+    this->isServerTiming = enabled;
+    if (enabled && !this->timing) this->timing = new Timing();
+}
+
+void Cnek::setStatsSink(FILE* sink) {
+    this->statsSink = sink;
+    if (sink && !this->timing) this->timing = new Timing();
+}
+
+void Cnek::setRecorder(Recorder* recorder) {
+    this->recorder = recorder;
+}
+
+void Cnek::setAccessLog(AccessLog* accessLog) {
+    this->accessLog = accessLog;
+}
+
+void Cnek::setLatencyStats(LatencyStats* latencyStats) {
+    this->latencyStats = latencyStats;
+    if (latencyStats && !this->timing) this->timing = new Timing();
+}
+
+void Cnek::setRoute(const char* route) {
+    this->route = route ? route : "";
+}
+
+void Cnek::setAllocStatsHeader(bool enabled) {
+    this->isAllocStatsHeader = enabled;
+}
+
+void Cnek::setHttpResponse(bool enabled) {
+    this->isHttpResponse = enabled;
+}
+
+Timing* Cnek::getTiming() {
+    return this->timing;
+}
+
+void Cnek::setAutoETag(bool enabled) {
+    this->isAutoETag = enabled;
+}
+
+void Cnek::setResponseCache(ResponseCache* responseCache) {
+    this->responseCache = responseCache;
+}
+
+CacheStatus Cnek::serveCached(FILE* output) {
+    if (!this->responseCache
+        || !this->serverRequest
+        || strcmp(this->serverRequest->getMethod(), "GET"))
+    {
+        return CACHE_MISS;
+    }
+
+    if (!this->cacheKey) {
+        this->cacheKey = this->responseCache->createKey(this->serverRequest);
+    }
+
+    char* data = NULL;
+    size_t length = 0;
+    CacheStatus status = this->responseCache->lookup(
+        this->cacheKey, &data, &length);
+    if (status == CACHE_MISS) return status;
+
+    // Answer conditional requests with "304 Not Modified" as
+    // emitResponse() does.
+    string head(data, headlength(data, length));
+    string etag = headfield(head, "ETag");
+    const char* ifNoneMatch =
+        this->serverRequest->getHeaderLine("If-None-Match");
+    bool isNotModified = this->isAutoETag
+        && *ifNoneMatch
+        && !etag.empty()
+        && etagmatches(ifNoneMatch, etag.c_str());
+    if (isNotModified) head = notmodifiedhead(head, this->isHttpResponse);
+
+    errno = 0;
+    bool isShort = isNotModified
+        ? fwrite(head.data(), 1, head.size(), output) < head.size()
+        : fwrite(data, 1, length, output) < length;
+    free(data);
+    if (isShort || fflush(output)) {
+        string error = strerror(errno);
+        string message =
+            "Failed to emit cached response while writing: " + error + ".";
+        throw runtime_error(message);
     }
 
-    delete response;
+    // Hits are logged as they are sent; a stale hit's refresh is not.
+    int statusCode = isNotModified ? 304 : headstatus(head);
+    this->bytesSent = isNotModified ? 0 : length - head.size();
+    this->recordLatency(statusCode);
+    this->logAccess(statusCode);
+
+    if (status == CACHE_STALE) {
+        this->isRevalidating = true;
+
+#ifndef _WIN32
+        // The web server waits for the CGI's stdout to close, so end the
+        // response now instead of after the handler refreshed the cache.
+        if (fileno(output) == STDOUT_FILENO) {
+            int null = open("/dev/null", O_WRONLY);
+            if (null >= 0) {
+                dup2(null, STDOUT_FILENO);
+                if (null != STDOUT_FILENO) ::close(null);
+            }
+        }
+#endif // _WIN32
+    }
+    return status;
 }
 
 Cnek::~Cnek() {
     delete this->serverRequest;
+    delete this->response;
+    delete[] this->cacheKey;
+    delete this->timing;
 }
 
 } // Cnek
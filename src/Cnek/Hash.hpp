@@ -0,0 +1,195 @@
+#ifndef CNEK_HASH
+
+#include <stdint.h>
+#include <string.h>
+
+namespace Cnek {
+
+namespace {
+
+const uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ULL;
+const uint64_t HASH_PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t HASH_PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Reads a little-endian 64-bit integer regardless of host byte order or
+ * alignment.
+ */
+inline uint64_t read64(const unsigned char* p) {
+    return (uint64_t)p[0]
+        | ((uint64_t)p[1] << 8)
+        | ((uint64_t)p[2] << 16)
+        | ((uint64_t)p[3] << 24)
+        | ((uint64_t)p[4] << 32)
+        | ((uint64_t)p[5] << 40)
+        | ((uint64_t)p[6] << 48)
+        | ((uint64_t)p[7] << 56);
+}
+
+/**
+ * Reads a little-endian 32-bit integer regardless of host byte order or
+ * alignment.
+ */
+inline uint32_t read32(const unsigned char* p) {
+    return (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t hashround(uint64_t acc, uint64_t input) {
+    acc += input * HASH_PRIME_2;
+    acc = rotl64(acc, 31);
+    return acc * HASH_PRIME_1;
+}
+
+inline uint64_t hashmerge(uint64_t acc, uint64_t value) {
+    acc ^= hashround(0, value);
+    return acc * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+/**
+ * Streaming 64-bit non-cryptographic hash.
+ *
+ * Produces the same values as XXH64, so data can be hashed in chunks as it
+ * is read from a stream without buffering it all.
+ *
+ * For internal use only.
+ */
+struct Hash {
+    uint64_t v1;
+    uint64_t v2;
+    uint64_t v3;
+    uint64_t v4;
+    uint64_t seed;
+    uint64_t total;
+    unsigned char buffer[32];
+    size_t buffered;
+
+    Hash(uint64_t seed = 0) {
+        this->seed = seed;
+        this->v1 = seed + HASH_PRIME_1 + HASH_PRIME_2;
+        this->v2 = seed + HASH_PRIME_2;
+        this->v3 = seed;
+        this->v4 = seed - HASH_PRIME_1;
+        this->total = 0;
+        this->buffered = 0;
+    }
+
+    /**
+     * Adds bytes to the hash.
+     *
+     * @param data Bytes to add.
+     * @param length Number of bytes to add.
+     */
+    void update(const void* data, size_t length) {
+        const unsigned char* p = (const unsigned char*)data;
+        const unsigned char* end = p + length;
+        this->total += length;
+
+        // Not enough for a full stripe yet, so keep buffering.
+        if (this->buffered + length < 32) {
+            memcpy(this->buffer + this->buffered, p, length);
+            this->buffered += length;
+            return;
+        }
+
+        // Complete the buffered stripe.
+        if (this->buffered) {
+            size_t fill = 32 - this->buffered;
+            memcpy(this->buffer + this->buffered, p, fill);
+            this->stripe(this->buffer);
+            p += fill;
+            this->buffered = 0;
+        }
+
+        while (p + 32 <= end) {
+            this->stripe(p);
+            p += 32;
+        }
+
+        this->buffered = end - p;
+        memcpy(this->buffer, p, this->buffered);
+    }
+
+    /**
+     * Gets the hash of all bytes added so far.
+     *
+     * @return 64-bit hash.
+     */
+    uint64_t digest() const {
+        uint64_t h;
+        if (this->total >= 32) {
+            h = rotl64(this->v1, 1) + rotl64(this->v2, 7)
+                + rotl64(this->v3, 12) + rotl64(this->v4, 18);
+            h = hashmerge(h, this->v1);
+            h = hashmerge(h, this->v2);
+            h = hashmerge(h, this->v3);
+            h = hashmerge(h, this->v4);
+        } else {
+            h = this->seed + HASH_PRIME_5;
+        }
+
+        h += this->total;
+
+        const unsigned char* p = this->buffer;
+        const unsigned char* end = p + this->buffered;
+        while (p + 8 <= end) {
+            h ^= hashround(0, read64(p));
+            h = rotl64(h, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+            p += 8;
+        }
+        if (p + 4 <= end) {
+            h ^= (uint64_t)read32(p) * HASH_PRIME_1;
+            h = rotl64(h, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+            p += 4;
+        }
+        while (p < end) {
+            h ^= (*p) * HASH_PRIME_5;
+            h = rotl64(h, 11) * HASH_PRIME_1;
+            p++;
+        }
+
+        // Avalanche.
+        h ^= h >> 33;
+        h *= HASH_PRIME_2;
+        h ^= h >> 29;
+        h *= HASH_PRIME_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    private:
+    void stripe(const unsigned char* p) {
+        this->v1 = hashround(this->v1, read64(p));
+        this->v2 = hashround(this->v2, read64(p + 8));
+        this->v3 = hashround(this->v3, read64(p + 16));
+        this->v4 = hashround(this->v4, read64(p + 24));
+    }
+};
+
+/**
+ * Hashes a buffer in one call.
+ *
+ * @param data Bytes to hash.
+ * @param length Number of bytes to hash.
+ * @param seed Seed to start the hash from.
+ * @return 64-bit hash.
+ */
+inline uint64_t hashbytes(const void* data, size_t length, uint64_t seed = 0) {
+    Hash hash(seed);
+    hash.update(data, length);
+    return hash.digest();
+}
+
+} // namespace
+
+} // Cnek
+#define CNEK_HASH
+#endif // CNEK_HASH
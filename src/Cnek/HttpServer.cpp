@@ -0,0 +1,1588 @@
+#include "HttpServer.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif // __linux__
+
+#if defined(__linux__) && !defined(CNEK_NO_IO_URING)
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#define CNEK_HTTP_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif // __NR_io_uring_setup
+#endif // __linux__ && !CNEK_NO_IO_URING
+
+// Max number of bytes of the request line and headers.
+// NOTE: Prevents DoS attacks; larger requests are answered with "431".
+#ifndef MAX_HTTP_HEADER_SIZE
+#define MAX_HTTP_HEADER_SIZE 65536 // Default 64KB.
+#endif // MAX_HTTP_HEADER_SIZE
+
+// Max number of bytes to read from the request body.
+// NOTE: Prevents DoS attacks; larger requests are answered with "413".
+#ifndef MAX_REQUEST_BODY_SIZE
+#define MAX_REQUEST_BODY_SIZE 4194304 // Default 4MB.
+#endif // MAX_REQUEST_BODY_SIZE
+
+// Size of buffer used to read from connections.
+#ifndef HTTP_BUFFER_SIZE
+#define HTTP_BUFFER_SIZE 16384 // Default 16KB.
+#endif // HTTP_BUFFER_SIZE
+
+// Seconds a connection may be idle, or take to send a request, before it is
+// closed.
+// NOTE: Prevents slow clients from holding connections open.
+#ifndef HTTP_IDLE_TIMEOUT
+#define HTTP_IDLE_TIMEOUT 10 // Default 10 seconds.
+#endif // HTTP_IDLE_TIMEOUT
+
+// Seconds a stopped server waits for requests being received before it
+// closes their connections.
+// NOTE: Handlers that wait are still resumed until they respond.
+#ifndef HTTP_DRAIN_TIMEOUT
+#define HTTP_DRAIN_TIMEOUT 5 // Default 5 seconds.
+#endif // HTTP_DRAIN_TIMEOUT
+
+// Max number of events handled per wait.
+#ifndef HTTP_MAX_EVENTS
+#define HTTP_MAX_EVENTS 64 // Default 64 events.
+#endif // HTTP_MAX_EVENTS
+
+// Number of submissions the io_uring queue holds; completions hold twice as
+// many.
+// NOTE: More are handed to the kernel in several system calls per batch.
+#ifndef HTTP_URING_ENTRIES
+#define HTTP_URING_ENTRIES 256 // Default 256 entries.
+#endif // HTTP_URING_ENTRIES
+
+// Number of HTTP_BUFFER_SIZE buffers registered with io_uring.
+// NOTE: Connections beyond it are received into buffers of their own.
+#ifndef HTTP_URING_BUFFERS
+#define HTTP_URING_BUFFERS 64 // Default 64 buffers, 1MB.
+#endif // HTTP_URING_BUFFERS
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+using Csr::Http::Message::HttpParser;
+using Csr::Http::Message::HttpRequestHead;
+using Csr::Http::Message::HttpHeaderSlice;
+using Csr::Http::Message::HttpSlice;
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::strerror;
+using std::string;
+
+/**
+ * State of one client connection.
+ */
+struct HttpConnection {
+    int fd;
+
+    /** Received bytes not yet handled, starting at a request. */
+    string input;
+
+    /** Responses not yet sent, from `written` on. */
+    string output;
+    size_t written;
+
+    time_t lastActive;
+
+    /** Close once the output is sent, and handle no more requests. */
+    bool isClosing;
+
+    /** "100 Continue" was sent for the current request. */
+    bool isContinued;
+
+    /** Waiting for the socket to be readable, or else writable. */
+    bool isReading;
+
+    /** Events the socket is waited on for with epoll, 0 while none. */
+    uint32_t events;
+
+    /** Server param of the client's address, "REMOTE_ADDR=127.0.0.1". */
+    char remoteAddress[32];
+
+    /** An io_uring receive or send of the connection is in flight. */
+    bool isBusy;
+
+    /** Buffer io_uring receives into, registered at `bufferIndex` or -1. */
+    char* buffer;
+    int bufferIndex;
+
+    /** Service and request of the request being handled. */
+    Cnek* cnek;
+    ServerRequest* request;
+
+    /** Handler of the request while it waits, or NULL. */
+    AsyncHandler* task;
+
+    /** Keep the connection alive after the response. */
+    bool isKeepAlive;
+
+    /** The request is HTTP/1.0, so keep-alive is announced. */
+    bool isHttp10;
+
+#ifdef CNEK_HTTP_IO_URING
+    /** Delay the handler waits for. */
+    struct __kernel_timespec delay;
+#endif // CNEK_HTTP_IO_URING
+
+    ~HttpConnection() {
+        delete this->task;
+        delete this->cnek;
+    }
+};
+
+#ifdef CNEK_HTTP_IO_URING
+/**
+ * Submission and completion queues of an io_uring instance, mapped from the
+ * kernel, and the state its operations point to.
+ */
+struct HttpRing {
+    int fd;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    struct io_uring_sqe* sqes;
+
+    /** Tail of the submissions prepared, and how many are not submitted. */
+    unsigned tail;
+    unsigned pending;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+
+    /** The listener is registered as fixed file 0. */
+    bool isListenerFixed;
+
+    /** Registered buffers and a stack of the indexes of those not in use. */
+    char* buffers;
+    int* freeBuffers;
+    int freeCount;
+
+    /** Address of the connection being accepted. */
+    struct sockaddr_in address;
+    socklen_t addressLength;
+
+    /** Interval of the timeout that wakes the loop to expire connections. */
+    struct __kernel_timespec tick;
+
+    bool isAccepting;
+    bool isTicking;
+};
+#endif // CNEK_HTTP_IO_URING
+
+#ifdef __linux__
+namespace {
+
+/**
+ * Case-insensitive check whether or not a slice equals a string.
+ */
+inline bool sliceequals(const HttpSlice& slice, const char* str) {
+    return slice.length == strlen(str)
+        && !strncasecmp(slice.data, str, slice.length);
+}
+
+/**
+ * Case-insensitive check whether or not a comma-separated header value
+ * contains a token, e.g. "close" in "Connection: keep-alive, close".
+ */
+bool hastoken(const HttpSlice& value, const char* token) {
+    const char* p = value.data;
+    const char* end = value.data + value.length;
+    while (p < end) {
+        const char* itemEnd = (const char*)memchr(p, ',', end - p);
+        if (!itemEnd) itemEnd = end;
+
+        HttpSlice item = {p, (size_t)(itemEnd - p)};
+        while (item.length && (*item.data == ' ' || *item.data == '\t')) {
+            item.data++;
+            item.length--;
+        }
+        while (item.length
+            && (item.data[item.length - 1] == ' '
+                || item.data[item.length - 1] == '\t'))
+        {
+            item.length--;
+        }
+
+        if (sliceequals(item, token)) return true;
+        p = itemEnd + 1;
+    }
+    return false;
+}
+
+/**
+ * Parses a Content-Length value.
+ *
+ * @return True if the value is only digits and fits, false if not.
+ */
+bool parselength(const HttpSlice& value, size_t* length) {
+    if (!value.length) return false;
+
+    size_t parsed = 0;
+    for (size_t i = 0; i < value.length; i++) {
+        char c = value.data[i];
+        if (c < '0' || c > '9') return false;
+        if (parsed > ((size_t)-1 - 9) / 10) return false;
+        parsed = parsed * 10 + (c - '0');
+    }
+    *length = parsed;
+    return true;
+}
+
+/**
+ * Answers the current request with an empty error response and closes the
+ * connection after it is sent.
+ *
+ * @param status Status code and reason phrase, e.g. "400 Bad Request".
+ */
+void fail(HttpConnection* connection, const char* status) {
+    connection->output += "HTTP/1.1 ";
+    connection->output += status;
+    connection->output += "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    connection->input.clear();
+    connection->isClosing = true;
+}
+
+/**
+ * Updates which events a connection is waited on for: EPOLLIN, EPOLLOUT, or
+ * none while its handler waits.
+ */
+void watch(int poller, HttpConnection* connection, uint32_t events) {
+    if (connection->events == events) return;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = connection;
+    epoll_ctl(poller, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+    connection->isReading = events != EPOLLOUT;
+}
+
+/**
+ * Waits on the listener for connections. The listener is told apart from
+ * connections by a NULL pointer. When several processes wait on it, only one
+ * is woken per connection.
+ */
+void watchlistener(int poller, int listener) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+    event.events |= EPOLLEXCLUSIVE;
+#endif // EPOLLEXCLUSIVE
+    event.data.ptr = NULL;
+    epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+}
+
+/**
+ * Checks whether or not a client sent bytes that were not received yet.
+ */
+bool hasinput(int fd) {
+    char byte;
+    return recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
+/**
+ * Gets the time of a clock that is never set back, in milliseconds.
+ */
+uint64_t monotonic() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Tags a connection as the user data of an operation its handler waits for,
+ * with the lowest bit, which pointers to connections never have set.
+ */
+inline uint64_t waittag(HttpConnection* connection) {
+    return (uint64_t)(uintptr_t)connection | 1;
+}
+
+#ifdef CNEK_HTTP_IO_URING
+// Tags of operations that are not of a connection, whose user data is a
+// pointer to it.
+const uint64_t URING_ACCEPT = 1;
+const uint64_t URING_TICK = 2;
+const uint64_t URING_CANCEL = 3;
+
+/**
+ * Hands prepared submissions to the kernel and waits for completions.
+ *
+ * @param wait Number of completions to wait for, or 0 not to wait.
+ * @return Number of submissions consumed, or -1 with errno set.
+ */
+int enterring(HttpRing* ring, unsigned wait) {
+    int result = (int)syscall(
+        __NR_io_uring_enter,
+        ring->fd,
+        ring->pending,
+        wait,
+        wait ? IORING_ENTER_GETEVENTS : 0,
+        NULL,
+        0);
+    if (result > 0) ring->pending -= result;
+    return result;
+}
+
+/**
+ * Prepares a submission, submitting those before it if the queue is full.
+ *
+ * The kernel only reads submissions when they are submitted, so fields MAY
+ * be set after this returns.
+ *
+ * @throws std::runtime_error The queue cannot be submitted.
+ */
+struct io_uring_sqe* prepare(
+    HttpRing* ring,
+    int opcode,
+    int fd,
+    uint64_t userData)
+{
+    while (ring->tail - *(volatile unsigned*)ring->sqHead == ring->sqEntries) {
+        if (enterring(ring, 0) < 0 && errno != EINTR) {
+            string error = strerror(errno);
+            throw runtime_error(
+                "Failed to submit HTTP operations: " + error + ".");
+        }
+    }
+
+    struct io_uring_sqe* sqe = &ring->sqes[ring->tail & ring->sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+
+    // Publish the tail only after the entry is written.
+    ring->tail++;
+    __sync_synchronize();
+    *(volatile unsigned*)ring->sqTail = ring->tail;
+    ring->pending++;
+    return sqe;
+}
+
+/**
+ * Queues accepting a connection on the listener.
+ */
+void armaccept(HttpRing* ring, int listener) {
+    struct io_uring_sqe* sqe = prepare(
+        ring,
+        IORING_OP_ACCEPT,
+        ring->isListenerFixed ? 0 : listener,
+        URING_ACCEPT);
+    if (ring->isListenerFixed) sqe->flags |= IOSQE_FIXED_FILE;
+    ring->addressLength = sizeof(ring->address);
+    sqe->addr = (uint64_t)(uintptr_t)&ring->address;
+    sqe->addr2 = (uint64_t)(uintptr_t)&ring->addressLength;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    ring->isAccepting = true;
+}
+
+/**
+ * Queues the timeout that wakes the loop once a second.
+ */
+void armtick(HttpRing* ring) {
+    struct io_uring_sqe* sqe = prepare(ring, IORING_OP_TIMEOUT, -1, URING_TICK);
+    sqe->addr = (uint64_t)(uintptr_t)&ring->tick;
+    sqe->len = 1;
+    ring->isTicking = true;
+}
+
+/**
+ * Unmaps and closes an io_uring instance, which cancels its operations.
+ */
+void closering(HttpRing* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing) munmap(ring->sqRing, ring->sqRingSize);
+    if (ring->fd >= 0) close(ring->fd);
+    free(ring->buffers);
+    free(ring->freeBuffers);
+}
+
+/**
+ * Creates an io_uring instance and registers the listener and buffers.
+ *
+ * @return True if io_uring is available, false if not.
+ */
+bool openring(HttpRing* ring, int listener) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = HTTP_URING_ENTRIES * 2;
+    ring->fd = (int)syscall(__NR_io_uring_setup, HTTP_URING_ENTRIES, &params);
+    if (ring->fd < 0) return false;
+
+    // Kernels with a single mapping for both rings report its size as the
+    // larger of the two.
+    ring->sqRingSize =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool isSingleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (isSingleMapping && ring->cqRingSize > ring->sqRingSize) {
+        ring->sqRingSize = ring->cqRingSize;
+    }
+
+    void* sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        closering(ring);
+        return false;
+    }
+    ring->sqRing = sqRing;
+
+    void* cqRing = sqRing;
+    if (!isSingleMapping) {
+        cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            closering(ring);
+            return false;
+        }
+    }
+    ring->cqRing = cqRing;
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        closering(ring);
+        return false;
+    }
+    ring->sqes = (struct io_uring_sqe*)sqes;
+
+    char* sq = (char*)sqRing;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->tail = *ring->sqTail;
+
+    // Entry i of the queue is always submission i.
+    unsigned* array = (unsigned*)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) array[i] = i;
+
+    char* cq = (char*)cqRing;
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    ring->tick.tv_sec = 1;
+    ring->tick.tv_nsec = 0;
+
+    // Both registrations are optional: without them, the listener is used
+    // by descriptor and connections receive into buffers of their own.
+    ring->isListenerFixed = syscall(__NR_io_uring_register,
+        ring->fd, IORING_REGISTER_FILES, &listener, 1) == 0;
+
+    ring->buffers =
+        (char*)malloc((size_t)HTTP_URING_BUFFERS * HTTP_BUFFER_SIZE);
+    ring->freeBuffers = (int*)malloc(HTTP_URING_BUFFERS * sizeof(int));
+    if (ring->buffers && ring->freeBuffers) {
+        std::vector<struct iovec> iovecs(HTTP_URING_BUFFERS);
+        for (int i = 0; i < HTTP_URING_BUFFERS; i++) {
+            iovecs[i].iov_base = ring->buffers + (size_t)i * HTTP_BUFFER_SIZE;
+            iovecs[i].iov_len = HTTP_BUFFER_SIZE;
+        }
+
+        if (syscall(__NR_io_uring_register, ring->fd,
+                IORING_REGISTER_BUFFERS, &iovecs[0], HTTP_URING_BUFFERS))
+        {
+            free(ring->buffers);
+            ring->buffers = NULL;
+        } else {
+            // Hand out low indexes first.
+            for (int i = HTTP_URING_BUFFERS - 1; i >= 0; i--) {
+                ring->freeBuffers[ring->freeCount++] = i;
+            }
+        }
+    }
+
+    return true;
+}
+#endif // CNEK_HTTP_IO_URING
+
+} // namespace
+#endif // __linux__
+
+HttpServer::HttpServer(const char* host, unsigned short port)
+    : listener(-1),
+      poller(-1),
+      isRunning(0),
+      emptyInput(NULL),
+      ring(NULL),
+      factory(NULL),
+      waiting(0),
+      drainDeadline(0)
+{
+#ifdef __linux__
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        throw invalid_argument("Invalid HTTP host '" + string(host) + "'.");
+    }
+
+    errno = 0;
+    this->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (this->listener < 0) {
+        string error = strerror(errno);
+        throw runtime_error("Failed to create HTTP socket: " + error + ".");
+    }
+
+    int enabled = 1;
+    setsockopt(
+        this->listener, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+    setsockopt(
+        this->listener, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled));
+
+    if (bind(this->listener, (struct sockaddr*)&address, sizeof(address))
+        || listen(this->listener, SOMAXCONN))
+    {
+        string error = strerror(errno);
+        ::close(this->listener);
+        throw runtime_error("Failed to listen on HTTP socket: " + error + ".");
+    }
+
+    this->initialize();
+#else
+    (void)host;
+    (void)port;
+    throw runtime_error("HTTP server is not supported on this platform.");
+#endif // __linux__
+}
+
+HttpServer::HttpServer(int listener)
+    : listener(listener),
+      poller(-1),
+      isRunning(0),
+      emptyInput(NULL),
+      ring(NULL),
+      factory(NULL),
+      waiting(0),
+      drainDeadline(0)
+{
+#ifdef __linux__
+    this->initialize();
+#else
+    throw runtime_error("HTTP server is not supported on this platform.");
+#endif // __linux__
+}
+
+void HttpServer::initialize() {
+#ifdef __linux__
+    fcntl(this->listener, F_SETFL, fcntl(this->listener, F_GETFL) | O_NONBLOCK);
+
+    errno = 0;
+    this->poller = epoll_create1(EPOLL_CLOEXEC);
+    this->emptyInput = fopen("/dev/null", "rb");
+    if (this->poller < 0 || !this->emptyInput) {
+        string error = strerror(errno);
+        if (this->poller >= 0) ::close(this->poller);
+        if (this->emptyInput) fclose(this->emptyInput);
+        ::close(this->listener);
+        throw runtime_error("Failed to create HTTP event loop: " + error + ".");
+    }
+
+    watchlistener(this->poller, this->listener);
+#endif // __linux__
+}
+
+void HttpServer::setIoUring(bool enabled) {
+#ifdef CNEK_HTTP_IO_URING
+    if (enabled && !this->ring) {
+        HttpRing* ring = new HttpRing();
+        if (openring(ring, this->listener)) this->ring = ring;
+        else delete ring;
+    } else if (!enabled && this->ring) {
+        closering(this->ring);
+        delete this->ring;
+        this->ring = NULL;
+    }
+#else
+    (void)enabled;
+#endif // CNEK_HTTP_IO_URING
+}
+
+bool HttpServer::isIoUring() {
+    return this->ring != NULL;
+}
+
+void HttpServer::serve(Handler handler) {
+    this->factory = NULL;
+    this->run(handler);
+}
+
+void HttpServer::serve(AsyncHandlerFactory factory) {
+    this->factory = factory;
+    this->run(NULL);
+}
+
+void HttpServer::run(Handler handler) {
+#ifdef CNEK_HTTP_IO_URING
+    if (this->ring) {
+        this->serveRing(handler);
+        return;
+    }
+#endif // CNEK_HTTP_IO_URING
+
+#ifdef __linux__
+    struct epoll_event events[HTTP_MAX_EVENTS];
+    time_t lastExpired = time(NULL);
+    bool isAccepting = true;
+
+    this->isRunning = 1;
+    while (true) {
+        // Stop accepting, then answer the requests already received and
+        // resume waiting handlers until they respond.
+        if (!this->isRunning) {
+            if (isAccepting) {
+                epoll_ctl(this->poller, EPOLL_CTL_DEL, this->listener, NULL);
+                isAccepting = false;
+                this->drainDeadline = time(NULL) + HTTP_DRAIN_TIMEOUT;
+            }
+            if (this->closeIdle()) break;
+        }
+
+        // Wake up at least every second to close idle connections, or when
+        // the first delay is over.
+        int timeout = 1000;
+        if (!this->timers.empty()) {
+            uint64_t now = monotonic();
+            uint64_t deadline = this->timers.begin()->first;
+            if (deadline <= now) timeout = 0;
+            else if (deadline - now < 1000) timeout = (int)(deadline - now);
+        }
+
+        errno = 0;
+        int count = epoll_wait(this->poller, events, HTTP_MAX_EVENTS, timeout);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            string error = strerror(errno);
+            if (!isAccepting) watchlistener(this->poller, this->listener);
+            throw runtime_error(
+                "Failed to wait for HTTP events: " + error + ".");
+        }
+
+        for (int i = 0; i < count; i++) {
+            // A descriptor a handler waits for became ready.
+            if (events[i].data.u64 & 1) {
+                HttpConnection* connection = (HttpConnection*)(uintptr_t)
+                    (events[i].data.u64 & ~(uint64_t)1);
+                epoll_ctl(
+                    this->poller, EPOLL_CTL_DEL, connection->task->fd, NULL);
+                this->wake(connection, 0);
+                this->process(connection, handler);
+                continue;
+            }
+
+            HttpConnection* connection = (HttpConnection*)events[i].data.ptr;
+            if (connection && connection->fd < 0) {
+                continue;
+            } else if (!connection) {
+                this->acceptAll();
+            } else if (connection->isReading) {
+                this->receive(connection, handler);
+            } else {
+                this->flush(connection);
+
+                // Handle requests that were pipelined behind the output.
+                if (connection->fd >= 0 && connection->isReading) {
+                    this->process(connection, handler);
+                }
+            }
+        }
+
+        // Resume the handlers whose delay is over. Those that wait again
+        // are resumed on the next iteration at the earliest.
+        if (!this->timers.empty()) {
+            uint64_t now = monotonic();
+            std::vector<HttpConnection*> due;
+            while (!this->timers.empty()
+                && this->timers.begin()->first <= now)
+            {
+                due.push_back(this->timers.begin()->second);
+                this->timers.erase(this->timers.begin());
+            }
+            for (size_t i = 0; i < due.size(); i++) {
+                this->wake(due[i], 0);
+                this->process(due[i], handler);
+            }
+        }
+
+        time_t now = time(NULL);
+        if (now != lastExpired) {
+            this->expire();
+            lastExpired = now;
+        }
+
+        // Connections closed while handling the batch are freed after it,
+        // since later events of the batch may still point to them.
+        for (size_t i = 0; i < this->closed.size(); i++) {
+            delete this->closed[i];
+        }
+        this->closed.clear();
+    }
+
+    for (size_t i = 0; i < this->closed.size(); i++) {
+        delete this->closed[i];
+    }
+    this->closed.clear();
+
+    if (!isAccepting) watchlistener(this->poller, this->listener);
+#else
+    (void)handler;
+#endif // __linux__
+}
+
+void HttpServer::stop() {
+    this->isRunning = 0;
+}
+
+void HttpServer::serveRing(Handler handler) {
+#ifdef CNEK_HTTP_IO_URING
+    HttpRing* ring = this->ring;
+    bool isStopping = false;
+
+    this->isRunning = 1;
+    armaccept(ring, this->listener);
+    if (!ring->isTicking) armtick(ring);
+
+    while (true) {
+        // Stop accepting, then answer the requests already received and
+        // resume waiting handlers until they respond.
+        if (!this->isRunning && !isStopping) {
+            isStopping = true;
+            if (ring->isAccepting) {
+                struct io_uring_sqe* sqe = prepare(
+                    ring, IORING_OP_ASYNC_CANCEL, -1, URING_CANCEL);
+                sqe->addr = URING_ACCEPT;
+            }
+            this->drainDeadline = time(NULL) + HTTP_DRAIN_TIMEOUT;
+            this->closeIdle();
+        }
+
+        if (isStopping && !ring->isAccepting) {
+            size_t i = 0;
+            while (i < this->connections.size() && !this->connections[i]) i++;
+            if (i == this->connections.size()) break;
+        }
+
+        // Submit what the previous batch queued and wait for completions,
+        // in one system call.
+        errno = 0;
+        if (enterring(ring, 1) < 0 && errno != EINTR) {
+            string error = strerror(errno);
+            closering(ring);
+            delete ring;
+            this->ring = NULL;
+            for (size_t i = 0; i < this->connections.size(); i++) {
+                if (this->connections[i]) this->connections[i]->isBusy = false;
+            }
+            throw runtime_error(
+                "Failed to wait for HTTP events: " + error + ".");
+        }
+
+        unsigned head = *ring->cqHead;
+        unsigned tail = *(volatile unsigned*)ring->cqTail;
+        __sync_synchronize();
+        while (head != tail) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+            uint64_t userData = cqe->user_data;
+            int result = cqe->res;
+
+            // Free the entry before handling it, which may wait for more.
+            head++;
+            __sync_synchronize();
+            *(volatile unsigned*)ring->cqHead = head;
+
+            if (userData == URING_ACCEPT) {
+                ring->isAccepting = false;
+                this->acceptRing(result);
+            } else if (userData == URING_TICK) {
+                ring->isTicking = false;
+                this->expire();
+                if (isStopping) this->closeIdle();
+                armtick(ring);
+            } else if (userData == URING_CANCEL) {
+                // Nothing to do.
+            } else if (userData & 1) {
+                // An operation a handler waits for completed. Timeouts end
+                // with -ETIME and polls with the events that are ready.
+                HttpConnection* connection =
+                    (HttpConnection*)(uintptr_t)(userData & ~(uint64_t)1);
+                if (result == -ETIME || result > 0) {
+                    if (connection->task->wait != ASYNC_READ) result = 0;
+                }
+                this->wake(connection, result);
+                while (!connection->isClosing
+                    && this->respond(connection, handler)) {}
+                if (!connection->isBusy) this->arm(connection);
+            } else {
+                HttpConnection* connection =
+                    (HttpConnection*)(uintptr_t)userData;
+                this->complete(connection, result, handler);
+            }
+
+            if (head == tail) {
+                tail = *(volatile unsigned*)ring->cqTail;
+                __sync_synchronize();
+            }
+        }
+
+        for (size_t i = 0; i < this->closed.size(); i++) {
+            delete this->closed[i];
+        }
+        this->closed.clear();
+    }
+#else
+    (void)handler;
+#endif // CNEK_HTTP_IO_URING
+}
+
+void HttpServer::acceptRing(int result) {
+#ifdef CNEK_HTTP_IO_URING
+    HttpRing* ring = this->ring;
+
+    // Out of descriptors or memory: retry on the next tick rather than
+    // failing again right away.
+    if (result < 0) {
+        if (this->isRunning
+            && (result == -EINTR
+                || result == -ECONNABORTED
+                || result == -EAGAIN))
+        {
+            armaccept(ring, this->listener);
+        }
+        return;
+    }
+    if (this->isRunning) armaccept(ring, this->listener);
+
+    int fd = result;
+    if (!this->isRunning) {
+        ::close(fd);
+        return;
+    }
+
+    int enabled = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+
+    HttpConnection* connection = new HttpConnection();
+    connection->fd = fd;
+    connection->written = 0;
+    connection->lastActive = time(NULL);
+    connection->isClosing = false;
+    connection->isContinued = false;
+    connection->isReading = true;
+    strcpy(connection->remoteAddress, "REMOTE_ADDR=");
+    if (ring->address.sin_family == AF_INET) {
+        inet_ntop(AF_INET,
+                  &ring->address.sin_addr,
+                  connection->remoteAddress + 12,
+                  sizeof(connection->remoteAddress) - 12);
+    }
+
+    // Receive into a registered buffer while there are some left.
+    if (ring->freeCount) {
+        connection->bufferIndex = ring->freeBuffers[--ring->freeCount];
+        connection->buffer =
+            ring->buffers + (size_t)connection->bufferIndex * HTTP_BUFFER_SIZE;
+    } else {
+        connection->bufferIndex = -1;
+        connection->buffer = new char[HTTP_BUFFER_SIZE];
+    }
+
+    if ((size_t)fd >= this->connections.size()) {
+        this->connections.resize(fd + 1, NULL);
+    }
+    this->connections[fd] = connection;
+    this->arm(connection);
+#else
+    (void)result;
+#endif // CNEK_HTTP_IO_URING
+}
+
+void HttpServer::complete(
+    HttpConnection* connection,
+    int result,
+    Handler handler)
+{
+#ifdef CNEK_HTTP_IO_URING
+    connection->isBusy = false;
+
+    if (connection->isReading) {
+        if (result > 0) {
+            connection->input.append(connection->buffer, result);
+            connection->lastActive = time(NULL);
+            while (!connection->isClosing
+                && this->respond(connection, handler)) {}
+        } else if (result == -EINTR || result == -EAGAIN) {
+            // Receive again.
+        } else if (!result) {
+            // Closed by the client: send what is pending, then close.
+            connection->input.clear();
+            connection->isClosing = true;
+        } else {
+            this->drop(connection);
+            return;
+        }
+    } else {
+        if (result > 0) {
+            connection->written += result;
+            connection->lastActive = time(NULL);
+        } else if (result != -EINTR && result != -EAGAIN) {
+            this->drop(connection);
+            return;
+        }
+
+        // Handle requests that were pipelined behind the output.
+        if (connection->written == connection->output.size()) {
+            connection->output.clear();
+            connection->written = 0;
+            while (!connection->isClosing
+                && this->respond(connection, handler)) {}
+        }
+    }
+
+    this->arm(connection);
+#else
+    (void)connection;
+    (void)result;
+    (void)handler;
+#endif // CNEK_HTTP_IO_URING
+}
+
+void HttpServer::arm(HttpConnection* connection) {
+#ifdef CNEK_HTTP_IO_URING
+    HttpRing* ring = this->ring;
+    uint64_t userData = (uint64_t)(uintptr_t)connection;
+
+    // Send pending output first, then close or receive the next request.
+    if (connection->written < connection->output.size()) {
+        struct io_uring_sqe* sqe =
+            prepare(ring, IORING_OP_SEND, connection->fd, userData);
+        const char* data = connection->output.data() + connection->written;
+        sqe->addr = (uint64_t)(uintptr_t)data;
+        sqe->len = connection->output.size() - connection->written;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        connection->isReading = false;
+    } else if (connection->task) {
+        // Receive no more until the handler responds.
+        return;
+    } else if (connection->isClosing) {
+        this->drop(connection);
+        return;
+    } else if (connection->bufferIndex >= 0) {
+        struct io_uring_sqe* sqe =
+            prepare(ring, IORING_OP_READ_FIXED, connection->fd, userData);
+        sqe->addr = (uint64_t)(uintptr_t)connection->buffer;
+        sqe->len = HTTP_BUFFER_SIZE;
+        sqe->buf_index = connection->bufferIndex;
+        sqe->off = (uint64_t)-1;
+        connection->isReading = true;
+    } else {
+        struct io_uring_sqe* sqe =
+            prepare(ring, IORING_OP_RECV, connection->fd, userData);
+        sqe->addr = (uint64_t)(uintptr_t)connection->buffer;
+        sqe->len = HTTP_BUFFER_SIZE;
+        connection->isReading = true;
+    }
+    connection->isBusy = true;
+#else
+    (void)connection;
+#endif // CNEK_HTTP_IO_URING
+}
+
+void HttpServer::acceptAll() {
+#ifdef __linux__
+    while (true) {
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        int fd = accept4(
+            this->listener,
+            (struct sockaddr*)&address,
+            &length,
+            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+
+            // EAGAIN when every pending connection was accepted; out of
+            // descriptors or memory otherwise, so retry on the next event.
+            return;
+        }
+
+        // Responses are written at once, so do not delay small ones.
+        int enabled = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+
+        HttpConnection* connection = new HttpConnection();
+        connection->fd = fd;
+        connection->written = 0;
+        connection->lastActive = time(NULL);
+        connection->isClosing = false;
+        connection->isContinued = false;
+        connection->isReading = true;
+        connection->events = EPOLLIN;
+        connection->bufferIndex = -1;
+        strcpy(connection->remoteAddress, "REMOTE_ADDR=");
+        if (address.sin_family == AF_INET) {
+            inet_ntop(AF_INET,
+                      &address.sin_addr,
+                      connection->remoteAddress + 12,
+                      sizeof(connection->remoteAddress) - 12);
+        }
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        if (epoll_ctl(this->poller, EPOLL_CTL_ADD, fd, &event)) {
+            ::close(fd);
+            delete connection;
+            continue;
+        }
+
+        if ((size_t)fd >= this->connections.size()) {
+            this->connections.resize(fd + 1, NULL);
+        }
+        this->connections[fd] = connection;
+    }
+#endif // __linux__
+}
+
+void HttpServer::receive(HttpConnection* connection, Handler handler) {
+#ifdef __linux__
+    char buffer[HTTP_BUFFER_SIZE];
+    bool isEnded = false;
+
+    // Read what is available, but no more than a whole request may take.
+    while (connection->input.size()
+        <= (size_t)MAX_HTTP_HEADER_SIZE + MAX_REQUEST_BODY_SIZE)
+    {
+        ssize_t bytesRead = ::read(connection->fd, buffer, sizeof(buffer));
+        if (bytesRead > 0) {
+            connection->input.append(buffer, bytesRead);
+            continue;
+        }
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // Closed by the client, or failed.
+        isEnded = true;
+        break;
+    }
+
+    connection->lastActive = time(NULL);
+    this->process(connection, handler);
+
+    // Answer what was received, then close, since no more can arrive.
+    if (isEnded && connection->fd >= 0) {
+        connection->isClosing = true;
+        this->flush(connection);
+    }
+#else
+    (void)connection;
+    (void)handler;
+#endif // __linux__
+}
+
+void HttpServer::process(HttpConnection* connection, Handler handler) {
+    while (!connection->isClosing && this->respond(connection, handler)) {}
+    this->flush(connection);
+}
+
+bool HttpServer::respond(HttpConnection* connection, Handler handler) {
+#ifdef __linux__
+    // Requests pipelined behind one whose handler waits are handled once it
+    // responds.
+    if (connection->task) return false;
+
+    string& input = connection->input;
+    HttpRequestHead head;
+    int headLength = HttpParser::parseRequest(input.data(), input.size(), &head);
+    if (!headLength) {
+        if (input.size() > MAX_HTTP_HEADER_SIZE) {
+            fail(connection, "431 Request Header Fields Too Large");
+        }
+        return false;
+    }
+    if (headLength < 0) {
+        fail(connection, "400 Bad Request");
+        return false;
+    }
+    if (headLength > MAX_HTTP_HEADER_SIZE) {
+        fail(connection, "431 Request Header Fields Too Large");
+        return false;
+    }
+    if (head.majorVersion != 1) {
+        fail(connection, "505 HTTP Version Not Supported");
+        return false;
+    }
+
+    bool isKeepAlive = head.minorVersion >= 1;
+    bool isExpectingContinue = false;
+    bool hasContentLength = false;
+    size_t contentLength = 0;
+    for (size_t i = 0; i < head.headerCount; i++) {
+        const HttpHeaderSlice& header = head.headers[i];
+
+        if (sliceequals(header.name, "Content-Length")) {
+            size_t length = 0;
+            if (!parselength(header.value, &length)
+                || (hasContentLength && length != contentLength))
+            {
+                fail(connection, "400 Bad Request");
+                return false;
+            }
+            contentLength = length;
+            hasContentLength = true;
+        } else if (sliceequals(header.name, "Transfer-Encoding")) {
+            fail(connection, "501 Not Implemented");
+            return false;
+        } else if (sliceequals(header.name, "Connection")) {
+            if (hastoken(header.value, "close")) isKeepAlive = false;
+            else if (hastoken(header.value, "keep-alive")) isKeepAlive = true;
+        } else if (sliceequals(header.name, "Expect")) {
+            isExpectingContinue = hastoken(header.value, "100-continue");
+        }
+    }
+
+    if (contentLength > MAX_REQUEST_BODY_SIZE) {
+        fail(connection, "413 Content Too Large");
+        return false;
+    }
+
+    // Wait for the body, asking the client to send it if it waits to be told.
+    size_t bodyStart = headLength;
+    if (input.size() - bodyStart < contentLength) {
+        if (isExpectingContinue && !connection->isContinued) {
+            connection->output += "HTTP/1.1 100 Continue\r\n\r\n";
+            connection->isContinued = true;
+        }
+        return false;
+    }
+
+    char* serverParams[] = {connection->remoteAddress, NULL};
+
+    FILE* body = this->emptyInput;
+    if (contentLength) {
+        body = fmemopen(&input[bodyStart], contentLength, "rb");
+    } else {
+        clearerr(body);
+    }
+    if (!body) {
+        fail(connection, "500 Internal Server Error");
+        return false;
+    }
+
+    Cnek* cnek = NULL;
+    ServerRequest* request = NULL;
+    try {
+        cnek = new Cnek();
+        cnek->setHttpResponse(true);
+        request = cnek->getServerRequest(head, serverParams, body);
+    } catch (std::exception& e) {
+        fprintf(stderr, "HTTP request failed: %s\n", e.what());
+    }
+    if (body != this->emptyInput) fclose(body);
+
+    if (!request) {
+        delete cnek;
+        fail(connection, "400 Bad Request");
+        return false;
+    }
+
+    // The body was copied into the request, so the input MAY be received
+    // over while its handler waits.
+    input.erase(0, bodyStart + contentLength);
+    connection->isContinued = false;
+    connection->isKeepAlive = isKeepAlive;
+    connection->isHttp10 = !head.minorVersion;
+    connection->cnek = cnek;
+    connection->request = request;
+
+    if (!this->factory) {
+        Response* response = NULL;
+        try {
+            response = handler(*cnek, request);
+        } catch (std::exception& e) {
+            fprintf(stderr, "HTTP request failed: %s\n", e.what());
+        }
+        return this->finish(connection, response);
+    }
+
+    try {
+        connection->task = this->factory();
+    } catch (std::exception& e) {
+        fprintf(stderr, "HTTP request failed: %s\n", e.what());
+    }
+    if (!connection->task) return this->finish(connection, NULL);
+    return this->resume(connection);
+#else
+    (void)connection;
+    (void)handler;
+    return false;
+#endif // __linux__
+}
+
+bool HttpServer::resume(HttpConnection* connection) {
+    AsyncHandler* task = connection->task;
+    while (true) {
+        Response* response = NULL;
+        task->wait = ASYNC_NONE;
+        try {
+            response = task->run(*connection->cnek, connection->request);
+        } catch (std::exception& e) {
+            fprintf(stderr, "HTTP request failed: %s\n", e.what());
+            return this->finish(connection, NULL);
+        }
+
+        // Returning NULL without awaiting is a failure of the handler.
+        if (response || task->wait == ASYNC_NONE) {
+            return this->finish(connection, response);
+        }
+
+        // Operations done without the loop resume the handler right away.
+        if (this->await(connection)) return false;
+    }
+}
+
+bool HttpServer::await(HttpConnection* connection) {
+    AsyncHandler* task = connection->task;
+
+#ifdef CNEK_HTTP_IO_URING
+    if (this->ring) {
+        struct io_uring_sqe* sqe = NULL;
+        uint64_t userData = waittag(connection);
+        if (task->wait == ASYNC_DELAY) {
+            connection->delay.tv_sec = task->milliseconds / 1000;
+            connection->delay.tv_nsec = task->milliseconds % 1000 * 1000000;
+            sqe = prepare(this->ring, IORING_OP_TIMEOUT, -1, userData);
+            sqe->addr = (uint64_t)(uintptr_t)&connection->delay;
+            sqe->len = 1;
+        } else if (task->wait == ASYNC_READ) {
+            sqe = prepare(this->ring, IORING_OP_READ, task->fd, userData);
+            sqe->addr = (uint64_t)(uintptr_t)task->buffer;
+            sqe->len = task->length;
+            sqe->off = task->offset;
+        } else {
+            sqe = prepare(this->ring, IORING_OP_POLL_ADD, task->fd, userData);
+            sqe->poll_events = task->wait == ASYNC_READABLE ? POLLIN : POLLOUT;
+        }
+        this->waiting++;
+        return true;
+    }
+#endif // CNEK_HTTP_IO_URING
+
+#ifdef __linux__
+    // Regular files are always ready for epoll, so are read right away.
+    if (task->wait == ASYNC_READ) {
+        ssize_t bytesRead = 0;
+        do {
+            errno = 0;
+            bytesRead =
+                pread(task->fd, task->buffer, task->length, task->offset);
+        } while (bytesRead < 0 && errno == EINTR);
+        task->result = bytesRead < 0 ? -errno : bytesRead;
+        return false;
+    }
+
+    if (task->wait == ASYNC_DELAY) {
+        this->timers.insert(std::make_pair(
+            monotonic() + task->milliseconds, connection));
+    } else {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = task->wait == ASYNC_READABLE ? EPOLLIN : EPOLLOUT;
+        event.data.u64 = waittag(connection);
+        if (epoll_ctl(this->poller, EPOLL_CTL_ADD, task->fd, &event)) {
+            task->result = -errno;
+            return false;
+        }
+    }
+    this->waiting++;
+    return true;
+#else
+    (void)task;
+    return false;
+#endif // __linux__
+}
+
+void HttpServer::wake(HttpConnection* connection, long result) {
+    this->waiting--;
+    connection->task->result = result;
+    this->resume(connection);
+}
+
+bool HttpServer::finish(HttpConnection* connection, Response* response) {
+#ifdef __linux__
+    Cnek* cnek = connection->cnek;
+    bool isKeepAlive = connection->isKeepAlive;
+
+    // A stopping server closes the connection once the client sent nothing
+    // more to answer.
+    if (!this->isRunning
+        && connection->input.empty()
+        && !hasinput(connection->fd))
+    {
+        isKeepAlive = false;
+    }
+    delete connection->task;
+    connection->task = NULL;
+    connection->cnek = NULL;
+    connection->request = NULL;
+    connection->lastActive = time(NULL);
+
+    char* data = NULL;
+    size_t size = 0;
+    FILE* output = response ? open_memstream(&data, &size) : NULL;
+
+    bool isEmitted = false;
+    if (output) {
+        try {
+            // Without a seekable body, the length is unknown, so the end of
+            // the response is marked by closing the connection.
+            if (!response->getBody()->isSeekable()) isKeepAlive = false;
+
+            if (!isKeepAlive) response->setHeader("Connection", "close");
+            else if (connection->isHttp10) {
+                response->setHeader("Connection", "keep-alive");
+            }
+
+            cnek->emitResponse(response, output);
+            isEmitted = true;
+        } catch (std::exception& e) {
+            fprintf(stderr, "HTTP request failed: %s\n", e.what());
+        }
+    } else {
+        cnek->releaseResponse(response);
+    }
+
+    bool isWritten = output && !fclose(output);
+    delete cnek;
+
+    if (isEmitted && isWritten) {
+        connection->output.append(data, size);
+    } else {
+        fail(connection, "500 Internal Server Error");
+    }
+    free(data);
+
+    if (connection->isClosing) return false;
+
+    if (!isKeepAlive) {
+        connection->input.clear();
+        connection->isClosing = true;
+    }
+    return true;
+#else
+    (void)connection;
+    (void)response;
+    return false;
+#endif // __linux__
+}
+
+void HttpServer::flush(HttpConnection* connection) {
+#ifdef __linux__
+    if (connection->fd < 0) return;
+
+    string& output = connection->output;
+    while (connection->written < output.size()) {
+        ssize_t bytesWritten = send(
+            connection->fd,
+            output.data() + connection->written,
+            output.size() - connection->written,
+            MSG_NOSIGNAL);
+        if (bytesWritten > 0) {
+            connection->written += bytesWritten;
+            continue;
+        }
+        if (bytesWritten < 0 && errno == EINTR) continue;
+        if (bytesWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Stop reading requests until the client reads the responses.
+            watch(this->poller, connection, EPOLLOUT);
+            return;
+        }
+
+        this->drop(connection);
+        return;
+    }
+
+    output.clear();
+    connection->written = 0;
+    connection->lastActive = time(NULL);
+
+    // While a handler waits, receive no more until it responds.
+    if (connection->isClosing && !connection->task) {
+        this->drop(connection);
+        return;
+    }
+    watch(this->poller, connection, connection->task ? 0 : (uint32_t)EPOLLIN);
+#else
+    (void)connection;
+#endif // __linux__
+}
+
+void HttpServer::drop(HttpConnection* connection) {
+#ifdef __linux__
+    if (connection->fd < 0) return;
+
+    // An io_uring operation still uses the connection: shutting the socket
+    // down completes it, and the connection is dropped then.
+    if (connection->isBusy) {
+        shutdown(connection->fd, SHUT_RDWR);
+        connection->isClosing = true;
+        return;
+    }
+
+    // A handler waits: the connection is dropped once it responds.
+    if (connection->task) {
+        connection->isClosing = true;
+        return;
+    }
+
+#ifdef CNEK_HTTP_IO_URING
+    if (connection->bufferIndex >= 0) {
+        // Registered buffers are gone with a ring that failed.
+        if (this->ring) {
+            this->ring->freeBuffers[this->ring->freeCount++] =
+                connection->bufferIndex;
+        }
+    } else {
+        delete[] connection->buffer;
+    }
+    connection->buffer = NULL;
+#endif // CNEK_HTTP_IO_URING
+
+    // Closing removes the descriptor from the epoll set. The connection is
+    // freed by serve() after the current batch of events.
+    this->connections[connection->fd] = NULL;
+    this->closed.push_back(connection);
+    ::close(connection->fd);
+    connection->fd = -1;
+#else
+    (void)connection;
+#endif // __linux__
+}
+
+bool HttpServer::closeIdle() {
+#ifdef __linux__
+    bool isExpired = time(NULL) >= this->drainDeadline;
+    bool isDrained = true;
+    for (size_t i = 0; i < this->connections.size(); i++) {
+        HttpConnection* connection = this->connections[i];
+        if (!connection) continue;
+
+        // Connections with a request being received, a response being sent
+        // or a handler waiting are kept until the deadline; handlers are
+        // still resumed after it.
+        bool isIdle = !connection->task
+            && connection->written == connection->output.size()
+            && connection->input.empty()
+            && !hasinput(connection->fd);
+        if (!isIdle && (!isExpired || connection->task)) {
+            isDrained = false;
+            continue;
+        }
+
+#ifdef CNEK_HTTP_IO_URING
+        // Cancel the receive rather than shut the socket down, so a request
+        // that completes it first is still answered.
+        if (isIdle && connection->isBusy && this->ring) {
+            struct io_uring_sqe* sqe = prepare(
+                this->ring, IORING_OP_ASYNC_CANCEL, -1, URING_CANCEL);
+            sqe->addr = (uint64_t)(uintptr_t)connection;
+            isDrained = false;
+            continue;
+        }
+#endif // CNEK_HTTP_IO_URING
+
+        this->drop(connection);
+        if (this->connections[i]) isDrained = false;
+    }
+    return isDrained;
+#else
+    return true;
+#endif // __linux__
+}
+
+void HttpServer::expire() {
+    time_t now = time(NULL);
+    for (size_t i = 0; i < this->connections.size(); i++) {
+        HttpConnection* connection = this->connections[i];
+        if (!connection || connection->task) continue;
+        if (now - connection->lastActive < HTTP_IDLE_TIMEOUT) continue;
+
+        this->drop(connection);
+    }
+}
+
+HttpServer::~HttpServer() {
+    for (size_t i = 0; i < this->connections.size(); i++) {
+        HttpConnection* connection = this->connections[i];
+        if (!connection) continue;
+
+        // Handlers still waiting, e.g. after serve() failed, are abandoned.
+        delete connection->task;
+        connection->task = NULL;
+        this->drop(connection);
+    }
+    for (size_t i = 0; i < this->closed.size(); i++) {
+        delete this->closed[i];
+    }
+
+#ifdef CNEK_HTTP_IO_URING
+    this->setIoUring(false);
+#endif // CNEK_HTTP_IO_URING
+
+#ifdef __linux__
+    if (this->poller >= 0) ::close(this->poller);
+    if (this->listener >= 0) ::close(this->listener);
+#endif // __linux__
+    if (this->emptyInput) fclose(this->emptyInput);
+}
+
+} // Cnek
@@ -0,0 +1,376 @@
+#include "JsonWriter.hpp"
+#include "../Csr/Http/Message/Shared.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+#if defined(__SSE2__) && !defined(CSR_NO_SIMD)
+#define CNEK_JSON_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ && !CSR_NO_SIMD
+
+namespace Cnek {
+
+using Csr::Http::Message::Stream;
+using Csr::Http::Message::lowestbit;
+
+using std::runtime_error;
+
+namespace {
+
+const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17
+};
+
+// Doubles below 2^53 in magnitude hold every integer exactly.
+const double maxExactInteger = 9007199254740992.0;
+
+/**
+ * Finds the next byte of a string that must be escaped: a control
+ * character, a quote or a backslash.
+ *
+ * @return Pointer to the byte, or `end` if there is none.
+ */
+inline const char* scanstring(const char* p, const char* end) {
+#ifdef CNEK_JSON_SSE2
+    const __m128i control = _mm_set1_epi8(0x1f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+
+        // Unsigned bytes <= 0x1f equal their minimum with 0x1f.
+        __m128i stops = _mm_or_si128(
+            _mm_cmpeq_epi8(_mm_min_epu8(bytes, control), bytes),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, quote),
+                         _mm_cmpeq_epi8(bytes, backslash)));
+        int mask = _mm_movemask_epi8(stops);
+        if (mask) return p + lowestbit(mask);
+        p += 16;
+    }
+#endif // CNEK_JSON_SSE2
+
+    while (p < end && (unsigned char)*p >= 0x20 && *p != '"' && *p != '\\') {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Formats an unsigned integer two digits at a time, backwards from `end`.
+ *
+ * @return Pointer to the first digit.
+ */
+inline char* formatdigits(uint64_t value, char* end) {
+    while (value >= 100) {
+        const char* pair = digitPairs + (value % 100) * 2;
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        const char* pair = digitPairs + value * 2;
+        *--end = pair[1];
+        *--end = pair[0];
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+/**
+ * Formats a double with the fewest significant digits that read back as
+ * the same double.
+ *
+ * Integers and numbers with few decimals are formatted exactly from an
+ * integer: if n / 10^k reads back as the value for the smallest k, the
+ * digits of n with k decimals are the shortest. Other numbers are very
+ * large or small, and take the fewest significant digits that read back,
+ * found by a binary search from 1 to 17 digits.
+ *
+ * @param value Finite number.
+ * @param number Buffer of at least 32 bytes.
+ * @return Number of bytes written.
+ */
+size_t formatnumber(double value, char* number) {
+    double magnitude = value < 0 ? -value : value;
+    bool isNegative = value < 0;
+
+    for (int decimals = 0; decimals <= 17; decimals++) {
+        double scaled = magnitude * powersOf10[decimals];
+        if (scaled >= maxExactInteger) break;
+
+        uint64_t integer = (uint64_t)(scaled + 0.5);
+        if ((double)integer / powersOf10[decimals] != magnitude) continue;
+
+        char digits[24];
+        char* end = digits + sizeof(digits);
+        char* start = formatdigits(integer, end);
+        while (end - start <= decimals) *--start = '0';
+
+        char* p = number;
+        if (isNegative && integer) *p++ = '-';
+        size_t wholeLength = end - start - decimals;
+        memcpy(p, start, wholeLength);
+        p += wholeLength;
+        if (decimals) {
+            *p++ = '.';
+            memcpy(p, start + wholeLength, decimals);
+            p += decimals;
+        }
+        return p - number;
+    }
+
+    // 17 significant digits always read back.
+    int low = 1;
+    int high = 17;
+    while (low < high) {
+        int precision = (low + high) / 2;
+        snprintf(number, 32, "%.*g", precision, value);
+        if (strtod(number, NULL) == value) high = precision;
+        else low = precision + 1;
+    }
+    int length = snprintf(number, 32, "%.*g", low, value);
+
+    // Locales MAY use a decimal comma, which JSON does not allow.
+    for (int i = 0; i < length; i++) {
+        if (number[i] == ',') number[i] = '.';
+    }
+    return length;
+}
+
+} // namespace
+
+JsonWriter::JsonWriter(Stream* stream)
+    : stream(stream),
+      length(0),
+      depth(0),
+      isFirst(true),
+      isKeyed(false),
+      isComplete(false)
+{}
+
+void JsonWriter::append(const char* data, size_t length) {
+    if (length > BUFFER_SIZE - this->length) {
+        this->flush();
+        if (length >= BUFFER_SIZE) {
+            this->stream->write(data, length);
+            return;
+        }
+    }
+    memcpy(this->buffer + this->length, data, length);
+    this->length += length;
+}
+
+void JsonWriter::appendString(const char* value, size_t length) {
+    const char* hex = "0123456789abcdef";
+    const char* end = value + length;
+
+    this->append("\"", 1);
+    while (true) {
+        const char* stop = scanstring(value, end);
+        this->append(value, stop - value);
+        if (stop == end) break;
+
+        char escape[6] = {'\\', *stop, '0', '0', '0', '0'};
+        size_t escapeLength = 2;
+        switch (*stop) {
+            case '"': case '\\': break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[4] = hex[(unsigned char)*stop >> 4];
+                escape[5] = hex[*stop & 0x0f];
+                escapeLength = 6;
+        }
+        this->append(escape, escapeLength);
+        value = stop + 1;
+    }
+    this->append("\"", 1);
+}
+
+void JsonWriter::beginValue() {
+    if (!this->depth) {
+        if (this->isComplete) {
+            throw runtime_error("JSON document is already complete.");
+        }
+        return;
+    }
+
+    if (this->isObject[this->depth - 1]) {
+        if (!this->isKeyed) {
+            throw runtime_error("JSON object value written without a key.");
+        }
+        this->isKeyed = false;
+        return;
+    }
+
+    if (!this->isFirst) this->append(",", 1);
+    this->isFirst = false;
+}
+
+void JsonWriter::endValue() {
+    if (this->depth) return;
+    this->isComplete = true;
+    this->flush();
+}
+
+void JsonWriter::beginObject() {
+    if (this->depth >= MAX_DEPTH) {
+        throw runtime_error("JSON is nested deeper than MAX_DEPTH.");
+    }
+    this->beginValue();
+    this->isObject[this->depth++] = true;
+    this->isFirst = true;
+    this->append("{", 1);
+}
+
+void JsonWriter::endObject() {
+    if (!this->depth || !this->isObject[this->depth - 1] || this->isKeyed) {
+        throw runtime_error("Unexpected end of JSON object.");
+    }
+    this->depth--;
+    this->isFirst = false;
+    this->append("}", 1);
+    this->endValue();
+}
+
+void JsonWriter::beginArray() {
+    if (this->depth >= MAX_DEPTH) {
+        throw runtime_error("JSON is nested deeper than MAX_DEPTH.");
+    }
+    this->beginValue();
+    this->isObject[this->depth++] = false;
+    this->isFirst = true;
+    this->append("[", 1);
+}
+
+void JsonWriter::endArray() {
+    if (!this->depth || this->isObject[this->depth - 1]) {
+        throw runtime_error("Unexpected end of JSON array.");
+    }
+    this->depth--;
+    this->isFirst = false;
+    this->append("]", 1);
+    this->endValue();
+}
+
+void JsonWriter::writeKey(const char* name) {
+    if (!this->depth || !this->isObject[this->depth - 1] || this->isKeyed) {
+        throw runtime_error("JSON key written outside an object.");
+    }
+    if (!this->isFirst) this->append(",", 1);
+    this->isFirst = false;
+    this->appendString(name ? name : "", name ? strlen(name) : 0);
+    this->append(":", 1);
+    this->isKeyed = true;
+}
+
+void JsonWriter::writeString(const char* value) {
+    if (!value) {
+        this->writeNull();
+        return;
+    }
+    this->writeString(value, strlen(value));
+}
+
+void JsonWriter::writeString(const char* value, size_t length) {
+    this->beginValue();
+    this->appendString(value, value ? length : 0);
+    this->endValue();
+}
+
+void JsonWriter::writeInteger(int64_t value) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    char* start = formatdigits(magnitude, end);
+    if (value < 0) *--start = '-';
+
+    this->beginValue();
+    this->append(start, end - start);
+    this->endValue();
+}
+
+void JsonWriter::writeUnsigned(uint64_t value) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* start = formatdigits(value, end);
+
+    this->beginValue();
+    this->append(start, end - start);
+    this->endValue();
+}
+
+void JsonWriter::writeNumber(double value) {
+    // NaN is not equal to itself, and infinity minus itself is NaN.
+    if (value != value || value - value != 0) {
+        this->writeNull();
+        return;
+    }
+
+    char number[32];
+    size_t length = formatnumber(value, number);
+
+    this->beginValue();
+    this->append(number, length);
+    this->endValue();
+}
+
+void JsonWriter::writeBool(bool value) {
+    this->beginValue();
+    if (value) this->append("true", 4);
+    else this->append("false", 5);
+    this->endValue();
+}
+
+void JsonWriter::writeNull() {
+    this->beginValue();
+    this->append("null", 4);
+    this->endValue();
+}
+
+void JsonWriter::flush() {
+    size_t length = this->length;
+    this->length = 0;
+    if (length) this->stream->write(this->buffer, length);
+}
+
+bool JsonWriter::isDone() {
+    return this->isComplete;
+}
+
+bool JsonWriter::isVectorized() {
+#ifdef CNEK_JSON_SSE2
+    return true;
+#else
+    return false;
+#endif // CNEK_JSON_SSE2
+}
+
+JsonWriter::~JsonWriter() {
+    try {
+        this->flush();
+    } catch (runtime_error&) {}
+}
+
+} // Cnek
@@ -0,0 +1,583 @@
+#include "LatencyStats.hpp"
+#include "Hash.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // _WIN32
+
+// Default number of series a latency stats file holds.
+#ifndef LATENCY_STATS_SERIES_COUNT
+#define LATENCY_STATS_SERIES_COUNT 256 // Default 256 series, about 1.8MB.
+#endif // LATENCY_STATS_SERIES_COUNT
+
+// Max number of bytes of the route of a latency series.
+#ifndef LATENCY_STATS_ROUTE_SIZE
+#define LATENCY_STATS_ROUTE_SIZE 64 // Default 64B.
+#endif // LATENCY_STATS_ROUTE_SIZE
+
+// Max number of bytes of the phase of a latency series.
+#ifndef LATENCY_STATS_PHASE_SIZE
+#define LATENCY_STATS_PHASE_SIZE 16 // Default 16B.
+#endif // LATENCY_STATS_PHASE_SIZE
+
+// Times to wait for another process to finish creating a series.
+#ifndef LATENCY_STATS_CLAIM_RETRIES
+#define LATENCY_STATS_CLAIM_RETRIES 1024 // Default 1024 retries.
+#endif // LATENCY_STATS_CLAIM_RETRIES
+
+namespace Cnek {
+
+using Csr::Http::Message::Response;
+
+using std::runtime_error;
+using std::string;
+
+namespace {
+
+const char statsMagic[8] = {'C', 'N', 'E', 'K', 'L', 'S', '0', '1'};
+
+/**
+ * Layout of the start of the stats file.
+ */
+struct StatsHeader {
+    char magic[8];
+    uint64_t seriesCount;
+    uint64_t routeSize;
+    uint64_t phaseSize;
+    uint64_t bucketCount;
+
+    // Latencies dropped for lack of room for their series.
+    uint64_t dropped;
+};
+
+/**
+ * States of a series in the stats file.
+ */
+enum SeriesState {
+    SERIES_EMPTY = 0,
+    SERIES_CLAIMED = 1,
+    SERIES_READY = 2
+};
+
+/**
+ * Layout of each series of the stats file.
+ */
+struct StatsSeries {
+    uint32_t state;
+    int32_t statusCode;
+    uint64_t keyHash;
+    char route[LATENCY_STATS_ROUTE_SIZE];
+    char phase[LATENCY_STATS_PHASE_SIZE];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t counts[LatencyHistogram::BUCKET_COUNT];
+};
+
+/**
+ * Full memory barrier, so a series key is written before it is published.
+ */
+inline void barrier() {
+#ifndef _WIN32
+    __sync_synchronize();
+#endif // _WIN32
+}
+
+inline uint32_t loadstate(StatsSeries* series) {
+    return *(volatile uint32_t*)&series->state;
+}
+
+inline uint64_t load64(uint64_t* value) {
+    return *(volatile uint64_t*)value;
+}
+
+inline void add64(uint64_t* counter, uint64_t value) {
+#ifndef _WIN32
+    __sync_fetch_and_add(counter, value);
+#else
+    *counter += value;
+#endif // _WIN32
+}
+
+/**
+ * Copies a string, truncated to fit a buffer.
+ */
+inline void copytruncated(char* buffer, size_t size, const char* value) {
+    size_t length = value ? strlen(value) : 0;
+    if (length >= size) length = size - 1;
+    memcpy(buffer, value, length);
+    buffer[length] = '\0';
+}
+
+/**
+ * Hashes the key of a series.
+ */
+inline uint64_t hashkey(const char* route, int statusCode, const char* phase) {
+    Hash hash;
+    hash.update(route, strlen(route) + 1);
+    hash.update(phase, strlen(phase) + 1);
+    int32_t status = statusCode;
+    hash.update(&status, sizeof(status));
+    return hash.digest();
+}
+
+/**
+ * Appends a Prometheus label value, escaping backslashes, quotes and
+ * newlines.
+ */
+inline void appendlabel(string& text, const char* value) {
+    for (const char* c = value; *c; c++) {
+        if (*c == '\\') text += "\\\\";
+        else if (*c == '"') text += "\\\"";
+        else if (*c == '\n') text += "\\n";
+        else text += *c;
+    }
+}
+
+/**
+ * Appends microseconds as seconds.
+ */
+inline void appendseconds(string& text, uint64_t microseconds) {
+    char value[32];
+    snprintf(value,
+             sizeof(value),
+             "%llu.%06llu",
+             (unsigned long long)(microseconds / 1000000),
+             (unsigned long long)(microseconds % 1000000));
+    text += value;
+}
+
+} // namespace
+
+/*******************************************************************************
+ * LatencyHistogram
+ ******************************************************************************/
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), max(0) {
+    memset(this->counts, 0, sizeof(this->counts));
+}
+
+size_t LatencyHistogram::getBucket(uint64_t microseconds) {
+    if (microseconds < SUB_BUCKET_COUNT) return (size_t)microseconds;
+    if (microseconds >> 32) return BUCKET_COUNT - 1;
+
+    // Index of the highest set bit, from 5 to 31.
+#ifdef __GNUC__
+    int highest = 31 - __builtin_clz((uint32_t)microseconds);
+#else
+    int highest = 5;
+    while (microseconds >> (highest + 1)) highest++;
+#endif // __GNUC__
+
+    // The 5 bits after the highest set bit pick one of 32 buckets of the
+    // power of two.
+    int shift = highest - 5;
+    return (shift + 1) * SUB_BUCKET_COUNT
+        + (size_t)((microseconds >> shift) - SUB_BUCKET_COUNT);
+}
+
+uint64_t LatencyHistogram::getBucketValue(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) return bucket;
+
+    int shift = (int)(bucket / SUB_BUCKET_COUNT) - 1;
+    uint64_t lowest =
+        (uint64_t)(SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t microseconds) {
+    this->counts[getBucket(microseconds)]++;
+    this->count++;
+    this->sum += microseconds;
+    if (microseconds > this->max) this->max = microseconds;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        this->counts[i] += other.counts[i];
+    }
+    this->count += other.count;
+    this->sum += other.sum;
+    if (other.max > this->max) this->max = other.max;
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const {
+    if (!this->count) return 0;
+    if (percentile > 100) percentile = 100;
+
+    // Rank of the value, from 1 to the count.
+    uint64_t rank = (uint64_t)(percentile / 100 * this->count + 0.999999);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += this->counts[i];
+        if (seen < rank) continue;
+
+        uint64_t value = getBucketValue(i);
+        return value < this->max ? value : this->max;
+    }
+    return this->max;
+}
+
+uint64_t LatencyHistogram::getCount() const {
+    return this->count;
+}
+
+uint64_t LatencyHistogram::getSum() const {
+    return this->sum;
+}
+
+uint64_t LatencyHistogram::getMax() const {
+    return this->max;
+}
+
+/*******************************************************************************
+ * LatencyStats
+ ******************************************************************************/
+LatencyStats::LatencyStats(const char* path, size_t seriesCount)
+    : file(-1),
+      memory(NULL),
+      mappedSize(0),
+      seriesCount(seriesCount ? seriesCount : LATENCY_STATS_SERIES_COUNT)
+{
+#ifndef _WIN32
+    if (!path) throw runtime_error("Cannot open latency stats without path.");
+
+    this->mappedSize =
+        sizeof(StatsHeader) + this->seriesCount * sizeof(StatsSeries);
+
+    errno = 0;
+    this->file = open(path, O_RDWR | O_CREAT, 0600);
+    if (this->file < 0) {
+        string error = strerror(errno);
+        string message = "Failed to open latency stats '" + string(path)
+            + "': " + error + ".";
+        throw runtime_error(message);
+    }
+
+    // Processes opening the file at once initialize it only once.
+    while (flock(this->file, LOCK_EX) == -1 && errno == EINTR) {}
+
+    struct stat info;
+    bool isValid = !fstat(this->file, &info)
+        && (size_t)info.st_size == this->mappedSize;
+
+    if (isValid) {
+        StatsHeader header;
+        isValid = pread(this->file, &header, sizeof(header), 0)
+                == (ssize_t)sizeof(header)
+            && !memcmp(header.magic, statsMagic, sizeof(statsMagic))
+            && header.seriesCount == this->seriesCount
+            && header.routeSize == LATENCY_STATS_ROUTE_SIZE
+            && header.phaseSize == LATENCY_STATS_PHASE_SIZE
+            && header.bucketCount == LatencyHistogram::BUCKET_COUNT;
+    }
+
+    if (!isValid) {
+        StatsHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, statsMagic, sizeof(statsMagic));
+        header.seriesCount = this->seriesCount;
+        header.routeSize = LATENCY_STATS_ROUTE_SIZE;
+        header.phaseSize = LATENCY_STATS_PHASE_SIZE;
+        header.bucketCount = LatencyHistogram::BUCKET_COUNT;
+
+        // Truncating first zeroes every series, which marks them empty.
+        if (ftruncate(this->file, 0)
+            || ftruncate(this->file, this->mappedSize)
+            || pwrite(this->file, &header, sizeof(header), 0)
+                != (ssize_t)sizeof(header))
+        {
+            string error = strerror(errno);
+            ::close(this->file);
+            throw runtime_error(
+                "Failed to initialize latency stats: " + error + ".");
+        }
+    }
+
+    flock(this->file, LOCK_UN);
+
+    void* mapping = mmap(NULL,
+                        this->mappedSize,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        this->file,
+                        0);
+    if (mapping == MAP_FAILED) {
+        string error = strerror(errno);
+        ::close(this->file);
+        throw runtime_error("Failed to map latency stats: " + error + ".");
+    }
+
+    this->memory = (char*)mapping;
+#else
+    (void)path;
+    throw runtime_error("Latency stats are not supported on this platform.");
+#endif // _WIN32
+}
+
+char* LatencyStats::getSeries(
+    const char* route,
+    int statusCode,
+    const char* phase,
+    bool isCreating)
+{
+    char routeKey[LATENCY_STATS_ROUTE_SIZE];
+    char phaseKey[LATENCY_STATS_PHASE_SIZE];
+    copytruncated(routeKey, sizeof(routeKey), route);
+    copytruncated(phaseKey, sizeof(phaseKey), phase);
+    uint64_t keyHash = hashkey(routeKey, statusCode, phaseKey);
+
+    StatsSeries* first = (StatsSeries*)(this->memory + sizeof(StatsHeader));
+    for (size_t probe = 0; probe < this->seriesCount; probe++) {
+        StatsSeries* series = first + (keyHash + probe) % this->seriesCount;
+        uint32_t state = loadstate(series);
+
+        if (state == SERIES_EMPTY) {
+            if (!isCreating) return NULL;
+
+            // Claim the series, or see what the process that did claims.
+#ifndef _WIN32
+            bool isClaimed = __sync_bool_compare_and_swap(
+                &series->state, SERIES_EMPTY, SERIES_CLAIMED);
+#else
+            bool isClaimed = true;
+            series->state = SERIES_CLAIMED;
+#endif // _WIN32
+            if (isClaimed) {
+                series->statusCode = statusCode;
+                series->keyHash = keyHash;
+                memcpy(series->route, routeKey, sizeof(routeKey));
+                memcpy(series->phase, phaseKey, sizeof(phaseKey));
+                barrier();
+                series->state = SERIES_READY;
+                return (char*)series;
+            }
+            state = loadstate(series);
+        }
+
+        // Wait for a series being created, in case it has the same key.
+        for (int i = 0;
+             state == SERIES_CLAIMED && i < LATENCY_STATS_CLAIM_RETRIES;
+             i++)
+        {
+#ifndef _WIN32
+            sched_yield();
+#endif // _WIN32
+            state = loadstate(series);
+        }
+        barrier();
+
+        if (state == SERIES_READY
+            && series->keyHash == keyHash
+            && series->statusCode == statusCode
+            && !strcmp(series->route, routeKey)
+            && !strcmp(series->phase, phaseKey))
+        {
+            return (char*)series;
+        }
+    }
+    return NULL;
+}
+
+bool LatencyStats::record(
+    const char* route,
+    int statusCode,
+    const char* phase,
+    uint64_t microseconds)
+{
+    StatsSeries* series =
+        (StatsSeries*)this->getSeries(route, statusCode, phase, true);
+    if (!series) {
+        add64(&((StatsHeader*)this->memory)->dropped, 1);
+        return false;
+    }
+
+    add64(&series->counts[LatencyHistogram::getBucket(microseconds)], 1);
+    add64(&series->count, 1);
+    add64(&series->sum, microseconds);
+
+    uint64_t max = load64(&series->max);
+    while (microseconds > max) {
+#ifndef _WIN32
+        if (__sync_bool_compare_and_swap(&series->max, max, microseconds)) {
+            break;
+        }
+#else
+        series->max = microseconds;
+#endif // _WIN32
+        max = load64(&series->max);
+    }
+    return true;
+}
+
+void LatencyStats::recordTiming(
+    const char* route,
+    int statusCode,
+    Timing& timing,
+    double totalMilliseconds)
+{
+    for (int i = 0; i < TIMING_PHASE_COUNT; i++) {
+        TimingPhase phase = (TimingPhase)i;
+        if (!timing.isRecorded(phase)) continue;
+
+        double microseconds = timing.getWallTime(phase) * 1000;
+        this->record(route,
+                     statusCode,
+                     Timing::getName(phase),
+                     (uint64_t)(microseconds + 0.5));
+    }
+
+    double microseconds = totalMilliseconds > 0 ? totalMilliseconds * 1000 : 0;
+    this->record(route, statusCode, "total", (uint64_t)(microseconds + 0.5));
+}
+
+LatencyHistogram LatencyStats::getSnapshot(
+    const char* route,
+    int statusCode,
+    const char* phase)
+{
+    LatencyHistogram snapshot;
+    char routeKey[LATENCY_STATS_ROUTE_SIZE];
+    char phaseKey[LATENCY_STATS_PHASE_SIZE];
+    copytruncated(routeKey, sizeof(routeKey), route);
+    copytruncated(phaseKey, sizeof(phaseKey), phase);
+
+    StatsSeries* first = (StatsSeries*)(this->memory + sizeof(StatsHeader));
+    for (size_t i = 0; i < this->seriesCount; i++) {
+        StatsSeries* series = first + i;
+        if (loadstate(series) != SERIES_READY) continue;
+        barrier();
+
+        if ((statusCode && series->statusCode != statusCode)
+            || strcmp(series->route, routeKey)
+            || strcmp(series->phase, phaseKey))
+        {
+            continue;
+        }
+
+        LatencyHistogram histogram;
+        this->copySeries((char*)series, histogram);
+        snapshot.merge(histogram);
+    }
+    return snapshot;
+}
+
+void LatencyStats::copySeries(char* series, LatencyHistogram& histogram) {
+    StatsSeries* source = (StatsSeries*)series;
+    histogram.count = load64(&source->count);
+    histogram.sum = load64(&source->sum);
+    histogram.max = load64(&source->max);
+    barrier();
+    for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; i++) {
+        histogram.counts[i] = load64(&source->counts[i]);
+    }
+}
+
+string LatencyStats::toPrometheus() {
+    const char* name = "cnek_request_duration_seconds";
+    const char* quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+
+    string text;
+    text += "# HELP cnek_request_duration_seconds"
+        " Time taken by each phase of handling a request.\n";
+    text += "# TYPE cnek_request_duration_seconds summary\n";
+
+    StatsSeries* first = (StatsSeries*)(this->memory + sizeof(StatsHeader));
+    for (size_t i = 0; i < this->seriesCount; i++) {
+        StatsSeries* series = first + i;
+        if (loadstate(series) != SERIES_READY) continue;
+        barrier();
+
+        LatencyHistogram histogram;
+        this->copySeries((char*)series, histogram);
+
+        string labels = "{route=\"";
+        appendlabel(labels, series->route);
+        char status[16];
+        snprintf(status, sizeof(status), "%d", (int)series->statusCode);
+        labels += "\",status=\"";
+        labels += status;
+        labels += "\",phase=\"";
+        appendlabel(labels, series->phase);
+        labels += "\"";
+
+        for (size_t j = 0; j < sizeof(quantiles) / sizeof(*quantiles); j++) {
+            text += name;
+            text += labels;
+            text += ",quantile=\"";
+            text += quantiles[j];
+            text += "\"} ";
+            appendseconds(
+                text, histogram.getPercentile(atof(quantiles[j]) * 100));
+            text += "\n";
+        }
+
+        char count[32];
+        snprintf(count,
+                 sizeof(count),
+                 "%llu",
+                 (unsigned long long)histogram.getCount());
+        text += name;
+        text += "_sum";
+        text += labels;
+        text += "} ";
+        appendseconds(text, histogram.getSum());
+        text += "\n";
+        text += name;
+        text += "_count";
+        text += labels;
+        text += "} ";
+        text += count;
+        text += "\n";
+    }
+
+    char dropped[32];
+    snprintf(dropped,
+             sizeof(dropped),
+             "%llu",
+             (unsigned long long)this->getDropped());
+    text += "# HELP cnek_request_duration_dropped_total"
+        " Latencies dropped for lack of room for their series.\n";
+    text += "# TYPE cnek_request_duration_dropped_total counter\n";
+    text += "cnek_request_duration_dropped_total ";
+    text += dropped;
+    text += "\n";
+    return text;
+}
+
+Response* LatencyStats::createResponse() {
+    string text = this->toPrometheus();
+
+    Response* response = new Response(200, "OK");
+    response->setHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    response->setHeader("Cache-Control", "no-store");
+    response->getBody()->write(text.data(), text.size());
+    return response;
+}
+
+uint64_t LatencyStats::getDropped() {
+    return load64(&((StatsHeader*)this->memory)->dropped);
+}
+
+LatencyStats::~LatencyStats() {
+#ifndef _WIN32
+    if (this->memory) munmap(this->memory, this->mappedSize);
+    if (this->file >= 0) ::close(this->file);
+#endif // _WIN32
+}
+
+} // Cnek
@@ -0,0 +1,396 @@
+#include "Prefork.hpp"
+#include "HttpServer.hpp"
+#include "ScgiServer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif // __linux__
+
+// Seconds stopping workers may take to finish their current request before
+// they are killed.
+#ifndef PREFORK_STOP_TIMEOUT
+#define PREFORK_STOP_TIMEOUT 30 // Default 30 seconds.
+#endif // PREFORK_STOP_TIMEOUT
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::strerror;
+using std::string;
+
+#ifdef __linux__
+namespace {
+
+/**
+ * State of the worker process, for the signal handler and the handler that
+ * counts requests, which cannot be given it otherwise.
+ */
+struct WorkerState {
+    Handler handler;
+    unsigned long requests;
+    unsigned long maxRequests;
+    size_t maxRss;
+    ScgiServer* scgiServer;
+    HttpServer* httpServer;
+    volatile sig_atomic_t isStopping;
+} worker;
+
+/**
+ * Stops the worker's server after its current request.
+ */
+void stopworker(int signal) {
+    (void)signal;
+    worker.isStopping = 1;
+    if (worker.scgiServer) worker.scgiServer->stop();
+    if (worker.httpServer) worker.httpServer->stop();
+}
+
+/**
+ * Gets the peak resident set size of the process, in bytes.
+ */
+size_t peakrss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) return 0;
+    return (size_t)usage.ru_maxrss * 1024;
+}
+
+/**
+ * Runs the worker's handler, then stops the worker if it reached a limit.
+ */
+Response* countinghandler(Cnek& cnek, ServerRequest* request) {
+    Response* response = worker.handler(cnek, request);
+
+    worker.requests++;
+    if ((worker.maxRequests && worker.requests >= worker.maxRequests)
+        || (worker.maxRss && peakrss() > worker.maxRss))
+    {
+        stopworker(0);
+    }
+
+    return response;
+}
+
+/**
+ * Gets the signals the master waits for.
+ */
+sigset_t mastersignals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    return signals;
+}
+
+/**
+ * Signals each process in a list.
+ */
+void killall(const std::vector<pid_t>& pids, int signal) {
+    for (size_t i = 0; i < pids.size(); i++) {
+        if (pids[i] > 0) kill(pids[i], signal);
+    }
+}
+
+} // namespace
+#endif // __linux__
+
+Prefork::Prefork(
+    const char* host,
+    unsigned short port,
+    PreforkProtocol protocol,
+    int workers)
+    : listener(-1),
+      protocol(protocol),
+      workerCount(workers),
+      maxRequests(0),
+      maxRss(0),
+      isCpuAffinity(false),
+      init(NULL)
+{
+#ifdef __linux__
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        throw invalid_argument("Invalid prefork host '" + string(host) + "'.");
+    }
+
+    errno = 0;
+    this->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (this->listener < 0) {
+        string error = strerror(errno);
+        throw runtime_error("Failed to create prefork socket: " + error + ".");
+    }
+
+    int enabled = 1;
+    setsockopt(
+        this->listener, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+
+    if (bind(this->listener, (struct sockaddr*)&address, sizeof(address))
+        || listen(this->listener, SOMAXCONN))
+    {
+        string error = strerror(errno);
+        close(this->listener);
+        throw runtime_error(
+            "Failed to listen on prefork socket: " + error + ".");
+    }
+
+    if (this->workerCount <= 0) {
+        this->workerCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#else
+    (void)host;
+    (void)port;
+    throw runtime_error("Prefork is not supported on this platform.");
+#endif // __linux__
+}
+
+Prefork::Prefork(int listener, PreforkProtocol protocol, int workers)
+    : listener(listener),
+      protocol(protocol),
+      workerCount(workers),
+      maxRequests(0),
+      maxRss(0),
+      isCpuAffinity(false),
+      init(NULL)
+{
+#ifdef __linux__
+    if (this->workerCount <= 0) {
+        this->workerCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#else
+    throw runtime_error("Prefork is not supported on this platform.");
+#endif // __linux__
+}
+
+void Prefork::setMaxRequests(unsigned long maxRequests) {
+    this->maxRequests = maxRequests;
+}
+
+void Prefork::setMaxRss(size_t maxRss) {
+    this->maxRss = maxRss;
+}
+
+void Prefork::setCpuAffinity(bool enabled) {
+    this->isCpuAffinity = enabled;
+}
+
+void Prefork::setWorkerInit(void (*init)()) {
+    this->init = init;
+}
+
+pid_t Prefork::spawn(int slot, Handler handler) {
+#ifdef __linux__
+    // Buffered output would otherwise be written again by the worker.
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if (pid) {
+        this->workers[slot] = pid > 0 ? pid : 0;
+        this->started[slot] = time(NULL);
+        return pid;
+    }
+
+    // Worker: stop on SIGTERM or SIGINT, without SA_RESTART so that waiting
+    // for connections is interrupted.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopworker;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGHUP, &action, NULL);
+
+    if (this->isCpuAffinity) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus > 0 ? slot % cpus : 0, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    worker.handler = handler;
+    worker.requests = 0;
+    worker.maxRequests = this->maxRequests;
+    worker.maxRss = this->maxRss;
+    worker.scgiServer = NULL;
+    worker.httpServer = NULL;
+    worker.isStopping = 0;
+
+    int status = 0;
+    try {
+        if (this->init) this->init();
+
+        // Signals are unblocked once the server can be stopped by them, and
+        // delivered right away if they are pending.
+        sigset_t signals = mastersignals();
+        if (this->protocol == PREFORK_HTTP) {
+            HttpServer server(this->listener);
+            worker.httpServer = &server;
+            sigprocmask(SIG_UNBLOCK, &signals, NULL);
+            if (!worker.isStopping) server.serve(countinghandler);
+            worker.httpServer = NULL;
+        } else {
+            ScgiServer server(this->listener);
+            worker.scgiServer = &server;
+            sigprocmask(SIG_UNBLOCK, &signals, NULL);
+            if (!worker.isStopping) server.serve(countinghandler);
+            worker.scgiServer = NULL;
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "Worker %d failed: %s\n", (int)getpid(), e.what());
+        status = 1;
+    }
+
+    // Never return into the master's code.
+    fflush(NULL);
+    _exit(status);
+#else
+    (void)slot;
+    (void)handler;
+    return -1;
+#endif // __linux__
+}
+
+void Prefork::reap(Handler handler, bool isRunning) {
+#ifdef __linux__
+    int status = 0;
+    pid_t pid = 0;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        bool isClean = WIFEXITED(status) && !WEXITSTATUS(status);
+        if (!isClean) {
+            fprintf(stderr,
+                    WIFSIGNALED(status)
+                        ? "Worker %d killed by signal %d.\n"
+                        : "Worker %d exited with status %d.\n",
+                    (int)pid,
+                    WIFSIGNALED(status)
+                        ? WTERMSIG(status)
+                        : WEXITSTATUS(status));
+        }
+
+        for (size_t i = 0; i < this->retiring.size(); i++) {
+            if (this->retiring[i] == pid) {
+                this->retiring.erase(this->retiring.begin() + i);
+                break;
+            }
+        }
+
+        for (size_t slot = 0; slot < this->workers.size(); slot++) {
+            if (this->workers[slot] != pid) continue;
+            this->workers[slot] = 0;
+
+            // Workers that fail right away are restarted at most once per
+            // second, so a broken handler does not fork in a busy loop.
+            if (isRunning
+                && (isClean || time(NULL) - this->started[slot] >= 1))
+            {
+                this->spawn(slot, handler);
+            }
+            break;
+        }
+    }
+#else
+    (void)handler;
+    (void)isRunning;
+#endif // __linux__
+}
+
+void Prefork::run(Handler handler) {
+#ifdef __linux__
+    sigset_t signals = mastersignals();
+    sigset_t previous;
+    sigprocmask(SIG_BLOCK, &signals, &previous);
+
+    this->workers.assign(this->workerCount, 0);
+    this->started.assign(this->workerCount, 0);
+    this->retiring.clear();
+    for (int slot = 0; slot < this->workerCount; slot++) {
+        if (this->spawn(slot, handler) < 0) {
+            string error = strerror(errno);
+            killall(this->workers, SIGKILL);
+            while (waitpid(-1, NULL, 0) > 0) {}
+            sigprocmask(SIG_SETMASK, &previous, NULL);
+            throw runtime_error("Failed to fork worker: " + error + ".");
+        }
+    }
+
+    bool isRunning = true;
+    time_t retireDeadline = 0;
+    while (isRunning || !this->retiring.empty()) {
+        // Wake up every second to restart failed workers and kill stuck ones.
+        struct timespec timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_nsec = 0;
+        int signal = sigtimedwait(&signals, NULL, &timeout);
+
+        if (signal == SIGCHLD) {
+            this->reap(handler, isRunning);
+        } else if (signal == SIGHUP && isRunning) {
+            // Start the new workers before stopping the old ones, so there
+            // is always a worker accepting connections.
+            for (size_t slot = 0; slot < this->workers.size(); slot++) {
+                pid_t old = this->workers[slot];
+                this->spawn(slot, handler);
+                if (old) {
+                    this->retiring.push_back(old);
+                    kill(old, SIGTERM);
+                }
+            }
+            retireDeadline = time(NULL) + PREFORK_STOP_TIMEOUT;
+        } else if ((signal == SIGTERM || signal == SIGINT) && isRunning) {
+            isRunning = false;
+            for (size_t slot = 0; slot < this->workers.size(); slot++) {
+                if (this->workers[slot]) {
+                    this->retiring.push_back(this->workers[slot]);
+                }
+                this->workers[slot] = 0;
+            }
+            killall(this->retiring, SIGTERM);
+            retireDeadline = time(NULL) + PREFORK_STOP_TIMEOUT;
+        }
+
+        time_t now = time(NULL);
+        if (!this->retiring.empty() && now >= retireDeadline) {
+            killall(this->retiring, SIGKILL);
+        }
+
+        for (size_t slot = 0; isRunning && slot < this->workers.size(); slot++) {
+            if (!this->workers[slot] && now > this->started[slot]) {
+                this->spawn(slot, handler);
+            }
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+#else
+    (void)handler;
+#endif // __linux__
+}
+
+Prefork::~Prefork() {
+#ifdef __linux__
+    if (this->listener >= 0) close(this->listener);
+#endif // __linux__
+}
+
+} // Cnek
@@ -0,0 +1,288 @@
+#include "Recorder.hpp"
+#include "Hash.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+// Max number of bytes of one capture record, to reject corrupt lengths.
+// NOTE: Prevents DoS attacks when loading untrusted captures.
+#ifndef MAX_CAPTURE_RECORD_SIZE
+#define MAX_CAPTURE_RECORD_SIZE 67108864 // Default 64MB.
+#endif // MAX_CAPTURE_RECORD_SIZE
+
+namespace Cnek {
+
+using std::runtime_error;
+using std::strerror;
+using std::string;
+
+namespace {
+
+const char recordMagic[4] = {'C', 'R', 'E', 'C'};
+
+/**
+ * Appends a little-endian 32-bit integer.
+ */
+inline void put32(string& buffer, uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; i++) bytes[i] = (char)(value >> (i * 8));
+    buffer.append(bytes, 4);
+}
+
+/**
+ * Appends a little-endian 64-bit integer.
+ */
+inline void put64(string& buffer, uint64_t value) {
+    char bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = (char)(value >> (i * 8));
+    buffer.append(bytes, 8);
+}
+
+/**
+ * Reads exactly `length` bytes.
+ *
+ * @return True if all bytes were read.
+ */
+inline bool readexact(FILE* file, void* buffer, size_t length) {
+    return fread(buffer, 1, length, file) == length;
+}
+
+/**
+ * Reads a little-endian 32-bit integer at an offset of a buffer.
+ */
+inline uint32_t get32(const string& buffer, size_t offset) {
+    return read32((const unsigned char*)buffer.data() + offset);
+}
+
+} // namespace
+
+/*******************************************************************************
+ * Recorder
+ ******************************************************************************/
+Recorder::Recorder(const char* path, unsigned long sampleRate)
+    : file(-1), stream(NULL), sampleRate(sampleRate ? sampleRate : 1)
+{
+    errno = 0;
+#ifndef _WIN32
+    this->file = open(path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+    bool isOpen = this->file >= 0;
+#else
+    this->stream = fopen(path, "ab");
+    bool isOpen = this->stream != NULL;
+#endif // _WIN32
+
+    if (!isOpen) {
+        string error = strerror(errno);
+        string message = "Failed to open capture file '" + string(path)
+            + "': " + error + ".";
+        throw runtime_error(message);
+    }
+
+    // Seed per process so concurrent processes sample independently.
+    uint64_t seed[3] = {(uint64_t)time(NULL), (uint64_t)clock(), 0};
+#ifndef _WIN32
+    seed[2] = (uint64_t)getpid();
+#endif // _WIN32
+    this->state = hashbytes(seed, sizeof(seed), (uintptr_t)this) | 1;
+}
+
+bool Recorder::isSampled() {
+    if (this->sampleRate == 1) return true;
+
+    // xorshift64*
+    this->state ^= this->state >> 12;
+    this->state ^= this->state << 25;
+    this->state ^= this->state >> 27;
+    uint64_t random = this->state * 0x2545F4914F6CDD1DULL;
+    return (random >> 32) % this->sampleRate == 0;
+}
+
+void Recorder::record(char** environment, const char* body, size_t length) {
+    uint32_t count = 0;
+    size_t envLength = 0;
+    for (char** env = environment; *env; env++) {
+        count++;
+        envLength += 4 + strlen(*env);
+    }
+
+    string record;
+    record.reserve(12 + 8 + 8 + envLength + length);
+    record.append(recordMagic, sizeof(recordMagic));
+    put32(record, (uint32_t)(8 + 4 + 4 + envLength + length));
+    put64(record, (uint64_t)time(NULL));
+    put32(record, count);
+    put32(record, (uint32_t)length);
+    for (char** env = environment; *env; env++) {
+        size_t varLength = strlen(*env);
+        put32(record, (uint32_t)varLength);
+        record.append(*env, varLength);
+    }
+    record.append(body, length);
+
+    // One write per record, so records from concurrent processes do not mix.
+    errno = 0;
+#ifndef _WIN32
+    const char* p = record.data();
+    size_t remaining = record.size();
+    while (remaining) {
+        ssize_t bytesWritten = write(this->file, p, remaining);
+        if (bytesWritten < 0 && errno == EINTR) continue;
+        if (bytesWritten <= 0) break;
+        p += bytesWritten;
+        remaining -= bytesWritten;
+    }
+    bool isWritten = !remaining;
+#else
+    bool isWritten =
+        fwrite(record.data(), 1, record.size(), this->stream) == record.size()
+        && !fflush(this->stream);
+#endif // _WIN32
+
+    if (!isWritten) {
+        string error = strerror(errno);
+        string message = "Failed to write capture record: " + error + ".";
+        throw runtime_error(message);
+    }
+}
+
+Recorder::~Recorder() {
+#ifndef _WIN32
+    if (this->file >= 0) close(this->file);
+#endif // _WIN32
+    if (this->stream) fclose(this->stream);
+}
+
+/*******************************************************************************
+ * Capture
+ ******************************************************************************/
+Capture::Capture(const char* path)
+    : file(NULL), environment(NULL), input(NULL), time(0)
+{
+    errno = 0;
+    this->file = fopen(path, "rb");
+    if (!this->file) {
+        string error = strerror(errno);
+        string message = "Failed to open capture file '" + string(path)
+            + "': " + error + ".";
+        throw runtime_error(message);
+    }
+}
+
+void Capture::clear() {
+    if (this->environment) {
+        for (char** env = this->environment; *env; env++) delete[] *env;
+        delete[] this->environment;
+        this->environment = NULL;
+    }
+
+    if (this->input) {
+        fclose(this->input);
+        this->input = NULL;
+    }
+
+    this->body.clear();
+    this->time = 0;
+}
+
+bool Capture::next() {
+    this->clear();
+
+    unsigned char head[8];
+    size_t headRead = fread(head, 1, sizeof(head), this->file);
+    if (!headRead) return false;
+
+    if (headRead < sizeof(head) || memcmp(head, recordMagic, 4)) {
+        throw runtime_error("Corrupt capture record.");
+    }
+
+    uint32_t length = read32(head + 4);
+    if (length < 16 || length > MAX_CAPTURE_RECORD_SIZE) {
+        throw runtime_error("Corrupt capture record.");
+    }
+
+    string record(length, '\0');
+    if (!readexact(this->file, &record[0], length)) {
+        throw runtime_error("Truncated capture record.");
+    }
+
+    this->time = read64((const unsigned char*)record.data());
+    uint32_t count = get32(record, 8);
+    uint32_t bodyLength = get32(record, 12);
+
+    // Every variable takes at least 4 bytes, so larger counts are corrupt.
+    size_t offset = 16;
+    if (count > (length - offset) / 4) {
+        throw runtime_error("Corrupt capture record.");
+    }
+
+    this->environment = new char*[count + 1];
+    for (uint32_t i = 0; i <= count; i++) this->environment[i] = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset + 4 > length) throw runtime_error("Corrupt capture record.");
+        uint32_t varLength = get32(record, offset);
+        offset += 4;
+
+        if (varLength > length - offset) {
+            throw runtime_error("Corrupt capture record.");
+        }
+
+        char* variable = new char[varLength + 1];
+        memcpy(variable, record.data() + offset, varLength);
+        variable[varLength] = '\0';
+        this->environment[i] = variable;
+        offset += varLength;
+    }
+
+    if (bodyLength != length - offset) {
+        throw runtime_error("Corrupt capture record.");
+    }
+    this->body.assign(record, offset, bodyLength);
+
+    errno = 0;
+    this->input = tmpfile();
+    if (!this->input
+        || fwrite(this->body.data(), 1, bodyLength, this->input) < bodyLength)
+    {
+        string error = strerror(errno);
+        string message = "Failed to rebuild capture input: " + error + ".";
+        throw runtime_error(message);
+    }
+    rewind(this->input);
+
+    return true;
+}
+
+char** Capture::getEnvironment() {
+    return this->environment;
+}
+
+FILE* Capture::getInput() {
+    return this->input;
+}
+
+const string& Capture::getBody() {
+    return this->body;
+}
+
+uint64_t Capture::getTime() {
+    return this->time;
+}
+
+Capture::~Capture() {
+    this->clear();
+    if (this->file) fclose(this->file);
+}
+
+} // Cnek
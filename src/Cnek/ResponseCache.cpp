@@ -0,0 +1,485 @@
+#include "ResponseCache.hpp"
+#include "Hash.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // _WIN32
+
+// Default number of entries in a response cache.
+#ifndef RESPONSE_CACHE_SLOT_COUNT
+#define RESPONSE_CACHE_SLOT_COUNT 1024 // Default 1024 entries.
+#endif // RESPONSE_CACHE_SLOT_COUNT
+
+// Default max number of bytes per response cache entry.
+#ifndef RESPONSE_CACHE_SLOT_SIZE
+#define RESPONSE_CACHE_SLOT_SIZE 65536 // Default 64KB.
+#endif // RESPONSE_CACHE_SLOT_SIZE
+
+// Number of slots following a key's hash that the key may be stored in.
+#ifndef RESPONSE_CACHE_WAYS
+#define RESPONSE_CACHE_WAYS 8 // Default 8 slots.
+#endif // RESPONSE_CACHE_WAYS
+
+// Seconds before another process may take over a stale entry's
+// revalidation.
+#ifndef RESPONSE_CACHE_REVALIDATE_TIMEOUT
+#define RESPONSE_CACHE_REVALIDATE_TIMEOUT 30 // Default 30 seconds.
+#endif // RESPONSE_CACHE_REVALIDATE_TIMEOUT
+
+// Times a read is retried when it races a write.
+#ifndef RESPONSE_CACHE_READ_RETRIES
+#define RESPONSE_CACHE_READ_RETRIES 16
+#endif // RESPONSE_CACHE_READ_RETRIES
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::ValueList;
+using Csr::Http::Message::ValueNode;
+
+using std::runtime_error;
+using std::string;
+
+namespace {
+
+const char cacheMagic[8] = {'C', 'N', 'E', 'K', 'R', 'C', '0', '1'};
+
+/**
+ * Layout of the start of the cache file.
+ */
+struct CacheHeader {
+    char magic[8];
+    uint64_t slotCount;
+    uint64_t slotSize;
+};
+
+/**
+ * Layout of the start of each slot, followed by the key and then the data.
+ */
+struct CacheSlot {
+    // Odd while the slot is being written.
+    uint32_t sequence;
+
+    // CLOCK reference bit, set when the entry is read.
+    uint32_t referenced;
+
+    uint64_t keyHash;
+    int64_t expiresAt;
+    int64_t staleUntil;
+
+    // When a process claimed revalidation of the stale entry, or 0.
+    int64_t revalidatingAt;
+
+    uint32_t keyLength;
+    uint32_t dataLength;
+};
+
+/**
+ * Full memory barrier, so seqlock reads and writes are not reordered.
+ */
+inline void barrier() {
+#ifndef _WIN32
+    __sync_synchronize();
+#endif // _WIN32
+}
+
+/**
+ * Atomically replaces a value if it still holds the expected value.
+ *
+ * @return True if the value was replaced.
+ */
+inline bool compareandswap(int64_t* value, int64_t expected, int64_t desired) {
+#ifndef _WIN32
+    return __sync_bool_compare_and_swap(value, expected, desired);
+#else
+    if (*value != expected) return false;
+    *value = desired;
+    return true;
+#endif // _WIN32
+}
+
+/**
+ * Case-insensitively compares a token with a null-terminated string.
+ */
+inline bool tokeneq(const char* token, size_t length, const char* str) {
+    if (strlen(str) != length) return false;
+    for (size_t i = 0; i < length; i++) {
+        if (tolower((unsigned char)token[i]) != tolower((unsigned char)str[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline uint32_t loadsequence(CacheSlot* slot) {
+    return *(volatile uint32_t*)&slot->sequence;
+}
+
+} // namespace
+
+ResponseCache::ResponseCache(
+    const char* path,
+    size_t slotCount,
+    size_t slotSize)
+    : file(-1),
+      memory(NULL),
+      mappedSize(0),
+      slotCount(slotCount ? slotCount : RESPONSE_CACHE_SLOT_COUNT),
+      slotSize(slotSize ? slotSize : RESPONSE_CACHE_SLOT_SIZE),
+      defaultTtl(0),
+      defaultStale(0),
+      varyHeaders(NULL),
+      isLocked(0)
+{
+#ifndef _WIN32
+    if (!path) throw runtime_error("Cannot open response cache without path.");
+
+    // Keep slots 8-byte aligned for the 64-bit fields.
+    this->slotSize = (this->slotSize + 7) & ~(size_t)7;
+    if (this->slotSize <= sizeof(CacheSlot)) {
+        throw runtime_error("Response cache slot size is too small.");
+    }
+
+    this->mappedSize = sizeof(CacheHeader) + this->slotCount * this->slotSize;
+
+    errno = 0;
+    this->file = open(path, O_RDWR | O_CREAT, 0600);
+    if (this->file < 0) {
+        string error = strerror(errno);
+        string message = "Failed to open response cache '" + string(path)
+            + "': " + error + ".";
+        throw runtime_error(message);
+    }
+
+    this->lock();
+
+    // Size the file before mapping it, or reinitialize it if another layout
+    // was used.
+    struct stat info;
+    bool isValid = !fstat(this->file, &info)
+        && (size_t)info.st_size == this->mappedSize;
+
+    if (isValid) {
+        CacheHeader header;
+        isValid = pread(this->file, &header, sizeof(header), 0)
+                == (ssize_t)sizeof(header)
+            && !memcmp(header.magic, cacheMagic, sizeof(cacheMagic))
+            && header.slotCount == this->slotCount
+            && header.slotSize == this->slotSize;
+    }
+
+    if (!isValid) {
+        CacheHeader header;
+        memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        header.slotCount = this->slotCount;
+        header.slotSize = this->slotSize;
+
+        // Truncating first zeroes every slot, which marks them empty.
+        if (ftruncate(this->file, 0)
+            || ftruncate(this->file, this->mappedSize)
+            || pwrite(this->file, &header, sizeof(header), 0)
+                != (ssize_t)sizeof(header))
+        {
+            string error = strerror(errno);
+            this->unlock();
+            ::close(this->file);
+            throw runtime_error(
+                "Failed to initialize response cache: " + error + ".");
+        }
+    }
+
+    this->unlock();
+
+    void* mapping = mmap(NULL,
+                        this->mappedSize,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        this->file,
+                        0);
+    if (mapping == MAP_FAILED) {
+        string error = strerror(errno);
+        ::close(this->file);
+        throw runtime_error("Failed to map response cache: " + error + ".");
+    }
+
+    this->memory = (char*)mapping;
+    this->varyHeaders = new ValueList();
+#else
+    (void)path;
+    throw runtime_error("Response cache is not supported on this platform.");
+#endif // _WIN32
+}
+
+void ResponseCache::lock() {
+#ifndef _WIN32
+    // Threads sharing this instance share its file lock too.
+    while (__sync_lock_test_and_set(&this->isLocked, 1)) sched_yield();
+
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+#ifdef F_OFD_SETLKW
+    // Locks of the open file, unlike those of the process, also exclude
+    // threads with their own instance.
+    int command = F_OFD_SETLKW;
+#else
+    int command = F_SETLKW;
+#endif // F_OFD_SETLKW
+    while (fcntl(this->file, command, &lock) == -1 && errno == EINTR) {}
+#endif // _WIN32
+}
+
+void ResponseCache::unlock() {
+#ifndef _WIN32
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_UNLCK;
+    lock.l_whence = SEEK_SET;
+#ifdef F_OFD_SETLK
+    fcntl(this->file, F_OFD_SETLK, &lock);
+#else
+    fcntl(this->file, F_SETLK, &lock);
+#endif // F_OFD_SETLK
+
+    __sync_lock_release(&this->isLocked);
+#endif // _WIN32
+}
+
+char* ResponseCache::getSlot(size_t index) {
+    return this->memory + sizeof(CacheHeader) + index * this->slotSize;
+}
+
+void ResponseCache::addVaryHeader(const char* name) {
+    this->varyHeaders->addValue(name);
+}
+
+bool ResponseCache::isVaryKeyed(const char* vary) {
+    const char* p = vary;
+    while (*p) {
+        while (*p == ',' || *p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        const char* token = p;
+        while (*p && *p != ',' && *p != ' ' && *p != '\t') p++;
+        size_t length = p - token;
+        if (length == 1 && *token == '*') return false;
+
+        bool isKeyed = false;
+        for (ValueNode* node = this->varyHeaders->head;
+             node && !isKeyed;
+             node = node->next)
+        {
+            isKeyed = tokeneq(token, length, node->value);
+        }
+        if (!isKeyed) return false;
+    }
+    return true;
+}
+
+void ResponseCache::setDefaultTtl(long ttl, long staleWhileRevalidate) {
+    this->defaultTtl = ttl;
+    this->defaultStale = staleWhileRevalidate;
+}
+
+long ResponseCache::getDefaultTtl() {
+    return this->defaultTtl;
+}
+
+long ResponseCache::getDefaultStale() {
+    return this->defaultStale;
+}
+
+char* ResponseCache::createKey(ServerRequest* request) {
+    // Virtual hosts MAY share a cache file.
+    string key = request->getMethod();
+    key += ' ';
+    key += request->getHeaderLine("Host");
+    key += ' ';
+    key += request->getRequestTarget();
+
+    for (ValueNode* node = this->varyHeaders->head; node; node = node->next) {
+        key += '\n';
+        key += node->value;
+        key += ':';
+        key += request->getHeaderLine(node->value);
+    }
+
+    char* copy = new char[key.size() + 1];
+    memcpy(copy, key.c_str(), key.size() + 1);
+    return copy;
+}
+
+CacheStatus ResponseCache::lookup(
+    const char* key,
+    char** data,
+    size_t* length)
+{
+    *data = NULL;
+    *length = 0;
+    if (!key) return CACHE_MISS;
+
+    size_t keyLength = strlen(key);
+    uint64_t keyHash = hashbytes(key, keyLength);
+    size_t ways = RESPONSE_CACHE_WAYS;
+    if (ways > this->slotCount) ways = this->slotCount;
+    size_t capacity = this->getCapacity();
+
+    for (size_t i = 0; i < ways; i++) {
+        char* base = this->getSlot((keyHash + i) % this->slotCount);
+        CacheSlot* slot = (CacheSlot*)base;
+
+        for (int retry = 0; retry < RESPONSE_CACHE_READ_RETRIES; retry++) {
+            uint32_t sequence = loadsequence(slot);
+            if (sequence & 1) continue; // Being written.
+            barrier();
+
+            CacheSlot copy = *slot;
+            if (copy.keyHash != keyHash || copy.keyLength != keyLength) {
+                // Only trust the mismatch if no write raced the copy.
+                barrier();
+                if (loadsequence(slot) == sequence) break;
+                continue;
+            }
+
+            if ((size_t)copy.keyLength + copy.dataLength > capacity
+                || memcmp(base + sizeof(CacheSlot), key, keyLength))
+            {
+                barrier();
+                if (loadsequence(slot) == sequence) break;
+                continue;
+            }
+
+            char* bytes = (char*)malloc(copy.dataLength ? copy.dataLength : 1);
+            if (!bytes) return CACHE_MISS;
+            memcpy(bytes, base + sizeof(CacheSlot) + keyLength, copy.dataLength);
+
+            barrier();
+            if (loadsequence(slot) != sequence) {
+                free(bytes);
+                continue;
+            }
+
+            int64_t now = time(NULL);
+            if (now >= copy.staleUntil) {
+                free(bytes);
+                return CACHE_MISS;
+            }
+
+            // Mark as recently used for CLOCK.
+            *(volatile uint32_t*)&slot->referenced = 1;
+
+            *data = bytes;
+            *length = copy.dataLength;
+
+            if (now < copy.expiresAt) return CACHE_HIT;
+
+            // Stale: let exactly one process revalidate it.
+            int64_t claimed = *(volatile int64_t*)&slot->revalidatingAt;
+            if (now - claimed >= RESPONSE_CACHE_REVALIDATE_TIMEOUT
+                && compareandswap(&slot->revalidatingAt, claimed, now))
+            {
+                return CACHE_STALE;
+            }
+            return CACHE_HIT;
+        }
+    }
+
+    return CACHE_MISS;
+}
+
+bool ResponseCache::store(
+    const char* key,
+    const char* data,
+    size_t length,
+    long ttl,
+    long staleWhileRevalidate)
+{
+    if (!key || (!data && length)) return false;
+
+    size_t keyLength = strlen(key);
+    if (keyLength + length > this->getCapacity()) return false;
+
+    uint64_t keyHash = hashbytes(key, keyLength);
+    size_t ways = RESPONSE_CACHE_WAYS;
+    if (ways > this->slotCount) ways = this->slotCount;
+    int64_t now = time(NULL);
+
+    this->lock();
+
+    // Pick the slot holding the key, else an empty or dead slot, else evict
+    // with CLOCK: clear reference bits until an unreferenced entry is found.
+    CacheSlot* target = NULL;
+    CacheSlot* empty = NULL;
+    for (size_t i = 0; i < ways && !target; i++) {
+        char* base = this->getSlot((keyHash + i) % this->slotCount);
+        CacheSlot* slot = (CacheSlot*)base;
+
+        if (slot->keyHash == keyHash
+            && slot->keyLength == keyLength
+            && !memcmp(base + sizeof(CacheSlot), key, keyLength))
+        {
+            target = slot;
+        } else if (!empty && (!slot->keyLength || now >= slot->staleUntil)) {
+            empty = slot;
+        }
+    }
+    if (!target) target = empty;
+
+    for (size_t i = 0; !target; i = (i + 1) % ways) {
+        CacheSlot* slot =
+            (CacheSlot*)this->getSlot((keyHash + i) % this->slotCount);
+        if (!slot->referenced) target = slot;
+        else slot->referenced = 0;
+    }
+
+    char* base = (char*)target;
+
+    // Readers retry while the sequence is odd or has changed.
+    target->sequence++;
+    barrier();
+
+    target->referenced = 0;
+    target->keyHash = keyHash;
+    target->expiresAt = now + ttl;
+    target->staleUntil = now + ttl + staleWhileRevalidate;
+    target->revalidatingAt = 0;
+    target->keyLength = keyLength;
+    target->dataLength = length;
+    memcpy(base + sizeof(CacheSlot), key, keyLength);
+    if (length) memcpy(base + sizeof(CacheSlot) + keyLength, data, length);
+
+    barrier();
+    target->sequence++;
+
+    this->unlock();
+    return true;
+}
+
+size_t ResponseCache::getCapacity() {
+    return this->slotSize - sizeof(CacheSlot);
+}
+
+ResponseCache::~ResponseCache() {
+#ifndef _WIN32
+    if (this->memory) munmap(this->memory, this->mappedSize);
+    if (this->file >= 0) ::close(this->file);
+#endif // _WIN32
+    delete this->varyHeaders;
+}
+
+} // Cnek
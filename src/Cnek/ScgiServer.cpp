@@ -0,0 +1,378 @@
+#include "ScgiServer.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif // _WIN32
+
+// Max number of bytes of the netstring of SCGI headers.
+// NOTE: Prevents DoS attacks.
+#ifndef MAX_SCGI_HEADER_SIZE
+#define MAX_SCGI_HEADER_SIZE 65536 // Default 64KB.
+#endif // MAX_SCGI_HEADER_SIZE
+
+// Max number of bytes to read from the request body.
+// NOTE: Prevents DoS attacks; larger requests are answered with "413".
+#ifndef MAX_REQUEST_BODY_SIZE
+#define MAX_REQUEST_BODY_SIZE 4194304 // Default 4MB.
+#endif // MAX_REQUEST_BODY_SIZE
+
+// Size of the buffer requests are first read into.
+// NOTE: Grows to fit larger requests and is reused across connections.
+#ifndef SCGI_BUFFER_SIZE
+#define SCGI_BUFFER_SIZE 4096 // Default 4KB.
+#endif // SCGI_BUFFER_SIZE
+
+// Seconds to wait for a client to send its request.
+// NOTE: Connections are handled one at a time, so slow clients block others.
+#ifndef SCGI_TIMEOUT
+#define SCGI_TIMEOUT 30 // Default 30 seconds.
+#endif // SCGI_TIMEOUT
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::strerror;
+using std::string;
+
+#ifndef _WIN32
+namespace {
+
+/**
+ * Parses the length prefix of a netstring, "LENGTH:".
+ *
+ * @param data Received bytes.
+ * @param size Number of received bytes.
+ * @param length Set to the length of the netstring.
+ * @return Number of bytes of the prefix, 0 if more bytes are needed, or -1
+ *     if the prefix is malformed.
+ */
+int parselength(const char* data, size_t size, size_t* length) {
+    *length = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == ':') return i ? (int)i + 1 : -1;
+        if (data[i] < '0' || data[i] > '9') return -1;
+
+        // Leading zeros are not allowed.
+        if (i == 1 && data[0] == '0') return -1;
+
+        *length = *length * 10 + (data[i] - '0');
+        if (*length > MAX_SCGI_HEADER_SIZE) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parses a block of SCGI headers in place into NAME=VALUE strings.
+ *
+ * @param block Null-terminated names and values.
+ * @param length Number of bytes of the block.
+ * @param environment Filled with pointers into the block, then NULL.
+ * @param contentLength Set to the value of CONTENT_LENGTH.
+ * @return True if the block is valid, false if not.
+ */
+bool parseheaders(
+    char* block,
+    size_t length,
+    std::vector<char*>& environment,
+    size_t* contentLength)
+{
+    environment.clear();
+    if (!length || block[length - 1]) return false;
+
+    bool hasContentLength = false;
+    char* end = block + length;
+    char* p = block;
+    while (p < end) {
+        char* name = p;
+        char* nameEnd = (char*)memchr(name, '\0', end - name);
+
+        // Names are never empty and cannot hold '=' in an environment.
+        if (nameEnd == name || memchr(name, '=', nameEnd - name)) return false;
+        if (nameEnd + 1 >= end) return false;
+
+        char* value = nameEnd + 1;
+        char* valueEnd = (char*)memchr(value, '\0', end - value);
+
+        if (!strcmp(name, "CONTENT_LENGTH")) {
+            if (!*value) return false;
+            char* digitsEnd = NULL;
+            errno = 0;
+            unsigned long parsed = strtoul(value, &digitsEnd, 10);
+            if (errno || *digitsEnd || *value < '0' || *value > '9') {
+                return false;
+            }
+            *contentLength = parsed;
+            hasContentLength = true;
+        }
+
+        *nameEnd = '=';
+        environment.push_back(name);
+        p = valueEnd + 1;
+    }
+
+    environment.push_back(NULL);
+    return hasContentLength;
+}
+
+/**
+ * Writes a whole buffer to a socket.
+ */
+void writeall(int client, const char* data, size_t length) {
+    while (length) {
+        ssize_t bytesWritten = write(client, data, length);
+        if (bytesWritten < 0 && errno == EINTR) continue;
+        if (bytesWritten <= 0) return;
+        data += bytesWritten;
+        length -= bytesWritten;
+    }
+}
+
+/**
+ * Creates a socket, binds it and listens on it.
+ */
+int listenon(int domain, const struct sockaddr* address, socklen_t length) {
+    errno = 0;
+    int listener = socket(domain, SOCK_STREAM, 0);
+    if (listener < 0) {
+        string error = strerror(errno);
+        throw runtime_error("Failed to create SCGI socket: " + error + ".");
+    }
+
+    int enabled = 1;
+    if (domain == AF_INET) {
+        setsockopt(
+            listener, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+    }
+
+    if (bind(listener, address, length) || listen(listener, SOMAXCONN)) {
+        string error = strerror(errno);
+        close(listener);
+        throw runtime_error("Failed to listen on SCGI socket: " + error + ".");
+    }
+
+    return listener;
+}
+
+} // namespace
+#endif // _WIN32
+
+ScgiServer::ScgiServer(const char* host, unsigned short port)
+    : listener(-1), isRunning(0), buffer(NULL), capacity(0)
+{
+#ifndef _WIN32
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        throw invalid_argument(
+            "Invalid SCGI host '" + string(host) + "'.");
+    }
+
+    this->listener = listenon(
+        AF_INET, (struct sockaddr*)&address, sizeof(address));
+#else
+    (void)host;
+    (void)port;
+    throw runtime_error("SCGI is not supported on this platform.");
+#endif // _WIN32
+}
+
+ScgiServer::ScgiServer(const char* path)
+    : listener(-1), isRunning(0), buffer(NULL), capacity(0)
+{
+#ifndef _WIN32
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        throw invalid_argument(
+            "SCGI socket path '" + string(path) + "' is too long.");
+    }
+    strcpy(address.sun_path, path);
+
+    // Replace the socket of a previous run.
+    struct stat info;
+    if (!lstat(path, &info) && S_ISSOCK(info.st_mode)) unlink(path);
+
+    this->listener = listenon(
+        AF_UNIX, (struct sockaddr*)&address, sizeof(address));
+#else
+    (void)path;
+    throw runtime_error("SCGI is not supported on this platform.");
+#endif // _WIN32
+}
+
+ScgiServer::ScgiServer(int listener)
+    : listener(listener), isRunning(0), buffer(NULL), capacity(0) {}
+
+void ScgiServer::serve(Handler handler) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+
+    this->isRunning = 1;
+    while (this->isRunning) {
+        errno = 0;
+        int client = accept(this->listener, NULL, NULL);
+        if (client < 0) {
+            // Interrupted, or the client gave up before it was accepted.
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+
+            string error = strerror(errno);
+            throw runtime_error(
+                "Failed to accept SCGI connection: " + error + ".");
+        }
+
+        this->handle(client, handler);
+    }
+#else
+    (void)handler;
+#endif // _WIN32
+}
+
+void ScgiServer::stop() {
+    this->isRunning = 0;
+}
+
+bool ScgiServer::receive(int client, size_t* size, size_t needed) {
+#ifndef _WIN32
+    if (needed > this->capacity) {
+        size_t grownCapacity =
+            needed > SCGI_BUFFER_SIZE ? needed : SCGI_BUFFER_SIZE;
+        char* grown = (char*)realloc(this->buffer, grownCapacity);
+        if (!grown) return false;
+        this->buffer = grown;
+        this->capacity = grownCapacity;
+    }
+
+    while (*size < needed) {
+        ssize_t bytesRead =
+            read(client, this->buffer + *size, this->capacity - *size);
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead <= 0) return false;
+        *size += bytesRead;
+    }
+    return true;
+#else
+    (void)client;
+    (void)size;
+    (void)needed;
+    return false;
+#endif // _WIN32
+}
+
+bool ScgiServer::handle(int client, Handler handler) {
+#ifndef _WIN32
+    struct timeval timeout;
+    timeout.tv_sec = SCGI_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Read the length prefix, then the rest of the netstring, then the body,
+    // into one buffer that is reused across connections.
+    size_t size = 0;
+    size_t length = 0;
+    int prefix = 0;
+    while (!prefix) {
+        if (!this->receive(client, &size, size + 1)) break;
+        prefix = parselength(this->buffer, size, &length);
+    }
+
+    size_t contentLength = 0;
+    bool isValid = prefix > 0
+        && this->receive(client, &size, prefix + length + 1)
+        && this->buffer[prefix + length] == ','
+        && parseheaders(
+            this->buffer + prefix, length, this->environment, &contentLength);
+
+    if (!isValid) {
+        close(client);
+        return false;
+    }
+
+    if (contentLength > MAX_REQUEST_BODY_SIZE) {
+        const char* tooLarge = "Status: 413 Content Too Large\r\n\r\n";
+        writeall(client, tooLarge, strlen(tooLarge));
+        close(client);
+        return false;
+    }
+
+    size_t bodyOffset = prefix + length + 1;
+    if (!this->receive(client, &size, bodyOffset + contentLength)) {
+        close(client);
+        return false;
+    }
+
+    // fmemopen() cannot open an empty buffer for reading everywhere.
+    FILE* input = contentLength
+        ? fmemopen(this->buffer + bodyOffset, contentLength, "rb")
+        : fopen("/dev/null", "rb");
+    FILE* output = fdopen(client, "wb");
+    if (!input || !output) {
+        if (input) fclose(input);
+        if (output) fclose(output);
+        else close(client);
+        return false;
+    }
+
+    bool isCreated = false;
+    bool isEmitted = false;
+    try {
+        // Reuse the request and response objects, but nothing the handler
+        // of the last connection set up.
+        this->cnek.reset();
+        this->cnek.clearSettings();
+        ServerRequest* request =
+            this->cnek.getServerRequest(&this->environment[0], input);
+        isCreated = true;
+        Response* response = handler(this->cnek, request);
+        isEmitted = true;
+        this->cnek.emitResponse(response, output);
+    } catch (std::exception& e) {
+        fprintf(stderr, "SCGI request failed: %s\n", e.what());
+
+        // Requests without REQUEST_METHOD or REQUEST_URI are the client's
+        // fault; anything else is the handler's.
+        if (!isCreated && dynamic_cast<invalid_argument*>(&e)) {
+            fputs("Status: 400 Bad Request\r\n\r\n", output);
+        } else if (!isEmitted) {
+            fputs("Status: 500 Internal Server Error\r\n\r\n", output);
+        }
+    }
+
+    fclose(input);
+    bool isWritten = !ferror(output);
+    return fclose(output) == 0 && isWritten && isEmitted;
+#else
+    (void)client;
+    (void)handler;
+    return false;
+#endif // _WIN32
+}
+
+ScgiServer::~ScgiServer() {
+#ifndef _WIN32
+    if (this->listener >= 0) close(this->listener);
+#endif // _WIN32
+    free(this->buffer);
+}
+
+} // Cnek
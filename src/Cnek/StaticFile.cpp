@@ -0,0 +1,769 @@
+#include "StaticFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif // _WIN32
+
+#ifdef CNEK_USE_ZLIB
+#include <zlib.h>
+#endif // CNEK_USE_ZLIB
+
+#ifdef CNEK_USE_BROTLI
+#include <brotli/encode.h>
+#endif // CNEK_USE_BROTLI
+
+#ifdef CNEK_USE_ZSTD
+#include <zstd.h>
+#endif // CNEK_USE_ZSTD
+
+// Max number of bytes of a file to load into memory for compression.
+// NOTE: Larger files are served without generating variants.
+#ifndef MAX_STATIC_COMPRESS_SIZE
+#define MAX_STATIC_COMPRESS_SIZE 16777216 // Default 16MB.
+#endif // MAX_STATIC_COMPRESS_SIZE
+
+// Compression levels used when generating variants. Variants are only
+// generated once per file version, so default to the smallest output.
+#ifndef STATIC_GZIP_LEVEL
+#define STATIC_GZIP_LEVEL 9
+#endif // STATIC_GZIP_LEVEL
+
+#ifndef STATIC_BROTLI_QUALITY
+#define STATIC_BROTLI_QUALITY 11
+#endif // STATIC_BROTLI_QUALITY
+
+#ifndef STATIC_ZSTD_LEVEL
+#define STATIC_ZSTD_LEVEL 19
+#endif // STATIC_ZSTD_LEVEL
+
+// Max number of bytes of variants to keep in a cache directory.
+// NOTE: Prevents filling the disk; the oldest variants are removed first.
+#ifndef MAX_STATIC_CACHE_SIZE
+#define MAX_STATIC_CACHE_SIZE 268435456 // Default 256MB.
+#endif // MAX_STATIC_CACHE_SIZE
+
+// Seconds after which a variant still being generated is presumed abandoned
+// by a process that died, so it MAY be generated again.
+#ifndef STATIC_GENERATE_TIMEOUT
+#define STATIC_GENERATE_TIMEOUT 300 // Default 5 minutes.
+#endif // STATIC_GENERATE_TIMEOUT
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+using Csr::Http::Message::Stream;
+
+namespace {
+
+// File extensions of each encoding, indexed by Encoding.
+const char* const extensions[] = {"", ".br", ".zst", ".gz"};
+
+// Content coding tokens of each encoding, indexed by Encoding.
+const char* const codings[] = {"identity", "br", "zstd", "gzip"};
+
+// Encodings in order of server preference.
+const Encoding preferred[] = {ENCODING_BR, ENCODING_ZSTD, ENCODING_GZIP};
+const size_t preferredCount = sizeof(preferred) / sizeof(preferred[0]);
+
+/**
+ * Concatenates strings into a newly allocated string.
+ *
+ * @return Pointer to the allocated, null-terminated concatenation.
+ */
+inline char* joinstr(const char* a, const char* b, const char* c = "") {
+    size_t lenA = strlen(a);
+    size_t lenB = strlen(b);
+    size_t lenC = strlen(c);
+    char* str = new char[lenA + lenB + lenC + 1]; // +1 for null-terminator.
+    memcpy(str, a, lenA);
+    memcpy(str + lenA, b, lenB);
+    memcpy(str + lenA + lenB, c, lenC);
+    str[lenA + lenB + lenC] = '\0';
+    return str;
+}
+
+/**
+ * Checks if a variant exists and is not older than the original file.
+ *
+ * @param variant Path of the variant.
+ * @param original Status of the original file.
+ * @return True if the variant can be served in place of the original.
+ */
+inline bool isfresh(const char* variant, const struct stat& original) {
+    struct stat info;
+    if (stat(variant, &info)) return false;
+    return (info.st_mode & S_IFMT) == S_IFREG
+        && info.st_mtime >= original.st_mtime;
+}
+
+/**
+ * Case-insensitively compares a coding token with a string.
+ *
+ * @param token Start of the token.
+ * @param length Length of the token.
+ * @param coding Null-terminated coding to compare with.
+ * @return True if they are equal.
+ */
+inline bool tokeneq(const char* token, size_t length, const char* coding) {
+    if (strlen(coding) != length) return false;
+    for (size_t i = 0; i < length; i++) {
+        if (tolower((unsigned char)token[i]) != coding[i]) return false;
+    }
+    return true;
+}
+
+/**
+ * Parses a q-value into thousandths.
+ *
+ * @param value Start of the value following "q=".
+ * @return Q-value from 0 to 1000.
+ */
+inline int parseq(const char* value) {
+    if (*value != '0' && *value != '1') return 0;
+    int q = (*value++ - '0') * 1000;
+    if (*value++ != '.') return q;
+    for (int scale = 100; scale && isdigit((unsigned char)*value); scale /= 10) {
+        q += (*value++ - '0') * scale;
+    }
+    return q > 1000 ? 1000 : q;
+}
+
+/**
+ * Gets the q-value an Accept-Encoding header assigns to a coding.
+ *
+ * @param acceptEncoding Value of the Accept-Encoding header.
+ * @param coding Coding to look up.
+ * @return Q-value in thousandths, or -1 if neither the coding nor "*" is
+ *     listed.
+ */
+inline int qvalue(const char* acceptEncoding, const char* coding) {
+    int q = -1;
+    int wildcard = -1;
+
+    const char* p = acceptEncoding;
+    while (*p) {
+        // Skip separators and whitespace.
+        while (*p == ',' || *p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        const char* token = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t length = p - token;
+
+        // Look for a q parameter before the next element.
+        int weight = 1000;
+        while (*p && *p != ',') {
+            if ((*p == 'q' || *p == 'Q') && p[1] == '=') weight = parseq(p + 2);
+            p++;
+        }
+
+        if (tokeneq(token, length, coding)
+            || (!strcmp(coding, "gzip") && tokeneq(token, length, "x-gzip")))
+        {
+            q = weight;
+        } else if (length == 1 && *token == '*') {
+            wildcard = weight;
+        }
+    }
+
+    return q >= 0 ? q : wildcard;
+}
+
+/**
+ * Checks if this build can generate variants of an encoding.
+ *
+ * @param encoding Encoding to check.
+ * @return True if a compressor for the encoding was built in.
+ */
+inline bool cangenerate(Encoding encoding) {
+    switch (encoding) {
+#ifdef CNEK_USE_ZLIB
+        case ENCODING_GZIP: return true;
+#endif // CNEK_USE_ZLIB
+#ifdef CNEK_USE_BROTLI
+        case ENCODING_BR: return true;
+#endif // CNEK_USE_BROTLI
+#ifdef CNEK_USE_ZSTD
+        case ENCODING_ZSTD: return true;
+#endif // CNEK_USE_ZSTD
+        default: return false;
+    }
+}
+
+/**
+ * Compresses a buffer.
+ *
+ * @param encoding Encoding to compress with.
+ * @param in Bytes to compress.
+ * @param inSize Number of bytes to compress.
+ * @param outSize Set to the number of compressed bytes.
+ * @return Allocated compressed bytes, to be released with free(), or NULL
+ *     if compression failed or is not supported.
+ */
+inline char* compress(
+    Encoding encoding,
+    const char* in,
+    size_t inSize,
+    size_t* outSize)
+{
+    char* out = NULL;
+    *outSize = 0;
+
+#ifdef CNEK_USE_ZLIB
+    if (encoding == ENCODING_GZIP) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+
+        // A window of 15 + 16 selects the gzip wrapper.
+        if (deflateInit2(&stream, STATIC_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 9,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return NULL;
+        }
+
+        uLong bound = deflateBound(&stream, (uLong)inSize);
+        out = (char*)malloc(bound);
+        if (out) {
+            stream.next_in = (Bytef*)in;
+            stream.avail_in = (uInt)inSize;
+            stream.next_out = (Bytef*)out;
+            stream.avail_out = (uInt)bound;
+
+            if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+                *outSize = stream.total_out;
+            } else {
+                free(out);
+                out = NULL;
+            }
+        }
+
+        deflateEnd(&stream);
+        return out;
+    }
+#endif // CNEK_USE_ZLIB
+
+#ifdef CNEK_USE_BROTLI
+    if (encoding == ENCODING_BR) {
+        size_t bound = BrotliEncoderMaxCompressedSize(inSize);
+        if (!bound) return NULL;
+
+        out = (char*)malloc(bound);
+        if (!out) return NULL;
+
+        *outSize = bound;
+        if (!BrotliEncoderCompress(STATIC_BROTLI_QUALITY,
+                                   BROTLI_DEFAULT_WINDOW,
+                                   BROTLI_MODE_GENERIC,
+                                   inSize,
+                                   (const uint8_t*)in,
+                                   outSize,
+                                   (uint8_t*)out))
+        {
+            free(out);
+            *outSize = 0;
+            return NULL;
+        }
+        return out;
+    }
+#endif // CNEK_USE_BROTLI
+
+#ifdef CNEK_USE_ZSTD
+    if (encoding == ENCODING_ZSTD) {
+        size_t bound = ZSTD_compressBound(inSize);
+        out = (char*)malloc(bound);
+        if (!out) return NULL;
+
+        size_t size = ZSTD_compress(out, bound, in, inSize, STATIC_ZSTD_LEVEL);
+        if (ZSTD_isError(size)) {
+            free(out);
+            return NULL;
+        }
+        *outSize = size;
+        return out;
+    }
+#endif // CNEK_USE_ZSTD
+
+    (void)encoding;
+    (void)in;
+    (void)inSize;
+    return out;
+}
+
+/**
+ * Removes variants from a cache directory: those of other versions of the
+ * file a variant was just generated for, then the oldest ones while the
+ * directory holds more than MAX_STATIC_CACHE_SIZE bytes.
+ *
+ * Temporary files are left alone unless they are older than
+ * STATIC_GENERATE_TIMEOUT, since they are still being written.
+ *
+ * @param directory Cache directory.
+ * @param target Path of the variant, in `directory`.
+ */
+inline void prunecache(const char* directory, const char* target) {
+#ifndef _WIN32
+    DIR* dir = opendir(directory);
+    if (!dir) return;
+
+    // Names are "HASH-SIZE-MTIME.EXT", where HASH is 16 hex digits of the
+    // original's path, so other versions share the "HASH-" prefix only.
+    const char* name = target + strlen(directory) + 1;
+    size_t versionLen = strcspn(name, ".");
+    const size_t hashLen = 17;
+
+    std::vector<std::pair<time_t, std::string> > variants;
+    unsigned long long totalSize = 0;
+    time_t now = time(NULL);
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        const char* entryName = entry->d_name;
+        if (*entryName == '.') continue;
+
+        std::string path = directory;
+        path += '/';
+        path += entryName;
+
+        struct stat info;
+        if (stat(path.c_str(), &info) || (info.st_mode & S_IFMT) != S_IFREG) {
+            continue;
+        }
+
+        if (strstr(entryName, ".tmp")) {
+            if (now - info.st_mtime >= STATIC_GENERATE_TIMEOUT) {
+                unlink(path.c_str());
+            }
+            continue;
+        }
+
+        bool isOtherVersion = versionLen > hashLen
+            && !strncmp(entryName, name, hashLen)
+            && (strncmp(entryName, name, versionLen)
+                || (entryName[versionLen] && entryName[versionLen] != '.'));
+        if (isOtherVersion) {
+            unlink(path.c_str());
+            continue;
+        }
+
+        // The variant just generated is kept even if it alone is too large.
+        totalSize += info.st_size;
+        if (strcmp(entryName, name)) {
+            variants.push_back(std::make_pair(info.st_mtime, path));
+        }
+    }
+    closedir(dir);
+
+    if (totalSize <= MAX_STATIC_CACHE_SIZE) return;
+
+    std::sort(variants.begin(), variants.end());
+    for (size_t i = 0;
+         i < variants.size() && totalSize > MAX_STATIC_CACHE_SIZE;
+         i++)
+    {
+        struct stat info;
+        if (stat(variants[i].second.c_str(), &info)) continue;
+        if (!unlink(variants[i].second.c_str())) totalSize -= info.st_size;
+    }
+#else
+    (void)directory;
+    (void)target;
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+/**
+ * Claims the generation of a variant by creating "<target>.tmp".
+ *
+ * A claim older than STATIC_GENERATE_TIMEOUT is presumed abandoned by a
+ * process that died, and is replaced.
+ *
+ * @param target Path of the variant.
+ * @return Allocated path of the claim, to be removed once the variant is
+ *     generated, or NULL if another process is generating it.
+ */
+inline char* claimvariant(const char* target) {
+    char* claim = joinstr(target, ".tmp");
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = open(claim, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0) {
+            ::close(fd);
+            return claim;
+        }
+
+        struct stat info;
+        if (errno != EEXIST
+            || stat(claim, &info)
+            || time(NULL) - info.st_mtime < STATIC_GENERATE_TIMEOUT)
+        {
+            break;
+        }
+        unlink(claim);
+    }
+
+    delete[] claim;
+    return NULL;
+}
+#endif // _WIN32
+
+#ifndef _WIN32
+/**
+ * Variant to generate in a helper thread, and its claim.
+ */
+struct Generation {
+    char* filename;
+    char* target;
+    Encoding encoding;
+    char* directory;
+    char* claim;
+
+    Generation(
+        const char* filename,
+        const char* target,
+        Encoding encoding,
+        const char* directory,
+        char* claim)
+        : filename(joinstr(filename, "")),
+          target(joinstr(target, "")),
+          encoding(encoding),
+          directory(joinstr(directory, "")),
+          claim(claim)
+    {
+    }
+
+    ~Generation() {
+        unlink(this->claim);
+        delete[] this->filename;
+        delete[] this->target;
+        delete[] this->directory;
+        delete[] this->claim;
+    }
+};
+
+/**
+ * Generates a variant in a helper thread, then prunes the cache directory.
+ */
+void* generatethread(void* arg) {
+    Generation* generation = (Generation*)arg;
+    if (StaticFile::generate(
+            generation->filename, generation->target, generation->encoding))
+    {
+        prunecache(generation->directory, generation->target);
+    }
+    delete generation;
+    return NULL;
+}
+#endif // _WIN32
+
+/**
+ * Generates a variant in a detached process, then prunes the cache
+ * directory.
+ *
+ * Only one process generates each variant at a time; requests for it while
+ * it is being generated do not fork again. A process serving a ThreadPool
+ * MUST NOT fork, since other threads may hold locks the child would wait on
+ * forever, so it generates the variant in a detached helper thread instead.
+ * Falls back to generating it in this process where processes cannot be
+ * forked.
+ *
+ * @param filename Original file.
+ * @param target Path to write the variant to.
+ * @param encoding Encoding to compress with.
+ * @param directory Cache directory `target` is in.
+ */
+inline void generatebackground(
+    const char* filename,
+    const char* target,
+    Encoding encoding,
+    const char* directory)
+{
+#ifndef _WIN32
+    char* claim = claimvariant(target);
+    if (!claim) return;
+
+    if (ThreadPool::isServing()) {
+        Generation* generation =
+            new Generation(filename, target, encoding, directory, claim);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, generatethread, generation)) {
+            delete generation;
+            return;
+        }
+        pthread_detach(thread);
+        return;
+    }
+
+    // Fork twice so the generating process is re-parented and never left as
+    // a zombie of this one.
+    pid_t pid = fork();
+    if (pid < 0) {
+        unlink(claim);
+        delete[] claim;
+        return;
+    }
+
+    if (!pid) {
+        if (!fork()) {
+            // The web server waits for the CGI's stdout to close, so detach
+            // from the standard streams before doing any work.
+            setsid();
+            int null = open("/dev/null", O_RDWR);
+            if (null >= 0) {
+                dup2(null, STDIN_FILENO);
+                dup2(null, STDOUT_FILENO);
+                dup2(null, STDERR_FILENO);
+                if (null > STDERR_FILENO) ::close(null);
+            }
+
+            // Client sockets, listeners and event descriptors inherited from
+            // a server would otherwise stay open, delaying the client's EOF.
+            long maxFd = sysconf(_SC_OPEN_MAX);
+            if (maxFd < 0) maxFd = 1024;
+            for (int fd = STDERR_FILENO + 1; fd < maxFd; fd++) ::close(fd);
+
+            if (StaticFile::generate(filename, target, encoding)) {
+                prunecache(directory, target);
+            }
+            unlink(claim);
+        }
+        _exit(0);
+    }
+
+    delete[] claim;
+    waitpid(pid, NULL, 0);
+#else
+    if (StaticFile::generate(filename, target, encoding)) {
+        prunecache(directory, target);
+    }
+#endif // _WIN32
+}
+
+} // namespace
+
+StaticFile::StaticFile(const char* cacheDirectory, GenerateMode generateMode)
+    : cacheDirectory(NULL), generateMode(generateMode)
+{
+    if (cacheDirectory && *cacheDirectory) {
+        this->cacheDirectory = joinstr(cacheDirectory, "");
+    }
+}
+
+char* StaticFile::findVariant(const char* filename, Encoding encoding) {
+    struct stat original;
+    if (stat(filename, &original)) return NULL;
+
+    // Prefer variants stored next to the original.
+    char* sibling = joinstr(filename, extensions[encoding]);
+    if (isfresh(sibling, original)) return sibling;
+    delete[] sibling;
+
+    if (!this->cacheDirectory) return NULL;
+
+    // Cached variants are keyed by the FNV-1a hash of the path, and the size
+    // and modification time of the original, so a changed file never
+    // matches a stale variant.
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = filename; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+
+    char key[80];
+    snprintf(key,
+             sizeof(key),
+             "/%08lx%08lx-%lu-%lu",
+             (unsigned long)(hash >> 32),
+             (unsigned long)(hash & 0xffffffffUL),
+             (unsigned long)original.st_size,
+             (unsigned long)original.st_mtime);
+
+    char* cached = joinstr(this->cacheDirectory, key, extensions[encoding]);
+    if (isfresh(cached, original)) return cached;
+
+    if (original.st_size <= MAX_STATIC_COMPRESS_SIZE && cangenerate(encoding)) {
+        if (this->generateMode == GENERATE_FIRST_HIT
+            && generate(filename, cached, encoding))
+        {
+            prunecache(this->cacheDirectory, cached);
+            return cached;
+        }
+
+        if (this->generateMode == GENERATE_BACKGROUND) {
+            generatebackground(
+                filename, cached, encoding, this->cacheDirectory);
+        }
+    }
+
+    delete[] cached;
+    return NULL;
+}
+
+void StaticFile::serve(
+    ServerRequest* request,
+    Response* response,
+    const char* filename)
+{
+    const char* acceptEncoding = request->getHeaderLine("Accept-Encoding");
+
+    // The chosen representation depends on Accept-Encoding, so caches must
+    // key on it too.
+    response->setAddedHeader("Vary", "Accept-Encoding");
+
+    Encoding available[preferredCount];
+    size_t count = preferredCount;
+    for (size_t i = 0; i < count; i++) available[i] = preferred[i];
+
+    // Try the preferred encoding first, and fall back to the next preferred
+    // whenever no variant exists for it.
+    while (*acceptEncoding && count) {
+        Encoding encoding = negotiate(acceptEncoding, available, count);
+        if (encoding == ENCODING_IDENTITY) break;
+
+        char* variant = this->findVariant(filename, encoding);
+        if (variant) {
+            Stream* body = NULL;
+            try {
+                body = new Stream(variant, "rb");
+            } catch (std::runtime_error&) {
+                // Removed since it was found, so keep looking.
+            }
+            delete[] variant;
+
+            if (body) {
+                response->setBody(body);
+                response->setHeader("Content-Encoding", codings[encoding]);
+                return;
+            }
+        }
+
+        // Remove the encoding from the candidates.
+        size_t j = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (available[i] != encoding) available[j++] = available[i];
+        }
+        count = j;
+    }
+
+    response->setBody(new Stream(filename, "rb"));
+}
+
+Encoding StaticFile::negotiate(
+    const char* acceptEncoding,
+    const Encoding* available,
+    size_t count)
+{
+    if (!acceptEncoding || !available) return ENCODING_IDENTITY;
+
+    Encoding best = ENCODING_IDENTITY;
+    int bestQ = 0;
+
+    for (size_t i = 0; i < preferredCount; i++) {
+        Encoding encoding = preferred[i];
+
+        bool isAvailable = false;
+        for (size_t j = 0; j < count; j++) {
+            if (available[j] == encoding) isAvailable = true;
+        }
+        if (!isAvailable) continue;
+
+        // Ties go to the earlier, more preferred encoding.
+        int q = qvalue(acceptEncoding, codings[encoding]);
+        if (q > bestQ) {
+            best = encoding;
+            bestQ = q;
+        }
+    }
+
+    return best;
+}
+
+bool StaticFile::generate(
+    const char* filename,
+    const char* target,
+    Encoding encoding)
+{
+    if (!filename || !target || !cangenerate(encoding)) return false;
+
+    FILE* in = fopen(filename, "rb");
+    if (!in) return false;
+
+    // Read the whole file; static assets are small enough to compress in
+    // one call, which also gives the best ratio.
+    size_t capacity = 4096;
+    size_t size = 0;
+    char* data = (char*)malloc(capacity);
+    size_t bytesRead = 0;
+    while (data && (bytesRead = fread(data + size, 1, capacity - size, in)) > 0) {
+        size += bytesRead;
+        if (size == capacity) {
+            if (capacity >= MAX_STATIC_COMPRESS_SIZE) break;
+            capacity *= 2;
+            char* grown = (char*)realloc(data, capacity);
+            if (!grown) {
+                free(data);
+                data = NULL;
+            } else data = grown;
+        }
+    }
+
+    bool isComplete = data && !ferror(in) && feof(in);
+    fclose(in);
+
+    if (!isComplete) {
+        free(data);
+        return false;
+    }
+
+    size_t compressedSize = 0;
+    char* compressed = compress(encoding, data, size, &compressedSize);
+    free(data);
+    if (!compressed) return false;
+
+    // Write next to the target and rename into place so readers never see
+    // a partially written variant.
+    char suffix[32];
+#ifndef _WIN32
+    snprintf(suffix, sizeof(suffix), ".tmp%ld", (long)getpid());
+#else
+    snprintf(suffix, sizeof(suffix), ".tmp");
+#endif // _WIN32
+    char* temporary = joinstr(target, suffix);
+
+    bool isGenerated = false;
+    FILE* out = fopen(temporary, "wb");
+    if (out) {
+        size_t bytesWritten = fwrite(compressed, 1, compressedSize, out);
+        isGenerated = !fclose(out) && bytesWritten == compressedSize;
+        isGenerated = isGenerated && !rename(temporary, target);
+        if (!isGenerated) remove(temporary);
+    }
+
+    delete[] temporary;
+    free(compressed);
+    return isGenerated;
+}
+
+StaticFile::~StaticFile() {
+    delete[] this->cacheDirectory;
+}
+
+} // Cnek
@@ -0,0 +1,630 @@
+#include "Template.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <sys/stat.h>
+#endif // _WIN32
+
+// Max number of bytes of a template file.
+#ifndef MAX_TEMPLATE_SIZE
+#define MAX_TEMPLATE_SIZE 1048576 // Default 1MB.
+#endif // MAX_TEMPLATE_SIZE
+
+// Max number of sections nested in one another.
+#ifndef TEMPLATE_MAX_DEPTH
+#define TEMPLATE_MAX_DEPTH 32 // Default 32 sections.
+#endif // TEMPLATE_MAX_DEPTH
+
+namespace Cnek {
+
+using Csr::Http::Message::Stream;
+
+using std::invalid_argument;
+using std::runtime_error;
+using std::strerror;
+using std::string;
+using std::vector;
+
+/**
+ * Name of a template value with its string and list items.
+ */
+struct TemplateValue {
+    string name;
+    uint32_t hash;
+    string value;
+    bool isSet;
+    vector<TemplateData*> items;
+};
+
+namespace {
+
+const char templateMagic[8] = {'C', 'N', 'E', 'K', 'T', 'P', '0', '1'};
+
+/**
+ * Layout of the start of a program, followed by its instructions and then
+ * its text.
+ */
+struct TemplateHeader {
+    char magic[8];
+
+    // Size and modification time of the compiled file, to validate caches.
+    uint64_t sourceSize;
+    int64_t sourceTime;
+
+    uint32_t instructionCount;
+    uint32_t textSize;
+};
+
+enum Opcode {
+    /** Writes `length` bytes of text at `offset`. */
+    OP_TEXT = 0,
+
+    /** Writes the escaped value named at `offset`. */
+    OP_VARIABLE = 1,
+
+    /** Runs up to the END at `jump` once per list item. */
+    OP_LOOP = 2,
+
+    /** Runs up to the END at `jump` if the value is non-empty. */
+    OP_IF = 3,
+
+    /** Runs up to the END at `jump` if the value is empty. */
+    OP_UNLESS = 4,
+
+    /** Ends the section starting at `jump`. */
+    OP_END = 5
+};
+
+/**
+ * Instruction of a program. Names are null-terminated in the text, and
+ * hashed so values are compared by hash first.
+ */
+struct TemplateInstruction {
+    uint32_t opcode;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t jump;
+    uint32_t hash;
+};
+
+/**
+ * Hashes a name with 32-bit FNV-1a.
+ */
+inline uint32_t hashname(const char* name, size_t length) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+inline bool isnamechar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.';
+}
+
+/**
+ * Gets the line number of an offset, for error messages.
+ */
+string linenumber(const char* source, size_t offset) {
+    unsigned long line = 1;
+    for (size_t i = 0; i < offset; i++) {
+        if (source[i] == '\n') line++;
+    }
+
+    char number[32];
+    snprintf(number, sizeof(number), "%lu", line);
+    return number;
+}
+
+inline const TemplateHeader* getheader(const char* program) {
+    return (const TemplateHeader*)program;
+}
+
+inline const TemplateInstruction* getinstructions(const char* program) {
+    return (const TemplateInstruction*)(program + sizeof(TemplateHeader));
+}
+
+inline const char* gettext(const char* program) {
+    return (const char*)(getinstructions(program)
+                         + getheader(program)->instructionCount);
+}
+
+/**
+ * Checks that a program read from a cache is complete and well-formed, so
+ * a corrupt cache cannot make rendering read out of bounds.
+ */
+bool isvalid(const char* program, size_t size) {
+    if (size < sizeof(TemplateHeader)) return false;
+
+    const TemplateHeader* header = getheader(program);
+    size_t count = header->instructionCount;
+    if (memcmp(header->magic, templateMagic, sizeof(templateMagic))
+        || count > (size - sizeof(TemplateHeader))
+            / sizeof(TemplateInstruction)
+        || size != sizeof(TemplateHeader)
+            + count * sizeof(TemplateInstruction) + header->textSize)
+    {
+        return false;
+    }
+
+    const TemplateInstruction* instructions = getinstructions(program);
+    const char* text = gettext(program);
+    vector<size_t> sections;
+    for (size_t i = 0; i < count; i++) {
+        const TemplateInstruction& instruction = instructions[i];
+        if (instruction.opcode > OP_END) return false;
+
+        if (instruction.opcode == OP_END) {
+            if (sections.empty() || sections.back() != instruction.jump
+                || instructions[instruction.jump].jump != i)
+            {
+                return false;
+            }
+            sections.pop_back();
+            continue;
+        }
+
+        if ((uint64_t)instruction.offset + instruction.length
+            >= (uint64_t)header->textSize + (instruction.opcode == OP_TEXT))
+        {
+            return false;
+        }
+        if (instruction.opcode == OP_TEXT) continue;
+        if (text[instruction.offset + instruction.length]) return false;
+
+        if (instruction.opcode != OP_VARIABLE) {
+            if (sections.size() >= TEMPLATE_MAX_DEPTH) return false;
+            sections.push_back(i);
+        }
+    }
+    return sections.empty();
+}
+
+/**
+ * Writes a string, replacing the characters that are special in HTML
+ * text and attribute values with entities.
+ */
+size_t writeescaped(Stream* stream, const char* value, size_t length) {
+    size_t written = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        const char* entity = NULL;
+        switch (value[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            case '\'': entity = "&#39;"; break;
+            default: continue;
+        }
+        written += stream->write(value + start, i - start);
+        written += stream->write(entity, strlen(entity));
+        start = i + 1;
+    }
+    return written + stream->write(value + start, length - start);
+}
+
+} // namespace
+
+/*******************************************************************************
+ * TemplateData
+ ******************************************************************************/
+
+TemplateData::TemplateData() {}
+
+TemplateValue* TemplateData::find(const char* name, uint32_t hash) {
+    for (size_t i = 0; i < this->values.size(); i++) {
+        TemplateValue* value = this->values[i];
+        if (value->hash == hash && value->name == name) return value;
+    }
+    return NULL;
+}
+
+TemplateValue* TemplateData::create(const char* name) {
+    if (!name) name = "";
+    uint32_t hash = hashname(name, strlen(name));
+    TemplateValue* value = this->find(name, hash);
+    if (value) return value;
+
+    value = new TemplateValue();
+    value->name = name;
+    value->hash = hash;
+    value->isSet = false;
+    this->values.push_back(value);
+    return value;
+}
+
+void TemplateData::set(const char* name, const char* value) {
+    TemplateValue* entry = this->create(name);
+    entry->value = value ? value : "";
+    entry->isSet = true;
+}
+
+TemplateData* TemplateData::add(const char* name) {
+    TemplateData* item = new TemplateData();
+    this->create(name)->items.push_back(item);
+    return item;
+}
+
+const char* TemplateData::get(const char* name) {
+    if (!name) return NULL;
+    TemplateValue* value = this->find(name, hashname(name, strlen(name)));
+    return value && value->isSet ? value->value.c_str() : NULL;
+}
+
+TemplateData::~TemplateData() {
+    for (size_t i = 0; i < this->values.size(); i++) {
+        TemplateValue* value = this->values[i];
+        for (size_t j = 0; j < value->items.size(); j++) {
+            delete value->items[j];
+        }
+        delete value;
+    }
+}
+
+/*******************************************************************************
+ * Template
+ ******************************************************************************/
+
+Template::Template() : program(NULL), programSize(0), isMapped(false) {}
+
+void Template::release() {
+#ifndef _WIN32
+    if (this->isMapped) munmap(this->program, this->programSize);
+    else delete[] this->program;
+#else
+    delete[] this->program;
+#endif // _WIN32
+    this->program = NULL;
+    this->programSize = 0;
+    this->isMapped = false;
+}
+
+void Template::compile(const char* source, size_t length) {
+    if (!source) length = 0;
+    if (length >= 0xffffffffUL) {
+        throw invalid_argument("Template is too large to compile.");
+    }
+
+    vector<TemplateInstruction> instructions;
+    vector<size_t> sections;
+    string text;
+    size_t position = 0;
+
+    while (position < length) {
+        const char* open = NULL;
+        for (size_t i = position; i + 1 < length; i++) {
+            if (source[i] == '{' && source[i + 1] == '{') {
+                open = source + i;
+                break;
+            }
+        }
+
+        // Literal text up to the next tag.
+        size_t end = open ? open - source : length;
+        if (end > position) {
+            TemplateInstruction instruction;
+            instruction.opcode = OP_TEXT;
+            instruction.offset = text.size();
+            instruction.length = end - position;
+            instruction.jump = 0;
+            instruction.hash = 0;
+            instructions.push_back(instruction);
+            text.append(source + position, end - position);
+        }
+        if (!open) break;
+
+        size_t tagStart = end + 2;
+        size_t tagEnd = tagStart;
+        while (tagEnd + 1 < length
+               && !(source[tagEnd] == '}' && source[tagEnd + 1] == '}'))
+        {
+            tagEnd++;
+        }
+        if (tagEnd + 1 >= length) {
+            throw invalid_argument(
+                "Unclosed template tag at line " + linenumber(source, end)
+                + ".");
+        }
+        position = tagEnd + 2;
+        string tag(open, source + position);
+
+        // Split the tag into its sigil and name, ignoring spaces.
+        while (tagStart < tagEnd && source[tagStart] == ' ') tagStart++;
+        while (tagEnd > tagStart && source[tagEnd - 1] == ' ') tagEnd--;
+        char sigil = tagStart < tagEnd ? source[tagStart] : '\0';
+        uint32_t opcode = OP_VARIABLE;
+        switch (sigil) {
+            case '#': opcode = OP_LOOP; break;
+            case '?': opcode = OP_IF; break;
+            case '^': opcode = OP_UNLESS; break;
+            case '/': opcode = OP_END; break;
+        }
+        if (opcode != OP_VARIABLE) tagStart++;
+        while (tagStart < tagEnd && source[tagStart] == ' ') tagStart++;
+
+        bool isValid = tagStart < tagEnd;
+        for (size_t i = tagStart; i < tagEnd; i++) {
+            if (!isnamechar(source[i])) isValid = false;
+        }
+        if (!isValid) {
+            throw invalid_argument(
+                "Invalid template tag '" + tag + "' at line "
+                + linenumber(source, end) + ".");
+        }
+
+        string name(source + tagStart, tagEnd - tagStart);
+        TemplateInstruction instruction;
+        instruction.opcode = opcode;
+        instruction.offset = 0;
+        instruction.length = 0;
+        instruction.jump = 0;
+        instruction.hash = 0;
+
+        if (opcode == OP_END) {
+            // Close the innermost section, which MUST have the same name.
+            if (sections.empty()
+                || name != text.c_str() + instructions[sections.back()].offset)
+            {
+                throw invalid_argument(
+                    "Unexpected '{{/" + name + "}}' at line "
+                    + linenumber(source, end) + ".");
+            }
+            instruction.jump = sections.back();
+            instructions[sections.back()].jump = instructions.size();
+            sections.pop_back();
+            instructions.push_back(instruction);
+            continue;
+        }
+
+        if (opcode != OP_VARIABLE) {
+            if (sections.size() >= TEMPLATE_MAX_DEPTH) {
+                throw invalid_argument(
+                    "Template sections are nested too deep at line "
+                    + linenumber(source, end) + ".");
+            }
+            sections.push_back(instructions.size());
+        }
+        instruction.offset = text.size();
+        instruction.length = name.size();
+        instruction.hash = hashname(name.data(), name.size());
+        instructions.push_back(instruction);
+        text.append(name.c_str(), name.size() + 1);
+    }
+
+    if (!sections.empty()) {
+        const TemplateInstruction& section = instructions[sections.back()];
+        throw invalid_argument(
+            "Unclosed template section '" + string(text.c_str() + section.offset)
+            + "'.");
+    }
+    if (text.size() >= 0xffffffffUL) {
+        throw invalid_argument("Template is too large to compile.");
+    }
+
+    TemplateHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, templateMagic, sizeof(templateMagic));
+    header.instructionCount = instructions.size();
+    header.textSize = text.size();
+
+    size_t size = sizeof(header)
+        + instructions.size() * sizeof(TemplateInstruction) + text.size();
+    char* program = new char[size];
+    memcpy(program, &header, sizeof(header));
+    if (!instructions.empty()) {
+        memcpy(program + sizeof(header),
+               &instructions[0],
+               instructions.size() * sizeof(TemplateInstruction));
+    }
+    memcpy(program + size - text.size(), text.data(), text.size());
+
+    this->release();
+    this->program = program;
+    this->programSize = size;
+}
+
+void Template::load(const char* path, const char* cachePath) {
+    if (!path) throw runtime_error("Cannot load template without path.");
+
+    errno = 0;
+    struct stat info;
+    if (stat(path, &info)) {
+        string error = strerror(errno);
+        throw runtime_error(
+            "Failed to open template '" + string(path) + "': " + error + ".");
+    }
+    if ((uint64_t)info.st_size > MAX_TEMPLATE_SIZE) {
+        throw runtime_error(
+            "Template '" + string(path) + "' exceeds MAX_TEMPLATE_SIZE.");
+    }
+    if (cachePath && this->map(cachePath, info.st_size, info.st_mtime)) {
+        return;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        string error = strerror(errno);
+        throw runtime_error(
+            "Failed to open template '" + string(path) + "': " + error + ".");
+    }
+    string source(info.st_size, '\0');
+    size_t bytesRead =
+        source.empty() ? 0 : fread(&source[0], 1, source.size(), file);
+    fclose(file);
+    if (bytesRead != source.size()) {
+        throw runtime_error(
+            "Failed to read template '" + string(path) + "'.");
+    }
+
+    this->compile(source.data(), source.size());
+
+    // The size and time identify the version of the file the program is of.
+    TemplateHeader* header = (TemplateHeader*)this->program;
+    header->sourceSize = info.st_size;
+    header->sourceTime = info.st_mtime;
+    if (cachePath) this->save(cachePath);
+}
+
+bool Template::map(
+    const char* cachePath,
+    uint64_t sourceSize,
+    int64_t sourceTime)
+{
+#ifndef _WIN32
+    int file = open(cachePath, O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat info;
+    if (fstat(file, &info) || (size_t)info.st_size < sizeof(TemplateHeader)) {
+        close(file);
+        return false;
+    }
+
+    size_t size = info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) return false;
+
+    const char* program = (const char*)mapping;
+    const TemplateHeader* header = getheader(program);
+    if (!isvalid(program, size)
+        || header->sourceSize != sourceSize
+        || header->sourceTime != sourceTime)
+    {
+        munmap(mapping, size);
+        return false;
+    }
+
+    this->release();
+    this->program = (char*)mapping;
+    this->programSize = size;
+    this->isMapped = true;
+    return true;
+#else
+    (void)cachePath;
+    (void)sourceSize;
+    (void)sourceTime;
+    return false;
+#endif // _WIN32
+}
+
+void Template::save(const char* cachePath) {
+#ifndef _WIN32
+    // Write a temporary file and rename it, so no process maps a partial
+    // program.
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+    string temporary = string(cachePath) + suffix;
+
+    int file = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) return;
+
+    const char* data = this->program;
+    size_t length = this->programSize;
+    while (length) {
+        ssize_t bytesWritten = write(file, data, length);
+        if (bytesWritten < 0 && errno == EINTR) continue;
+        if (bytesWritten <= 0) break;
+        data += bytesWritten;
+        length -= bytesWritten;
+    }
+    if (close(file) || length || rename(temporary.c_str(), cachePath)) {
+        unlink(temporary.c_str());
+    }
+#else
+    (void)cachePath;
+#endif // _WIN32
+}
+
+size_t Template::render(TemplateData& data, Stream* stream) {
+    if (!this->program) return 0;
+
+    vector<TemplateData*> scopes;
+    scopes.push_back(&data);
+    return this->renderRange(
+        0, getheader(this->program)->instructionCount, scopes, stream);
+}
+
+size_t Template::renderRange(
+    size_t begin,
+    size_t end,
+    vector<TemplateData*>& scopes,
+    Stream* stream)
+{
+    const TemplateInstruction* instructions = getinstructions(this->program);
+    const char* text = gettext(this->program);
+    size_t written = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        const TemplateInstruction& instruction = instructions[i];
+        if (instruction.opcode == OP_TEXT) {
+            written += stream->write(text + instruction.offset,
+                                     instruction.length);
+            continue;
+        }
+        if (instruction.opcode == OP_END) continue;
+
+        // Look the name up in the innermost scope that has it.
+        TemplateValue* value = NULL;
+        for (size_t j = scopes.size(); !value && j > 0; j--) {
+            value = scopes[j - 1]->find(
+                text + instruction.offset, instruction.hash);
+        }
+        bool isSet = value && !value->value.empty();
+        bool hasItems = value && !value->items.empty();
+
+        switch (instruction.opcode) {
+            case OP_VARIABLE:
+                if (isSet) {
+                    written += writeescaped(
+                        stream, value->value.data(), value->value.size());
+                }
+                break;
+
+            case OP_LOOP:
+                for (size_t j = 0; hasItems && j < value->items.size(); j++) {
+                    scopes.push_back(value->items[j]);
+                    written += this->renderRange(
+                        i + 1, instruction.jump, scopes, stream);
+                    scopes.pop_back();
+                }
+                i = instruction.jump;
+                break;
+
+            case OP_IF:
+            case OP_UNLESS:
+                if ((isSet || hasItems) == (instruction.opcode == OP_IF)) {
+                    written += this->renderRange(
+                        i + 1, instruction.jump, scopes, stream);
+                }
+                i = instruction.jump;
+                break;
+        }
+    }
+    return written;
+}
+
+size_t Template::getProgramSize() {
+    return this->programSize;
+}
+
+Template::~Template() {
+    this->release();
+}
+
+} // Cnek
@@ -0,0 +1,365 @@
+#include "ThreadPool.hpp"
+#include "ScgiServer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include <cstring>
+#include <deque>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+using std::runtime_error;
+using std::invalid_argument;
+using std::strerror;
+using std::string;
+
+#ifndef _WIN32
+/**
+ * Worker thread of a pool and the connections queued on it.
+ */
+struct ThreadWorker {
+    ThreadPool* pool;
+    size_t index;
+    pthread_t thread;
+
+    /** Guards `connections`, which other workers steal from. */
+    pthread_mutex_t mutex;
+    std::deque<int> connections;
+
+    /**
+     * Server whose buffer, environment, server request and response are
+     * reused for each connection.
+     */
+    ScgiServer server;
+
+    ThreadWorker(ThreadPool* pool, size_t index)
+        : pool(pool), index(index), server(-1)
+    {
+        pthread_mutex_init(&this->mutex, NULL);
+    }
+
+    ~ThreadWorker() {
+        pthread_mutex_destroy(&this->mutex);
+    }
+};
+
+namespace {
+
+/** Number of pools in serve(). */
+int servingCount = 0;
+
+/**
+ * Sets or clears O_NONBLOCK on a descriptor.
+ */
+void setblocking(int fd, bool isBlocking) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return;
+    fcntl(fd, F_SETFL, isBlocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+} // namespace
+#endif // _WIN32
+
+ThreadPool::ThreadPool(const char* host, unsigned short port, int threads)
+    : listener(-1),
+      threadCount(threads),
+      handler(NULL),
+      queued(0),
+      isDraining(false)
+{
+#ifndef _WIN32
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        throw invalid_argument(
+            "Invalid thread pool host '" + string(host) + "'.");
+    }
+
+    errno = 0;
+    this->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (this->listener < 0) {
+        string error = strerror(errno);
+        throw runtime_error(
+            "Failed to create thread pool socket: " + error + ".");
+    }
+
+    int enabled = 1;
+    setsockopt(
+        this->listener, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+
+    if (bind(this->listener, (struct sockaddr*)&address, sizeof(address))
+        || listen(this->listener, SOMAXCONN))
+    {
+        string error = strerror(errno);
+        close(this->listener);
+        throw runtime_error(
+            "Failed to listen on thread pool socket: " + error + ".");
+    }
+
+    try {
+        this->initialize();
+    } catch (...) {
+        close(this->listener);
+        throw;
+    }
+#else
+    (void)host;
+    (void)port;
+    throw runtime_error("Thread pools are not supported on this platform.");
+#endif // _WIN32
+}
+
+ThreadPool::ThreadPool(int listener, int threads)
+    : listener(listener),
+      threadCount(threads),
+      handler(NULL),
+      queued(0),
+      isDraining(false)
+{
+#ifndef _WIN32
+    this->initialize();
+#else
+    throw runtime_error("Thread pools are not supported on this platform.");
+#endif // _WIN32
+}
+
+void ThreadPool::initialize() {
+#ifndef _WIN32
+    if (this->threadCount <= 0) {
+        this->threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (this->threadCount <= 0) this->threadCount = 1;
+
+    errno = 0;
+    if (pipe(this->wakeup)) {
+        string error = strerror(errno);
+        throw runtime_error(
+            "Failed to create thread pool wakeup pipe: " + error + ".");
+    }
+
+    // stop() never blocks, even from a signal handler, and serve() empties
+    // the pipe without waiting.
+    setblocking(this->wakeup[0], false);
+    setblocking(this->wakeup[1], false);
+
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->ready, NULL);
+#endif // _WIN32
+}
+
+void ThreadPool::serve(Handler handler) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+
+    this->handler = handler;
+    this->queued = 0;
+    this->isDraining = false;
+    __sync_fetch_and_add(&servingCount, 1);
+
+    for (int i = 0; i < this->threadCount; i++) {
+        ThreadWorker* worker = new ThreadWorker(this, i);
+        int error = pthread_create(
+            &worker->thread, NULL, ThreadPool::work, worker);
+        if (error) {
+            delete worker;
+            this->drain();
+            __sync_fetch_and_sub(&servingCount, 1);
+            throw runtime_error(
+                "Failed to start thread pool worker: "
+                + string(strerror(error)) + ".");
+        }
+        this->workers.push_back(worker);
+    }
+
+    // Wait on the listener and the wakeup pipe, so stop() returns from the
+    // wait in whichever thread it is called.
+    setblocking(this->listener, false);
+    struct pollfd fds[2];
+    fds[0].fd = this->listener;
+    fds[0].events = POLLIN;
+    fds[1].fd = this->wakeup[0];
+    fds[1].events = POLLIN;
+
+    string error;
+    size_t next = 0;
+    bool isRunning = true;
+    while (isRunning) {
+        errno = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            error = "Failed to wait for connections: "
+                + string(strerror(errno)) + ".";
+            break;
+        }
+
+        if (fds[1].revents) {
+            char bytes[16];
+            while (read(this->wakeup[0], bytes, sizeof(bytes)) > 0) {}
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        // Accept every pending connection; another process sharing the
+        // socket may have taken them first.
+        while (true) {
+            errno = 0;
+            int client = accept(this->listener, NULL, NULL);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+                error = "Failed to accept SCGI connection: "
+                    + string(strerror(errno)) + ".";
+                isRunning = false;
+                break;
+            }
+
+            // Connections are handled with blocking reads and writes. Some
+            // systems make accepted sockets inherit O_NONBLOCK.
+            setblocking(client, true);
+            this->dispatch(client, &next);
+        }
+    }
+
+    setblocking(this->listener, true);
+    this->drain();
+    __sync_fetch_and_sub(&servingCount, 1);
+
+    if (!error.empty()) throw runtime_error(error);
+#else
+    (void)handler;
+#endif // _WIN32
+}
+
+void ThreadPool::stop() {
+#ifndef _WIN32
+    ssize_t bytesWritten = write(this->wakeup[1], "", 1);
+    (void)bytesWritten;
+#endif // _WIN32
+}
+
+bool ThreadPool::isServing() {
+#ifndef _WIN32
+    return __sync_fetch_and_add(&servingCount, 0) > 0;
+#else
+    return false;
+#endif // _WIN32
+}
+
+void ThreadPool::dispatch(int client, size_t* next) {
+#ifndef _WIN32
+    ThreadWorker* worker = this->workers[*next];
+    *next = (*next + 1) % this->workers.size();
+
+    // Queue before counting, so a counted connection is always queued.
+    pthread_mutex_lock(&worker->mutex);
+    worker->connections.push_back(client);
+    pthread_mutex_unlock(&worker->mutex);
+
+    pthread_mutex_lock(&this->mutex);
+    this->queued++;
+    pthread_cond_signal(&this->ready);
+    pthread_mutex_unlock(&this->mutex);
+#else
+    (void)client;
+    (void)next;
+#endif // _WIN32
+}
+
+int ThreadPool::take(ThreadWorker* worker) {
+#ifndef _WIN32
+    // Claim one of the queued connections, or stop once none are left.
+    pthread_mutex_lock(&this->mutex);
+    while (!this->queued && !this->isDraining) {
+        pthread_cond_wait(&this->ready, &this->mutex);
+    }
+    if (!this->queued) {
+        pthread_mutex_unlock(&this->mutex);
+        return -1;
+    }
+    this->queued--;
+    pthread_mutex_unlock(&this->mutex);
+
+    // Take the oldest connection of our own queue, or else steal the newest
+    // of another worker's. The claimed connection is in one of the queues,
+    // though other claimants may take it first from under us.
+    size_t count = this->workers.size();
+    for (size_t i = 0;; i = (i + 1) % count) {
+        ThreadWorker* victim = this->workers[(worker->index + i) % count];
+        int client = -1;
+
+        pthread_mutex_lock(&victim->mutex);
+        if (!victim->connections.empty()) {
+            if (victim == worker) {
+                client = victim->connections.front();
+                victim->connections.pop_front();
+            } else {
+                client = victim->connections.back();
+                victim->connections.pop_back();
+            }
+        }
+        pthread_mutex_unlock(&victim->mutex);
+
+        if (client >= 0) return client;
+    }
+#else
+    (void)worker;
+    return -1;
+#endif // _WIN32
+}
+
+void ThreadPool::drain() {
+#ifndef _WIN32
+    pthread_mutex_lock(&this->mutex);
+    this->isDraining = true;
+    pthread_cond_broadcast(&this->ready);
+    pthread_mutex_unlock(&this->mutex);
+
+    for (size_t i = 0; i < this->workers.size(); i++) {
+        pthread_join(this->workers[i]->thread, NULL);
+        delete this->workers[i];
+    }
+    this->workers.clear();
+#endif // _WIN32
+}
+
+void* ThreadPool::work(void* worker) {
+#ifndef _WIN32
+    ThreadWorker* self = (ThreadWorker*)worker;
+    ThreadPool* pool = self->pool;
+
+    int client = -1;
+    while ((client = pool->take(self)) >= 0) {
+        self->server.handle(client, pool->handler);
+    }
+#else
+    (void)worker;
+#endif // _WIN32
+    return NULL;
+}
+
+ThreadPool::~ThreadPool() {
+#ifndef _WIN32
+    if (this->listener >= 0) close(this->listener);
+    close(this->wakeup[0]);
+    close(this->wakeup[1]);
+    pthread_mutex_destroy(&this->mutex);
+    pthread_cond_destroy(&this->ready);
+#endif // _WIN32
+}
+
+} // Cnek
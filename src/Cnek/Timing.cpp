@@ -0,0 +1,166 @@
+#include "Timing.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+namespace {
+
+const char* phaseNames[TIMING_PHASE_COUNT] = {
+    "env",
+    "body",
+    "urlencoded",
+    "multipart",
+    "json",
+    "handler",
+    "emit"
+};
+
+/**
+ * Gets the current time of a monotonic clock.
+ *
+ * @return Milliseconds since an arbitrary point.
+ */
+inline double walltime() {
+#ifndef _WIN32
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#else
+    return clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif // _WIN32
+}
+
+/**
+ * Gets the CPU time used by the calling thread.
+ *
+ * ThreadPool workers share a process, so the time of the whole process
+ * would include every other worker's requests.
+ *
+ * @return Milliseconds of user and system time.
+ */
+inline double cputime() {
+#ifndef _WIN32
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif // RUSAGE_THREAD
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+#else
+    return clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif // _WIN32
+}
+
+} // namespace
+
+Timing::Timing() {
+    this->reset();
+}
+
+void Timing::reset() {
+    for (int i = 0; i < TIMING_PHASE_COUNT; i++) {
+        this->wallStart[i] = 0;
+        this->cpuStart[i] = 0;
+        this->wall[i] = 0;
+        this->cpu[i] = 0;
+        this->running[i] = false;
+        this->recorded[i] = false;
+    }
+}
+
+void Timing::start(TimingPhase phase) {
+    this->cpuStart[phase] = cputime();
+    this->wallStart[phase] = walltime();
+    this->running[phase] = true;
+}
+
+void Timing::stop(TimingPhase phase) {
+    if (!this->running[phase]) return;
+
+    this->wall[phase] += walltime() - this->wallStart[phase];
+    this->cpu[phase] += cputime() - this->cpuStart[phase];
+    this->running[phase] = false;
+    this->recorded[phase] = true;
+}
+
+bool Timing::isRecorded(TimingPhase phase) {
+    return this->recorded[phase];
+}
+
+double Timing::getWallTime(TimingPhase phase) {
+    return this->wall[phase];
+}
+
+double Timing::getCpuTime(TimingPhase phase) {
+    return this->cpu[phase];
+}
+
+const char* Timing::getName(TimingPhase phase) {
+    return phaseNames[phase];
+}
+
+const char* Timing::toHeader(char* buffer, size_t size) {
+    if (!size) return buffer;
+    *buffer = '\0';
+
+    size_t length = 0;
+    for (int i = 0; i < TIMING_PHASE_COUNT && length < size; i++) {
+        if (!this->recorded[i]) continue;
+
+        length += snprintf(buffer + length,
+                           size - length,
+                           "%s%s;dur=%.3f;desc=\"cpu=%.3f\"",
+                           length ? ", " : "",
+                           phaseNames[i],
+                           this->wall[i],
+                           this->cpu[i]);
+    }
+
+    return buffer;
+}
+
+void Timing::writeStats(
+    FILE* sink,
+    const char* method,
+    const char* target,
+    int statusCode)
+{
+    char line[1024];
+    size_t size = sizeof(line) - 1; // Leave room for the newline.
+    size_t length = snprintf(line,
+                             size,
+                             "%s %.512s %d",
+                             method,
+                             target,
+                             statusCode);
+
+    for (int i = 0; i < TIMING_PHASE_COUNT && length < size; i++) {
+        if (!this->recorded[i]) continue;
+
+        length += snprintf(line + length,
+                           size - length,
+                           " %s=%.3f/%.3f",
+                           phaseNames[i],
+                           this->wall[i],
+                           this->cpu[i]);
+    }
+
+    if (length > size - 1) length = size - 1;
+    line[length++] = '\n';
+
+    // One write per line so lines from concurrent processes do not mix.
+    fwrite(line, 1, length, sink);
+    fflush(sink);
+}
+
+} // Cnek
@@ -0,0 +1,198 @@
+#include "AllocStats.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+#ifdef CSR_ALLOC_STATS
+// Bytes in front of each allocation that hold its size.
+// NOTE: 16 keeps the memory aligned for any type.
+const size_t prefixSize = 16;
+
+unsigned long allocations = 0;
+unsigned long frees = 0;
+unsigned long bytes = 0;
+unsigned long current = 0;
+unsigned long peak = 0;
+
+#if defined(__GNUC__)
+inline void add(unsigned long* counter, unsigned long value) {
+    __sync_add_and_fetch(counter, value);
+}
+
+inline unsigned long addfetch(unsigned long* counter, unsigned long value) {
+    return __sync_add_and_fetch(counter, value);
+}
+
+inline void sub(unsigned long* counter, unsigned long value) {
+    __sync_sub_and_fetch(counter, value);
+}
+
+inline void raisemax(unsigned long* counter, unsigned long value) {
+    unsigned long seen = *counter;
+    while (value > seen) {
+        unsigned long prior = __sync_val_compare_and_swap(counter, seen, value);
+        if (prior == seen) break;
+        seen = prior;
+    }
+}
+#else
+inline void add(unsigned long* counter, unsigned long value) {
+    *counter += value;
+}
+
+inline unsigned long addfetch(unsigned long* counter, unsigned long value) {
+    return *counter += value;
+}
+
+inline void sub(unsigned long* counter, unsigned long value) {
+    *counter -= value;
+}
+
+inline void raisemax(unsigned long* counter, unsigned long value) {
+    if (value > *counter) *counter = value;
+}
+#endif // __GNUC__
+
+/**
+ * Counts an allocation of `size` bytes.
+ */
+inline void counted(size_t size) {
+    add(&allocations, 1);
+    add(&bytes, size);
+    raisemax(&peak, addfetch(&current, size));
+}
+
+/**
+ * Counts freeing an allocation of `size` bytes.
+ */
+inline void uncounted(size_t size) {
+    add(&frees, 1);
+    sub(&current, size);
+}
+#endif // CSR_ALLOC_STATS
+
+} // namespace
+
+bool AllocStats::isEnabled() {
+#ifdef CSR_ALLOC_STATS
+    return true;
+#else
+    return false;
+#endif // CSR_ALLOC_STATS
+}
+
+AllocCounters AllocStats::get() {
+    AllocCounters counters;
+    memset(&counters, 0, sizeof(counters));
+#ifdef CSR_ALLOC_STATS
+    counters.allocations = allocations;
+    counters.frees = frees;
+    counters.bytes = bytes;
+    counters.current = current;
+    counters.peak = peak;
+#endif // CSR_ALLOC_STATS
+    return counters;
+}
+
+void AllocStats::reset() {
+#ifdef CSR_ALLOC_STATS
+    allocations = 0;
+    frees = 0;
+    bytes = 0;
+    peak = current;
+#endif // CSR_ALLOC_STATS
+}
+
+void* AllocStats::allocate(size_t size) {
+#ifdef CSR_ALLOC_STATS
+    char* memory = (char*)malloc(prefixSize + size);
+    if (!memory) return NULL;
+
+    *(size_t*)memory = size;
+    counted(size);
+    return memory + prefixSize;
+#else
+    return malloc(size);
+#endif // CSR_ALLOC_STATS
+}
+
+void* AllocStats::reallocate(void* memory, size_t size) {
+#ifdef CSR_ALLOC_STATS
+    if (!memory) return allocate(size);
+
+    char* start = (char*)memory - prefixSize;
+    size_t oldSize = *(size_t*)start;
+    char* resized = (char*)realloc(start, prefixSize + size);
+    if (!resized) return NULL;
+
+    // Count a resize as freeing the old block and allocating the new one.
+    *(size_t*)resized = size;
+    uncounted(oldSize);
+    counted(size);
+    return resized + prefixSize;
+#else
+    return realloc(memory, size);
+#endif // CSR_ALLOC_STATS
+}
+
+void AllocStats::release(void* memory) {
+#ifdef CSR_ALLOC_STATS
+    if (!memory) return;
+
+    char* start = (char*)memory - prefixSize;
+    uncounted(*(size_t*)start);
+    free(start);
+#else
+    free(memory);
+#endif // CSR_ALLOC_STATS
+}
+
+}}} // Csr::Http::Message
+
+#ifdef CSR_ALLOC_STATS
+/*******************************************************************************
+ * Counting operator new and delete
+ ******************************************************************************/
+void* operator new(size_t size) throw(std::bad_alloc) {
+    void* memory = Csr::Http::Message::AllocStats::allocate(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+    void* memory = Csr::Http::Message::AllocStats::allocate(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory) throw() {
+    Csr::Http::Message::AllocStats::release(memory);
+}
+
+void operator delete[](void* memory) throw() {
+    Csr::Http::Message::AllocStats::release(memory);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw() {
+    return Csr::Http::Message::AllocStats::allocate(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw() {
+    return Csr::Http::Message::AllocStats::allocate(size ? size : 1);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) throw() {
+    Csr::Http::Message::AllocStats::release(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) throw() {
+    Csr::Http::Message::AllocStats::release(memory);
+}
+#endif // CSR_ALLOC_STATS
@@ -0,0 +1,86 @@
+#include "HeaderValidator.hpp"
+#include "Shared.hpp"
+
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(CSR_NO_SIMD)
+#define CSR_HEADER_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ && !CSR_NO_SIMD
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+inline bool isunsafe(char c) {
+    return c == '\r' || c == '\n' || c == '\0';
+}
+
+} // namespace
+
+bool HeaderValidator::isVectorized() {
+#ifdef CSR_HEADER_SSE2
+    return true;
+#else
+    return false;
+#endif // CSR_HEADER_SSE2
+}
+
+size_t HeaderValidator::scan(const char* data, size_t length) {
+    const char* p = data;
+    const char* end = data + length;
+
+#ifdef CSR_HEADER_SSE2
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    const __m128i lineFeed = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+        __m128i stops = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, carriageReturn),
+                         _mm_cmpeq_epi8(bytes, lineFeed)),
+            _mm_cmpeq_epi8(bytes, zero));
+        int mask = _mm_movemask_epi8(stops);
+        if (mask) return p + lowestbit(mask) - data;
+        p += 16;
+    }
+#endif // CSR_HEADER_SSE2
+
+    while (p < end && !isunsafe(*p)) p++;
+    return p - data;
+}
+
+bool HeaderValidator::isValidName(const char* name) {
+    if (!name || !*name) return false;
+    for (const char* p = name; *p; p++) {
+        if (!istoken(*p)) return false;
+    }
+    return true;
+}
+
+bool HeaderValidator::isValidValue(const char* value, size_t length) {
+    if (!value) return false;
+    return scan(value, length) == length;
+}
+
+size_t HeaderValidator::strip(char* value, size_t length) {
+    size_t offset = scan(value, length);
+    if (offset == length) return length;
+
+    // Shift the safe runs between unsafe bytes down over them.
+    char* out = value + offset;
+    const char* p = value + offset;
+    const char* end = value + length;
+    while (p < end) {
+        p++;
+        size_t run = scan(p, end - p);
+        memmove(out, p, run);
+        out += run;
+        p += run;
+    }
+    return out - value;
+}
+
+}}} // Csr::Http::Message
@@ -0,0 +1,199 @@
+#include "HttpParser.hpp"
+#include "Shared.hpp"
+
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(CSR_NO_SIMD)
+#define CSR_HTTP_PARSER_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ && !CSR_NO_SIMD
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+/**
+ * Finds the end of a request-target: the first space, control character
+ * or DEL.
+ *
+ * @return Pointer to the end, or `end` if it is not in the data yet.
+ */
+inline const char* scantarget(const char* p, const char* end) {
+#ifdef CSR_HTTP_PARSER_SSE2
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+
+        // Unsigned bytes <= ' ' equal their minimum with ' '.
+        __m128i stops = _mm_or_si128(
+            _mm_cmpeq_epi8(_mm_min_epu8(bytes, space), bytes),
+            _mm_cmpeq_epi8(bytes, del));
+        int mask = _mm_movemask_epi8(stops);
+        if (mask) return p + lowestbit(mask);
+        p += 16;
+    }
+#endif // CSR_HTTP_PARSER_SSE2
+
+    while (p < end && (unsigned char)*p > ' ' && *p != 0x7f) p++;
+    return p;
+}
+
+/**
+ * Finds the end of a header value: the first control character other than
+ * HTAB, or DEL. Bytes 128 to 255 (obs-text) are allowed.
+ *
+ * @return Pointer to the end, or `end` if it is not in the data yet.
+ */
+inline const char* scanvalue(const char* p, const char* end) {
+#ifdef CSR_HTTP_PARSER_SSE2
+    const __m128i control = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+
+        // Unsigned bytes <= 0x1f equal their minimum with 0x1f.
+        __m128i stops = _mm_or_si128(
+            _mm_andnot_si128(
+                _mm_cmpeq_epi8(bytes, tab),
+                _mm_cmpeq_epi8(_mm_min_epu8(bytes, control), bytes)),
+            _mm_cmpeq_epi8(bytes, del));
+        int mask = _mm_movemask_epi8(stops);
+        if (mask) return p + lowestbit(mask);
+        p += 16;
+    }
+#endif // CSR_HTTP_PARSER_SSE2
+
+    while (p < end
+        && ((unsigned char)*p >= ' ' || *p == '\t')
+        && *p != 0x7f)
+    {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Sets a slice from its start and end.
+ */
+inline void slice(HttpSlice* s, const char* start, const char* end) {
+    s->data = start;
+    s->length = end - start;
+}
+
+} // namespace
+
+bool HttpParser::isVectorized() {
+#ifdef CSR_HTTP_PARSER_SSE2
+    return true;
+#else
+    return false;
+#endif // CSR_HTTP_PARSER_SSE2
+}
+
+int HttpParser::parseRequest(
+    const char* data,
+    size_t size,
+    HttpRequestHead* head)
+{
+    const char* p = data;
+    const char* end = data + size;
+    head->headerCount = 0;
+
+    // Skip empty lines, e.g. ones sent after the body of a previous request.
+    while (end - p >= 2 && p[0] == '\r' && p[1] == '\n') p += 2;
+    if (end - p < 2 && p < end && *p == '\r') return 0;
+
+    // Method.
+    const char* start = p;
+    while (p < end && istoken(*p)) p++;
+    if (p == end) return 0;
+    if (p == start || *p != ' ') return -1;
+    slice(&head->method, start, p);
+    p++;
+
+    // Request-target.
+    start = p;
+    p = scantarget(p, end);
+    if (p == end) return 0;
+    if (p == start || *p != ' ') return -1;
+    slice(&head->target, start, p);
+
+    const char* question = (const char*)memchr(start, '?', p - start);
+    if (question) {
+        slice(&head->path, start, question);
+        slice(&head->query, question + 1, p);
+    } else {
+        slice(&head->path, start, p);
+        slice(&head->query, p, p);
+    }
+    p++;
+
+    // Protocol: "HTTP/" DIGIT "." DIGIT CRLF.
+    start = p;
+    const char* protocol = "HTTP/";
+    for (int i = 0; i < 10; i++, p++) {
+        if (p == end) return 0;
+
+        bool isValid = false;
+        if (i < 5) isValid = *p == protocol[i];
+        else if (i == 5 || i == 7) isValid = *p >= '0' && *p <= '9';
+        else if (i == 6) isValid = *p == '.';
+        else if (i == 8) isValid = *p == '\r';
+        else isValid = *p == '\n';
+
+        if (!isValid) return -1;
+    }
+    slice(&head->protocol, start, p - 2);
+    head->majorVersion = start[5] - '0';
+    head->minorVersion = start[7] - '0';
+
+    // Header fields: name ":" OWS value OWS CRLF, until an empty line.
+    while (true) {
+        if (p == end) return 0;
+        if (*p == '\r') {
+            if (p + 1 == end) return 0;
+            if (p[1] != '\n') return -1;
+            p += 2;
+            break;
+        }
+
+        if (head->headerCount == MAX_HTTP_PARSER_HEADERS) return -1;
+        HttpHeaderSlice* header = &head->headers[head->headerCount];
+
+        // Name. Whitespace before the colon or at the start of the line
+        // (obsolete line folding) is not a token, so it is rejected.
+        start = p;
+        while (p < end && istoken(*p)) p++;
+        if (p == end) return 0;
+        if (p == start || *p != ':') return -1;
+        slice(&header->name, start, p);
+        p++;
+
+        // Value.
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        start = p;
+        p = scanvalue(p, end);
+        if (p == end) return 0;
+        if (*p != '\r') return -1;
+        if (p + 1 == end) return 0;
+        if (p[1] != '\n') return -1;
+
+        const char* valueEnd = p;
+        while (valueEnd > start
+            && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        {
+            valueEnd--;
+        }
+        slice(&header->value, start, valueEnd);
+        head->headerCount++;
+        p += 2;
+    }
+
+    return (int)(p - data);
+}
+
+}}} // Csr::Http::Message
@@ -0,0 +1,757 @@
+#include "JsonDocument.hpp"
+#include "Utf8Validator.hpp"
+#include "Shared.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) && !defined(CSR_NO_SIMD)
+#define CSR_JSON_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ && !CSR_NO_SIMD
+
+// Max number of bytes of a JSON text, e.g. a request body.
+// NOTE: Prevents DoS attacks.
+#ifndef MAX_JSON_BODY_SIZE
+#define MAX_JSON_BODY_SIZE 16777216 // Default 16MB.
+#endif // MAX_JSON_BODY_SIZE
+
+// Size of the chunks a JSON body is read from its stream in.
+#ifndef JSON_READ_BUFFER_SIZE
+#define JSON_READ_BUFFER_SIZE 65536 // Default 64KB.
+#endif // JSON_READ_BUFFER_SIZE
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+using std::invalid_argument;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Bytes indexed at once, one bit per byte of a mask.
+const size_t JSON_BLOCK_SIZE = 64;
+
+// Bytes of spaces after the text, so blocks and literals may read past its
+// end.
+const size_t JSON_PADDING = 64;
+
+const uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+/**
+ * Classes of bytes for the scalar indexer.
+ */
+enum JsonClass {
+    JSON_CLASS_OPERATOR = 1,
+    JSON_CLASS_WHITESPACE = 2,
+    JSON_CLASS_QUOTE = 4,
+    JSON_CLASS_BACKSLASH = 8
+};
+
+/**
+ * Masks of one block of text.
+ */
+struct JsonBlock {
+    uint64_t operators;
+    uint64_t whitespace;
+    uint64_t quotes;
+    uint64_t backslashes;
+    uint64_t nonAscii;
+};
+
+inline unsigned char classof(unsigned char c) {
+    switch (c) {
+        case '{': case '}': case '[': case ']': case ':': case ',':
+            return JSON_CLASS_OPERATOR;
+        case ' ': case '\t': case '\n': case '\r':
+            return JSON_CLASS_WHITESPACE;
+        case '"':
+            return JSON_CLASS_QUOTE;
+        case '\\':
+            return JSON_CLASS_BACKSLASH;
+    }
+    return 0;
+}
+
+/**
+ * Classifies the 64 bytes of a block.
+ */
+inline void classify(const char* p, JsonBlock* block) {
+#ifdef CSR_JSON_SSE2
+    const __m128i openBrace = _mm_set1_epi8('{');
+    const __m128i closeBrace = _mm_set1_epi8('}');
+    const __m128i openBracket = _mm_set1_epi8('[');
+    const __m128i closeBracket = _mm_set1_epi8(']');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    memset(block, 0, sizeof(*block));
+    for (int i = 0; i < 4; i++) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(p + i * 16));
+        __m128i operators = _mm_or_si128(
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, openBrace),
+                             _mm_cmpeq_epi8(bytes, closeBrace)),
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, openBracket),
+                             _mm_cmpeq_epi8(bytes, closeBracket))),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, colon),
+                         _mm_cmpeq_epi8(bytes, comma)));
+        __m128i whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, space),
+                         _mm_cmpeq_epi8(bytes, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, newline),
+                         _mm_cmpeq_epi8(bytes, carriageReturn)));
+
+        int shift = i * 16;
+        block->operators |=
+            (uint64_t)(unsigned)_mm_movemask_epi8(operators) << shift;
+        block->whitespace |=
+            (uint64_t)(unsigned)_mm_movemask_epi8(whitespace) << shift;
+        block->quotes |= (uint64_t)(unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(bytes, quote)) << shift;
+        block->backslashes |= (uint64_t)(unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(bytes, backslash)) << shift;
+        block->nonAscii |=
+            (uint64_t)(unsigned)_mm_movemask_epi8(bytes) << shift;
+    }
+#else
+    memset(block, 0, sizeof(*block));
+    for (size_t i = 0; i < JSON_BLOCK_SIZE; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        if ((unsigned char)p[i] >= 0x80) block->nonAscii |= bit;
+
+        unsigned char type = classof((unsigned char)p[i]);
+        if (!type) continue;
+
+        if (type == JSON_CLASS_OPERATOR) block->operators |= bit;
+        else if (type == JSON_CLASS_WHITESPACE) block->whitespace |= bit;
+        else if (type == JSON_CLASS_QUOTE) block->quotes |= bit;
+        else block->backslashes |= bit;
+    }
+#endif // CSR_JSON_SSE2
+}
+
+/**
+ * Finds the bytes escaped by a backslash: those after an odd-length run of
+ * backslashes.
+ *
+ * @param backslashes Backslashes of the block.
+ * @param carry Whether the previous block ended with an escaping
+ *     backslash; updated for the next block.
+ * @return Mask of escaped bytes.
+ */
+inline uint64_t findescaped(uint64_t backslashes, uint64_t* carry) {
+    // A backslash escaped by the previous block starts no run.
+    backslashes &= ~*carry;
+    uint64_t followsEscape = (backslashes << 1) | *carry;
+
+    // Runs starting on odd bits end on even bits when their length is odd,
+    // and adding the run starts to the runs flips the bits past their end.
+    uint64_t oddStarts = backslashes & ~EVEN_BITS & ~followsEscape;
+    uint64_t evenRuns = oddStarts + backslashes;
+    *carry = evenRuns < oddStarts ? 1 : 0;
+
+    uint64_t invert = evenRuns << 1;
+    return (EVEN_BITS ^ invert) & followsEscape;
+}
+
+/**
+ * Sets each bit to the parity of the bits up to it, so the bits between an
+ * opening and a closing quote are set.
+ */
+inline uint64_t prefixxor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+inline bool isdelimiter(char c) {
+    return classof((unsigned char)c) & (JSON_CLASS_OPERATOR
+                                        | JSON_CLASS_WHITESPACE);
+}
+
+inline bool isdigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * Checks that a literal is spelled out in full and ends where it should.
+ */
+inline bool isliteral(const char* p, const char* literal, size_t length) {
+    return !memcmp(p, literal, length) && isdelimiter(p[length]);
+}
+
+/**
+ * Finds the end of a number and checks its grammar.
+ *
+ * @param p Start of the number.
+ * @param isInteger Set to whether it has no fraction or exponent.
+ * @return End of the number, or NULL if it is malformed.
+ */
+const char* scannumber(const char* p, bool* isInteger) {
+    *isInteger = true;
+    if (*p == '-') p++;
+
+    if (*p == '0') p++;
+    else if (*p >= '1' && *p <= '9') while (isdigit(*p)) p++;
+    else return NULL;
+
+    if (*p == '.') {
+        *isInteger = false;
+        p++;
+        if (!isdigit(*p)) return NULL;
+        while (isdigit(*p)) p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        *isInteger = false;
+        p++;
+        if (*p == '+' || *p == '-') p++;
+        if (!isdigit(*p)) return NULL;
+        while (isdigit(*p)) p++;
+    }
+    return isdelimiter(*p) ? p : NULL;
+}
+
+/**
+ * Reads the 4 hex digits of a \u escape.
+ *
+ * @return The code unit, or -1 if a digit is not hex.
+ */
+long readhex(const char* p) {
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return -1;
+    }
+    return value;
+}
+
+/**
+ * Unescapes a string.
+ *
+ * @param p First byte after the opening quote.
+ * @param end Closing quote.
+ * @param output Buffer of at least `end - p` bytes.
+ * @return Number of bytes written, or -1 if an escape is malformed.
+ */
+long unescape(const char* p, const char* end, char* output) {
+    char* out = output;
+    while (p < end) {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+
+        p++;
+        switch (*p++) {
+            case '"': *out++ = '"'; continue;
+            case '\\': *out++ = '\\'; continue;
+            case '/': *out++ = '/'; continue;
+            case 'b': *out++ = '\b'; continue;
+            case 'f': *out++ = '\f'; continue;
+            case 'n': *out++ = '\n'; continue;
+            case 'r': *out++ = '\r'; continue;
+            case 't': *out++ = '\t'; continue;
+            case 'u': break;
+            default: return -1;
+        }
+
+        // Escaped code points are written as UTF-8, joining surrogate
+        // pairs; "\uXXXX" is 6 bytes and no code point takes more than 4.
+        if (end - p < 4) return -1;
+        long codePoint = readhex(p);
+        p += 4;
+        if (codePoint < 0 || (codePoint >= 0xdc00 && codePoint <= 0xdfff)) {
+            return -1;
+        }
+        if (codePoint >= 0xd800 && codePoint <= 0xdbff) {
+            if (end - p < 6 || p[0] != '\\' || p[1] != 'u') return -1;
+            long low = readhex(p + 2);
+            if (low < 0xdc00 || low > 0xdfff) return -1;
+            p += 6;
+            codePoint = 0x10000 + ((codePoint - 0xd800) << 10)
+                + (low - 0xdc00);
+        }
+
+        if (codePoint < 0x80) {
+            *out++ = (char)codePoint;
+        } else if (codePoint < 0x800) {
+            *out++ = (char)(0xc0 | (codePoint >> 6));
+            *out++ = (char)(0x80 | (codePoint & 0x3f));
+        } else if (codePoint < 0x10000) {
+            *out++ = (char)(0xe0 | (codePoint >> 12));
+            *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            *out++ = (char)(0x80 | (codePoint & 0x3f));
+        } else {
+            *out++ = (char)(0xf0 | (codePoint >> 18));
+            *out++ = (char)(0x80 | ((codePoint >> 12) & 0x3f));
+            *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            *out++ = (char)(0x80 | (codePoint & 0x3f));
+        }
+    }
+    return out - output;
+}
+
+/**
+ * Finds the closing quote of a string.
+ *
+ * @param p First byte after the opening quote.
+ * @param hasEscapes Set to whether the string has escapes.
+ * @return The closing quote, or NULL if the string holds a control
+ *     character.
+ */
+const char* scanstring(const char* p, bool* hasEscapes) {
+    *hasEscapes = false;
+    while (*p != '"') {
+        if ((unsigned char)*p < 0x20) return NULL;
+        if (*p == '\\') {
+            *hasEscapes = true;
+            p++;
+            if ((unsigned char)*p < 0x20) return NULL;
+        }
+        p++;
+    }
+    return p;
+}
+
+} // namespace
+
+/*******************************************************************************
+ * JsonValue
+ ******************************************************************************/
+
+JsonValue::JsonValue() : document(NULL), index(0) {}
+
+JsonValue::JsonValue(JsonDocument* document, size_t index)
+    : document(document),
+      index(index)
+{}
+
+char JsonValue::getStart() {
+    if (!this->document) return '\0';
+    return this->document->data[this->document->structurals[this->index]];
+}
+
+size_t JsonValue::skip(size_t index) {
+    char c = this->document->data[this->document->structurals[index]];
+    if (c == '{' || c == '[') return this->document->ends[index] + 1;
+    return index + 1;
+}
+
+JsonType JsonValue::getType() {
+    switch (this->getStart()) {
+        case '\0': return JSON_MISSING;
+        case '{': return JSON_OBJECT;
+        case '[': return JSON_ARRAY;
+        case '"': return JSON_STRING;
+        case 't': case 'f': return JSON_BOOL;
+        case 'n': return JSON_NULL;
+    }
+    return JSON_NUMBER;
+}
+
+bool JsonValue::isMissing() {
+    return !this->document;
+}
+
+bool JsonValue::isNull() {
+    return this->getStart() == 'n';
+}
+
+JsonValue JsonValue::get(const char* name) {
+    if (this->getStart() != '{' || !name) return JsonValue();
+
+    size_t nameLength = strlen(name);
+    for (JsonValue value = this->getFirst();
+         !value.isMissing();
+         value = value.getNext())
+    {
+        const char* key = NULL;
+        size_t keyLength = 0;
+        if (value.getKey(&key, &keyLength)
+            && keyLength == nameLength
+            && !memcmp(key, name, nameLength))
+        {
+            return value;
+        }
+    }
+    return JsonValue();
+}
+
+JsonValue JsonValue::at(size_t position) {
+    if (this->getStart() != '[') return JsonValue();
+
+    JsonValue value = this->getFirst();
+    while (position-- && !value.isMissing()) value = value.getNext();
+    return value;
+}
+
+JsonValue JsonValue::getFirst() {
+    char c = this->getStart();
+    if (c != '{' && c != '[') return JsonValue();
+
+    // Object members are a key, a colon and the value.
+    const char* data = this->document->data;
+    const vector<uint32_t>& structurals = this->document->structurals;
+    size_t first = this->index + 1;
+    char next = data[structurals[first]];
+    if (next == '}' || next == ']') return JsonValue();
+    return JsonValue(this->document, c == '{' ? first + 2 : first);
+}
+
+JsonValue JsonValue::getNext() {
+    if (!this->document || !this->index) return JsonValue();
+
+    const char* data = this->document->data;
+    const vector<uint32_t>& structurals = this->document->structurals;
+    size_t next = this->skip(this->index);
+    if (data[structurals[next]] != ',') return JsonValue();
+
+    // A member value follows its key and a colon.
+    bool isMember = data[structurals[this->index - 1]] == ':';
+    return JsonValue(this->document, isMember ? next + 3 : next + 1);
+}
+
+bool JsonValue::getKey(const char** data, size_t* length) {
+    if (!this->document || this->index < 2) return false;
+
+    const char* text = this->document->data;
+    const vector<uint32_t>& structurals = this->document->structurals;
+    if (text[structurals[this->index - 1]] != ':') return false;
+    return JsonValue(this->document, this->index - 2).getString(data, length);
+}
+
+size_t JsonValue::getSize() {
+    size_t size = 0;
+    for (JsonValue value = this->getFirst();
+         !value.isMissing();
+         value = value.getNext())
+    {
+        size++;
+    }
+    return size;
+}
+
+bool JsonValue::getString(const char** data, size_t* length) {
+    if (this->getStart() != '"') return false;
+
+    const char* start =
+        this->document->data + this->document->structurals[this->index] + 1;
+    bool hasEscapes = false;
+    const char* end = scanstring(start, &hasEscapes);
+    if (!end) return false;
+
+    if (!hasEscapes) {
+        *data = start;
+        *length = end - start;
+        return true;
+    }
+
+    char* unescaped = new char[end - start];
+    long unescapedLength = unescape(start, end, unescaped);
+    if (unescapedLength < 0) {
+        delete[] unescaped;
+        return false;
+    }
+    this->document->strings.push_back(unescaped);
+    *data = unescaped;
+    *length = unescapedLength;
+    return true;
+}
+
+bool JsonValue::getInteger(int64_t* value) {
+    if (this->getType() != JSON_NUMBER) return false;
+
+    const char* p =
+        this->document->data + this->document->structurals[this->index];
+    bool isInteger = false;
+    const char* end = scannumber(p, &isInteger);
+    if (!end || !isInteger) return false;
+
+    bool isNegative = *p == '-';
+    if (isNegative) p++;
+
+    // Accumulate negatively, since -2^63 has no positive counterpart.
+    int64_t result = 0;
+    const int64_t min = -9223372036854775807LL - 1;
+    for (; p < end; p++) {
+        int digit = *p - '0';
+        if (result < (min + digit) / 10) return false;
+        result = result * 10 - digit;
+    }
+    if (!isNegative && result == min) return false;
+
+    *value = isNegative ? result : -result;
+    return true;
+}
+
+bool JsonValue::getNumber(double* value) {
+    if (this->getType() != JSON_NUMBER) return false;
+
+    const char* p =
+        this->document->data + this->document->structurals[this->index];
+    bool isInteger = false;
+    if (!scannumber(p, &isInteger)) return false;
+
+    // The number is followed by a delimiter, where strtod() stops.
+    *value = strtod(p, NULL);
+    return true;
+}
+
+bool JsonValue::getBool(bool* value) {
+    char c = this->getStart();
+    if (c != 't' && c != 'f') return false;
+    *value = c == 't';
+    return true;
+}
+
+/*******************************************************************************
+ * JsonDocument
+ ******************************************************************************/
+
+JsonDocument::JsonDocument()
+    : data(NULL),
+      length(0),
+      capacity(0),
+      isAsciiText(true)
+{}
+
+void JsonDocument::reserve(size_t length) {
+    if (length + JSON_PADDING <= this->capacity) return;
+
+    size_t capacity = this->capacity ? this->capacity : JSON_READ_BUFFER_SIZE;
+    while (capacity < length + JSON_PADDING) capacity *= 2;
+
+    char* data = (char*)trackedrealloc(this->data, capacity);
+    if (!data) throw runtime_error("Failed to allocate JSON buffer.");
+    this->data = data;
+    this->capacity = capacity;
+}
+
+void JsonDocument::parse(const char* json, size_t length) {
+    this->clear();
+    if (length > MAX_JSON_BODY_SIZE) {
+        this->fail("JSON text exceeds MAX_JSON_BODY_SIZE.");
+    }
+
+    this->reserve(length);
+    if (length) memcpy(this->data, json, length);
+    this->length = length;
+    this->index();
+    this->validate();
+}
+
+void JsonDocument::parse(Stream* stream) {
+    this->clear();
+    stream->rewind();
+
+    while (true) {
+        this->reserve(this->length + JSON_READ_BUFFER_SIZE);
+        size_t bytesRead =
+            stream->read(this->data + this->length, JSON_READ_BUFFER_SIZE);
+        if (!bytesRead) break;
+
+        this->length += bytesRead;
+        if (this->length > MAX_JSON_BODY_SIZE) {
+            this->fail("JSON text exceeds MAX_JSON_BODY_SIZE.");
+        }
+    }
+
+    this->index();
+    this->validate();
+}
+
+void JsonDocument::index() {
+    // Pad the text with whitespace so whole blocks can be read.
+    memset(this->data + this->length, ' ', JSON_PADDING);
+    this->structurals.reserve(this->length / 4 + 1);
+
+    uint64_t escapeCarry = 0;
+    uint64_t inStringCarry = 0;
+    uint64_t scalarCarry = 0;
+    uint64_t nonAscii = 0;
+    for (size_t offset = 0; offset < this->length; offset += JSON_BLOCK_SIZE) {
+        JsonBlock block;
+        classify(this->data + offset, &block);
+        nonAscii |= block.nonAscii;
+
+        uint64_t escaped = findescaped(block.backslashes, &escapeCarry);
+        uint64_t quotes = block.quotes & ~escaped;
+
+        // Bits from an opening quote up to, not including, its closing one.
+        uint64_t inString = prefixxor(quotes) ^ inStringCarry;
+        inStringCarry = (uint64_t)((int64_t)inString >> 63);
+        uint64_t stringTails = inString ^ quotes;
+
+        // A value starts at a byte that is not an operator or whitespace and
+        // does not follow such a byte; quotes end their string.
+        uint64_t scalars = ~(block.operators | block.whitespace);
+        uint64_t nonQuoteScalars = scalars & ~quotes;
+        uint64_t followsScalar = (nonQuoteScalars << 1) | scalarCarry;
+        scalarCarry = nonQuoteScalars >> 63;
+        uint64_t starts = scalars & ~followsScalar;
+
+        uint64_t structurals = (block.operators | starts) & ~stringTails;
+        while (structurals) {
+            this->structurals.push_back(
+                (uint32_t)(offset + lowestbit(structurals)));
+            structurals &= structurals - 1;
+        }
+    }
+
+    this->isAsciiText = !nonAscii;
+    if (inStringCarry) this->fail("Unclosed JSON string.");
+}
+
+void JsonDocument::validate() {
+    enum State {
+        STATE_VALUE,
+        STATE_VALUE_OR_CLOSE,
+        STATE_KEY,
+        STATE_KEY_OR_CLOSE,
+        STATE_COLON,
+        STATE_COMMA_OR_CLOSE,
+        STATE_DONE
+    };
+
+    const char* data = this->data;
+    size_t count = this->structurals.size();
+    this->ends.resize(count);
+
+    vector<uint32_t> containers;
+    State state = STATE_VALUE;
+    for (size_t i = 0; i < count; i++) {
+        const char* p = data + this->structurals[i];
+        char c = *p;
+        bool isClosed = false;
+        bool isValue = false;
+
+        switch (state) {
+            case STATE_VALUE:
+            case STATE_VALUE_OR_CLOSE:
+                if (c == ']' && state == STATE_VALUE_OR_CLOSE) {
+                    isClosed = true;
+                } else if (c == '{' || c == '[') {
+                    containers.push_back(i);
+                    state = c == '{' ? STATE_KEY_OR_CLOSE
+                                     : STATE_VALUE_OR_CLOSE;
+                } else if (c == '"'
+                           || c == '-'
+                           || isdigit(c)
+                           || (c == 't' && isliteral(p, "true", 4))
+                           || (c == 'f' && isliteral(p, "false", 5))
+                           || (c == 'n' && isliteral(p, "null", 4)))
+                {
+                    isValue = true;
+                } else {
+                    this->fail("Unexpected JSON value.");
+                }
+                break;
+
+            case STATE_KEY:
+            case STATE_KEY_OR_CLOSE:
+                if (c == '}' && state == STATE_KEY_OR_CLOSE) isClosed = true;
+                else if (c == '"') state = STATE_COLON;
+                else this->fail("Expected JSON object key.");
+                break;
+
+            case STATE_COLON:
+                if (c != ':') this->fail("Expected ':' after JSON key.");
+                state = STATE_VALUE;
+                break;
+
+            case STATE_COMMA_OR_CLOSE: {
+                bool isObject = data[this->structurals[containers.back()]]
+                    == '{';
+                if (c == ',') {
+                    state = isObject ? STATE_KEY : STATE_VALUE;
+                } else if (c == (isObject ? '}' : ']')) {
+                    isClosed = true;
+                } else {
+                    this->fail("Expected ',' or end of JSON container.");
+                }
+                break;
+            }
+
+            case STATE_DONE:
+                this->fail("Unexpected data after JSON value.");
+        }
+
+        if (isClosed) {
+            this->ends[containers.back()] = i;
+            containers.pop_back();
+            isValue = true;
+        }
+        if (isValue) {
+            state = containers.empty() ? STATE_DONE : STATE_COMMA_OR_CLOSE;
+        }
+    }
+
+    if (state != STATE_DONE) this->fail("Unexpected end of JSON text.");
+}
+
+void JsonDocument::fail(const string& message) {
+    this->clear();
+    this->error = message;
+    throw invalid_argument(message);
+}
+
+void JsonDocument::clear() {
+    this->length = 0;
+    this->structurals.clear();
+    this->ends.clear();
+    for (size_t i = 0; i < this->strings.size(); i++) {
+        delete[] this->strings[i];
+    }
+    this->strings.clear();
+    this->error.clear();
+    this->isAsciiText = true;
+}
+
+JsonValue JsonDocument::getRoot() {
+    if (this->structurals.empty()) return JsonValue();
+    return JsonValue(this, 0);
+}
+
+const char* JsonDocument::getError() {
+    return this->error.empty() ? NULL : this->error.c_str();
+}
+
+bool JsonDocument::isUtf8() {
+    return this->isAsciiText
+        || Utf8Validator::isValid(this->data, this->length);
+}
+
+bool JsonDocument::isVectorized() {
+#ifdef CSR_JSON_SSE2
+    return true;
+#else
+    return false;
+#endif // CSR_JSON_SSE2
+}
+
+JsonDocument::~JsonDocument() {
+    this->clear();
+    trackedfree(this->data);
+}
+
+}}} // Csr::Http::Message
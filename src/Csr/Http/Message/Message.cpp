@@ -1,4 +1,5 @@
 #include "Message.hpp"
+#include "HeaderValidator.hpp"
 #include "Shared.hpp"
 
 #include <stdlib.h>
@@ -11,6 +12,22 @@ namespace Message {
 
 using std::runtime_error;
 
+namespace {
+
+/**
+ * Rejects a header field that could inject other fields into a head.
+ */
+inline void checkheader(const char* name, const char* value) {
+    if (!HeaderValidator::isValidName(name)) {
+        throw runtime_error("Invalid header name.");
+    }
+    if (value && !HeaderValidator::isValidValue(value, strlen(value))) {
+        throw runtime_error("Invalid header value: CR and LF are not allowed.");
+    }
+}
+
+} // namespace
+
 /*******************************************************************************
  * ValueNode
  ******************************************************************************/
@@ -26,15 +43,16 @@ ValueNode::~ValueNode() {
 /*******************************************************************************
  * ValueList
  ******************************************************************************/
-ValueList::ValueList() : head(NULL), tail(NULL), line(NULL) {}
+ValueList::ValueList() : head(NULL), tail(NULL), line(NULL), joined(NULL) {}
 
 void ValueList::addValue(const char* value) {
     ValueNode* node = new ValueNode(value);
 
-    // Handle first value in list.
+    // Handle first value in list; a single value is its own line.
     if (!this->head && !this->tail) {
         this->head = node;
         this->tail = node;
+        this->line = node->value;
         return;
     }
 
@@ -43,42 +61,22 @@ void ValueList::addValue(const char* value) {
 
     // Set next tail.
     this->tail = node;
+
+    // Join the new value to the line. The length should be that of the line
+    // plus one for the comma separator, the value and the null-terminator.
+    char* joined = new char[strlen(this->line) + strlen(node->value) + 2];
+    strcpy(joined, this->line);
+    strcat(joined, ",");
+    strcat(joined, node->value);
+
+    delete[] this->joined;
+    this->joined = joined;
+    this->line = joined;
 }
 
 const char* ValueList::getLine() {
-    delete[] this->line;
-
     // Return null-terminated string if there are no values.
-    if (!this->head) {
-        this->line = nullstr();
-        return this->line;
-    }
-
-    // Start at head.
-    ValueNode* node = this->head;
-
-    // Get length of line string. It should be the length of the value plus
-    // one for each comma separator and the null-terminator.
-    size_t length = 0;
-    while (node) {
-        length += strlen(node->value) + 1;
-        node = node->next;
-    }
-
-    this->line = new char[length];
-    *this->line = '\0';
-
-    // Reset to head.
-    node = this->head;
-
-    // Concatenate strings to form line.
-    while (node) {
-        strcat(this->line, node->value);
-        node = node->next;
-        if (node) strcat(this->line, ",");
-    }
-
-    return this->line;
+    return this->line ? this->line : "";
 }
 
 ValueList::~ValueList() {
@@ -95,6 +93,8 @@ ValueList::~ValueList() {
         // Set next node.
         node = next;
     }
+
+    delete[] this->joined;
 }
 
 /*******************************************************************************
@@ -196,8 +196,10 @@ void HeaderList::addHeader(const char* name, const char* value) {
                 node->next = curr->next;
             }
 
+            // Names are unique, so nothing else to replace.
             delete curr;
             exists = true;
+            break;
         }
 
         prev = curr;
@@ -243,7 +245,7 @@ void HeaderList::addHeaderValue(const char* name, const char* value) {
 
         // Set next tail.
         this->tail = node;
-    }
+    } else delete node;
 }
 
 ValueList* HeaderList::getHeader(const char* name) {
@@ -300,7 +302,9 @@ void HeaderList::removeHeader(const char* name) {
                 prev->next = curr->next;
             }
 
+            // Names are unique, so nothing else to remove.
             delete curr;
+            break;
         }
 
         prev = curr;
@@ -308,7 +312,7 @@ void HeaderList::removeHeader(const char* name) {
     }
 }
 
-HeaderList::~HeaderList() {
+void HeaderList::reset() {
     // Start at head.
     HeaderNode* node = this->head;
 
@@ -322,6 +326,13 @@ HeaderList::~HeaderList() {
         // Set next node.
         node = next;
     }
+
+    this->head = NULL;
+    this->tail = NULL;
+}
+
+HeaderList::~HeaderList() {
+    this->reset();
 }
 
 /*******************************************************************************
@@ -372,7 +383,7 @@ ValueIterator HeaderIterator::getValues() {
 /*******************************************************************************
  * Message
  ******************************************************************************/
-Message::Message() : version(nullstr()), headers(), body(new Stream()) {}
+Message::Message() : version(nullstr()), headers(), body(NULL) {}
 
 const char* Message::getProtocolVersion() {
     return this->version;
@@ -404,10 +415,12 @@ const char* Message::getHeaderLine(const char* name) {
 }
 
 void Message::setHeader(const char* name, const char* value) {
+    checkheader(name, value);
     this->headers.addHeader(name, value);
 }
 
 void Message::setAddedHeader(const char* name, const char* value) {
+    checkheader(name, value);
     this->headers.addHeaderValue(name, value);
 }
 
@@ -416,15 +429,24 @@ void Message::removeHeader(const char* name) {
 }
 
 Stream* Message::getBody() {
+    // Created on first use, so messages without a body cost no stream.
+    if (!this->body) this->body = new Stream();
     return this->body;
 }
 
 void Message::setBody(Stream* body) {
-    this->body->close();
+    if (this->body) this->body->close();
     delete this->body;
     this->body = body;
 }
 
+void Message::reset() {
+    // Keep the buffer; versions are replaced, never appended to.
+    *this->version = '\0';
+    this->headers.reset();
+    if (this->body) this->body->reset();
+}
+
 Message::~Message() {
     delete[] this->version;
     if (this->body) this->body->close();
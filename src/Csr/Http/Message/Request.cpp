@@ -39,95 +39,79 @@ inline void validatemethod(const char* value) {
     }
 }
 
-} // namespace
-
-Request::Request(const char* method, const char* uri) {
-    this->requestTarget = NULL;
-    this->method = NULL;
-    this->uri = NULL;
-
-    validatemethod(method);
-    this->method = copystr(method);
-
-    this->uri = new Uri(uri);
-    this->setHeader("Host", this->uri->getHost());
-
-    const char* path = this->uri->getPath();
-    const char* query = this->uri->getQuery();
+/**
+ * Builds the request-target of a URI in origin-form.
+ *
+ * @param uri URI of the request.
+ * @return Newly allocated request-target, "/" if the URI has neither a path
+ *     nor a query.
+ */
+inline char* origintarget(Uri* uri) {
+    const char* path = uri->getPath();
+    const char* query = uri->getQuery();
 
     // If the URI does not provide a path or query then default the
-    // request-target to "/".
+    // request-target to '/'.
     if (!*path && !*query) {
-        this->requestTarget = new char[2];
-        this->requestTarget[0] = '/';
-        this->requestTarget[1] = '\0';
-        return;
+        char* target = new char[2];
+        target[0] = '/';
+        target[1] = '\0';
+        return target;
     }
 
     // Otherwise default the request-target to origin-form.
-    size_t length = 1; // For '\0';
+    size_t length = 1; // For '\0'.
     if (*path) length += strlen(path);
     if (*query) length += strlen(query) + 1; // For '?'.
 
-    this->requestTarget = new char[length];
-    *this->requestTarget = '\0';
+    char* target = new char[length];
+    *target = '\0';
 
     if (*path) {
-        strcat(this->requestTarget, path);
+        strcat(target, path);
     }
 
     if (*query) {
         const char* connector = "?";
-        strcat(this->requestTarget, connector);
+        strcat(target, connector);
 
-        strcat(this->requestTarget, query);
+        strcat(target, query);
     }
+
+    return target;
 }
 
-Request::Request(const char* method, Uri* uri) {
+} // namespace
+
+Request::Request(const char* method, const char* uri) {
     this->requestTarget = NULL;
     this->method = NULL;
     this->uri = NULL;
 
     validatemethod(method);
-
     this->method = copystr(method);
 
-    if (!uri) return;
-
-    this->uri = uri;
+    this->uri = new Uri(uri);
     this->setHeader("Host", this->uri->getHost());
 
-    const char* path = this->uri->getPath();
-    const char* query = this->uri->getQuery();
+    this->requestTarget = origintarget(this->uri);
+}
 
-    // If the URI does not provide a path or query then default the
-    // request-target to '/'.
-    if (!*path && !*query) {
-        this->requestTarget = new char[2];
-        this->requestTarget[0] = '/';
-        this->requestTarget[1] = '\0';
-        return;
-    }
+Request::Request(const char* method, Uri* uri) {
+    this->requestTarget = NULL;
+    this->method = NULL;
+    this->uri = NULL;
 
-    // Otherwise default the request-target to origin-form.
-    size_t length = 1; // For '\0'.
-    if (*path) length += strlen(path);
-    if (*query) length += strlen(query) + 1; // For '?'.
+    validatemethod(method);
 
-    this->requestTarget = new char[length];
-    *this->requestTarget = '\0';
+    this->method = copystr(method);
 
-    if (*path) {
-        strcat(this->requestTarget, path);
-    }
+    if (!uri) return;
 
-    if (*query) {
-        const char* connector = "?";
-        strcat(this->requestTarget, connector);
+    this->uri = uri;
+    this->setHeader("Host", this->uri->getHost());
 
-        strcat(this->requestTarget, query);
-    }
+    this->requestTarget = origintarget(this->uri);
 }
 
 const char* Request::getRequestTarget() {
@@ -158,6 +142,20 @@ void Request::setUri(Uri* uri, bool preserveHost) {
     if (uri && preserveHost) this->setHeader("Host", uri->getHost());
 }
 
+void Request::reset(const char* method, const char* uri) {
+    validatemethod(method);
+    Uri* parsed = new Uri(uri);
+
+    Message::reset();
+    delete[] this->method;
+    this->method = copystr(method);
+    delete this->uri;
+    this->uri = parsed;
+    this->setHeader("Host", this->uri->getHost());
+    delete[] this->requestTarget;
+    this->requestTarget = origintarget(this->uri);
+}
+
 Request::~Request() {
     delete[] this->requestTarget;
     delete[] this->method;
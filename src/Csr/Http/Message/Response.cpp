@@ -1,14 +1,13 @@
 #include "Response.hpp"
 #include "Shared.hpp"
 
+#include <stdio.h>
 #include <stdexcept>
-#include <sstream>
 
 namespace Csr {
 namespace Http {
 namespace Message {
 
-using std::ostringstream;
 using std::invalid_argument;
 
 namespace {
@@ -35,9 +34,9 @@ inline void validateStatusCode(unsigned short code) {
         return;
     }
 
-    ostringstream oss;
-    oss << "Invalid status code: " << code << ".";
-    throw invalid_argument(oss.str());
+    char message[32];
+    snprintf(message, sizeof(message), "Invalid status code: %u.", (unsigned)code);
+    throw invalid_argument(message);
 }
 
 } // namespace
@@ -63,6 +62,13 @@ const char* Response::getReasonPhrase() {
     return this->reasonPhrase;
 }
 
+void Response::reset(unsigned short code, const char* reasonPhrase) {
+    Message::reset();
+    this->code = code;
+    delete[] this->reasonPhrase;
+    this->reasonPhrase = copystr(reasonPhrase);
+}
+
 Response::~Response() {
     delete[] this->reasonPhrase; 
 }
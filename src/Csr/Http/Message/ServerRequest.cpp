@@ -1,5 +1,7 @@
 #include "ServerRequest.hpp"
 #include "UploadedFile.hpp"
+#include "HeaderValidator.hpp"
+#include "Utf8Validator.hpp"
 #include "Shared.hpp"
 
 #include <stdlib.h>
@@ -7,6 +9,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdexcept>
+#include <string>
 
 // Size of buffer to parse upload file body lines.
 // NOTE: Prevents DoS attacks.
@@ -35,48 +38,21 @@
 #define MAX_HEADER_LENGTH 1024 // Default 1KB.
 #endif // MAX_HEADER_LENGTH
 
+// Size of the chunks a body is read in to validate it as UTF-8.
+#ifndef UTF8_READ_BUFFER_SIZE
+#define UTF8_READ_BUFFER_SIZE 16384 // Default 16KB.
+#endif // UTF8_READ_BUFFER_SIZE
+
 namespace Csr {
 namespace Http {
 namespace Message {
 
+using std::invalid_argument;
 using std::runtime_error;
+using std::string;
 
 namespace {
 
-/**
- * Decode a URL-encoded string.
- *
- * This function MUST return a null-terminated string if it cannot decode
- * the given string.
- *
- * @param str String to decode.
- */
-inline char* urldecode(const char* str) {
-    if (!str) return NULL;
-
-    size_t len = strlen(str);
-    char* dst = new char[len + 1];
-    char* start = dst;
-
-    unsigned short i = 0;
-    while (*str && i <= len) {
-        if (*str == '+') {
-            *dst++ = ' ';
-            str++;
-        } else if (*str == '%' && str[1] && str[2]) {
-            char hex[3] = {str[1], str[2], '\0'};
-            *dst++ = (char)strtol(hex, NULL, 16);
-            str += 3;
-        } else *dst++ = *str++;
-
-        i++;
-    }
-
-    *dst = '\0';
-
-    return start;
-}
-
 /**
  * Read a line from a file.
  *
@@ -93,6 +69,29 @@ inline int readline(FILE* file, char* buffer, size_t size) {
     return 1;
 }
 
+/**
+ * Copies a slice into a null-terminated string, reusing its memory.
+ */
+inline const char* slicestr(string& str, const HttpSlice& slice) {
+    str.assign(slice.data, slice.length);
+    return str.c_str();
+}
+
+/**
+ * Removes the bytes of a header value that could inject other fields.
+ */
+inline const char* stripstr(string& str) {
+    if (!str.empty()) str.resize(HeaderValidator::strip(&str[0], str.size()));
+    return str.c_str();
+}
+
+/**
+ * Checks whether or not a null-terminated string is valid UTF-8.
+ */
+inline bool isutf8(const char* str) {
+    return Utf8Validator::isValid(str, strlen(str));
+}
+
 } // namespace
 
 /*******************************************************************************
@@ -100,7 +99,7 @@ inline int readline(FILE* file, char* buffer, size_t size) {
  ******************************************************************************/
 ServerParamNode::ServerParamNode(const char* name, const char* value) {
     this->name = copystr(name);
-    this->value = copystr(name);
+    this->value = copystr(value);
     this->next = NULL;
 }
 
@@ -147,7 +146,7 @@ const char* ServerParamList::getServerParam(const char* name) {
     return "";
 }
 
-ServerParamList::~ServerParamList() {
+void ServerParamList::reset() {
     // Start at head.
     ServerParamNode * node = this->head;
 
@@ -161,6 +160,13 @@ ServerParamList::~ServerParamList() {
         // Set next node.
         node = next;
     }
+
+    this->head = NULL;
+    this->tail = NULL;
+}
+
+ServerParamList::~ServerParamList() {
+    this->reset();
 }
 
 /*******************************************************************************
@@ -170,6 +176,7 @@ CookieNode::CookieNode(const char* name, const char* value) {
     this->name = copystr(name);
     this->value = copystr(value);
     this->next = NULL;
+    this->isUtf8 = isutf8(this->name) && isutf8(this->value);
 }
 
 CookieNode::~CookieNode() {
@@ -215,7 +222,21 @@ const char* CookieList::getCookie(const char* name) {
     return "";
 }
 
-CookieList::~CookieList() {
+bool CookieList::isUtf8(const char* name) {
+    CookieNode* curr = this->head;
+
+    while (curr) {
+        if (!strcmp(name, curr->name)) {
+            return curr->isUtf8;
+        }
+
+        curr = curr->next;
+    }
+
+    return true;
+}
+
+void CookieList::reset() {
     // Start at head.
     CookieNode* node = this->head;
 
@@ -229,15 +250,27 @@ CookieList::~CookieList() {
         // Set next node.
         node = next;
     }
+
+    this->head = NULL;
+    this->tail = NULL;
+}
+
+CookieList::~CookieList() {
+    this->reset();
 }
 
 /*******************************************************************************
  * QueryParamNode
  ******************************************************************************/
 QueryParamNode::QueryParamNode(const char* name, const char* value) {
-    this->name = urldecode(name);
-    this->value = urldecode(value);
+    // Decoding tells whether there is anything but ASCII to validate.
+    bool isNameAscii = false;
+    bool isValueAscii = false;
+    this->name = urldecode(name, &isNameAscii);
+    this->value = urldecode(value, &isValueAscii);
     this->next = NULL;
+    this->isUtf8 = (isNameAscii || isutf8(this->name))
+        && (isValueAscii || isutf8(this->value));
 }
 
 QueryParamNode::~QueryParamNode() {
@@ -283,7 +316,21 @@ const char* QueryParamList::getQueryParam(const char* name) {
     return "";
 }
 
-QueryParamList::~QueryParamList() {
+bool QueryParamList::isUtf8(const char* name) {
+    QueryParamNode* curr = this->head;
+
+    while (curr) {
+        if (!strcmp(name, curr->name)) {
+            return curr->isUtf8;
+        }
+
+        curr = curr->next;
+    }
+
+    return true;
+}
+
+void QueryParamList::reset() {
     // Start at head.
     QueryParamNode * node = this->head;
 
@@ -297,6 +344,13 @@ QueryParamList::~QueryParamList() {
         // Set next node.
         node = next;
     }
+
+    this->head = NULL;
+    this->tail = NULL;
+}
+
+QueryParamList::~QueryParamList() {
+    this->reset();
 }
 
 /*******************************************************************************
@@ -351,7 +405,7 @@ UploadedFile* UploadedFileList::getUploadedFile(const char* name) {
     return NULL;
 }
 
-UploadedFileList::~UploadedFileList() {
+void UploadedFileList::reset() {
     // Start at head.
     UploadedFileNode* node = this->head;
 
@@ -365,15 +419,27 @@ UploadedFileList::~UploadedFileList() {
         // Set next node.
         node = next;
     }
+
+    this->head = NULL;
+    this->tail = NULL;
+}
+
+UploadedFileList::~UploadedFileList() {
+    this->reset();
 }
 
 /*******************************************************************************
  * BodyParamNode
  ******************************************************************************/
 BodyParamNode::BodyParamNode(const char* name, const char* value) {
-    this->name = urldecode(name);
-    this->value = urldecode(value);
+    // Decoding tells whether there is anything but ASCII to validate.
+    bool isNameAscii = false;
+    bool isValueAscii = false;
+    this->name = urldecode(name, &isNameAscii);
+    this->value = urldecode(value, &isValueAscii);
     this->next = NULL;
+    this->isUtf8 = (isNameAscii || isutf8(this->name))
+        && (isValueAscii || isutf8(this->value));
 }
 
 BodyParamNode::~BodyParamNode() {
@@ -419,7 +485,21 @@ const char* BodyParamList::getBodyParam(const char* name) {
     return "";
 }
 
-BodyParamList::~BodyParamList() {
+bool BodyParamList::isUtf8(const char* name) {
+    BodyParamNode* curr = this->head;
+
+    while (curr) {
+        if (!strcmp(name, curr->name)) {
+            return curr->isUtf8;
+        }
+
+        curr = curr->next;
+    }
+
+    return true;
+}
+
+void BodyParamList::reset() {
     // Start at head.
     BodyParamNode* node = this->head;
 
@@ -433,6 +513,13 @@ BodyParamList::~BodyParamList() {
         // Set next node.
         node = next;
     }
+
+    this->head = NULL;
+    this->tail = NULL;
+}
+
+BodyParamList::~BodyParamList() {
+    this->reset();
 }
 
 /*******************************************************************************
@@ -492,6 +579,9 @@ void AttributeList::removeAttribute(const char* name) {
     AttributeNode* curr = this->head;
 
     while (curr) {
+        // Save next, since the node may be deleted.
+        AttributeNode* next = curr->next;
+
         // If names are equal, delete the node.
         if (!strcmp(name, curr->name)) {
             // If it's the only node in the list, clear it.
@@ -501,7 +591,7 @@ void AttributeList::removeAttribute(const char* name) {
             }
             // If it's the head, replace it.
             else if (curr == this->head) {
-                this->head = curr->next;
+                this->head = next;
             }
             // If it's the tail, replace it and reset prev's next.
             else if (curr == this->tail) {
@@ -510,18 +600,18 @@ void AttributeList::removeAttribute(const char* name) {
 
             // If there is a previous node, reset it's next.
             if (prev) {
-                prev->next = curr->next;
+                prev->next = next;
             }
 
+            // Attributes MAY repeat, so keep looking.
             delete curr;
-        }
+        } else prev = curr;
 
-        prev = curr;
-        curr = curr->next;
+        curr = next;
     }
 }
 
-AttributeList::~AttributeList() {
+void AttributeList::reset() {
     // Start at head.
     AttributeNode* node = this->head;
 
@@ -535,6 +625,13 @@ AttributeList::~AttributeList() {
         // Set next node.
         node = next;
     }
+
+    this->head = NULL;
+    this->tail = NULL;
+}
+
+AttributeList::~AttributeList() {
+    this->reset();
 }
 
 /*******************************************************************************
@@ -556,8 +653,9 @@ void ServerRequest::parseBody() {
     {
         const char* content = this->getBody()->toString();
         char* copy = copystr(content);
+        char* cursor = copy;
 
-        char* token = strtok(copy, "&");
+        char* token = nexttoken(&cursor, '&');
         while (token && copy) {
             char* eq = strchr(token, '=');
             if (eq) {
@@ -567,7 +665,7 @@ void ServerRequest::parseBody() {
                 this->bodyParams->addBodyParam(token, eq + 1);
             }
 
-            token = strtok(NULL, "&");
+            token = nexttoken(&cursor, '&');
         }
 
         delete[] copy;
@@ -613,7 +711,7 @@ void ServerRequest::parseBody() {
                 name[0] = 0;
                 type[0] = 0;
                 filename[0] = 0;
-                free(content);
+                trackedfree(content);
                 content = NULL;
                 contentSize = 0;
                 contentCap = 0;
@@ -642,7 +740,7 @@ void ServerRequest::parseBody() {
                 contentSize = 0;
                 contentCap = sizeof(line);
 
-                content = (char*)malloc(contentCap);
+                content = (char*)trackedmalloc(contentCap);
                 if (!content) {
                     throw new runtime_error(
                         "Failed to allocate upload content buffer.");
@@ -667,7 +765,7 @@ void ServerRequest::parseBody() {
                             contentCap = MAX_UPLOAD_FILE_SIZE - contentCap;
                         } else contentCap += sizeof(line);
 
-                        content = (char*)realloc(content, contentCap);
+                        content = (char*)trackedrealloc(content, contentCap);
                         if (!content) {
                             throw new runtime_error(
                                 "Failed to reallocate upload content buffer.");
@@ -696,7 +794,7 @@ void ServerRequest::parseBody() {
         }
 
         fclose(fp);
-        if (content) free(content);
+        if (content) trackedfree(content);
     }
 }
 
@@ -718,17 +816,48 @@ ServerRequest::ServerRequest(
     this->attributes = new AttributeList();
 
     this->isBodyParsed = false;
+    this->jsonBody = NULL;
+    this->isJsonParsed = false;
+    this->isBodyUtf8Checked = false;
+    this->isBodyUtf8Valid = false;
+
+    this->parseEnvironment();
+    this->parseParams();
+}
+
+ServerRequest::ServerRequest(const HttpRequestHead& head, char** serverParams)
+    : Request(
+        string(head.method.data, head.method.length).c_str(),
+        string(head.target.data, head.target.length).c_str())
+{
+    this->environment = serverParams;
+
+    this->serverParams = new ServerParamList();
+    this->cookies = new CookieList();
+    this->queryParams = new QueryParamList();
+    this->uploadedFiles = new UploadedFileList();
+    this->bodyParams = new BodyParamList();
+    this->attributes = new AttributeList();
+
+    this->isBodyParsed = false;
+    this->jsonBody = NULL;
+    this->isJsonParsed = false;
+    this->isBodyUtf8Checked = false;
+    this->isBodyUtf8Valid = false;
+
+    this->parseHead(head);
+    this->parseParams();
+}
 
+void ServerRequest::parseEnvironment() {
     // Parse headers.
     //
-    // TODO: Headers should be sanitized for hidden '\0' null-terminators,
-    // as well as '\r' and '\n' to prevent CRLF injection attacks.
-    //
-    // NOTE: Some headers are set in `Request` like `Host`. It might not be
-    // a bad idea to add sanitization to `Message` instead of `ServerRequest`
-    // to make sure all angles are covered for these vulnerabilities.
+    // NOTE: Message rejects header fields with '\r' or '\n', which could
+    // inject other fields, so they are stripped from values here and fields
+    // with invalid names are skipped, rather than failing the request.
     unsigned short count = 0;
-    for (char** env = serverParams; *env; env++) {
+    string value;
+    for (char** env = this->environment; *env; env++) {
         // HTTP headers will start with "HTTP_" prefix.
         if (!strncmp(*env, "HTTP_", 5)) {
             // Each header is in the form NAME=VALUE.
@@ -752,14 +881,14 @@ ServerRequest::ServerRequest(
                 }
 
                 // Limit header length to maximum.
-                if (eq + 1 && strlen(eq + 1) < MAX_HEADER_LENGTH) {
-                    this->setHeader(modName, eq + 1);
-                } else if (eq + 1) {
-                    char* value = new char[MAX_HEADER_LENGTH];
-                    memcpy(eq + 1, value, MAX_HEADER_LENGTH);
-                    value[MAX_HEADER_LENGTH - 1] = '\0';
-                    this->setHeader(modName, value);
-                    delete[] value;
+                size_t length = strlen(eq + 1);
+                if (length >= MAX_HEADER_LENGTH) {
+                    length = MAX_HEADER_LENGTH - 1;
+                }
+                value.assign(eq + 1, length);
+
+                if (HeaderValidator::isValidName(modName)) {
+                    this->setHeader(modName, stripstr(value));
                 }
 
                 delete[] name;
@@ -768,7 +897,55 @@ ServerRequest::ServerRequest(
             if (count++ == MAX_HEADER_COUNT) break;
         }
     }
+}
 
+void ServerRequest::parseHead(const HttpRequestHead& head) {
+    ServerParamList* params = this->serverParams;
+    string name;
+    string value;
+    params->addServerParam("REQUEST_METHOD", slicestr(value, head.method));
+    params->addServerParam("REQUEST_URI", slicestr(value, head.target));
+    params->addServerParam("QUERY_STRING", slicestr(value, head.query));
+    params->addServerParam("SERVER_PROTOCOL", slicestr(value, head.protocol));
+
+    // Unlike in a CGI environment, Content-Type and Content-Length are
+    // headers too.
+    size_t count = head.headerCount;
+    if (count > MAX_HEADER_COUNT) count = MAX_HEADER_COUNT;
+    for (size_t i = 0; i < count; i++) {
+        const HttpHeaderSlice& header = head.headers[i];
+        slicestr(name, header.name);
+
+        // Limit header length to maximum.
+        HttpSlice limited = header.value;
+        if (limited.length >= MAX_HEADER_LENGTH) {
+            limited.length = MAX_HEADER_LENGTH - 1;
+        }
+        slicestr(value, limited);
+        stripstr(value);
+        if (!HeaderValidator::isValidName(name.c_str())) continue;
+
+        if (strcasecmp(name.c_str(), "Content-Type")
+            && !*this->serverParams->getServerParam("CONTENT_TYPE"))
+        {
+            params->addServerParam("CONTENT_TYPE", value.c_str());
+        } else if (strcasecmp(name.c_str(), "Content-Length")
+            && !*this->serverParams->getServerParam("CONTENT_LENGTH"))
+        {
+            params->addServerParam("CONTENT_LENGTH", value.c_str());
+        }
+
+        // Repeated fields are combined, except Host, which replaces the
+        // empty one taken from an origin-form URI.
+        if (strcasecmp(name.c_str(), "Host")) {
+            this->setHeader(name.c_str(), value.c_str());
+        } else {
+            this->setAddedHeader(name.c_str(), value.c_str());
+        }
+    }
+}
+
+void ServerRequest::parseParams() {
     // Get protocol version.
     const char* protocol = this->getServerParam("SERVER_PROTOCOL");
     const char* versionStart = strchr(protocol, '/');
@@ -778,8 +955,9 @@ ServerRequest::ServerRequest(
     const char* cookie = this->getHeaderLine("Cookie");
     if (*cookie) {
         char* copy = copystr(cookie);
+        char* cursor = copy;
 
-        char* token = strtok(copy, ";");
+        char* token = nexttoken(&cursor, ';');
         while (token) {
             // Cookies typically have a space after ';', so skip them.
             if (*token == ' ') {
@@ -795,7 +973,7 @@ ServerRequest::ServerRequest(
                 this->cookies->addCookie(token, eq + 1);
             }
 
-            token = strtok(NULL, ";");
+            token = nexttoken(&cursor, ';');
         }
 
         delete[] copy;
@@ -805,8 +983,9 @@ ServerRequest::ServerRequest(
     const char* query = this->getServerParam("QUERY_STRING");
     if (*query) {
         char* copy = copystr(query);
+        char* cursor = copy;
 
-        char* token = strtok(copy, "&");
+        char* token = nexttoken(&cursor, '&');
         while (token) {
             char* eq = strchr(token, '=');
             if (eq) {
@@ -816,7 +995,7 @@ ServerRequest::ServerRequest(
                 this->queryParams->addQueryParam(token, eq + 1);
             }
 
-            token = strtok(NULL, "&");
+            token = nexttoken(&cursor, '&');
         }
 
         delete[] copy;
@@ -826,6 +1005,10 @@ ServerRequest::ServerRequest(
 }
 
 const char* ServerRequest::getServerParam(const char* name) {
+    // Params derived from a parsed request head come first.
+    const char* param = this->serverParams->getServerParam(name);
+    if (*param || !this->environment) return param;
+
     // TODO: Like with headers, server params, which are typically environment
     // variables, should be sanitized for CRLF injection and DoS attacks. If
     // a malicious user is able to create environment variables, this method
@@ -859,6 +1042,117 @@ const char* ServerRequest::getBodyParam(const char* name) {
     return this->bodyParams->getBodyParam(name);
 }
 
+bool ServerRequest::isJson() {
+    // Compare the media type without its parameters or surrounding spaces.
+    const char* start = this->getServerParam("CONTENT_TYPE");
+    while (*start == ' ' || *start == '\t') start++;
+    const char* end = start;
+    while (*end && *end != ';') end++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+
+    string mediaType(start, end - start);
+    for (size_t i = 0; i < mediaType.size(); i++) {
+        mediaType[i] = (char)tolower((unsigned char)mediaType[i]);
+    }
+    return mediaType == "application/json"
+        || (mediaType.size() > 5
+            && !mediaType.compare(mediaType.size() - 5, 5, "+json"));
+}
+
+JsonValue ServerRequest::getJsonBody() {
+    // Only index the body once; a failure is kept and thrown again.
+    if (!this->isJsonParsed) {
+        this->isJsonParsed = true;
+        if (!this->isJson()) return JsonValue();
+
+        if (!this->jsonBody) this->jsonBody = new JsonDocument();
+        try {
+            this->jsonBody->parse(this->getBody());
+        } catch (invalid_argument&) {}
+    }
+
+    if (!this->jsonBody || !this->isJson()) return JsonValue();
+    if (this->jsonBody->getError()) {
+        throw invalid_argument(this->jsonBody->getError());
+    }
+    return this->jsonBody->getRoot();
+}
+
+bool ServerRequest::isCookieParamUtf8(const char* name) {
+    return this->cookies->isUtf8(name);
+}
+
+bool ServerRequest::isQueryParamUtf8(const char* name) {
+    return this->queryParams->isUtf8(name);
+}
+
+bool ServerRequest::isBodyParamUtf8(const char* name) {
+    this->parseBody();
+    return this->bodyParams->isUtf8(name);
+}
+
+bool ServerRequest::isBodyUtf8() {
+    // Only validate the body once.
+    if (this->isBodyUtf8Checked) return this->isBodyUtf8Valid;
+    this->isBodyUtf8Checked = true;
+
+    // A JSON body was already copied and scanned while it was indexed.
+    if (this->isJsonParsed && this->jsonBody && !this->jsonBody->getError()) {
+        this->isBodyUtf8Valid = this->jsonBody->isUtf8();
+        return this->isBodyUtf8Valid;
+    }
+
+    // Read in chunks, carrying a sequence cut off at the end of one chunk
+    // over to the next.
+    Stream* body = this->getBody();
+    char buffer[UTF8_READ_BUFFER_SIZE + 4];
+    size_t truncated = 0;
+    body->rewind();
+    while (true) {
+        size_t bytesRead =
+            body->read(buffer + truncated, UTF8_READ_BUFFER_SIZE);
+        if (!bytesRead) break;
+
+        size_t length = truncated + bytesRead;
+        if (!Utf8Validator::isValid(buffer, length, &truncated)) {
+            this->isBodyUtf8Valid = false;
+            return false;
+        }
+        memmove(buffer, buffer + length - truncated, truncated);
+    }
+
+    this->isBodyUtf8Valid = !truncated;
+    return this->isBodyUtf8Valid;
+}
+
+bool ServerRequest::isUtf8() {
+    for (CookieNode* node = this->cookies->head; node; node = node->next) {
+        if (!node->isUtf8) return false;
+    }
+    for (QueryParamNode* node = this->queryParams->head;
+         node;
+         node = node->next)
+    {
+        if (!node->isUtf8) return false;
+    }
+
+    this->parseBody();
+    for (BodyParamNode* node = this->bodyParams->head;
+         node;
+         node = node->next)
+    {
+        if (!node->isUtf8) return false;
+    }
+
+    // Other bodies, such as uploaded files, MAY be binary.
+    const char* contentType = this->getServerParam("CONTENT_TYPE");
+    while (*contentType == ' ' || *contentType == '\t') contentType++;
+    if (this->isJson() || strncasecmp(contentType, "text/", 5)) {
+        return this->isBodyUtf8();
+    }
+    return true;
+}
+
 const char* ServerRequest::getAttribute(const char* name, const char* def) {
     const char* value = this->attributes->getAttribute(name);
     if (!*value) return def;
@@ -873,6 +1167,44 @@ void ServerRequest::removeAttribute(const char* name) {
     this->attributes->removeAttribute(name);
 }
 
+void ServerRequest::reset(
+    const char* method,
+    const char* uri,
+    char** serverParams)
+{
+    Request::reset(method, uri);
+    this->resetParams();
+    this->environment = serverParams;
+
+    this->parseEnvironment();
+    this->parseParams();
+}
+
+void ServerRequest::reset(const HttpRequestHead& head, char** serverParams) {
+    Request::reset(
+        string(head.method.data, head.method.length).c_str(),
+        string(head.target.data, head.target.length).c_str());
+    this->resetParams();
+    this->environment = serverParams;
+
+    this->parseHead(head);
+    this->parseParams();
+}
+
+void ServerRequest::resetParams() {
+    this->serverParams->reset();
+    this->cookies->reset();
+    this->queryParams->reset();
+    this->uploadedFiles->reset();
+    this->bodyParams->reset();
+    this->attributes->reset();
+    this->isBodyParsed = false;
+    if (this->jsonBody) this->jsonBody->clear();
+    this->isJsonParsed = false;
+    this->isBodyUtf8Checked = false;
+    this->isBodyUtf8Valid = false;
+}
+
 ServerRequest::~ServerRequest() {
     delete this->serverParams;
     delete this->cookies;
@@ -880,6 +1212,7 @@ ServerRequest::~ServerRequest() {
     delete this->uploadedFiles;
     delete this->bodyParams;
     delete this->attributes;
+    delete this->jsonBody;
 }
 
 }}} // Csr::Http::Message
@@ -1,5 +1,7 @@
 #ifndef CSR_HTTP_MESSAGE_SHARED
 
+#include "AllocStats.hpp"
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -134,6 +136,185 @@ static inline char* copynstr(const char* str, size_t len) {
     return copy;
 }
 
+/**
+ * Splits the next token off a string.
+ *
+ * Similar to C's strtok(), empty tokens are skipped, but the position is kept
+ * in `cursor` instead of static storage, so threads MAY tokenize at once.
+ *
+ * @param cursor Position in a mutable string, advanced past the token.
+ * @param delimiter Character between tokens, replaced with '\0'.
+ * @return The token, or NULL if there are no more.
+ */
+static inline char* nexttoken(char** cursor, char delimiter) {
+    char* token = *cursor;
+    while (*token == delimiter) token++;
+    if (!*token) {
+        *cursor = token;
+        return NULL;
+    }
+
+    char* end = strchr(token, delimiter);
+    if (end) {
+        *end = '\0';
+        *cursor = end + 1;
+    } else {
+        *cursor = token + strlen(token);
+    }
+    return token;
+}
+
+/**
+ * Decode a URL-encoded string.
+ *
+ * This function MUST return a null-terminated string if it cannot decode
+ * the given string.
+ *
+ * For internal use only.
+ *
+ * @param str String to decode.
+ * @param isAscii If not NULL, set to whether or not every decoded byte is
+ *     ASCII, so only other strings need to be validated as UTF-8.
+ */
+static inline char* urldecode(const char* str, bool* isAscii = NULL) {
+    if (isAscii) *isAscii = true;
+    if (!str) return NULL;
+
+    size_t len = strlen(str);
+    char* dst = new char[len + 1];
+    char* start = dst;
+
+    // High bits of every decoded byte.
+    unsigned char bits = 0;
+
+    unsigned short i = 0;
+    while (*str && i <= len) {
+        if (*str == '+') {
+            *dst++ = ' ';
+            str++;
+        } else if (*str == '%' && str[1] && str[2]) {
+            char hex[3] = {str[1], str[2], '\0'};
+            *dst++ = (char)strtol(hex, NULL, 16);
+            str += 3;
+        } else *dst++ = *str++;
+
+        bits |= (unsigned char)dst[-1];
+        i++;
+    }
+
+    *dst = '\0';
+    if (isAscii) *isAscii = bits < 0x80;
+
+    return start;
+}
+
+/**
+ * Allocates memory that is counted when built with CSR_ALLOC_STATS.
+ *
+ * Memory MUST be resized with trackedrealloc() and freed with trackedfree().
+ *
+ * For internal use only.
+ *
+ * @param size Number of bytes to allocate.
+ * @return Allocated memory, or NULL if out of memory.
+ */
+static inline void* trackedmalloc(size_t size) {
+    return AllocStats::allocate(size);
+}
+
+/**
+ * Resizes memory from trackedmalloc(), like realloc().
+ *
+ * For internal use only.
+ *
+ * @param memory Memory to resize, or NULL to allocate.
+ * @param size New number of bytes.
+ * @return Resized memory, or NULL if out of memory.
+ */
+static inline void* trackedrealloc(void* memory, size_t size) {
+    return AllocStats::reallocate(memory, size);
+}
+
+/**
+ * Frees memory from trackedmalloc() or trackedrealloc().
+ *
+ * For internal use only.
+ *
+ * @param memory Memory to free, or NULL.
+ */
+static inline void trackedfree(void* memory) {
+    AllocStats::release(memory);
+}
+
+/**
+ * Checks whether or not a character may be part of a token, such as a
+ * method or header name.
+ *
+ * Tokens are made of "!#$%&'*+-.^_`|~", digits and letters, per RFC 9110.
+ *
+ * For internal use only.
+ *
+ * @param c Character to check.
+ * @return True if the character is allowed in tokens, false if not.
+ */
+static inline bool istoken(char c) {
+    static const bool tokenChars[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+        0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0,
+        // Bytes 128 to 255 are never part of tokens.
+    };
+    return tokenChars[(unsigned char)c];
+}
+
+/**
+ * Gets the index of the lowest set bit of a non-zero mask, e.g. the offset
+ * of the first byte a vector comparison matched.
+ *
+ * For internal use only.
+ *
+ * @param mask Mask with at least one bit set.
+ * @return Index of the bit.
+ */
+static inline int lowestbit(int mask) {
+#ifdef __GNUC__
+    return __builtin_ctz((unsigned int)mask);
+#else
+    int index = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif // __GNUC__
+}
+
+/**
+ * Gets the index of the lowest set bit of a non-zero 64-bit mask.
+ *
+ * For internal use only.
+ *
+ * @param mask Mask with at least one bit set.
+ * @return Index of the bit.
+ */
+static inline int lowestbit(uint64_t mask) {
+#ifdef __GNUC__
+    return __builtin_ctzll(mask);
+#else
+    int index = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif // __GNUC__
+}
+
 }}} // Csr::Http::Message
 #define CSR_HTTP_MESSAGE_SHARED
 #endif // CSR_HTTP_MESSAGE_SHARED
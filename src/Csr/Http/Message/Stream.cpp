@@ -1,4 +1,5 @@
 #include "Stream.hpp"
+#include "Shared.hpp"
 
 #include <float.h>
 #include <stdio.h>
@@ -8,9 +9,14 @@
 #include <cerrno>
 #include <cstring>
 #include <string>
-#include <sstream>
 #include <stdlib.h>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif // _WIN32
+
 // Size of buffer used in read().
 // NOTE: Saves on memory.
 #ifndef STREAM_BUFFER_SIZE
@@ -30,7 +36,6 @@ namespace Message {
 using std::strerror;
 using std::snprintf;
 using std::runtime_error;
-using std::ostringstream;
 
 namespace {
 
@@ -44,21 +49,91 @@ inline size_t sizelen(size_t value) {
     return snprintf(NULL, 0, "%zu", value);
 }
 
-} // namespace
+/**
+ * Builds the message of a failed read or write from errno.
+ *
+ * NOTE: Formatted with snprintf() so streams do not pull in iostreams.
+ *
+ * @param action "reading" or "writing".
+ * @param count Number of bytes transferred.
+ * @param length Number of bytes requested.
+ * @return Error message.
+ */
+inline std::string ioerror(const char* action, size_t count, size_t length) {
+    char message[256];
+    snprintf(message,
+             sizeof(message),
+             "Unexpected error after %s %lu of %lu bytes: %s.",
+             action,
+             (unsigned long)count,
+             (unsigned long)length,
+             strerror(errno));
+    return message;
+}
 
-Stream::Stream() : readBuffer(NULL) {
-    errno = 0;
-    this->resource = tmpfile();
-    if (errno || !this->resource) {
-        std::string error = strerror(errno);
-        std::string message = "Failed to open default stream: " + error + ".";
-        throw runtime_error(message);
+/**
+ * Allocates a string read from a stream, linked to the previous one so both
+ * are freed together.
+ *
+ * @param previous Previous string, or NULL.
+ * @param size Number of bytes, including the null-terminator.
+ * @return The string, or NULL if out of memory.
+ */
+inline char* allocread(char* previous, size_t size) {
+    char** link = (char**)trackedmalloc(sizeof(char*) + size);
+    if (!link) return NULL;
+    *link = previous;
+    return (char*)(link + 1);
+}
+
+/**
+ * Resizes the string allocated last, keeping its link.
+ */
+inline char* reallocread(char* string, size_t size) {
+    char** link = (char**)trackedrealloc(
+        (char**)string - 1, sizeof(char*) + size);
+    return link ? (char*)(link + 1) : NULL;
+}
+
+/**
+ * Truncates a file to empty and moves to its beginning.
+ *
+ * @return True if the file was truncated, false if not.
+ */
+inline bool truncatefile(FILE* file) {
+    if (fflush(file)) return false;
+#ifdef _WIN32
+    if (_chsize(_fileno(file), 0)) return false;
+#else
+    if (ftruncate(fileno(file), 0)) return false;
+#endif // _WIN32
+    std::rewind(file);
+    return true;
+}
+
+/**
+ * Frees a string read from a stream and every string before it.
+ */
+inline void freereads(char* string) {
+    while (string) {
+        char** link = (char**)string - 1;
+        string = *link;
+        trackedfree(link);
     }
+}
+
+} // namespace
+
+Stream::Stream()
+    : resource(NULL), readBuffer(NULL), isDeferred(true), isTemporary(false)
+{
     this->readable = true;
     this->writable = true;
 }
 
-Stream::Stream(const char* filename, const char* mode) : readBuffer(NULL) {
+Stream::Stream(const char* filename, const char* mode)
+    : readBuffer(NULL), isDeferred(false), isTemporary(false)
+{
     errno = 0;
     this->resource = fopen(filename, mode);
     if (errno || !this->resource) {
@@ -81,7 +156,9 @@ Stream::Stream(const char* filename, const char* mode) : readBuffer(NULL) {
     }
 }
 
-Stream::Stream(FILE* resource) : readBuffer(NULL) {
+Stream::Stream(FILE* resource)
+    : readBuffer(NULL), isDeferred(false), isTemporary(false)
+{
     this->resource = resource;
 
     // NOTE: It's hard to tell if an existing FILE* is readable or writable
@@ -92,46 +169,74 @@ Stream::Stream(FILE* resource) : readBuffer(NULL) {
     this->writable = true;
 }
 
+void Stream::create() {
+    errno = 0;
+    FILE* resource = tmpfile();
+    if (errno || !resource) {
+        if (resource) fclose(resource);
+        std::string error = strerror(errno);
+        std::string message = "Failed to open default stream: " + error + ".";
+        throw runtime_error(message);
+    }
+    this->resource = resource;
+    this->isDeferred = false;
+    this->isTemporary = true;
+}
+
 const char* Stream::toString() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted toString() on closed or detached stream.");
     }
 
     long cursor = this->tell();
     this->seek(0);
     const char* string = this->read(MAX_STREAM_READ_SIZE);
-    this->seek(cursor);
+    this->position(cursor, SEEK_SET);
     return string;
 }
 
 void Stream::close() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted close() on closed or detached stream.");
     }
 
+    // Nothing was written, so there is no resource to close.
+    if (this->isDeferred) {
+        this->isDeferred = false;
+        this->readable = false;
+        this->writable = false;
+        return;
+    }
+
     fclose(this->resource);
     this->resource = NULL;
+    this->isTemporary = false;
     this->readable = false;
     this->writable = false;
 }
 
 FILE* Stream::detach() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted detach() on closed or detached stream.");
     }
 
+    if (this->isDeferred) this->create();
+
     FILE* temp = this->resource;
     this->resource = NULL;
+    this->isTemporary = false;
     this->readable = false;
     this->writable = false;
     return temp;
 }
 
 long Stream::getSize() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted getSize() on closed or detached stream.");
     }
 
+    if (this->isDeferred) return 0;
+
     errno = 0;
     long cursor = ftell(this->resource);
     if (errno) {
@@ -139,18 +244,20 @@ long Stream::getSize() {
         return -1;
     }
 
-    this->seek(0, SEEK_END);
+    this->position(0, SEEK_END);
     long size = ftell(this->resource);
-    this->seek(cursor);
+    this->position(cursor, SEEK_SET);
 
     return size;
 }
 
 long Stream::tell() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted tell() on closed or detached stream.");
     }
 
+    if (this->isDeferred) return 0;
+
     errno = 0;
     long position = ftell(this->resource);
     if (errno) {
@@ -162,23 +269,37 @@ long Stream::tell() {
 }
 
 bool Stream::eof() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted eof() on closed or detached stream.");
     }
 
+    if (this->isDeferred) this->create();
+
     return feof(this->resource) != 0;
 }
 
 bool Stream::isSeekable() {
+    if (this->isDeferred) return true;
     if (!this->resource) return false;
     return fseek(this->resource, 0, SEEK_CUR) == 0;
 }
 
 void Stream::seek(long offset, int whence) {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted seek() on closed or detached stream.");
     }
 
+    freereads(this->readBuffer);
+    this->readBuffer = NULL;
+    this->position(offset, whence);
+}
+
+void Stream::position(long offset, int whence) {
+    // Every offset from an empty stream other than 0 needs a resource to
+    // seek past the end or fail with.
+    if (this->isDeferred && !offset) return;
+    if (this->isDeferred) this->create();
+
     errno = 0;
     int result = fseek(this->resource, offset, whence);
     if (errno || result) {
@@ -189,10 +310,14 @@ void Stream::seek(long offset, int whence) {
 }
 
 void Stream::rewind() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted rewind() on closed or detached stream.");
     }
 
+    freereads(this->readBuffer);
+    this->readBuffer = NULL;
+    if (this->isDeferred) return;
+
     std::rewind(this->resource);
 }
 
@@ -201,20 +326,26 @@ bool Stream::isWritable() {
 }
 
 size_t Stream::write(const char* string) {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted write() on closed or detached stream.");
     }
 
     if (!string || !*string) return 0;
-    size_t length = strlen(string);
+    return this->write(string, strlen(string));
+}
+
+size_t Stream::write(const char* data, size_t length) {
+    if (!this->resource && !this->isDeferred) {
+        throw runtime_error("Attempted write() on closed or detached stream.");
+    }
+
+    if (!data || !length) return 0;
+    if (this->isDeferred) this->create();
+
     errno = 0;
-    size_t count = fwrite(string, 1, length, this->resource);
+    size_t count = fwrite(data, 1, length, this->resource);
     if (count < length && ferror(this->resource)) {
-        ostringstream oss;
-        oss << "Unexpected error after writing " << count
-            << " of " << length
-            << " bytes: " << strerror(errno) << ".";
-        throw runtime_error(oss.str());
+        throw runtime_error(ioerror("writing", count, length));
     }
     return count;
 }
@@ -224,11 +355,12 @@ bool Stream::isReadable() {
 }
 
 const char* Stream::read(size_t length) {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted read() on closed or detached stream.");
     }
 
-    free(this->readBuffer);
+    // Nothing was written, so the stream is empty.
+    if (this->isDeferred) return "";
 
     // Limit length to max read size for added security.
     if (length > MAX_STREAM_READ_SIZE) length = MAX_STREAM_READ_SIZE;
@@ -238,10 +370,20 @@ const char* Stream::read(size_t length) {
     // Limit buffer size to length to save on memory.
     if (bufferSize > length) bufferSize = length;
 
-    this->readBuffer = (char*)malloc(bufferSize);
-    if (!this->readBuffer) {
+    // Only the previous string stays valid, so reading a large stream in a
+    // loop holds at most two strings.
+    if (this->readBuffer) {
+        char** link = (char**)this->readBuffer - 1;
+        freereads(*link);
+        *link = NULL;
+    }
+
+    // +1 for null-terminator.
+    char* string = allocread(this->readBuffer, bufferSize + 1);
+    if (!string) {
         throw runtime_error("Unexpected error when allocating stream buffer.");
     }
+    this->readBuffer = string;
 
     size_t bytesRead = 0;
     size_t totalBytes = 0;
@@ -262,23 +404,20 @@ const char* Stream::read(size_t length) {
 
         if (bytesRemain < STREAM_BUFFER_SIZE) bufferSize = bytesRemain;
 
-        this->readBuffer = (char*)realloc(
+        char* grown = reallocread(
             this->readBuffer,
-            totalBytes + bufferSize);
+            totalBytes + bufferSize + 1);
 
-        if (!this->readBuffer) {
+        if (!grown) {
             throw runtime_error(
                 "Unexpected error when reallocating stream buffer.");
         }
+        this->readBuffer = grown;
     }
 
     // Read error checks.
     if (totalBytes < length && ferror(this->resource)) {
-        ostringstream oss;
-        oss << "Unexpected error after reading " << bytesRead
-            << " of " << length
-            << " bytes: " << strerror(errno) << ".";
-        throw runtime_error(oss.str());
+        throw runtime_error(ioerror("reading", bytesRead, length));
     }
 
     // Don't forget null-terminator!
@@ -287,19 +426,47 @@ const char* Stream::read(size_t length) {
     return this->readBuffer;
 }
 
+size_t Stream::read(char* buffer, size_t length) {
+    if (!this->resource && !this->isDeferred) {
+        throw runtime_error("Attempted read() on closed or detached stream.");
+    }
+
+    if (!buffer || !length || this->isDeferred) return 0;
+    errno = 0;
+    size_t count = fread(buffer, 1, length, this->resource);
+    if (count < length && ferror(this->resource)) {
+        throw runtime_error(ioerror("reading", count, length));
+    }
+    return count;
+}
+
 const char* Stream::getContents() {
-    if (!this->resource) {
+    if (!this->resource && !this->isDeferred) {
         throw runtime_error("Attempted getContents() on closed or detached stream.");
     }
 
     return this->read(MAX_STREAM_READ_SIZE);
 }
 
+void Stream::reset() {
+    freereads(this->readBuffer);
+    this->readBuffer = NULL;
+    this->readable = true;
+    this->writable = true;
+
+    if (this->isTemporary && truncatefile(this->resource)) return;
+
+    if (this->resource) fclose(this->resource);
+    this->resource = NULL;
+    this->isDeferred = true;
+    this->isTemporary = false;
+}
+
 Stream::~Stream() {
     // NOTE: We probably don't want to free this->resource because it could
     // be stdin or something. Users should be using close() or detach() when
     // they're done.
-    free(this->readBuffer);
+    freereads(this->readBuffer);
 }
 
 }}} // Csr::Http::Message
@@ -42,9 +42,9 @@ void UploadedFile::moveTo(const char* targetPath) {
     // Start at the beginning.
     this->stream->rewind();
 
-    while (!this->stream->eof()) {
-        const char* content = this->stream->read(sizeof(buffer));
-        outFile->write(content);
+    size_t bytesRead;
+    while ((bytesRead = this->stream->read(buffer, sizeof(buffer))) > 0) {
+        outFile->write(buffer, bytesRead);
     }
 
     outFile->close();
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdexcept>
 #include <string>
 
@@ -188,21 +189,18 @@ Uri::Uri(const char* uri) {
 
     // Default to null-terminated strings.
     if (!this->scheme) this->scheme = nullstr();
-    if (!this->authority) this->authority = nullstr();
     if (!this->userInfo) this->userInfo = nullstr();
     if (!this->host) this->host = nullstr();
     if (!this->port) this->port = nullstr();
     if (!this->path) this->path = nullstr();
     if (!this->query) this->query = nullstr();
     if (!this->fragment) this->fragment = nullstr();
-    if (!this->string) this->string = nullstr();
-}
 
-const char* Uri::getScheme() {
-    return this->scheme;
+    this->update();
 }
 
-const char* Uri::getAuthority() {
+void Uri::update() {
+    // "[user-info@]host[:port]".
     delete[] this->authority;
 
     size_t length = 1; // For '\0'.
@@ -223,6 +221,61 @@ const char* Uri::getAuthority() {
         strcat(this->authority, this->port);
     }
 
+    // Full URI reference.
+    delete[] this->string;
+
+    length = 1; // For '\0'.
+    if (*this->scheme) length += strlen(this->scheme) + 3; // For "://".
+    if (*this->userInfo) length += strlen(this->userInfo) + 1; // For '@'.
+    if (*this->host) length += strlen(this->host);
+    if (*this->port) length += strlen(this->port) + 1; // For ':'.
+    if (*this->path) length += strlen(this->path) + 1; // For '/'.
+    if (*this->query) length += strlen(this->query) + 1; // For '?'.
+    if (*this->fragment) length += strlen(this->fragment) + 1; // For '#'.
+
+    this->string = new char[length];
+    *this->string = '\0';
+
+    if (*this->scheme) {
+        strcat(this->string, this->scheme);
+        strcat(this->string, "://");
+    }
+
+    if (*this->userInfo) {
+        strcat(this->string, this->userInfo);
+        strcat(this->string, "@");
+    }
+
+    if (*this->host) {
+        strcat(this->string, this->host);
+    }
+
+    if (*this->port) {
+        strcat(this->string, ":");
+        strcat(this->string, this->port);
+    }
+
+    if (*this->path) {
+        if (*this->path != '/') strcat(this->string, "/");
+        strcat(this->string, this->path);
+    }
+
+    if (*this->query) {
+        strcat(this->string, "?");
+        strcat(this->string, this->query);
+    }
+
+    if (*this->fragment) {
+        strcat(this->string, "#");
+        strcat(this->string, this->fragment);
+    }
+}
+
+const char* Uri::getScheme() {
+    return this->scheme;
+}
+
+const char* Uri::getAuthority() {
     return this->authority;
 }
 
@@ -254,6 +307,7 @@ void Uri::setScheme(const char* scheme) {
     delete[] this->scheme;
     this->scheme = copystr(scheme);
     strtolower(this->scheme);
+    this->update();
 }
 
 void Uri::setUserInfo(const char* user, const char* password) {
@@ -271,83 +325,41 @@ void Uri::setUserInfo(const char* user, const char* password) {
         strcat(this->userInfo, ":");
         strcat(this->userInfo, password);
     }
+    this->update();
 }
 
 void Uri::setHost(const char* host) {
     delete[] this->host;
     this->host = copystr(host);
     strtolower(this->host);
+    this->update();
 }
 
 void Uri::setPort(uint16_t port) {
     delete[] this->port;
     this->port = uinttostr(port);
+    this->update();
 }
 
 void Uri::setPath(const char* path) {
     delete[] this->path;
     this->path = copystr(path);
+    this->update();
 }
 
 void Uri::setQuery(const char* query) {
     delete[] this->query;
     this->query = copystr(query);
+    this->update();
 }
 
 void Uri::setFragment(const char* fragment) {
     delete[] this->fragment;
     this->fragment = copystr(fragment);
+    this->update();
 }
 
 const char* Uri::toString() {
-    delete[] this->string;
-
-    size_t length = 1; // For '\0'.
-    if (*this->scheme) length += strlen(this->scheme) + 3; // For "://".
-    if (*this->userInfo) length += strlen(this->userInfo) + 1; // For '@'.
-    if (*this->host) length += strlen(this->host);
-    if (*this->port) length += strlen(this->port) + 1; // For ':'.
-    if (*this->path) length += strlen(this->path) + 1; // For '/'.
-    if (*this->query) length += strlen(this->query) + 1; // For '?'.
-    if (*this->fragment) length += strlen(this->fragment) + 1; // For '#'.
-
-    this->string = new char[length];
-    *this->string = '\0';
-
-    if (*this->scheme) {
-        strcat(this->string, this->scheme);
-        strcat(this->string, "://");
-    }
-
-    if (*this->userInfo) {
-        strcat(this->string, this->userInfo);
-        strcat(this->string, "@");
-    }
-
-    if (*this->host) {
-        strcat(this->string, this->host);
-    }
-
-    if (*this->port) {
-        strcat(this->string, ":");
-        strcat(this->string, this->port);
-    }
-
-    if (*this->path) {
-        if (*this->path != '/') strcat(this->string, "/");
-        strcat(this->string, this->path);
-    }
-
-    if (*this->query) {
-        strcat(this->string, "?");
-        strcat(this->string, this->query);
-    }
-
-    if (*this->fragment) {
-        strcat(this->string, "#");
-        strcat(this->string, this->fragment);
-    }
-
     return this->string;
 }
 
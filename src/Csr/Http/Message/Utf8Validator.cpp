@@ -0,0 +1,107 @@
+#include "Utf8Validator.hpp"
+#include "Shared.hpp"
+
+#if defined(__SSE2__) && !defined(CSR_NO_SIMD)
+#define CSR_UTF8_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ && !CSR_NO_SIMD
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+/**
+ * Finds the next byte that is not ASCII.
+ *
+ * @return Pointer to the byte, or `end` if there is none.
+ */
+inline const unsigned char* scanascii(const unsigned char* p,
+                                      const unsigned char* end)
+{
+#ifdef CSR_UTF8_SSE2
+    while (end - p >= 16) {
+        // The high bit of every byte that is not ASCII is set.
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+        if (mask) return p + lowestbit(mask);
+        p += 16;
+    }
+#endif // CSR_UTF8_SSE2
+
+    while (p < end && *p < 0x80) p++;
+    return p;
+}
+
+/**
+ * Checks a multi-byte sequence, per the table of well-formed sequences of
+ * RFC 3629, section 4.
+ *
+ * @param p Lead byte of the sequence, which is not ASCII.
+ * @param end End of the data.
+ * @return Number of bytes of the sequence; 0 if it is malformed; or -1 if
+ *     it is well-formed so far but cut off by `end`.
+ */
+inline int checksequence(const unsigned char* p, const unsigned char* end) {
+    unsigned char lead = *p;
+    int length = 0;
+
+    // Range of the second byte, which excludes overlong forms, surrogates
+    // and code points above U+10FFFF.
+    unsigned char low = 0x80;
+    unsigned char high = 0xbf;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        length = 2;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        length = 3;
+        if (lead == 0xe0) low = 0xa0;
+        else if (lead == 0xed) high = 0x9f;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        length = 4;
+        if (lead == 0xf0) low = 0x90;
+        else if (lead == 0xf4) high = 0x8f;
+    } else {
+        return 0;
+    }
+
+    for (int i = 1; i < length; i++) {
+        if (p + i == end) return -1;
+        unsigned char c = p[i];
+        if (i == 1 ? c < low || c > high : c < 0x80 || c > 0xbf) return 0;
+    }
+    return length;
+}
+
+} // namespace
+
+bool Utf8Validator::isVectorized() {
+#ifdef CSR_UTF8_SSE2
+    return true;
+#else
+    return false;
+#endif // CSR_UTF8_SSE2
+}
+
+bool Utf8Validator::isValid(const char* data, size_t length,
+                            size_t* truncated)
+{
+    if (truncated) *truncated = 0;
+    if (!data) return !length;
+
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + length;
+    while (true) {
+        p = scanascii(p, end);
+        if (p == end) return true;
+
+        int sequenceLength = checksequence(p, end);
+        if (sequenceLength < 0 && truncated) {
+            *truncated = end - p;
+            return true;
+        }
+        if (sequenceLength <= 0) return false;
+        p += sequenceLength;
+    }
+}
+
+}}} // Csr::Http::Message
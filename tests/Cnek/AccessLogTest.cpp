@@ -0,0 +1,195 @@
+#include "Cnek.hpp"
+#include "AccessLog.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+using Csr::Http::Message::Response;
+
+using std::string;
+
+namespace {
+
+const char* logPath = "cnek_access_log_test.log";
+
+/**
+ * Reads the whole log file.
+ */
+string readlog() {
+    string data;
+    FILE* file = fopen(logPath, "rb");
+    if (!file) return data;
+
+    char buffer[4096];
+    size_t bytesRead = 0;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    fclose(file);
+    return data;
+}
+
+/**
+ * Counts the lines of a string.
+ */
+size_t countlines(const string& data) {
+    size_t count = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i] == '\n') count++;
+    }
+    return count;
+}
+
+void testLogFlush() {
+    // Setup.
+    remove(logPath);
+
+    // Given we have an access log with two requests logged, one with a
+    // newline and a space in its request-target.
+    AccessLog* accessLog = new AccessLog(logPath);
+    assert(accessLog->log("GET", "/report?page=2", 200, 5120, 1.2044));
+    assert(accessLog->log("POST", "/a b\nGET /forged", 404, 0, 0.5));
+
+    // Then we see nothing is written before flushing.
+    assert(readlog().empty());
+
+    // When we flush it.
+    // Then we see both records were written as escaped lines.
+    assert(accessLog->flush() == 2);
+    string data = readlog();
+    assert(countlines(data) == 2);
+    assert(data.find("Z GET /report?page=2 200 5120 1.204\n") != string::npos);
+    assert(data.find("Z POST /a%20b%0AGET%20/forged 404 0 0.500\n")
+           != string::npos);
+    assert(data.size() > 20 && data[4] == '-' && data[19] == 'Z');
+
+    // And flushing again writes nothing.
+    assert(accessLog->flush() == 0);
+
+    // When we log another request and destroy the log.
+    accessLog->log("DELETE", "/item", 204, 0, 2);
+    delete accessLog;
+
+    // Then we see it was flushed.
+    assert(countlines(readlog()) == 3);
+
+    // Teardown.
+    remove(logPath);
+}
+
+void testFull() {
+    // Setup.
+    remove(logPath);
+
+    // Given we have an access log whose ring holds 4 records.
+    AccessLog accessLog(logPath, 3);
+
+    // When we log 6 requests without flushing.
+    size_t added = 0;
+    for (int i = 0; i < 6; i++) {
+        if (accessLog.log("GET", "/", 200, 0, 0)) added++;
+    }
+
+    // Then we see 2 were dropped instead of blocking.
+    assert(added == 4);
+    assert(accessLog.getDropped() == 2);
+
+    // And after flushing, the ring takes records again.
+    assert(accessLog.flush() == 4);
+    assert(accessLog.log("GET", "/", 200, 0, 0));
+
+    // Teardown.
+    remove(logPath);
+}
+
+#ifndef _WIN32
+AccessLog* sharedLog = NULL;
+
+void* logmany(void* arg) {
+    (void)arg;
+    for (int i = 0; i < 1000; i++) {
+        sharedLog->log("GET", "/thread", 200, i, 0.1);
+    }
+    return NULL;
+}
+
+void testBackgroundThread() {
+    // Setup.
+    remove(logPath);
+    sharedLog = new AccessLog(logPath, 8192);
+
+    // Given we have an access log flushed by its background thread.
+    sharedLog->start();
+
+    // When 4 threads log 1000 requests each at once.
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        assert(!pthread_create(&threads[i], NULL, logmany, NULL));
+    }
+    for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+
+    // And we stop the thread.
+    sharedLog->stop();
+
+    // Then we see every request was written, once.
+    assert(!sharedLog->getDropped());
+    assert(countlines(readlog()) == 4000);
+
+    // Teardown.
+    delete sharedLog;
+    remove(logPath);
+}
+#endif // _WIN32
+
+void testCnek() {
+    // Setup.
+    remove(logPath);
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char requestUri[] = "REQUEST_URI=/foo/bar";
+    char* env[] = {requestMethod, requestUri, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    AccessLog accessLog(logPath);
+
+    // Given we have a cnek with an access log.
+    Cnek* cnek = new Cnek();
+    cnek->setAccessLog(&accessLog);
+    cnek->getServerRequest(env, input);
+
+    // When we emit a response with a 5 byte body.
+    Response* response = new Response(201, "Created");
+    response->getBody()->write("Hello");
+    cnek->emitResponse(response, output);
+    delete cnek;
+
+    // Then we see the request was logged with its status and bytes sent.
+    assert(accessLog.flush() == 1);
+    assert(readlog().find("Z GET /foo/bar 201 5 ") != string::npos);
+
+    // Teardown.
+    fclose(input);
+    fclose(output);
+    remove(logPath);
+}
+
+} // namespace
+
+void AccessLogTest() {
+    testLogFlush();
+    testFull();
+#ifndef _WIN32
+    testBackgroundThread();
+#endif // _WIN32
+    testCnek();
+    printf("AccessLogTest passed!\n");
+}
+
+} // Cnek
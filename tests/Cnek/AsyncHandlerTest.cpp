@@ -0,0 +1,225 @@
+#include "HttpServer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif // __linux__
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+using std::string;
+
+namespace {
+
+#ifdef __linux__
+const char* filePath = "cnek_async_handler_test.txt";
+
+HttpServer* stoppingServer = NULL;
+int backend[2];
+
+/**
+ * Waits for a delay, reads a file in small chunks or waits for a pipe,
+ * depending on the path.
+ */
+class PathHandler : public AsyncHandler {
+    int fd;
+    off_t offset;
+    char buffer[4];
+    Response* response;
+
+    public:
+    PathHandler() : fd(-1), offset(0), response(NULL) {}
+
+    Response* run(Cnek& cnek, ServerRequest* request) {
+        (void)cnek;
+        const char* path = request->getServerParam("REQUEST_URI");
+
+        CNEK_ASYNC_BEGIN;
+        if (!strcmp(path, "/fail")) return NULL;
+
+        this->response = new Response(200, "OK");
+        if (!strcmp(path, "/slow")) {
+            CNEK_AWAIT(this->delay(300));
+            this->response->getBody()->write("Slow");
+        } else if (!strcmp(path, "/file")) {
+            this->fd = open(filePath, O_RDONLY);
+            while (true) {
+                CNEK_AWAIT(this->readFile(
+                    this->fd, this->buffer, sizeof(this->buffer), this->offset));
+                if (this->getResult() <= 0) break;
+
+                this->response->getBody()->write(
+                    this->buffer, this->getResult());
+                this->offset += this->getResult();
+            }
+            close(this->fd);
+        } else if (!strcmp(path, "/backend")) {
+            CNEK_AWAIT(this->waitReadable(backend[0]));
+            this->response->getBody()->write("Backend: ");
+            if (read(backend[0], this->buffer, 1) == 1) {
+                this->response->getBody()->write(this->buffer, 1);
+            }
+        } else if (!strcmp(path, "/stop")) {
+            stoppingServer->stop();
+            CNEK_AWAIT(this->delay(100));
+            this->response->getBody()->write("Stopped");
+        }
+        return this->response;
+        CNEK_ASYNC_END;
+    }
+};
+
+AsyncHandler* createhandler() {
+    return new PathHandler();
+}
+
+/**
+ * Connects to a port on 127.0.0.1 and sends requests.
+ */
+int sendrequests(unsigned short port, const char* requests) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(client, (struct sockaddr*)&address, sizeof(address))) {
+        _exit(1);
+    }
+    if (write(client, requests, strlen(requests)) != (ssize_t)strlen(requests)) {
+        _exit(1);
+    }
+    return client;
+}
+
+/**
+ * Reads until the server closes the connection.
+ */
+string readall(int fd) {
+    string data;
+    char buffer[4096];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    close(fd);
+    return data;
+}
+
+/**
+ * Runs the client side of testServe().
+ *
+ * @return Exit status, 0 if every response was as expected.
+ */
+int runclient(unsigned short port) {
+    // A slow request with a file request pipelined behind it, answered in
+    // order, while requests on other connections are answered meanwhile.
+    int slow = sendrequests(port,
+        "GET /slow HTTP/1.1\r\n\r\n"
+        "GET /file HTTP/1.1\r\nConnection: close\r\n\r\n");
+    usleep(50000);
+
+    string file = readall(sendrequests(port,
+        "GET /file HTTP/1.1\r\nConnection: close\r\n\r\n"));
+    if (file.find("\r\n\r\nHello, async world!") == string::npos) return 2;
+
+    int waiting = sendrequests(port,
+        "GET /backend HTTP/1.1\r\nConnection: close\r\n\r\n");
+    usleep(50000);
+    if (write(backend[1], "x", 1) != 1) return 3;
+    if (readall(waiting).find("\r\n\r\nBackend: x") == string::npos) return 4;
+
+    struct pollfd fd;
+    fd.fd = slow;
+    fd.events = POLLIN;
+    if (poll(&fd, 1, 0)) return 5;
+
+    string responses = readall(slow);
+    size_t slowAt = responses.find("\r\n\r\nSlow");
+    size_t fileAt = responses.find("\r\n\r\nHello, async world!");
+    if (slowAt == string::npos || fileAt == string::npos || fileAt < slowAt) {
+        return 6;
+    }
+
+    // Handlers that return without a response fail the request.
+    string failed = readall(sendrequests(port,
+        "GET /fail HTTP/1.1\r\nConnection: close\r\n\r\n"));
+    if (failed.find("HTTP/1.1 500 ") != 0) return 7;
+
+    // A handler that stops the server and waits is still answered.
+    string stopped = readall(sendrequests(port,
+        "GET /stop HTTP/1.1\r\nConnection: close\r\n\r\n"));
+    if (stopped.find("\r\n\r\nStopped") == string::npos) return 8;
+    return 0;
+}
+
+void testServe(bool isIoUring) {
+    // Setup.
+    FILE* file = fopen(filePath, "wb");
+    fputs("Hello, async world!", file);
+    fclose(file);
+    assert(!pipe(backend));
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(!bind(listener, (struct sockaddr*)&address, sizeof(address)));
+    assert(!listen(listener, SOMAXCONN));
+    socklen_t length = sizeof(address);
+    assert(!getsockname(listener, (struct sockaddr*)&address, &length));
+    HttpServer* server = new HttpServer(listener);
+    server->setIoUring(isIoUring);
+    stoppingServer = server;
+
+    // Given a client process sends a slow request, then requests that read
+    // a file and wait for a backend on other connections.
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (!pid) _exit(runclient(ntohs(address.sin_port)));
+
+    // When we serve with handlers that wait on the loop until stopped.
+    server->serve(createhandler);
+
+    // Then we see the other requests were answered while the slow one was
+    // waiting, and every request got its response.
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+
+    // Teardown.
+    delete server;
+    close(backend[0]);
+    close(backend[1]);
+    remove(filePath);
+}
+#endif // __linux__
+
+} // namespace
+
+void AsyncHandlerTest() {
+#ifdef __linux__
+    testServe(false);
+
+    // Kernels without io_uring are served with epoll again.
+    testServe(true);
+#endif // __linux__
+    printf("AsyncHandlerTest passed!\n");
+}
+
+} // Cnek
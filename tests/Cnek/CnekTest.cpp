@@ -1,6 +1,8 @@
 #include "Cnek.hpp"
+#include "AllocStats.hpp"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -86,11 +88,470 @@ void testEmitResponse() {
     fclose(output);
 }
 
+void testEmitResponseAutoETag() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char requestUri[] = "REQUEST_URI=/poll";
+    char* env[] = {requestMethod, requestUri, NULL, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    char content[256];
+
+    // Given we have a cnek with automatic ETags and a GET request.
+    Cnek* cnek = new Cnek();
+    cnek->setAutoETag(true);
+    cnek->getServerRequest(env, input);
+
+    // When we emit a "200 OK" response with body "Same as before".
+    Response* response = new Response(200, "OK");
+    response->getBody()->write("Same as before");
+    cnek->emitResponse(response, output);
+
+    // Then we see the output has a quoted ETag header and the body.
+    rewind(output);
+    size_t length = fread(content, 1, sizeof(content) - 1, output);
+    content[length] = '\0';
+    const char* etag = strstr(content, "ETag: \"");
+    assert(etag);
+    assert(strstr(content, "\r\n\r\nSame as before"));
+
+    char ifNoneMatch[64] = "HTTP_IF_NONE_MATCH=";
+    strncat(ifNoneMatch, etag + 6, 18);
+
+    // Teardown.
+    delete cnek;
+    fclose(output);
+    rewind(input);
+
+    // Setup.
+    output = tmpfile();
+    env[2] = ifNoneMatch;
+
+    // Given we have a request with If-None-Match set to the previous ETag.
+    cnek = new Cnek();
+    cnek->setAutoETag(true);
+    cnek->getServerRequest(env, input);
+
+    // When we emit the same response again.
+    response = new Response(200, "OK");
+    response->getBody()->write("Same as before");
+    cnek->emitResponse(response, output);
+
+    // Then we see "304 Not Modified" is emitted without the body.
+    rewind(output);
+    length = fread(content, 1, sizeof(content) - 1, output);
+    content[length] = '\0';
+    assert(strstr(content, "Status: 304 Not Modified\r\n\r\n"));
+    assert(!strstr(content, "Same as before"));
+
+    // Teardown.
+    delete cnek;
+    fclose(output);
+    rewind(input);
+
+    // Setup.
+    output = tmpfile();
+    char postMethod[] = "REQUEST_METHOD=POST";
+    env[0] = postMethod;
+    env[2] = NULL;
+
+    // Given we have a POST request.
+    cnek = new Cnek();
+    cnek->setAutoETag(true);
+    cnek->getServerRequest(env, input);
+
+    // When we emit a "200 OK" response.
+    response = new Response(200, "OK");
+    response->getBody()->write("Created");
+    cnek->emitResponse(response, output);
+
+    // Then we see no ETag is added.
+    rewind(output);
+    length = fread(content, 1, sizeof(content) - 1, output);
+    content[length] = '\0';
+    assert(!strstr(content, "ETag"));
+    assert(strstr(content, "\r\n\r\nCreated"));
+
+    // Teardown.
+    delete cnek;
+    fclose(output);
+    fclose(input);
+}
+
+/**
+ * Emits a "200 OK" response with body "0123456789" to a GET request with the
+ * given Range and If-Range headers, and reads the output.
+ */
+void emitRange(const char* range, const char* ifRange, char* content, size_t size) {
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char requestUri[] = "REQUEST_URI=/export.csv";
+    char rangeHeader[64];
+    char ifRangeHeader[64];
+    char* env[] = {requestMethod, requestUri, rangeHeader, ifRangeHeader, NULL};
+    snprintf(rangeHeader, sizeof(rangeHeader), "HTTP_RANGE=%s", range);
+    snprintf(ifRangeHeader, sizeof(ifRangeHeader), "HTTP_IF_RANGE=%s", ifRange);
+    if (!*ifRange) env[3] = NULL;
+
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    Cnek cnek;
+    cnek.getServerRequest(env, input);
+
+    Response* response = new Response(200, "OK");
+    response->setHeader("Content-Type", "text/csv");
+    response->setHeader("ETag", "\"v1\"");
+    response->getBody()->write("0123456789");
+    cnek.emitResponse(response, output);
+
+    rewind(output);
+    size_t length = fread(content, 1, size - 1, output);
+    content[length] = '\0';
+    fclose(output);
+    fclose(input);
+}
+
+void testEmitResponseRange() {
+    char content[512];
+
+    // Given a request for bytes 2 to 4.
+    // When we emit the response.
+    emitRange("bytes=2-4", "", content, sizeof(content));
+
+    // Then we see "206 Partial Content" with only those bytes.
+    assert(strstr(content, "Status: 206 Partial Content\r\n"));
+    assert(strstr(content, "Content-Range: bytes 2-4/10\r\n"));
+    assert(strstr(content, "Content-Length: 3\r\n"));
+    assert(strstr(content, "Accept-Ranges: bytes\r\n"));
+    assert(!strcmp(strstr(content, "\r\n\r\n"), "\r\n\r\n234"));
+
+    // Given a request for the last 3 bytes and bytes past the end.
+    emitRange("bytes=-3, 20-", "", content, sizeof(content));
+
+    // Then we see only the satisfiable range is emitted.
+    assert(strstr(content, "Content-Range: bytes 7-9/10\r\n"));
+    assert(!strcmp(strstr(content, "\r\n\r\n"), "\r\n\r\n789"));
+
+    // Given a request for two ranges.
+    emitRange("bytes=0-1,8-", "", content, sizeof(content));
+
+    // Then we see a multipart/byteranges body with both parts.
+    assert(strstr(content, "Status: 206 Partial Content\r\n"));
+    const char* boundary = strstr(content, "boundary=");
+    assert(boundary);
+    boundary += 9;
+    char delimiter[32] = "\r\n--";
+    strncat(delimiter, boundary, strcspn(boundary, "\r"));
+
+    const char* body = strstr(content, "\r\n\r\n") + 4;
+    const char* part = strstr(body, delimiter);
+    assert(part == body);
+    assert(strstr(part, "Content-Type: text/csv\r\nContent-Range: bytes 0-1/10\r\n\r\n01\r\n--"));
+    assert(strstr(part, "Content-Range: bytes 8-9/10\r\n\r\n89\r\n--"));
+    assert(!strcmp(content + strlen(content) - 4, "--\r\n"));
+
+    // And we see Content-Length matches the body.
+    long contentLength = atol(strstr(content, "Content-Length: ") + 16);
+    assert(contentLength == (long)strlen(body));
+
+    // Given a request for a range past the end.
+    emitRange("bytes=10-", "", content, sizeof(content));
+
+    // Then we see "416 Range Not Satisfiable" without a body.
+    assert(strstr(content, "Status: 416 Range Not Satisfiable\r\n"));
+    assert(strstr(content, "Content-Range: bytes */10\r\n"));
+    assert(!strcmp(strstr(content, "\r\n\r\n"), "\r\n\r\n"));
+
+    // Given a request with an If-Range that does not match the ETag.
+    emitRange("bytes=2-4", "\"v0\"", content, sizeof(content));
+
+    // Then we see the whole body is emitted.
+    assert(strstr(content, "Status: 200 OK\r\n"));
+    assert(!strcmp(strstr(content, "\r\n\r\n"), "\r\n\r\n0123456789"));
+
+    // Given a request with an If-Range that matches the ETag.
+    emitRange("bytes=2-4", "\"v1\"", content, sizeof(content));
+
+    // Then we see the range is emitted.
+    assert(strstr(content, "Status: 206 Partial Content\r\n"));
+
+    // Given an invalid Range header.
+    emitRange("bytes=4-2", "", content, sizeof(content));
+
+    // Then we see it is ignored.
+    assert(strstr(content, "Status: 200 OK\r\n"));
+    assert(!strcmp(strstr(content, "\r\n\r\n"), "\r\n\r\n0123456789"));
+}
+
+void testEmitResponseTiming() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=POST";
+    char requestUri[] = "REQUEST_URI=/form";
+    char contentType[] = "CONTENT_TYPE=application/x-www-form-urlencoded";
+    char* env[] = {requestMethod, requestUri, contentType, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    FILE* sink = tmpfile();
+    char content[512];
+    fputs("name=cnek", input);
+    rewind(input);
+
+    // Given we have a cnek with Server-Timing and a stats sink enabled.
+    Cnek cnek;
+    cnek.setServerTiming(true);
+    cnek.setStatsSink(sink);
+
+    // When we get a urlencoded POST request and emit a response.
+    cnek.getServerRequest(env, input);
+    cnek.emitResponse(new Response(200, "OK"), output);
+
+    // Then we see the body was parsed as its own phase.
+    Timing* timing = cnek.getTiming();
+    assert(timing->isRecorded(TIMING_ENV));
+    assert(timing->isRecorded(TIMING_BODY));
+    assert(timing->isRecorded(TIMING_URLENCODED));
+    assert(!timing->isRecorded(TIMING_MULTIPART));
+    assert(!timing->isRecorded(TIMING_JSON));
+    assert(timing->isRecorded(TIMING_HANDLER));
+    assert(timing->isRecorded(TIMING_EMIT));
+
+    // And we see a Server-Timing header with the phases before emitting.
+    rewind(output);
+    size_t length = fread(content, 1, sizeof(content) - 1, output);
+    content[length] = '\0';
+    const char* header = strstr(content, "Server-Timing: env;dur=");
+    assert(header);
+    assert(strstr(header, "urlencoded;dur="));
+    assert(!strstr(header, "emit"));
+
+    // And we see a stats line with every phase.
+    rewind(sink);
+    assert(fgets(content, sizeof(content), sink));
+    assert(!strncmp(content, "POST /form 200 env=", 19));
+    assert(strstr(content, " handler="));
+    assert(strstr(content, " emit="));
+
+    // Teardown.
+    fclose(output);
+    fclose(input);
+    fclose(sink);
+}
+
+void testEmitResponseJsonTiming() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=PATCH";
+    char requestUri[] = "REQUEST_URI=/users/7";
+    char contentType[] = "CONTENT_TYPE=application/json";
+    char* env[] = {requestMethod, requestUri, contentType, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    fputs("{\"name\": \"cnek\"}", input);
+    rewind(input);
+
+    // Given we have a cnek with timers enabled.
+    Cnek cnek;
+    cnek.setServerTiming(true);
+
+    // When we get a JSON request.
+    ServerRequest* serverRequest = cnek.getServerRequest(env, input);
+
+    // Then we see the body was indexed as its own phase.
+    Timing* timing = cnek.getTiming();
+    assert(timing->isRecorded(TIMING_JSON));
+    assert(!timing->isRecorded(TIMING_URLENCODED));
+    assert(!serverRequest->getJsonBody().get("name").isMissing());
+
+    // And we see it listed in the Server-Timing header.
+    cnek.emitResponse(new Response(200, "OK"), output);
+    char content[512];
+    rewind(output);
+    size_t length = fread(content, 1, sizeof(content) - 1, output);
+    content[length] = '\0';
+    assert(strstr(content, "json;dur="));
+
+    // Teardown.
+    fclose(output);
+    fclose(input);
+}
+
+void testEmitResponseInjection() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char requestUri[] = "REQUEST_URI=/";
+    char* env[] = {requestMethod, requestUri, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    char content[256];
+
+    // Given we have a response with a reason phrase that could inject a
+    // header.
+    Cnek cnek;
+    cnek.getServerRequest(env, input);
+    Response* response = new Response(200, "OK\r\nSet-Cookie: id=1");
+
+    // When we emit it.
+    cnek.emitResponse(response, output);
+
+    // Then we see the CR and LF were stripped from the status.
+    rewind(output);
+    size_t length = fread(content, 1, sizeof(content) - 1, output);
+    content[length] = '\0';
+    assert(strstr(content, "Status: 200 OKSet-Cookie: id=1\r\n"));
+    assert(!strstr(content, "\r\nSet-Cookie"));
+
+    // Teardown.
+    fclose(output);
+    fclose(input);
+}
+
+void testEmitResponseAllocStats() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char requestUri[] = "REQUEST_URI=/";
+    char* env[] = {requestMethod, requestUri, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    char content[256];
+
+    // Given we have a cnek with the X-Alloc-Stats header enabled.
+    Cnek cnek;
+    cnek.setAllocStatsHeader(true);
+    cnek.getServerRequest(env, input);
+
+    // When we emit a response.
+    cnek.emitResponse(new Response(200, "OK"), output);
+
+    // Then we see the header only in builds with CSR_ALLOC_STATS.
+    rewind(output);
+    size_t length = fread(content, 1, sizeof(content) - 1, output);
+    content[length] = '\0';
+    const char* header = strstr(content, "X-Alloc-Stats: allocations=");
+    assert(Csr::Http::Message::AllocStats::isEnabled() ? header != NULL : !header);
+
+    // Teardown.
+    fclose(output);
+    fclose(input);
+}
+
+/**
+ * Emits a response with body "Hello" in HTTP form to a request with the
+ * given method, and reads the output.
+ */
+void emitHttp(const char* method, Response* response, char* content, size_t size) {
+    char requestMethod[32];
+    char requestUri[] = "REQUEST_URI=/";
+    char* env[] = {requestMethod, requestUri, NULL};
+    snprintf(requestMethod, sizeof(requestMethod), "REQUEST_METHOD=%s", method);
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+
+    Cnek cnek;
+    cnek.setHttpResponse(true);
+    cnek.getServerRequest(env, input);
+    response->getBody()->write("Hello");
+    cnek.emitResponse(response, output);
+
+    rewind(output);
+    size_t length = fread(content, 1, size - 1, output);
+    content[length] = '\0';
+    fclose(output);
+    fclose(input);
+}
+
+void testEmitResponseHttp() {
+    char content[256];
+
+    // Given we emit a response without a reason phrase in HTTP form.
+    emitHttp("GET", new Response(), content, sizeof(content));
+
+    // Then we see it starts with a status line with the standard reason
+    // phrase instead of having a Status header.
+    assert(!strncmp(content, "HTTP/1.1 200 OK\r\n", 17));
+    assert(!strstr(content, "Status:"));
+
+    // And we see the Date and Content-Length headers and the body.
+    assert(strstr(content, "\r\nDate: "));
+    assert(strstr(content, "\r\nContent-Length: 5\r\n"));
+    assert(!strcmp(strstr(content, "\r\n\r\n"), "\r\n\r\nHello"));
+
+    // Given we emit a response with a reason phrase to a HEAD request.
+    emitHttp("HEAD", new Response(404, "Missing"), content, sizeof(content));
+
+    // Then we see its reason phrase and length, without the body.
+    assert(!strncmp(content, "HTTP/1.1 404 Missing\r\n", 22));
+    assert(strstr(content, "\r\nContent-Length: 5\r\n"));
+    assert(!strcmp(strstr(content, "\r\n\r\n"), "\r\n\r\n"));
+}
+
+void testReuse() {
+    // Setup.
+    char firstMethod[] = "REQUEST_METHOD=POST";
+    char firstUri[] = "REQUEST_URI=/first?page=2";
+    char* firstEnv[] = {firstMethod, firstUri, NULL};
+    char secondMethod[] = "REQUEST_METHOD=GET";
+    char secondUri[] = "REQUEST_URI=/second";
+    char* secondEnv[] = {secondMethod, secondUri, NULL};
+
+    FILE* input = tmpfile();
+    fputs("First body", input);
+    rewind(input);
+    FILE* output = tmpfile();
+
+    // Given we have a cnek that handled a request with a pooled response.
+    Cnek cnek;
+    ServerRequest* first = cnek.getServerRequest(firstEnv, input);
+    Response* response = cnek.createResponse(404, "Not Found");
+    response->setHeader("X-First", "1");
+    response->getBody()->write("First");
+    cnek.emitResponse(response, output);
+
+    // When we reset it and handle another request.
+    cnek.reset();
+    fclose(input);
+    input = tmpfile();
+    fputs("Second", input);
+    rewind(input);
+    ServerRequest* second = cnek.getServerRequest(secondEnv, input);
+
+    // Then we see the same server request is reused for the new request.
+    assert(second == first);
+    assert(!strcmp(second->getMethod(), "GET"));
+    assert(!strcmp(second->getUri()->getPath(), "/second"));
+    assert(!strcmp(second->getQueryParam("page"), ""));
+    assert(!strcmp(second->getBody()->toString(), "Second"));
+
+    // And the emitted response is reused, emptied, for the new response.
+    Response* reused = cnek.createResponse();
+    assert(reused == response);
+    assert(reused->getStatusCode() == 200);
+    assert(!reused->hasHeader("X-First"));
+    assert(reused->getBody()->getSize() == 0);
+
+    // And a response created while it is in use is a separate one.
+    Response* separate = cnek.createResponse(500);
+    assert(separate != reused);
+
+    // Teardown.
+    // NOTE: Pooled responses are freed with the cnek, others when emitted or
+    // released.
+    cnek.releaseResponse(separate);
+    cnek.releaseResponse(reused);
+    fclose(input);
+    fclose(output);
+}
+
 } // namespace
 
 void CnekTest() {
     testGetServerRequest();
     testEmitResponse();
+    testEmitResponseAutoETag();
+    testEmitResponseRange();
+    testEmitResponseTiming();
+    testEmitResponseJsonTiming();
+    testEmitResponseInjection();
+    testEmitResponseAllocStats();
+    testEmitResponseHttp();
+    testReuse();
     printf("CnekTest passed!\n");
 }
 
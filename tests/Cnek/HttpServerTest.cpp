@@ -0,0 +1,228 @@
+#include "HttpServer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif // __linux__
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+using std::string;
+
+namespace {
+
+#ifdef __linux__
+HttpServer* stoppingServer = NULL;
+
+/**
+ * Connects to a port on 127.0.0.1.
+ */
+int connectto(unsigned short port) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(client, (struct sockaddr*)&address, sizeof(address))) {
+        _exit(1);
+    }
+    return client;
+}
+
+/**
+ * Sends requests, then reads until the server closes the connection.
+ */
+string exchange(unsigned short port, const string& requests) {
+    int client = connectto(port);
+    write(client, requests.data(), requests.size());
+
+    string data;
+    char buffer[4096];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = read(client, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    close(client);
+    return data;
+}
+
+/**
+ * Counts the occurrences of a string.
+ */
+int count(const string& data, const char* needle) {
+    int occurrences = 0;
+    for (size_t i = data.find(needle); i != string::npos;
+         i = data.find(needle, i + 1))
+    {
+        occurrences++;
+    }
+    return occurrences;
+}
+
+Response* hellohandler(Cnek& cnek, ServerRequest* request) {
+    (void)cnek;
+    if (!strcmp(request->getServerParam("REQUEST_URI"), "/stop")) {
+        stoppingServer->stop();
+    }
+
+    const char* name = request->getQueryParam("name");
+    if (!*name) name = request->getBodyParam("name");
+
+    Response* response = new Response(200, "OK");
+    response->setHeader("Content-Type", "text/plain");
+    response->getBody()->write("Hello, ");
+    response->getBody()->write(name);
+    response->getBody()->write(" from ");
+    response->getBody()->write(request->getServerParam("REMOTE_ADDR"));
+    response->getBody()->write("!");
+    return response;
+}
+
+/**
+ * Runs the client side of testServe(), exiting with 0 if every response
+ * was as expected.
+ */
+void runclient(unsigned short port) {
+    // Pipelined GET, HEAD and POST requests on one connection.
+    string responses = exchange(port,
+        "GET /a?name=Get HTTP/1.1\r\nHost: example.com\r\n\r\n"
+        "HEAD /b HTTP/1.1\r\nHost: example.com\r\n\r\n"
+        "POST /c HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: 9\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "name=Post");
+    if (count(responses, "HTTP/1.1 200 OK\r\n") != 3
+        || count(responses, "Hello, ") != 2
+        || responses.find("Hello, Get from 127.0.0.1!") == string::npos
+        || responses.find("Hello, Post from 127.0.0.1!") == string::npos
+        || count(responses, "Connection: close\r\n") != 1)
+    {
+        _exit(2);
+    }
+
+    // A request split across writes.
+    int client = connectto(port);
+    write(client, "GET /?name=Split HTTP/1.1\r\n", 27);
+    usleep(10000);
+    write(client, "Connection: close\r\n\r\n", 21);
+    string data;
+    char buffer[4096];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = read(client, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    close(client);
+    if (data.find("Hello, Split") == string::npos) _exit(3);
+
+    // Malformed and unsupported requests.
+    if (exchange(port, "NOT HTTP\r\n\r\n").find("HTTP/1.1 400 ") != 0) {
+        _exit(4);
+    }
+    if (exchange(port, "GET / HTTP/2.0\r\n\r\n").find("HTTP/1.1 505 ") != 0) {
+        _exit(5);
+    }
+    if (exchange(port,
+            "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n")
+        .find("HTTP/1.1 501 ") != 0)
+    {
+        _exit(6);
+    }
+
+    // A request being received and an idle connection when the server is
+    // stopped.
+    int pending = connectto(port);
+    write(pending, "GET /?name=Pending HTTP/1.1\r\n", 29);
+    int idle = connectto(port);
+    usleep(10000);
+
+    // An HTTP/1.0 request is closed after its response.
+    responses = exchange(port, "GET /stop HTTP/1.0\r\n\r\n");
+    if (responses.find("HTTP/1.1 200 OK\r\n") != 0
+        || responses.find("Connection: close\r\n") == string::npos)
+    {
+        _exit(7);
+    }
+
+    // The request being received is still answered, then closed.
+    write(pending, "Host: example.com\r\n\r\n", 21);
+    data.clear();
+    while ((bytesRead = read(pending, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    close(pending);
+    if (data.find("Hello, Pending") == string::npos
+        || data.find("Connection: close\r\n") == string::npos)
+    {
+        _exit(8);
+    }
+
+    // The idle connection is closed.
+    if (read(idle, buffer, sizeof(buffer)) > 0) _exit(9);
+    close(idle);
+
+    _exit(0);
+}
+
+void testServe(bool isIoUring) {
+    // Setup.
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(!bind(listener, (struct sockaddr*)&address, sizeof(address)));
+    assert(!listen(listener, SOMAXCONN));
+    socklen_t length = sizeof(address);
+    assert(!getsockname(listener, (struct sockaddr*)&address, &length));
+    HttpServer* server = new HttpServer(listener);
+    server->setIoUring(isIoUring);
+    stoppingServer = server;
+
+    // Given a client process sends pipelined, split, malformed and closing
+    // requests to the server, and a request split across the stop.
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (!pid) runclient(ntohs(address.sin_port));
+
+    // When we serve until the handler stops the server.
+    server->serve(hellohandler);
+
+    // Then we see the client received the expected responses.
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+
+    // Teardown.
+    delete server;
+}
+#endif // __linux__
+
+} // namespace
+
+void HttpServerTest() {
+#ifdef __linux__
+    testServe(false);
+
+    // Kernels without io_uring are served with epoll again.
+    testServe(true);
+#endif // __linux__
+    printf("HttpServerTest passed!\n");
+}
+
+} // Cnek
@@ -0,0 +1,191 @@
+#include "JsonWriter.hpp"
+#include "Stream.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+#include <string>
+
+namespace Cnek {
+
+using Csr::Http::Message::Stream;
+
+using std::runtime_error;
+using std::string;
+
+namespace {
+
+/**
+ * Formats a number with a writer.
+ */
+string formatnumber(double value) {
+    Stream stream;
+    JsonWriter json(&stream);
+    json.writeNumber(value);
+    return stream.toString();
+}
+
+void testDocument() {
+    // Given we have a writer on a stream.
+    Stream stream;
+    JsonWriter json(&stream);
+
+    // When we write an object with nested values.
+    json.beginObject();
+    json.writeKey("id");
+    json.writeInteger(-9223372036854775807LL - 1);
+    json.writeKey("size");
+    json.writeUnsigned(18446744073709551615ULL);
+    json.writeKey("tags");
+    json.beginArray();
+    json.writeString("new");
+    json.beginObject();
+    json.endObject();
+    json.beginArray();
+    json.endArray();
+    json.writeBool(true);
+    json.writeBool(false);
+    json.writeNull();
+    json.writeString(NULL);
+    json.endArray();
+    json.writeKey("say \"hi\"");
+    json.writeString("line\nbreak\\ \t\x01\x7f caf\xc3\xa9");
+    json.endObject();
+
+    // Then we see the document was written once complete.
+    assert(json.isDone());
+    assert(!strcmp(stream.toString(),
+        "{\"id\":-9223372036854775808,\"size\":18446744073709551615,"
+        "\"tags\":[\"new\",{},[],true,false,null,null],"
+        "\"say \\\"hi\\\"\":\"line\\nbreak\\\\ \\t\\u0001\x7f caf\xc3\xa9\"}"));
+
+    // And another top-level value is rejected.
+    bool isThrown = false;
+    try {
+        json.writeNull();
+    } catch (runtime_error&) {
+        isThrown = true;
+    }
+    assert(isThrown);
+}
+
+void testLongString() {
+    // Given we have a string longer than the buffer, with quotes at the
+    // end of SIMD blocks.
+    string value;
+    for (int i = 0; i < 1000; i++) value += "0123456789abcde\"";
+    string expected = "\"";
+    for (int i = 0; i < 1000; i++) expected += "0123456789abcde\\\"";
+    expected += "\"";
+
+    // When we write it.
+    Stream stream;
+    JsonWriter json(&stream);
+    json.writeString(value.data(), value.size());
+
+    // Then we see every quote was escaped.
+    assert(stream.toString() == expected);
+
+    // And a string with a null byte keeps it escaped.
+    Stream binary;
+    JsonWriter binaryJson(&binary);
+    binaryJson.writeString("a\0b", 3);
+    assert(!strcmp(binary.toString(), "\"a\\u0000b\""));
+}
+
+void testNumbers() {
+    // Given we have numbers.
+    // Then we see each written with the fewest digits that read back.
+    assert(formatnumber(0) == "0");
+    assert(formatnumber(-0.0) == "0");
+    assert(formatnumber(42) == "42");
+    assert(formatnumber(-1.5) == "-1.5");
+    assert(formatnumber(0.1) == "0.1");
+    assert(formatnumber(0.3) == "0.3");
+    assert(formatnumber(0.1 + 0.2) == "0.30000000000000004");
+    assert(formatnumber(1.0 / 3) == "0.3333333333333333");
+    assert(formatnumber(123456.789) == "123456.789");
+    assert(formatnumber(9007199254740993.0) == "9007199254740992");
+    assert(formatnumber(1e21) == "1e+21");
+    assert(formatnumber(1.7976931348623157e308) == "1.7976931348623157e+308");
+    assert(formatnumber(5e-324) == "5e-324");
+
+    // And numbers read back exactly.
+    double values[] = {3.141592653589793, 2.5e-8, 1e300, -6.02214076e23};
+    for (size_t i = 0; i < sizeof(values) / sizeof(*values); i++) {
+        assert(strtod(formatnumber(values[i]).c_str(), NULL) == values[i]);
+    }
+
+    // And numbers JSON cannot represent are null.
+    double zero = 0;
+    assert(formatnumber(1 / zero) == "null");
+    assert(formatnumber(zero / zero) == "null");
+}
+
+void testMisuse() {
+    // Given we have a writer inside an object.
+    Stream stream;
+    JsonWriter json(&stream);
+    json.beginObject();
+
+    // Then we see a value without a key is rejected.
+    bool isThrown = false;
+    try {
+        json.writeInteger(1);
+    } catch (runtime_error&) {
+        isThrown = true;
+    }
+    assert(isThrown);
+
+    // And ending an array is rejected.
+    isThrown = false;
+    try {
+        json.endArray();
+    } catch (runtime_error&) {
+        isThrown = true;
+    }
+    assert(isThrown);
+
+    // And nesting deeper than MAX_DEPTH is rejected.
+    Stream deepStream;
+    JsonWriter deep(&deepStream);
+    isThrown = false;
+    try {
+        for (int i = 0; i <= JsonWriter::MAX_DEPTH; i++) deep.beginArray();
+    } catch (runtime_error&) {
+        isThrown = true;
+    }
+    assert(isThrown);
+}
+
+void testLargeArray() {
+    // Given we have a writer.
+    Stream stream;
+    JsonWriter json(&stream);
+
+    // When we write an array of 10000 numbers.
+    json.beginArray();
+    for (int i = 0; i < 10000; i++) json.writeInteger(i);
+    json.endArray();
+
+    // Then we see it written across several buffers.
+    string result = stream.toString();
+    assert(result.size() == 48891);
+    assert(result.compare(0, 8, "[0,1,2,3") == 0);
+    assert(result.compare(result.size() - 10, 10, "9998,9999]") == 0);
+}
+
+} // namespace
+
+void JsonWriterTest() {
+    testDocument();
+    testLongString();
+    testNumbers();
+    testMisuse();
+    testLargeArray();
+    printf("JsonWriterTest passed!\n");
+}
+
+} // Cnek
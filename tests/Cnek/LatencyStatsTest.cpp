@@ -0,0 +1,195 @@
+#include "Cnek.hpp"
+#include "LatencyStats.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+using Csr::Http::Message::Response;
+
+using std::string;
+
+namespace {
+
+const char* statsPath = "cnek_latency_stats_test.bin";
+
+void testHistogram() {
+    // Given we have a histogram of the values 1 to 10000 microseconds.
+    LatencyHistogram histogram;
+    for (uint64_t i = 1; i <= 10000; i++) histogram.record(i);
+
+    // Then we see its count, sum and max.
+    assert(histogram.getCount() == 10000);
+    assert(histogram.getSum() == 50005000);
+    assert(histogram.getMax() == 10000);
+
+    // And we see its percentiles within 3%, never below the actual value.
+    uint64_t p50 = histogram.getPercentile(50);
+    uint64_t p99 = histogram.getPercentile(99);
+    assert(p50 >= 5000 && p50 <= 5150);
+    assert(p99 >= 9900 && p99 <= 10000);
+    assert(histogram.getPercentile(100) == 10000);
+
+    // And small values are exact.
+    assert(LatencyHistogram::getBucketValue(LatencyHistogram::getBucket(7))
+           == 7);
+
+    // When we merge a histogram of one slow value into it.
+    LatencyHistogram slow;
+    slow.record(5000000);
+    histogram.merge(slow);
+
+    // Then we see both are counted.
+    assert(histogram.getCount() == 10001);
+    assert(histogram.getMax() == 5000000);
+    assert(histogram.getPercentile(100) == 5000000);
+    assert(histogram.getPercentile(99) <= 10000);
+
+    // And an empty histogram has no percentiles.
+    assert(LatencyHistogram().getPercentile(99) == 0);
+}
+
+void testShared() {
+    // Setup.
+    remove(statsPath);
+    LatencyStats* stats = new LatencyStats(statsPath, 8);
+
+    // Given a process records latencies of a route with two status codes.
+#ifndef _WIN32
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (!pid) {
+        LatencyStats child(statsPath, 8);
+        for (int i = 0; i < 99; i++) child.record("/report", 200, "handler", 100);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+#else
+    for (int i = 0; i < 99; i++) stats->record("/report", 200, "handler", 100);
+#endif // _WIN32
+    stats->record("/report", 500, "handler", 20000);
+
+    // When we take snapshots in this process.
+    LatencyHistogram ok = stats->getSnapshot("/report", 200, "handler");
+    LatencyHistogram all = stats->getSnapshot("/report", 0, "handler");
+
+    // Then we see the other process's latencies.
+    assert(ok.getCount() == 99);
+    assert(ok.getPercentile(99) == 100);
+
+    // And the series of every status code merged.
+    assert(all.getCount() == 100);
+    assert(all.getPercentile(100) == 20000);
+
+    // And nothing for other series.
+    assert(!stats->getSnapshot("/report", 200, "emit").getCount());
+    assert(!stats->getSnapshot("/other", 0, "handler").getCount());
+
+    // When we record more series than the file holds.
+    for (int i = 0; i < 8; i++) stats->record("/full", 200 + i, "total", 1);
+
+    // Then we see the ones without room were dropped.
+    assert(stats->getDropped() == 2);
+
+    // Teardown.
+    delete stats;
+    remove(statsPath);
+}
+
+void testPrometheus() {
+    // Setup.
+    remove(statsPath);
+    LatencyStats stats(statsPath, 8);
+
+    // Given we recorded a latency of 1.5 milliseconds under a route with a
+    // quote in it.
+    stats.record("/say\"hi\"", 200, "handler", 1500);
+
+    // When we render the stats.
+    Response* response = stats.createResponse();
+    string text = response->getBody()->toString();
+
+    // Then we see them as a Prometheus summary with escaped labels.
+    assert(!strcmp(response->getHeaderLine("Content-Type"),
+                   "text/plain; version=0.0.4; charset=utf-8"));
+    assert(text.find("# TYPE cnek_request_duration_seconds summary\n")
+           != string::npos);
+    assert(text.find(
+        "cnek_request_duration_seconds{route=\"/say\\\"hi\\\"\",status=\"200\","
+        "phase=\"handler\",quantile=\"0.99\"} 0.001500\n") != string::npos);
+    assert(text.find(
+        "cnek_request_duration_seconds_sum{route=\"/say\\\"hi\\\"\","
+        "status=\"200\",phase=\"handler\"} 0.001500\n") != string::npos);
+    assert(text.find(
+        "cnek_request_duration_seconds_count{route=\"/say\\\"hi\\\"\","
+        "status=\"200\",phase=\"handler\"} 1\n") != string::npos);
+    assert(text.find("cnek_request_duration_dropped_total 0\n")
+           != string::npos);
+
+    // Teardown.
+    delete response;
+    remove(statsPath);
+}
+
+void testCnek() {
+    // Setup.
+    remove(statsPath);
+    char requestMethod[] = "REQUEST_METHOD=POST";
+    char requestUri[] = "REQUEST_URI=/users/7";
+    char contentType[] = "CONTENT_TYPE=application/x-www-form-urlencoded";
+    char* env[] = {requestMethod, requestUri, contentType, NULL};
+    FILE* input = tmpfile();
+    fputs("name=cnek", input);
+    rewind(input);
+    FILE* output = tmpfile();
+    LatencyStats stats(statsPath, 32);
+
+    // Given we have a cnek with latency stats and a form request.
+    Cnek* cnek = new Cnek();
+    cnek->setLatencyStats(&stats);
+    cnek->getServerRequest(env, input);
+
+    // When we emit a response under the route "/users/:id".
+    cnek->setRoute("/users/:id");
+    cnek->emitResponse(new Response(201, "Created"), output);
+    delete cnek;
+
+    // Then we see each phase was recorded, with body parsing apart from the
+    // handler.
+    const char* phases[] = {"env", "body", "urlencoded", "handler", "emit",
+                            "total"};
+    for (size_t i = 0; i < sizeof(phases) / sizeof(*phases); i++) {
+        assert(stats.getSnapshot("/users/:id", 201, phases[i]).getCount() == 1);
+    }
+    assert(!stats.getSnapshot("/users/:id", 201, "multipart").getCount());
+
+    // Teardown.
+    fclose(input);
+    fclose(output);
+    remove(statsPath);
+}
+
+} // namespace
+
+void LatencyStatsTest() {
+    testHistogram();
+#ifndef _WIN32
+    testShared();
+    testPrometheus();
+    testCnek();
+#endif // _WIN32
+    printf("LatencyStatsTest passed!\n");
+}
+
+} // Cnek
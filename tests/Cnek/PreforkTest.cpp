@@ -0,0 +1,138 @@
+#include "Prefork.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif // __linux__
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+using std::string;
+
+namespace {
+
+#ifdef __linux__
+/**
+ * Sends a request to a port on 127.0.0.1 and reads the whole response.
+ *
+ * Failures return an empty response instead of asserting, so the test can
+ * stop the processes it forked before it fails.
+ */
+string get(unsigned short port) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(client, (struct sockaddr*)&address, sizeof(address))) {
+        close(client);
+        return "";
+    }
+
+    const char* request = "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+    write(client, request, strlen(request));
+
+    string data;
+    char buffer[4096];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = read(client, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    close(client);
+    return data;
+}
+
+/**
+ * Gets the body of a response, the process ID of the worker, or an empty
+ * string if there is none.
+ */
+string getpidof(const string& response) {
+    size_t bodyStart = response.find("\r\n\r\n");
+    if (bodyStart == string::npos) return "";
+    return response.substr(bodyStart + 4);
+}
+
+Response* pidhandler(Cnek& cnek, ServerRequest* request) {
+    (void)cnek;
+    (void)request;
+    char pid[24];
+    snprintf(pid, sizeof(pid), "%d", (int)getpid());
+    Response* response = new Response(200, "OK");
+    response->getBody()->write(pid);
+    return response;
+}
+
+void testRun() {
+    // Setup.
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(!bind(listener, (struct sockaddr*)&address, sizeof(address)));
+    assert(!listen(listener, SOMAXCONN));
+    socklen_t length = sizeof(address);
+    assert(!getsockname(listener, (struct sockaddr*)&address, &length));
+    unsigned short port = ntohs(address.sin_port);
+
+    // Given a master process supervising 2 HTTP workers that are restarted
+    // after each request.
+    fflush(stdout);
+    pid_t master = fork();
+    assert(master >= 0);
+    if (!master) {
+        Prefork prefork(listener, PREFORK_HTTP, 2);
+        prefork.setMaxRequests(1);
+        prefork.setCpuAffinity(true);
+        prefork.run(pidhandler);
+        _exit(0);
+    }
+    close(listener);
+
+    // When we send requests one after another, reload the workers, send
+    // another request, then stop the master.
+    // Results are only checked once the master is stopped, so a failure
+    // does not leave it and its workers running.
+    string first = getpidof(get(port));
+    string second = getpidof(get(port));
+    string third = getpidof(get(port));
+    kill(master, SIGHUP);
+    string reloaded = getpidof(get(port));
+    kill(master, SIGTERM);
+    int status = 0;
+    waitpid(master, &status, 0);
+
+    // Then we see each request was answered by a different worker.
+    assert(!first.empty() && !second.empty() && !third.empty());
+    assert(first != second && second != third && first != third);
+
+    // And we see requests are still answered after the reload.
+    assert(!reloaded.empty());
+
+    // And we see the master stops its workers and returns.
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+}
+#endif // __linux__
+
+} // namespace
+
+void PreforkTest() {
+#ifdef __linux__
+    testRun();
+#endif // __linux__
+    printf("PreforkTest passed!\n");
+}
+
+} // Cnek
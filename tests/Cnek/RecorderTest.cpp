@@ -0,0 +1,149 @@
+#include "Cnek.hpp"
+#include "Recorder.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+
+namespace Cnek {
+
+namespace {
+
+const char* capturePath = "cnek_recorder_test.cap";
+
+void testRecordLoad() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=POST";
+    char requestUri[] = "REQUEST_URI=/upload";
+    char* env[] = {requestMethod, requestUri, NULL};
+    char* emptyEnv[] = {NULL};
+    const char body[] = {'a', '\0', 'b'};
+    remove(capturePath);
+
+    // Given we record a request with a binary body and one without anything.
+    Recorder* recorder = new Recorder(capturePath);
+    recorder->record(env, body, sizeof(body));
+    recorder->record(emptyEnv, "", 0);
+    delete recorder;
+
+    // When we load the capture.
+    Capture capture(capturePath);
+
+    // Then we see the first request's environment and body.
+    assert(capture.next());
+    char** loaded = capture.getEnvironment();
+    assert(!strcmp(loaded[0], "REQUEST_METHOD=POST"));
+    assert(!strcmp(loaded[1], "REQUEST_URI=/upload"));
+    assert(!loaded[2]);
+    assert(capture.getBody().size() == sizeof(body));
+    assert(!memcmp(capture.getBody().data(), body, sizeof(body)));
+    assert(capture.getTime() > 0);
+
+    // And we see the input stream has the body.
+    char input[8];
+    assert(fread(input, 1, sizeof(input), capture.getInput()) == sizeof(body));
+    assert(!memcmp(input, body, sizeof(body)));
+
+    // And we see the second request is empty.
+    assert(capture.next());
+    assert(!*capture.getEnvironment());
+    assert(capture.getBody().empty());
+
+    // And we see the end of the capture.
+    assert(!capture.next());
+
+    // Teardown.
+    remove(capturePath);
+}
+
+void testCorrupt() {
+    // Setup.
+    FILE* file = fopen(capturePath, "wb");
+    fputs("CREC\xff\xff\xff\x7f", file);
+    fclose(file);
+
+    // Given a capture with an impossible record length.
+    Capture capture(capturePath);
+
+    // When we load it.
+    // Then we see it throws.
+    bool threw = false;
+    try {
+        capture.next();
+    } catch (std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Teardown.
+    remove(capturePath);
+}
+
+void testSampling() {
+    // Setup.
+    remove(capturePath);
+
+    // Given a recorder that samples 1 in 10 requests.
+    Recorder recorder(capturePath, 10);
+
+    // When we ask it 10000 times.
+    int sampled = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (recorder.isSampled()) sampled++;
+    }
+
+    // Then we see about 1000 were sampled.
+    assert(sampled > 800 && sampled < 1200);
+
+    // Teardown.
+    remove(capturePath);
+}
+
+void testGetServerRequest() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=POST";
+    char requestUri[] = "REQUEST_URI=/form";
+    char* env[] = {requestMethod, requestUri, NULL};
+    FILE* input = tmpfile();
+    fputs("name=cnek", input);
+    rewind(input);
+    remove(capturePath);
+
+    // Given we have a cnek recording every request.
+    Recorder* recorder = new Recorder(capturePath);
+    Cnek* cnek = new Cnek();
+    cnek->setRecorder(recorder);
+
+    // When we get the server request.
+    cnek->getServerRequest(env, input);
+    delete cnek;
+    delete recorder;
+
+    // Then we see the capture rebuilds the same request.
+    Capture capture(capturePath);
+    assert(capture.next());
+    cnek = new Cnek();
+    Csr::Http::Message::ServerRequest* serverRequest =
+        cnek->getServerRequest(capture.getEnvironment(), capture.getInput());
+    assert(!strcmp(serverRequest->getMethod(), "POST"));
+    assert(!strcmp(serverRequest->getRequestTarget(), "/form"));
+    assert(!strcmp(serverRequest->getBody()->toString(), "name=cnek"));
+
+    // Teardown.
+    delete cnek;
+    fclose(input);
+    remove(capturePath);
+}
+
+} // namespace
+
+void RecorderTest() {
+    testRecordLoad();
+    testCorrupt();
+    testSampling();
+    testGetServerRequest();
+    printf("RecorderTest passed!\n");
+}
+
+} // Cnek
@@ -0,0 +1,363 @@
+#include "Cnek.hpp"
+#include "ResponseCache.hpp"
+#include "AccessLog.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+namespace {
+
+const char* cachePath = "cnek_response_cache_test.bin";
+
+/**
+ * Emits a response to one request, then serves another from the cache.
+ */
+CacheStatus emitandserve(
+    char** emitEnv,
+    char** serveEnv,
+    ResponseCache* cache,
+    Response* response)
+{
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+
+    Cnek* cnek = new Cnek();
+    cnek->setResponseCache(cache);
+    cnek->getServerRequest(emitEnv, input);
+    cnek->emitResponse(response, output);
+    delete cnek;
+    rewind(input);
+
+    cnek = new Cnek();
+    cnek->setResponseCache(cache);
+    cnek->getServerRequest(serveEnv, input);
+    CacheStatus status = cnek->serveCached(output);
+    delete cnek;
+
+    fclose(output);
+    fclose(input);
+    return status;
+}
+
+void testStoreLookup() {
+    // Setup.
+    ResponseCache* cache = new ResponseCache(cachePath, 16, 1024);
+    char* data = NULL;
+    size_t length = 0;
+
+    // Given we store "Hello" under "GET /a" for 60 seconds.
+    assert(cache->store("GET /a", "Hello", 5, 60));
+
+    // When we look it up.
+    CacheStatus status = cache->lookup("GET /a", &data, &length);
+
+    // Then we see a hit with "Hello".
+    assert(status == CACHE_HIT);
+    assert(length == 5 && !memcmp(data, "Hello", 5));
+    free(data);
+
+    // And another key misses.
+    assert(cache->lookup("GET /b", &data, &length) == CACHE_MISS);
+    assert(!data && !length);
+
+    // And entries larger than a slot are not stored.
+    char large[2048];
+    memset(large, 'x', sizeof(large));
+    assert(!cache->store("GET /large", large, sizeof(large), 60));
+
+    // Teardown.
+    delete cache;
+
+    // Given we reopen the cache file.
+    cache = new ResponseCache(cachePath, 16, 1024);
+
+    // Then we see the entry is still there.
+    assert(cache->lookup("GET /a", &data, &length) == CACHE_HIT);
+    free(data);
+
+    // Teardown.
+    delete cache;
+    remove(cachePath);
+}
+
+void testStaleWhileRevalidate() {
+    // Setup.
+    ResponseCache* cache = new ResponseCache(cachePath, 16, 1024);
+    char* data = NULL;
+    size_t length = 0;
+
+    // Given an expired entry that may be served stale for 60 seconds.
+    cache->store("GET /stale", "Old", 3, 0, 60);
+
+    // When we look it up.
+    // Then we see it is stale and we are chosen to revalidate it.
+    assert(cache->lookup("GET /stale", &data, &length) == CACHE_STALE);
+    assert(length == 3 && !memcmp(data, "Old", 3));
+    free(data);
+
+    // And other lookups get the stale entry as a hit.
+    assert(cache->lookup("GET /stale", &data, &length) == CACHE_HIT);
+    free(data);
+
+    // Given an expired entry that may not be served stale.
+    cache->store("GET /expired", "Old", 3, 0, 0);
+
+    // Then we see it misses.
+    assert(cache->lookup("GET /expired", &data, &length) == CACHE_MISS);
+
+    // Teardown.
+    delete cache;
+    remove(cachePath);
+}
+
+void testClockEviction() {
+    // Setup.
+    ResponseCache* cache = new ResponseCache(cachePath, 2, 1024);
+    char* data = NULL;
+    size_t length = 0;
+
+    // Given a full cache where only "GET /a" was used since it was stored.
+    cache->store("GET /a", "A", 1, 60);
+    cache->store("GET /b", "B", 1, 60);
+    assert(cache->lookup("GET /a", &data, &length) == CACHE_HIT);
+    free(data);
+
+    // When we store another entry.
+    cache->store("GET /c", "C", 1, 60);
+
+    // Then we see the unused entry was evicted.
+    assert(cache->lookup("GET /b", &data, &length) == CACHE_MISS);
+    assert(cache->lookup("GET /a", &data, &length) == CACHE_HIT);
+    free(data);
+    assert(cache->lookup("GET /c", &data, &length) == CACHE_HIT);
+    free(data);
+
+    // Teardown.
+    delete cache;
+    remove(cachePath);
+}
+
+void testServeCached() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char requestUri[] = "REQUEST_URI=/report?page=2";
+    char* env[] = {requestMethod, requestUri, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    char first[256];
+    char second[256];
+
+    ResponseCache cache(cachePath, 16, 1024);
+
+    // Given a cnek with a response cache and nothing cached.
+    Cnek* cnek = new Cnek();
+    cnek->setResponseCache(&cache);
+    cnek->getServerRequest(env, input);
+
+    // Then we see the request misses.
+    assert(cnek->serveCached(output) == CACHE_MISS);
+
+    // When we emit a response that may be cached for 60 seconds.
+    Response* response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "max-age=60");
+    response->getBody()->write("Report");
+    cnek->emitResponse(response, output);
+    rewind(output);
+    size_t firstLength = fread(first, 1, sizeof(first), output);
+
+    // Teardown.
+    delete cnek;
+    fclose(output);
+    rewind(input);
+
+    // Setup.
+    output = tmpfile();
+
+    // Given another process handles the same request with an access log.
+    const char* logPath = "cnek_response_cache_test.log";
+    AccessLog* accessLog = new AccessLog(logPath);
+    cnek = new Cnek();
+    cnek->setResponseCache(&cache);
+    cnek->setAccessLog(accessLog);
+    cnek->getServerRequest(env, input);
+
+    // When we serve it from the cache.
+    CacheStatus status = cnek->serveCached(output);
+
+    // Then we see a hit with the first response and its length.
+    assert(status == CACHE_HIT);
+    rewind(output);
+    size_t secondLength = fread(second, 1, sizeof(second) - 1, output);
+    second[secondLength] = '\0';
+    const char* length = "Content-Length: 6\r\n";
+    assert(secondLength == firstLength + strlen(length));
+    assert(strstr(second, length));
+    assert(!memcmp(second + secondLength - 10, "\r\n\r\nReport", 10));
+
+    // And we see the hit was logged with its status and body size.
+    assert(accessLog->flush() == 1);
+    FILE* log = fopen(logPath, "rb");
+    size_t logLength = fread(second, 1, sizeof(second) - 1, log);
+    second[logLength] = '\0';
+    fclose(log);
+    assert(strstr(second, " GET /report?page=2 200 6 "));
+    delete accessLog;
+    remove(logPath);
+
+    // Teardown.
+    delete cnek;
+    fclose(output);
+    fclose(input);
+    remove(cachePath);
+}
+
+void testServeCachedNotModified() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char requestUri[] = "REQUEST_URI=/report";
+    char ifNoneMatch[256] = "HTTP_IF_NONE_MATCH=";
+    char* env[] = {requestMethod, requestUri, NULL, NULL};
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    char head[256];
+
+    ResponseCache cache(cachePath, 16, 1024);
+
+    // Given a cached response with an automatic ETag.
+    Cnek* cnek = new Cnek();
+    cnek->setAutoETag(true);
+    cnek->setResponseCache(&cache);
+    cnek->getServerRequest(env, input);
+    Response* response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "max-age=60");
+    response->setHeader("Content-Type", "text/plain");
+    response->getBody()->write("Report");
+    cnek->emitResponse(response, output);
+    rewind(output);
+    size_t headLength = fread(head, 1, sizeof(head) - 1, output);
+    head[headLength] = '\0';
+    const char* etag = strstr(head, "ETag: ") + 6;
+    strncat(ifNoneMatch, etag, strcspn(etag, "\r"));
+    delete cnek;
+    fclose(output);
+    rewind(input);
+
+    // When another request with the ETag in If-None-Match is served from
+    // the cache.
+    env[2] = ifNoneMatch;
+    output = tmpfile();
+    cnek = new Cnek();
+    cnek->setAutoETag(true);
+    cnek->setResponseCache(&cache);
+    cnek->getServerRequest(env, input);
+
+    // Then we see a hit answered with "304 Not Modified" and no body.
+    assert(cnek->serveCached(output) == CACHE_HIT);
+    rewind(output);
+    headLength = fread(head, 1, sizeof(head) - 1, output);
+    head[headLength] = '\0';
+    assert(strstr(head, "Status: 304 Not Modified\r\n"));
+    assert(strstr(head, "ETag: "));
+    assert(strstr(head, "Cache-Control: max-age=60\r\n"));
+    assert(!strstr(head, "Content-Type"));
+    assert(!strstr(head, "Report"));
+
+    // Teardown.
+    delete cnek;
+    fclose(output);
+    fclose(input);
+    remove(cachePath);
+}
+
+void testCacheSafety() {
+    // Setup.
+    char requestMethod[] = "REQUEST_METHOD=GET";
+    char accountUri[] = "REQUEST_URI=/account";
+    char publicUri[] = "REQUEST_URI=/public";
+    char reportUri[] = "REQUEST_URI=/report";
+    char hostA[] = "HTTP_HOST=a.example";
+    char hostB[] = "HTTP_HOST=b.example";
+    char authorization[] = "HTTP_AUTHORIZATION=Basic dXNlcjpwYXNz";
+    char* env[] = {requestMethod, reportUri, hostA, NULL};
+    char* otherHostEnv[] = {requestMethod, reportUri, hostB, NULL};
+    char* authEnv[] = {requestMethod, accountUri, hostA, authorization, NULL};
+
+    ResponseCache cache(cachePath, 16, 1024);
+    Response* response;
+
+    // Given a cacheable response to a request with Authorization.
+    response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "max-age=60");
+
+    // When we emit it and serve the request again.
+    // Then we see it was not stored.
+    assert(emitandserve(authEnv, authEnv, &cache, response) == CACHE_MISS);
+
+    // Given the response is marked public.
+    response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "public, max-age=60");
+
+    // Then we see it was stored.
+    authEnv[1] = publicUri;
+    assert(emitandserve(authEnv, authEnv, &cache, response) == CACHE_HIT);
+
+    // Given a response that varies on a header outside the key.
+    response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "max-age=60");
+    response->setHeader("Vary", "Accept-Encoding");
+
+    // Then we see it was not stored.
+    assert(emitandserve(env, env, &cache, response) == CACHE_MISS);
+
+    // Given the header is added to the key.
+    cache.addVaryHeader("accept-encoding");
+    response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "max-age=60");
+    response->setHeader("Vary", "Accept-Encoding");
+
+    // Then we see it was stored.
+    assert(emitandserve(env, env, &cache, response) == CACHE_HIT);
+
+    // Given a response that varies on everything.
+    env[1] = accountUri;
+    response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "max-age=60");
+    response->setHeader("Vary", "*");
+
+    // Then we see it was not stored.
+    assert(emitandserve(env, env, &cache, response) == CACHE_MISS);
+
+    // Given a cacheable response for one host.
+    response = new Response(200, "OK");
+    response->setHeader("Cache-Control", "max-age=60");
+
+    // When we serve the same request-target for another host.
+    // Then we see it misses.
+    assert(emitandserve(env, otherHostEnv, &cache, response) == CACHE_MISS);
+
+    // Teardown.
+    remove(cachePath);
+}
+
+} // namespace
+
+void ResponseCacheTest() {
+#ifndef _WIN32
+    testStoreLookup();
+    testStaleWhileRevalidate();
+    testClockEviction();
+    testServeCached();
+    testServeCachedNotModified();
+    testCacheSafety();
+#endif // _WIN32
+    printf("ResponseCacheTest passed!\n");
+}
+
+} // Cnek
@@ -0,0 +1,301 @@
+#include "ScgiServer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+using std::runtime_error;
+using std::string;
+
+namespace {
+
+#ifndef _WIN32
+const char* socketPath = "cnek_scgi_test.sock";
+
+ScgiServer* stoppingServer = NULL;
+
+/**
+ * Builds an SCGI request from NAME, VALUE pairs and a body.
+ */
+string scgirequest(const char** headers, const string& body) {
+    string block;
+    char contentLength[24];
+    snprintf(contentLength, sizeof(contentLength), "%lu",
+             (unsigned long)body.size());
+    block.append("CONTENT_LENGTH", 15);
+    block.append(contentLength, strlen(contentLength) + 1);
+    block.append("SCGI\0" "1", 7);
+    for (const char** header = headers; *header; header++) {
+        block.append(*header, strlen(*header) + 1);
+    }
+
+    char prefix[24];
+    snprintf(prefix, sizeof(prefix), "%lu:", (unsigned long)block.size());
+    return prefix + block + "," + body;
+}
+
+/**
+ * Reads until the peer closes the connection.
+ */
+string readall(int fd) {
+    string data;
+    char buffer[4096];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    return data;
+}
+
+Response* hellohandler(Cnek& cnek, ServerRequest* request) {
+    (void)cnek;
+    Response* response = new Response();
+    response->setHeader("Content-Type", "text/plain");
+    response->setHeader("X-Scgi", request->getServerParam("SCGI"));
+    response->getBody()->write("Hello, ");
+    response->getBody()->write(request->getBodyParam("name"));
+    response->getBody()->write(" from ");
+    response->getBody()->write(request->getHeaderLine("Host"));
+    response->getBody()->write("!");
+    return response;
+}
+
+Response* failinghandler(Cnek& cnek, ServerRequest* request) {
+    (void)cnek;
+    (void)request;
+    throw runtime_error("Handler failed.");
+}
+
+Cnek* reusedCnek = NULL;
+ServerRequest* reusedRequest = NULL;
+
+Response* reusinghandler(Cnek& cnek, ServerRequest* request) {
+    // Nothing set up for the last connection is left.
+    assert(!cnek.getTiming());
+    cnek.setServerTiming(true);
+
+    reusedCnek = &cnek;
+    reusedRequest = request;
+    Response* response = cnek.createResponse();
+    response->getBody()->write(request->getUri()->getPath());
+    return response;
+}
+
+Response* stoppinghandler(Cnek& cnek, ServerRequest* request) {
+    stoppingServer->stop();
+    return hellohandler(cnek, request);
+}
+
+const char* postHeaders[] = {
+    "REQUEST_METHOD", "POST",
+    "REQUEST_URI", "/hello",
+    "CONTENT_TYPE", "application/x-www-form-urlencoded",
+    "HTTP_HOST", "example.com",
+    NULL
+};
+
+void testHandle() {
+    // Setup.
+    int fds[2];
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    ScgiServer server(-1);
+
+    // Given a client sent an SCGI POST request with a form body.
+    string request = scgirequest(postHeaders, "name=World");
+    assert(write(fds[0], request.data(), request.size())
+        == (ssize_t)request.size());
+
+    // When we handle the connection.
+    bool isEmitted = server.handle(fds[1], hellohandler);
+
+    // Then we see the response was emitted in CGI form with the headers and
+    // body of the request.
+    assert(isEmitted);
+    string response = readall(fds[0]);
+    assert(response.find("Status: 200 ") != string::npos);
+    assert(response.find("X-Scgi: 1\r\n") != string::npos);
+    assert(response.find("\r\n\r\nHello, World from example.com!")
+        != string::npos);
+
+    // Teardown.
+    close(fds[0]);
+}
+
+void testReuse() {
+    // Setup.
+    ScgiServer server(-1);
+    const char* paths[] = {"/first", "/second"};
+    Cnek* firstCnek = NULL;
+    ServerRequest* firstRequest = NULL;
+
+    for (int i = 0; i < 2; i++) {
+        int fds[2];
+        assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+        // Given a client sent a GET request.
+        const char* headers[] = {
+            "REQUEST_METHOD", "GET",
+            "REQUEST_URI", paths[i],
+            NULL
+        };
+        string request = scgirequest(headers, "");
+        assert(write(fds[0], request.data(), request.size())
+            == (ssize_t)request.size());
+
+        // When the same server handles the connection.
+        assert(server.handle(fds[1], reusinghandler));
+
+        // Then we see the response is for this request, and timed since
+        // its handler enabled timing.
+        string response = readall(fds[0]);
+        assert(response.find("Server-Timing: ") != string::npos);
+        assert(response.find(string("\r\n\r\n") + paths[i])
+            != string::npos);
+
+        if (!i) {
+            firstCnek = reusedCnek;
+            firstRequest = reusedRequest;
+        }
+
+        // Teardown.
+        close(fds[0]);
+    }
+
+    // And we see the second connection reused the first one's objects.
+    assert(reusedCnek == firstCnek);
+    assert(reusedRequest == firstRequest);
+}
+
+void testMalformed() {
+    const char* requests[] = {
+        "abc",                                  // No length.
+        "05:ab\0cd,",                           // Leading zero.
+        "4:ab\0c,",                             // Missing null-terminator.
+        "5:ab\0c\0;",                           // Missing ','.
+        "13:SCGI\0" "1\0a=b\0c\0,",             // Name with '='.
+        "7:SCGI\0" "1\0,",                      // No CONTENT_LENGTH.
+        "17:CONTENT_LENGTH\0x\0,",              // Invalid CONTENT_LENGTH.
+        "18:CONTENT_LENGTH\0" "10\0,abc",       // Truncated body.
+        NULL
+    };
+    size_t lengths[] = {3, 9, 7, 8, 17, 10, 21, 25};
+
+    for (int i = 0; requests[i]; i++) {
+        // Setup.
+        int fds[2];
+        assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        ScgiServer server(-1);
+
+        // Given a client sent a malformed request and nothing more.
+        assert(write(fds[0], requests[i], lengths[i]) == (ssize_t)lengths[i]);
+        shutdown(fds[0], SHUT_WR);
+
+        // When we handle the connection.
+        bool isEmitted = server.handle(fds[1], hellohandler);
+
+        // Then we see it was closed without a response.
+        assert(!isEmitted);
+        assert(readall(fds[0]).empty());
+
+        // Teardown.
+        close(fds[0]);
+    }
+}
+
+void testErrors() {
+    // Setup.
+    int fds[2];
+    ScgiServer server(-1);
+
+    // Given a request whose handler throws.
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    string request = scgirequest(postHeaders, "");
+    write(fds[0], request.data(), request.size());
+
+    // When we handle the connection.
+    // Then we see "500 Internal Server Error".
+    assert(!server.handle(fds[1], failinghandler));
+    assert(readall(fds[0]) == "Status: 500 Internal Server Error\r\n\r\n");
+    close(fds[0]);
+
+    // Given a request without REQUEST_METHOD.
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    const char* noMethod[] = {"REQUEST_URI", "/", NULL};
+    request = scgirequest(noMethod, "");
+    write(fds[0], request.data(), request.size());
+
+    // When we handle the connection.
+    // Then we see "400 Bad Request".
+    assert(!server.handle(fds[1], hellohandler));
+    assert(readall(fds[0]) == "Status: 400 Bad Request\r\n\r\n");
+    close(fds[0]);
+}
+
+void testServe() {
+    // Setup.
+    ScgiServer* server = new ScgiServer(socketPath);
+    stoppingServer = server;
+
+    // Given a client process connects to the server's socket and sends a
+    // request.
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (!pid) {
+        int client = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, socketPath);
+        if (connect(client, (struct sockaddr*)&address, sizeof(address))) {
+            _exit(1);
+        }
+
+        string request = scgirequest(postHeaders, "name=Socket");
+        write(client, request.data(), request.size());
+        string response = readall(client);
+        _exit(response.find("Hello, Socket from example.com!")
+            == string::npos);
+    }
+
+    // When we serve until the handler stops the server.
+    server->serve(stoppinghandler);
+
+    // Then we see the client received its response.
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+
+    // Teardown.
+    delete server;
+    unlink(socketPath);
+}
+#endif // _WIN32
+
+} // namespace
+
+void ScgiServerTest() {
+#ifndef _WIN32
+    testHandle();
+    testReuse();
+    testMalformed();
+    testErrors();
+    testServe();
+#endif // _WIN32
+    printf("ScgiServerTest passed!\n");
+}
+
+} // Cnek
@@ -0,0 +1,288 @@
+#include "StaticFile.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <string>
+
+#ifdef CNEK_USE_ZLIB
+#include <dirent.h>
+#include <unistd.h>
+#endif // CNEK_USE_ZLIB
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+using Csr::Http::Message::Stream;
+
+namespace {
+
+const char* filename = "cnek_static_test.css";
+const char* gzipFilename = "cnek_static_test.css.gz";
+
+/**
+ * Writes bytes to a file, replacing its contents.
+ */
+void writeFile(const char* name, const char* data, size_t size) {
+    FILE* file = fopen(name, "wb");
+    assert(file);
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+/**
+ * Creates a GET server request with the given Accept-Encoding header.
+ */
+ServerRequest* createRequest(const char* acceptEncoding) {
+    static char header[256];
+    static char* env[2];
+
+    snprintf(header, sizeof(header), "HTTP_ACCEPT_ENCODING=%s", acceptEncoding);
+    env[0] = header;
+    env[1] = NULL;
+    if (!*acceptEncoding) env[0] = NULL;
+
+    return new ServerRequest("GET", "/app.css", env);
+}
+
+void testNegotiate() {
+    const Encoding all[] = {ENCODING_GZIP, ENCODING_ZSTD, ENCODING_BR};
+    const Encoding gzip[] = {ENCODING_GZIP};
+
+    // Given the client accepts gzip fully and br at half weight.
+    // Then we see gzip is picked.
+    assert(StaticFile::negotiate("gzip, br;q=0.5", all, 3) == ENCODING_GZIP);
+
+    // Given the client accepts br and gzip equally.
+    // Then we see the server preference, br, is picked.
+    assert(StaticFile::negotiate("gzip, br", all, 3) == ENCODING_BR);
+
+    // Given the client refuses gzip but accepts anything else.
+    // Then we see br is picked.
+    assert(StaticFile::negotiate("gzip;q=0, *", all, 3) == ENCODING_BR);
+
+    // Given only gzip is available.
+    // Then we see gzip is picked even though br is preferred.
+    assert(StaticFile::negotiate("br, x-gzip", gzip, 1) == ENCODING_GZIP);
+
+    // Given the client only accepts identity.
+    // Then we see no encoding is picked.
+    assert(StaticFile::negotiate("identity", all, 3) == ENCODING_IDENTITY);
+    assert(StaticFile::negotiate("br;q=0", all, 3) == ENCODING_IDENTITY);
+}
+
+void testServeVariant() {
+    // Setup.
+    const char original[] = "body{}";
+    const char compressed[] = {'\x1f', '\x8b', '\0', 'x'};
+    char buffer[16];
+    writeFile(filename, original, sizeof(original) - 1);
+    writeFile(gzipFilename, compressed, sizeof(compressed));
+
+    StaticFile staticFile;
+    ServerRequest* request = createRequest("gzip, deflate");
+    Response* response = new Response();
+
+    // Given a gzip variant is stored next to the file and gzip is accepted.
+    // When we serve the file.
+    staticFile.serve(request, response, filename);
+
+    // Then we see the gzip variant is the body.
+    assert(!strcmp(response->getHeaderLine("Content-Encoding"), "gzip"));
+    assert(!strcmp(response->getHeaderLine("Vary"), "Accept-Encoding"));
+    size_t bytesRead = response->getBody()->read(buffer, sizeof(buffer));
+    assert(bytesRead == sizeof(compressed));
+    assert(!memcmp(buffer, compressed, sizeof(compressed)));
+
+    // Teardown.
+    delete response;
+    delete request;
+
+    // Setup.
+    request = createRequest("");
+    response = new Response();
+
+    // Given the client does not send Accept-Encoding.
+    // When we serve the file.
+    staticFile.serve(request, response, filename);
+
+    // Then we see the original file is the body.
+    assert(!response->hasHeader("Content-Encoding"));
+    assert(!strcmp(response->getBody()->toString(), original));
+
+    // Teardown.
+    delete response;
+    delete request;
+
+    // Setup.
+    struct utimbuf times;
+    times.actime = time(NULL) + 60;
+    times.modtime = times.actime;
+    utime(filename, &times);
+    request = createRequest("gzip");
+    response = new Response();
+
+    // Given the original file is newer than its gzip variant.
+    // When we serve the file.
+    staticFile.serve(request, response, filename);
+
+    // Then we see the stale variant is ignored.
+    assert(!response->hasHeader("Content-Encoding"));
+    assert(!strcmp(response->getBody()->toString(), original));
+
+    // Teardown.
+    delete response;
+    delete request;
+    remove(filename);
+    remove(gzipFilename);
+}
+
+#ifdef CNEK_USE_ZLIB
+const char* cacheDirectory = "cnek_static_cache";
+
+/**
+ * Lists the names of the files in the cache directory, one per line.
+ */
+std::string listcache() {
+    std::string names;
+    DIR* dir = opendir(cacheDirectory);
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (*entry->d_name == '.') continue;
+        names += entry->d_name;
+        names += '\n';
+    }
+    closedir(dir);
+    return names;
+}
+
+/**
+ * Removes the cache directory and every file in it.
+ */
+void removecache() {
+    DIR* dir = opendir(cacheDirectory);
+    struct dirent* entry;
+    char path[512];
+    while ((entry = readdir(dir))) {
+        if (*entry->d_name == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", cacheDirectory, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(cacheDirectory);
+}
+
+/**
+ * Serves the file and checks whether or not it was served as gzip.
+ */
+bool servegzip(StaticFile& staticFile) {
+    ServerRequest* request = createRequest("gzip");
+    Response* response = new Response();
+    staticFile.serve(request, response, filename);
+    bool isGzip = !strcmp(response->getHeaderLine("Content-Encoding"), "gzip");
+    delete response;
+    delete request;
+    return isGzip;
+}
+
+void testGenerateFirstHit() {
+    // Setup.
+    const char original[] = "body{margin:0}body{margin:0}body{margin:0}";
+    writeFile(filename, original, sizeof(original) - 1);
+    mkdir(cacheDirectory, 0700);
+
+    StaticFile staticFile(cacheDirectory, GENERATE_FIRST_HIT);
+    ServerRequest* request = createRequest("gzip");
+    Response* response = new Response();
+
+    // Given there is no gzip variant and first-hit generation is enabled.
+    // When we serve the file.
+    staticFile.serve(request, response, filename);
+
+    // Then we see a gzip variant was generated and served.
+    assert(!strcmp(response->getHeaderLine("Content-Encoding"), "gzip"));
+    char magic[2];
+    assert(response->getBody()->read(magic, sizeof(magic)) == 2);
+    assert(magic[0] == '\x1f' && magic[1] == '\x8b');
+
+    // When the file changes and is served again.
+    const char changed[] = "body{margin:1px}body{margin:1px}body{margin:1px}";
+    writeFile(filename, changed, sizeof(changed) - 1);
+    assert(servegzip(staticFile));
+
+    // Then we see the variant of the old version was removed.
+    std::string names = listcache();
+    assert(names.find('\n') == names.size() - 1);
+
+    // Teardown.
+    delete response;
+    delete request;
+    remove(filename);
+    removecache();
+}
+
+void testGenerateBackground() {
+    // Setup.
+    const char original[] = "p{color:red}p{color:red}p{color:red}";
+    writeFile(filename, original, sizeof(original) - 1);
+    mkdir(cacheDirectory, 0700);
+    StaticFile staticFile(cacheDirectory, GENERATE_BACKGROUND);
+
+    // Given there is no gzip variant and background generation is enabled.
+    // When we serve the file.
+    // Then we see it is served uncompressed while the variant is generated.
+    assert(!servegzip(staticFile));
+    std::string names;
+    for (int i = 0; i < 500 && (names.empty() || names.find(".tmp")
+                                 != std::string::npos); i++) {
+        usleep(10000);
+        names = listcache();
+    }
+    assert(names.find(".gz\n") != std::string::npos);
+    assert(servegzip(staticFile));
+
+    // Given the file changed and another process claimed its variant.
+    const char changed[] = "p{color:blue}p{color:blue}p{color:blue}";
+    writeFile(filename, changed, sizeof(changed) - 1);
+    struct stat info;
+    assert(!stat(filename, &info));
+    char claim[512];
+    snprintf(claim,
+             sizeof(claim),
+             "%s/%.17s%lu-%lu.gz.tmp",
+             cacheDirectory,
+             names.c_str(),
+             (unsigned long)info.st_size,
+             (unsigned long)info.st_mtime);
+    writeFile(claim, "", 0);
+
+    // When we serve the file.
+    // Then we see no other process generates it.
+    assert(!servegzip(staticFile));
+    usleep(200000);
+    assert(!servegzip(staticFile));
+
+    // Teardown.
+    remove(filename);
+    removecache();
+}
+#endif // CNEK_USE_ZLIB
+
+} // namespace
+
+void StaticFileTest() {
+    testNegotiate();
+    testServeVariant();
+#ifdef CNEK_USE_ZLIB
+    testGenerateFirstHit();
+    testGenerateBackground();
+#endif // CNEK_USE_ZLIB
+    printf("StaticFileTest passed!\n");
+}
+
+} // Cnek
@@ -0,0 +1,182 @@
+#include "Template.hpp"
+#include "Stream.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+#include <string>
+
+namespace Cnek {
+
+using Csr::Http::Message::Stream;
+
+using std::invalid_argument;
+using std::string;
+
+namespace {
+
+const char* templatePath = "cnek_template_test.html";
+const char* cachePath = "cnek_template_test.cache";
+
+/**
+ * Renders a template into a string.
+ */
+string render(Template& page, TemplateData& data) {
+    Stream stream;
+    size_t written = page.render(data, &stream);
+    string result = stream.toString();
+    assert(written == result.size());
+    return result;
+}
+
+/**
+ * Writes a file.
+ */
+void writefile(const char* path, const char* data) {
+    FILE* file = fopen(path, "wb");
+    assert(file);
+    fputs(data, file);
+    fclose(file);
+}
+
+/**
+ * Checks whether compiling a template throws std::invalid_argument.
+ */
+bool isrejected(const char* source) {
+    Template page;
+    try {
+        page.compile(source, strlen(source));
+    } catch (invalid_argument&) {
+        return true;
+    }
+    return false;
+}
+
+void testRender() {
+    // Given we have a template with a variable, a loop and conditionals.
+    const char* source =
+        "<h1>{{ title }}</h1>"
+        "{{#users}}<p class=\"{{?admin}}admin{{/admin}}\">{{name}} of {{title}}"
+        "</p>{{/users}}"
+        "{{^users}}<p>Nobody</p>{{/users}}";
+    Template page;
+    page.compile(source, strlen(source));
+
+    // And values with HTML special characters.
+    TemplateData data;
+    data.set("title", "Tom & Jerry's <Show>");
+    TemplateData* user = data.add("users");
+    user->set("name", "\"Tom\"");
+    user->set("admin", "1");
+    data.add("users")->set("name", "Jerry");
+
+    // When we render it.
+    string result = render(page, data);
+
+    // Then we see the values escaped, the list repeated and outer values
+    // looked up from inside the loop.
+    assert(result ==
+        "<h1>Tom &amp; Jerry&#39;s &lt;Show&gt;</h1>"
+        "<p class=\"admin\">&quot;Tom&quot; of Tom &amp; Jerry&#39;s "
+        "&lt;Show&gt;</p>"
+        "<p class=\"\">Jerry of Tom &amp; Jerry&#39;s &lt;Show&gt;</p>");
+
+    // When we render it without users.
+    TemplateData empty;
+    empty.set("title", "Nobody");
+
+    // Then we see the inverted section.
+    assert(render(page, empty) == "<h1>Nobody</h1><p>Nobody</p>");
+
+    // And a value can be read back.
+    assert(!strcmp(data.get("title"), "Tom & Jerry's <Show>"));
+    assert(!data.get("missing"));
+
+    // And an empty template renders nothing.
+    Template blank;
+    assert(render(blank, data).empty());
+}
+
+void testInvalid() {
+    // Given we have malformed templates.
+    // Then we see each is rejected.
+    assert(isrejected("<p>{{name</p>"));
+    assert(isrejected("{{#users}}<p>"));
+    assert(isrejected("{{#users}}{{/admin}}"));
+    assert(isrejected("{{/users}}"));
+    assert(isrejected("{{}}"));
+    assert(isrejected("{{na me}}"));
+
+    // And sections nested deeper than TEMPLATE_MAX_DEPTH are rejected.
+    string deep;
+    for (int i = 0; i < 33; i++) deep += "{{#a}}";
+    for (int i = 0; i < 33; i++) deep += "{{/a}}";
+    assert(isrejected(deep.c_str()));
+
+    // And a lone brace is text.
+    Template page;
+    page.compile("{ {{a}} }", 9);
+    TemplateData data;
+    data.set("a", "b");
+    assert(render(page, data) == "{ b }");
+}
+
+void testCache() {
+#ifndef _WIN32
+    // Setup.
+    remove(cachePath);
+    writefile(templatePath, "<p>Hello, {{name}}!</p>");
+    TemplateData data;
+    data.set("name", "Cnek");
+
+    // Given we load a template with a cache path.
+    Template first;
+    first.load(templatePath, cachePath);
+
+    // Then we see the compiled program was cached.
+    FILE* cache = fopen(cachePath, "rb");
+    assert(cache);
+    fseek(cache, 0, SEEK_END);
+    assert((size_t)ftell(cache) == first.getProgramSize());
+    fclose(cache);
+
+    // When another template loads it from the cache.
+    Template second;
+    second.load(templatePath, cachePath);
+
+    // Then we see it renders the same.
+    assert(render(second, data) == "<p>Hello, Cnek!</p>");
+
+    // When the template file changes size.
+    writefile(templatePath, "<p>Goodbye, {{name}}!</p>");
+    Template third;
+    third.load(templatePath, cachePath);
+
+    // Then we see the cache is not used.
+    assert(render(third, data) == "<p>Goodbye, Cnek!</p>");
+
+    // When the cache is corrupt.
+    writefile(cachePath, "CNEKTP01 not a program");
+    Template fourth;
+    fourth.load(templatePath, cachePath);
+
+    // Then we see the template is compiled again.
+    assert(render(fourth, data) == "<p>Goodbye, Cnek!</p>");
+
+    // Teardown.
+    remove(templatePath);
+    remove(cachePath);
+#endif // _WIN32
+}
+
+} // namespace
+
+void TemplateTest() {
+    testRender();
+    testInvalid();
+    testCache();
+    printf("TemplateTest passed!\n");
+}
+
+} // Cnek
@@ -0,0 +1,180 @@
+#include "ThreadPool.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif // _WIN32
+
+namespace Cnek {
+
+using Csr::Http::Message::ServerRequest;
+using Csr::Http::Message::Response;
+
+using std::string;
+
+namespace {
+
+#ifndef _WIN32
+const char* socketPath = "cnek_thread_pool_test.sock";
+
+ThreadPool* pool = NULL;
+
+/** Whether or not the last handler saw a pool serving. */
+bool isServingInHandler = false;
+
+/**
+ * Builds an SCGI GET request for a path.
+ */
+string scgiget(const char* path) {
+    string block;
+    block.append("CONTENT_LENGTH\0" "0\0", 17);
+    block.append("SCGI\0" "1\0", 7);
+    block.append("REQUEST_METHOD\0" "GET\0", 19);
+    block.append("REQUEST_URI\0", 12);
+    block.append(path, strlen(path) + 1);
+
+    char prefix[24];
+    snprintf(prefix, sizeof(prefix), "%lu:", (unsigned long)block.size());
+    return prefix + block + ",";
+}
+
+/**
+ * Connects to the pool's socket and sends a request.
+ */
+int sendrequest(const char* path) {
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    if (connect(client, (struct sockaddr*)&address, sizeof(address))) {
+        _exit(1);
+    }
+
+    string request = scgiget(path);
+    if (write(client, request.data(), request.size())
+        != (ssize_t)request.size())
+    {
+        _exit(1);
+    }
+    return client;
+}
+
+/**
+ * Reads until the peer closes the connection.
+ */
+string readall(int fd) {
+    string data;
+    char buffer[4096];
+    ssize_t bytesRead = 0;
+    while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, bytesRead);
+    }
+    close(fd);
+    return data;
+}
+
+Response* pathhandler(Cnek& cnek, ServerRequest* request) {
+    (void)cnek;
+    const char* path = request->getServerParam("REQUEST_URI");
+    if (!strcmp(path, "/slow")) usleep(500000);
+    if (!strcmp(path, "/stop")) pool->stop();
+    isServingInHandler = ThreadPool::isServing();
+
+    Response* response = new Response(200, "OK");
+    response->getBody()->write("Path: ");
+    response->getBody()->write(path);
+    return response;
+}
+
+/**
+ * Runs the client: a slow request, quick ones queued behind it, then a
+ * request that stops the pool.
+ *
+ * @return Exit status, 0 if every response was as expected.
+ */
+int runclient() {
+    // The slow request occupies one worker; with round-robin, every other
+    // quick request is queued behind it and MUST be stolen to be answered
+    // before it.
+    int slow = sendrequest("/slow");
+    usleep(50000);
+
+    int quick[4];
+    for (int i = 0; i < 4; i++) quick[i] = sendrequest("/quick");
+    for (int i = 0; i < 4; i++) {
+        if (readall(quick[i]).find("\r\n\r\nPath: /quick") == string::npos) {
+            return 2;
+        }
+    }
+
+    struct pollfd fd;
+    fd.fd = slow;
+    fd.events = POLLIN;
+    if (poll(&fd, 1, 0)) return 3;
+    if (readall(slow).find("\r\n\r\nPath: /slow") == string::npos) return 4;
+
+    if (readall(sendrequest("/stop")).find("Path: /stop") == string::npos) {
+        return 5;
+    }
+    return 0;
+}
+
+void testServe() {
+    // Setup.
+    unlink(socketPath);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    assert(!bind(listener, (struct sockaddr*)&address, sizeof(address)));
+    assert(!listen(listener, SOMAXCONN));
+    pool = new ThreadPool(listener, 2);
+
+    // Given a client process sends a slow request, quick requests queued
+    // behind it, then a request that stops the pool.
+    assert(!ThreadPool::isServing());
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (!pid) _exit(runclient());
+
+    // When we serve with two worker threads until stopped.
+    pool->serve(pathhandler);
+
+    // Then we see every quick request was answered while the slow one was
+    // still being handled, and every request got its response.
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+
+    // And we see handlers know a pool is serving until it returns.
+    assert(isServingInHandler);
+    assert(!ThreadPool::isServing());
+
+    // Teardown.
+    delete pool;
+    pool = NULL;
+    unlink(socketPath);
+}
+#endif // _WIN32
+
+} // namespace
+
+void ThreadPoolTest() {
+#ifndef _WIN32
+    testServe();
+#endif // _WIN32
+    printf("ThreadPoolTest passed!\n");
+}
+
+} // Cnek
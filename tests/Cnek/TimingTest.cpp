@@ -0,0 +1,110 @@
+#include "Timing.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+namespace Cnek {
+
+namespace {
+
+/**
+ * Spends some CPU time so timers have something to measure.
+ */
+void spin() {
+    volatile unsigned long sum = 0;
+    for (unsigned long i = 0; i < 2000000; i++) sum += i;
+}
+
+void testStartStop() {
+    // Given we have timings.
+    Timing timing;
+
+    // Then we see no phase is recorded.
+    assert(!timing.isRecorded(TIMING_ENV));
+    assert(timing.getWallTime(TIMING_ENV) == 0);
+
+    // When we time the handler phase.
+    timing.start(TIMING_HANDLER);
+    spin();
+    timing.stop(TIMING_HANDLER);
+
+    // Then we see only it is recorded, with non-negative times.
+    assert(timing.isRecorded(TIMING_HANDLER));
+    assert(!timing.isRecorded(TIMING_EMIT));
+    assert(timing.getWallTime(TIMING_HANDLER) > 0);
+    assert(timing.getCpuTime(TIMING_HANDLER) >= 0);
+
+    // When we stop a phase that was never started.
+    timing.stop(TIMING_EMIT);
+
+    // Then we see it is still not recorded.
+    assert(!timing.isRecorded(TIMING_EMIT));
+}
+
+void testToHeader() {
+    // Setup.
+    char header[256];
+    Timing timing;
+
+    // Given nothing was timed.
+    // Then we see an empty header value.
+    assert(!strcmp(timing.toHeader(header, sizeof(header)), ""));
+
+    // Given the env and handler phases were timed.
+    timing.start(TIMING_ENV);
+    timing.stop(TIMING_ENV);
+    timing.start(TIMING_HANDLER);
+    timing.stop(TIMING_HANDLER);
+
+    // When we format the header.
+    timing.toHeader(header, sizeof(header));
+
+    // Then we see both metrics with durations and CPU descriptions.
+    assert(!strncmp(header, "env;dur=", 8));
+    assert(strstr(header, ";desc=\"cpu="));
+    assert(strstr(header, ", handler;dur="));
+    assert(!strstr(header, "body"));
+
+    // And we see a small buffer is filled without overflowing.
+    char small[8];
+    timing.toHeader(small, sizeof(small));
+    assert(strlen(small) == sizeof(small) - 1);
+}
+
+void testWriteStats() {
+    // Setup.
+    char line[256];
+    FILE* sink = tmpfile();
+    Timing timing;
+
+    // Given the body phase was timed.
+    timing.start(TIMING_BODY);
+    timing.stop(TIMING_BODY);
+
+    // When we write the stats of "GET /report" with status 200.
+    timing.writeStats(sink, "GET", "/report", 200);
+
+    // Then we see one line with the request and the phase's wall and CPU
+    // times.
+    rewind(sink);
+    assert(fgets(line, sizeof(line), sink));
+    assert(!strncmp(line, "GET /report 200 body=", 21));
+    assert(strchr(line + 21, '/'));
+    assert(line[strlen(line) - 1] == '\n');
+    assert(!fgets(line, sizeof(line), sink));
+
+    // Teardown.
+    fclose(sink);
+}
+
+} // namespace
+
+void TimingTest() {
+    testStartStop();
+    testToHeader();
+    testWriteStats();
+    printf("TimingTest passed!\n");
+}
+
+} // Cnek
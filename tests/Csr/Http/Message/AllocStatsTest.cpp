@@ -0,0 +1,71 @@
+#include "AllocStats.hpp"
+#include "Message.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+namespace {
+
+void testAllocateRelease() {
+    // Given we allocate 16 bytes and grow them to 64 bytes.
+    char* memory = (char*)AllocStats::allocate(16);
+    assert(memory);
+    memcpy(memory, "0123456789abcde", 16);
+    memory = (char*)AllocStats::reallocate(memory, 64);
+
+    // Then we see the contents are kept.
+    assert(!strcmp(memory, "0123456789abcde"));
+
+    // Teardown.
+    AllocStats::release(memory);
+    AllocStats::release(NULL);
+}
+
+void testCounters() {
+    // Given we reset the counters.
+    AllocStats::reset();
+    AllocCounters before = AllocStats::get();
+
+    // When we add 10 headers and delete them.
+    HeaderList* headers = new HeaderList();
+    for (int i = 0; i < 10; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "X-Header-%d", i);
+        headers->addHeader(name, "value");
+    }
+    AllocCounters filled = AllocStats::get();
+    delete headers;
+    AllocCounters after = AllocStats::get();
+
+    if (!AllocStats::isEnabled()) {
+        // Then we see nothing is counted without CSR_ALLOC_STATS.
+        assert(!after.allocations && !after.frees && !after.peak);
+        return;
+    }
+
+    // Then we see the list, nodes and copies were counted.
+    assert(before.allocations == 0 && before.frees == 0);
+    assert(filled.allocations >= 1 + 10 * 3);
+    assert(filled.current > before.current);
+    assert(filled.peak >= filled.current);
+
+    // And we see everything was freed, while the peak is kept.
+    assert(after.frees - before.frees == after.allocations - before.allocations);
+    assert(after.current == before.current);
+    assert(after.peak == filled.peak);
+}
+
+} // namespace
+
+void AllocStatsTest() {
+    testAllocateRelease();
+    testCounters();
+    printf("AllocStatsTest passed!\n");
+}
+
+}}} // Csr::Http::Message
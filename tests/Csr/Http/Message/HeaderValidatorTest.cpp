@@ -0,0 +1,88 @@
+#include "HeaderValidator.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+using std::string;
+
+namespace {
+
+/**
+ * Strips a value with the validator.
+ */
+string strip(string value) {
+    if (value.empty()) return value;
+    value.resize(HeaderValidator::strip(&value[0], value.size()));
+    return value;
+}
+
+void testScan() {
+    // Given we have values with CR, LF and NUL at every offset of the
+    // 16-byte blocks.
+    const char unsafe[] = {'\r', '\n', '\0'};
+    for (size_t offset = 0; offset < 40; offset++) {
+        for (size_t i = 0; i < sizeof(unsafe); i++) {
+            string value(offset, 'a');
+            value += unsafe[i];
+            value += string(offset, 'b');
+
+            // Then we see the first unsafe byte is found.
+            assert(HeaderValidator::scan(value.data(), value.size()) == offset);
+            assert(!HeaderValidator::isValidValue(value.data(), value.size()));
+        }
+
+        // And we see safe values are valid, including tabs and obs-text.
+        string value = string(offset, 'a') + "\t\x7f\xc3\xa9";
+        assert(HeaderValidator::scan(value.data(), value.size())
+               == value.size());
+        assert(HeaderValidator::isValidValue(value.data(), value.size()));
+    }
+}
+
+void testNames() {
+    // Given we have header names.
+    // Then we see only non-empty tokens are valid.
+    assert(HeaderValidator::isValidName("Content-Type"));
+    assert(HeaderValidator::isValidName("X-Custom_1!#$%&'*+.^`|~"));
+    assert(!HeaderValidator::isValidName(""));
+    assert(!HeaderValidator::isValidName(NULL));
+    assert(!HeaderValidator::isValidName("X-Evil\r\nSet-Cookie"));
+    assert(!HeaderValidator::isValidName("Host:"));
+    assert(!HeaderValidator::isValidName("Two Words"));
+    assert(!HeaderValidator::isValidName("caf\xc3\xa9"));
+}
+
+void testStrip() {
+    // Given we have values with unsafe bytes.
+    // Then we see they are removed and the rest kept in order.
+    assert(strip("") == "");
+    assert(strip("safe value") == "safe value");
+    assert(strip("a\r\nSet-Cookie: id=1") == "aSet-Cookie: id=1");
+    assert(strip(string("\r\n\0\r\n", 5)) == "");
+    assert(strip(string("x\0y\rz\n", 6)) == "xyz");
+
+    string value;
+    string expected;
+    for (int i = 0; i < 100; i++) {
+        value += "0123456789\r\n";
+        expected += "0123456789";
+    }
+    assert(strip(value) == expected);
+}
+
+} // namespace
+
+void HeaderValidatorTest() {
+    testScan();
+    testNames();
+    testStrip();
+    printf("HeaderValidatorTest passed!\n");
+}
+
+}}} // Csr::Http::Message
@@ -0,0 +1,178 @@
+#include "HttpParser.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+using std::string;
+
+namespace {
+
+/**
+ * Checks whether or not a slice equals a string.
+ */
+bool equals(const HttpSlice& slice, const char* str) {
+    return slice.length == strlen(str)
+        && !memcmp(slice.data, str, slice.length);
+}
+
+const char* getRequest =
+    "GET /search?q=cnek&page=2 HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "User-Agent:  curl/8.0 \t\r\n"
+    "Cookie: a=1; b=2\r\n"
+    "Empty:\r\n"
+    "\r\n";
+
+void testParseRequest() {
+    // Setup.
+    HttpRequestHead head;
+    string data = string(getRequest) + "body";
+
+    // Given a complete request head followed by a body.
+    // When we parse it.
+    int length = HttpParser::parseRequest(data.data(), data.size(), &head);
+
+    // Then we see the length of the head, without the body.
+    assert(length == (int)strlen(getRequest));
+
+    // And the slices of the request line.
+    assert(equals(head.method, "GET"));
+    assert(equals(head.target, "/search?q=cnek&page=2"));
+    assert(equals(head.path, "/search"));
+    assert(equals(head.query, "q=cnek&page=2"));
+    assert(equals(head.protocol, "HTTP/1.1"));
+    assert(head.majorVersion == 1 && head.minorVersion == 1);
+
+    // And the header fields in order, with values trimmed.
+    assert(head.headerCount == 4);
+    assert(equals(head.headers[0].name, "Host"));
+    assert(equals(head.headers[0].value, "example.com"));
+    assert(equals(head.headers[1].name, "User-Agent"));
+    assert(equals(head.headers[1].value, "curl/8.0"));
+    assert(equals(head.headers[2].value, "a=1; b=2"));
+    assert(equals(head.headers[3].name, "Empty"));
+    assert(equals(head.headers[3].value, ""));
+
+    // And the slices point into the data.
+    assert(head.method.data == data.data());
+}
+
+void testIncomplete() {
+    // Setup.
+    HttpRequestHead head;
+    size_t size = strlen(getRequest);
+
+    // Given every incomplete prefix of a request head.
+    for (size_t i = 0; i < size; i++) {
+        // When we parse it.
+        // Then we see more bytes are needed.
+        assert(!HttpParser::parseRequest(getRequest, i, &head));
+    }
+
+    // Given empty lines before a request, as sent after a previous body.
+    string data = string("\r\n\r\n") + getRequest;
+
+    // When we parse it.
+    // Then we see they are skipped.
+    assert(HttpParser::parseRequest(data.data(), data.size(), &head)
+        == (int)data.size());
+    assert(equals(head.method, "GET"));
+}
+
+void testMalformed() {
+    const char* requests[] = {
+        " GET / HTTP/1.1\r\n\r\n",                  // Empty method.
+        "G(T / HTTP/1.1\r\n\r\n",                   // Method not a token.
+        "GET  HTTP/1.1\r\n\r\n",                    // Empty target.
+        "GET /a\x7f HTTP/1.1\r\n\r\n",              // DEL in target.
+        "GET / HTTP/1.1 \r\n\r\n",                  // Trailing space.
+        "GET / HTTPS/1.1\r\n\r\n",                  // Wrong protocol.
+        "GET / HTTP/11\r\n\r\n",                    // Missing '.'.
+        "GET / HTTP/1.1\n\r\n",                     // Bare LF.
+        "GET / HTTP/1.1\r\nHost : a\r\n\r\n",       // Space before ':'.
+        "GET / HTTP/1.1\r\n: a\r\n\r\n",            // Empty name.
+        "GET / HTTP/1.1\r\nA: b\r\n c\r\n\r\n",     // Obsolete folding.
+        "GET / HTTP/1.1\r\nA: b\rc\r\n\r\n",        // Bare CR in value.
+        "GET / HTTP/1.1\r\nA: b\r\n\r\r\n",         // Bad empty line.
+        NULL
+    };
+
+    for (int i = 0; requests[i]; i++) {
+        // Setup.
+        HttpRequestHead head;
+
+        // Given a malformed request.
+        // When we parse it.
+        // Then we see it is rejected.
+        assert(HttpParser::parseRequest(
+            requests[i], strlen(requests[i]), &head) == -1);
+    }
+
+    // Given a value with a null byte.
+    HttpRequestHead head;
+    const char withNull[] = "GET / HTTP/1.1\r\nA: b\0c\r\n\r\n";
+
+    // When we parse it.
+    // Then we see it is rejected.
+    assert(HttpParser::parseRequest(
+        withNull, sizeof(withNull) - 1, &head) == -1);
+
+    // Given a request with more header fields than allowed.
+    string tooMany = "GET / HTTP/1.1\r\n";
+    for (int i = 0; i <= MAX_HTTP_PARSER_HEADERS; i++) tooMany += "A: b\r\n";
+    tooMany += "\r\n";
+
+    // When we parse it.
+    // Then we see it is rejected.
+    assert(HttpParser::parseRequest(
+        tooMany.data(), tooMany.size(), &head) == -1);
+}
+
+void testScanBoundaries() {
+    // Setup.
+    HttpRequestHead head;
+
+    for (size_t position = 0; position < 40; position++) {
+        // Given long values and targets, with the end of each at every
+        // offset within and across 16-byte blocks.
+        string target = "/" + string(position, 'a');
+        string value = string(position, 'v') + "\xc3\xa9\t!";
+        string data = "GET " + target + " HTTP/1.0\r\nName: " + value
+            + "\r\n\r\n";
+
+        // When we parse it.
+        int length = HttpParser::parseRequest(data.data(), data.size(), &head);
+
+        // Then we see the slices end at the same bytes whether or not
+        // scanning is vectorized.
+        assert(length == (int)data.size());
+        assert(equals(head.target, target.c_str()));
+        assert(equals(head.headers[0].value, value.c_str()));
+
+        // Given a control character at that offset instead.
+        string bad = "GET / HTTP/1.0\r\nName: " + string(position, 'v')
+            + "\x01" + "\r\n\r\n";
+
+        // When we parse it.
+        // Then we see it is rejected.
+        assert(HttpParser::parseRequest(bad.data(), bad.size(), &head) == -1);
+    }
+}
+
+} // namespace
+
+void HttpParserTest() {
+    testParseRequest();
+    testIncomplete();
+    testMalformed();
+    testScanBoundaries();
+    printf("HttpParserTest passed!\n");
+}
+
+}}} // Csr::Http::Message
@@ -0,0 +1,302 @@
+#include "JsonDocument.hpp"
+#include "Stream.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+#include <string>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+using std::invalid_argument;
+using std::string;
+
+namespace {
+
+/**
+ * Checks whether or not a value is a string equal to another.
+ */
+bool equals(JsonValue value, const string& expected) {
+    const char* data = NULL;
+    size_t length = 0;
+    return value.getString(&data, &length)
+        && string(data, length) == expected;
+}
+
+/**
+ * Checks whether or not a text is rejected.
+ */
+bool isrejected(const string& json) {
+    JsonDocument document;
+    try {
+        document.parse(json.data(), json.size());
+    } catch (invalid_argument&) {
+        return document.getError() && document.getRoot().isMissing();
+    }
+    return false;
+}
+
+void testLookup() {
+    // Given we have a document with nested objects and arrays.
+    JsonDocument document;
+    const char* json =
+        " {\"user\": {\"id\": 42, \"name\": \"cnek\", \"tags\": [\"a\", [], {}]},"
+        "  \"active\": true, \"deleted\": false, \"parent\": null,"
+        "  \"user\": \"duplicate\"} ";
+
+    // When we parse it.
+    document.parse(json, strlen(json));
+
+    // Then we see members looked up through the tree.
+    JsonValue root = document.getRoot();
+    assert(!document.getError());
+    assert(root.getType() == JSON_OBJECT);
+    assert(root.getSize() == 5);
+
+    int64_t id = 0;
+    assert(root.get("user").get("id").getInteger(&id) && id == 42);
+    assert(equals(root.get("user").get("name"), "cnek"));
+
+    JsonValue tags = root.get("user").get("tags");
+    assert(tags.getType() == JSON_ARRAY);
+    assert(tags.getSize() == 3);
+    assert(equals(tags.at(0), "a"));
+    assert(tags.at(1).getType() == JSON_ARRAY && !tags.at(1).getSize());
+    assert(tags.at(2).getType() == JSON_OBJECT && !tags.at(2).getSize());
+    assert(tags.at(3).isMissing());
+
+    bool flag = false;
+    assert(root.get("active").getBool(&flag) && flag);
+    assert(root.get("deleted").getBool(&flag) && !flag);
+    assert(root.get("parent").isNull());
+
+    // And we see the first of duplicate members is returned.
+    assert(root.get("user").getType() == JSON_OBJECT);
+
+    // And we see lookups of what does not exist are missing.
+    assert(root.get("missing").isMissing());
+    assert(root.get("missing").get("id").getType() == JSON_MISSING);
+    assert(!root.get("missing").getInteger(&id));
+    assert(root.get("active").get("id").isMissing());
+    assert(tags.get("a").isMissing());
+    assert(root.at(0).isMissing());
+    assert(!equals(root.get("user").get("id"), "42"));
+}
+
+void testIteration() {
+    // Given we have a document with an object of arrays.
+    JsonDocument document;
+    const char* json = "{\"a\":[1,[2,3],{\"b\":4}],\"c\":{},\"d\":5}";
+    document.parse(json, strlen(json));
+
+    // When we iterate over its members.
+    string keys;
+    for (JsonValue value = document.getRoot().getFirst();
+         !value.isMissing();
+         value = value.getNext())
+    {
+        const char* key = NULL;
+        size_t length = 0;
+        assert(value.getKey(&key, &length));
+        keys.append(key, length);
+    }
+
+    // Then we see each key once, skipping the nested values.
+    assert(keys == "acd");
+
+    // And we see array elements have no key.
+    JsonValue first = document.getRoot().get("a").getFirst();
+    const char* key = NULL;
+    size_t length = 0;
+    assert(!first.getKey(&key, &length));
+    assert(first.getNext().getType() == JSON_ARRAY);
+    assert(first.getNext().getNext().getType() == JSON_OBJECT);
+    assert(first.getNext().getNext().getNext().isMissing());
+    assert(document.getRoot().getNext().isMissing());
+}
+
+void testStrings() {
+    // Given we have strings with escapes.
+    JsonDocument document;
+    const char* json =
+        "[\"plain\", \"say \\\"hi\\\"\", \"a\\\\\", \"\\\\\\\"\","
+        " \"\\/\\b\\f\\n\\r\\t\", \"caf\\u00e9 \\u20ac \\ud83d\\ude00\","
+        " \"\\u0000\", \"\\ud83d\", \"\\x\", \"]\"]";
+
+    // When we parse them.
+    document.parse(json, strlen(json));
+    JsonValue root = document.getRoot();
+
+    // Then we see each unescaped.
+    assert(root.getSize() == 10);
+    assert(equals(root.at(0), "plain"));
+    assert(equals(root.at(1), "say \"hi\""));
+    assert(equals(root.at(2), "a\\"));
+    assert(equals(root.at(3), "\\\""));
+    assert(equals(root.at(4), "/\b\f\n\r\t"));
+    assert(equals(root.at(5), "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80"));
+    assert(equals(root.at(6), string("\0", 1)));
+    assert(equals(root.at(9), "]"));
+
+    // And we see malformed escapes are rejected when read.
+    const char* data = NULL;
+    size_t length = 0;
+    assert(!root.at(7).getString(&data, &length));
+    assert(!root.at(8).getString(&data, &length));
+
+    // And we see control characters are rejected when read.
+    const char* control = "\"a\tb\"";
+    document.parse(control, strlen(control));
+    assert(!document.getRoot().getString(&data, &length));
+    assert(document.isUtf8());
+
+    // And we see text that is not UTF-8 is flagged.
+    document.parse("\"caf\xc3\xa9\"", 7);
+    assert(document.isUtf8());
+    document.parse("\"caf\xe9\"", 6);
+    assert(!document.isUtf8());
+}
+
+void testBlockBoundaries() {
+    // Given we have escaped quotes and runs of backslashes across every
+    // offset of the 64-byte blocks.
+    for (size_t offset = 0; offset < 130; offset++) {
+        string padding(offset, 'x');
+        string json = "[\"" + padding + "\\\"\", \"" + padding
+            + "\\\\\", \"" + padding + "\\\\\\\\\\\"\", 7]";
+
+        // When we parse them.
+        JsonDocument document;
+        document.parse(json.data(), json.size());
+        JsonValue root = document.getRoot();
+
+        // Then we see the strings end at their closing quotes.
+        int64_t value = 0;
+        assert(root.getSize() == 4);
+        assert(equals(root.at(0), padding + "\""));
+        assert(equals(root.at(1), padding + "\\"));
+        assert(equals(root.at(2), padding + "\\\\\""));
+        assert(root.at(3).getInteger(&value) && value == 7);
+    }
+}
+
+void testNumbers() {
+    // Given we have numbers.
+    JsonDocument document;
+    const char* json =
+        "[0, -7, 9223372036854775807, -9223372036854775808,"
+        " 9223372036854775808, 1.5, -2.5e3, 1E-2, 01, 1., -, 1e]";
+
+    // When we parse them.
+    document.parse(json, strlen(json));
+    JsonValue root = document.getRoot();
+
+    // Then we see integers read within range.
+    int64_t integer = 1;
+    assert(root.at(0).getInteger(&integer) && integer == 0);
+    assert(root.at(1).getInteger(&integer) && integer == -7);
+    assert(root.at(2).getInteger(&integer)
+           && integer == 9223372036854775807LL);
+    assert(root.at(3).getInteger(&integer)
+           && integer == -9223372036854775807LL - 1);
+    assert(!root.at(4).getInteger(&integer));
+    assert(!root.at(5).getInteger(&integer));
+
+    // And we see numbers read as doubles.
+    double number = 0;
+    assert(root.at(4).getNumber(&number) && number == 9223372036854775808.0);
+    assert(root.at(5).getNumber(&number) && number == 1.5);
+    assert(root.at(6).getNumber(&number) && number == -2500);
+    assert(root.at(7).getNumber(&number) && number == 0.01);
+    assert(root.at(1).getNumber(&number) && number == -7);
+
+    // And we see malformed numbers are rejected when read.
+    for (size_t i = 8; i < 12; i++) {
+        assert(root.at(i).getType() == JSON_NUMBER);
+        assert(!root.at(i).getNumber(&number));
+        assert(!root.at(i).getInteger(&integer));
+    }
+
+    // And we see other values are not numbers.
+    assert(!root.getNumber(&number));
+    assert(!root.at(12).getNumber(&number));
+}
+
+void testMalformed() {
+    // Given we have malformed texts.
+    // Then we see each is rejected.
+    assert(isrejected(""));
+    assert(isrejected("   "));
+    assert(isrejected("[1 2]"));
+    assert(isrejected("{\"a\"}"));
+    assert(isrejected("{\"a\":}"));
+    assert(isrejected("{\"a\":1,}"));
+    assert(isrejected("[1,]"));
+    assert(isrejected("{1:2}"));
+    assert(isrejected("[1}"));
+    assert(isrejected("[[]"));
+    assert(isrejected("]"));
+    assert(isrejected("\"unclosed"));
+    assert(isrejected("[\"a\\\"]"));
+    assert(isrejected("{} {}"));
+    assert(isrejected("1 2"));
+    assert(isrejected("tru"));
+    assert(isrejected("truex"));
+    assert(isrejected("[nul]"));
+    assert(isrejected("\"a\"b"));
+    assert(isrejected(string("[1,\0]", 5)));
+
+    // And we see a rejected document is empty until parsed again.
+    JsonDocument document;
+    bool isThrown = false;
+    try {
+        document.parse("[", 1);
+    } catch (invalid_argument&) {
+        isThrown = true;
+    }
+    assert(isThrown);
+    assert(document.getError());
+    document.parse("true", 4);
+    assert(!document.getError());
+    assert(document.getRoot().getType() == JSON_BOOL);
+}
+
+void testStream() {
+    // Given we have a stream with an array larger than the read chunks.
+    Stream stream;
+    stream.write("[");
+    for (int i = 0; i < 20000; i++) {
+        char element[32];
+        snprintf(element, sizeof(element), "%s{\"id\":%d}", i ? "," : "", i);
+        stream.write(element);
+    }
+    stream.write("]");
+
+    // When we parse it.
+    JsonDocument document;
+    document.parse(&stream);
+
+    // Then we see every element.
+    JsonValue root = document.getRoot();
+    assert(root.getSize() == 20000);
+    int64_t id = 0;
+    assert(root.at(19999).get("id").getInteger(&id) && id == 19999);
+}
+
+} // namespace
+
+void JsonDocumentTest() {
+    testLookup();
+    testIteration();
+    testStrings();
+    testBlockBoundaries();
+    testNumbers();
+    testMalformed();
+    testStream();
+    printf("JsonDocumentTest passed!\n");
+}
+
+}}} // Csr::Http::Message
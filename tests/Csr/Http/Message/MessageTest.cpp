@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <stdexcept>
 
 namespace Csr {
 namespace Http {
@@ -185,6 +186,40 @@ void testRemoveHeader() {
     delete message;
 }
 
+void testSetHeaderInjection() {
+    // Setup.
+    Message* message = new Message();
+    const char* names[] = {"X-Evil\r\nSet-Cookie", "Host:", "", "X-Ok"};
+    const char* values[] = {"ok", "ok", "ok", "a\r\nSet-Cookie: id=1"};
+
+    // Given we have header fields that could inject other fields.
+    for (int i = 0; i < 4; i++) {
+        // When we set or add each.
+        // Then we see each is rejected.
+        bool isThrown = false;
+        try {
+            message->setHeader(names[i], values[i]);
+        } catch (std::runtime_error&) {
+            isThrown = true;
+        }
+        assert(isThrown);
+
+        isThrown = false;
+        try {
+            message->setAddedHeader(names[i], values[i]);
+        } catch (std::runtime_error&) {
+            isThrown = true;
+        }
+        assert(isThrown);
+    }
+
+    // And we see none were set.
+    assert(!message->getHeaders().next());
+
+    // Teardown.
+    delete message;
+}
+
 void testGetBody() {
     // Setup.
     Message* message = new Message();
@@ -217,6 +252,7 @@ void MessageTest() {
     testSetGetHeader();
     testSetAddedGetHeaderLine();
     testRemoveHeader();
+    testSetHeaderInjection();
     testGetBody();
     printf("MessageTest passed!\n");
 }
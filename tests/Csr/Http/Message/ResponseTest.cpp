@@ -47,11 +47,35 @@ void testStatusCodeReasonPhrase() {
     delete response;
 }
 
+void testReset() {
+    // Given we have a response with a header, body and protocol version.
+    Response* response = new Response(404, "Not Found");
+    response->setHeader("Content-Type", "text/html");
+    response->setProtocolVersion("1.0");
+    response->getBody()->write("Missing");
+
+    // When we reset it to "201 Created".
+    response->reset(201, "Created");
+
+    // Then we see the new status.
+    assert(response->getStatusCode() == 201);
+    assert(!strcmp(response->getReasonPhrase(), "Created"));
+
+    // And the headers, protocol version and body are gone.
+    assert(!response->hasHeader("Content-Type"));
+    assert(!strcmp(response->getProtocolVersion(), ""));
+    assert(response->getBody()->getSize() == 0);
+
+    // Teardown.
+    delete response;
+}
+
 } // namespace
 
 void ResponseTest() {
     testCreateResponse();
     testStatusCodeReasonPhrase();
+    testReset();
     printf("ResponseTest passed!\n");
 }
 
@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <stdexcept>
+#include <string>
 
 namespace Csr {
 namespace Http {
@@ -51,6 +53,52 @@ void testCreateServerRequest() {
     delete serverRequest;
 }
 
+void testCreateServerRequestFromHead() {
+    // Setup.
+    const char* data =
+        "POST /form?page=2 HTTP/1.0\r\n"
+        "Host: example.com\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Cookie: session=abc; theme=dark\r\n"
+        "Accept: text/html\r\n"
+        "accept: text/plain\r\n"
+        "\r\n";
+    HttpRequestHead head;
+    assert(HttpParser::parseRequest(data, strlen(data), &head) > 0);
+    char remoteAddr[] = "REMOTE_ADDR=127.0.0.1";
+    char* serverParams[] = {remoteAddr, NULL};
+
+    // Given we have a server request created from a parsed request head.
+    ServerRequest* serverRequest = new ServerRequest(head, serverParams);
+
+    // Then we see the method, uri and protocol version of the request line.
+    assert(!strcmp(serverRequest->getMethod(), "POST"));
+    assert(!strcmp(serverRequest->getUri()->getPath(), "/form"));
+    assert(!strcmp(serverRequest->getProtocolVersion(), "1.0"));
+
+    // And the headers, with repeated fields combined.
+    assert(!strcmp(serverRequest->getHeaderLine("Host"), "example.com"));
+    assert(!strcmp(serverRequest->getHeaderLine("Accept"),
+                   "text/html,text/plain"));
+
+    // And the cookies and query params.
+    assert(!strcmp(serverRequest->getCookieParam("theme"), "dark"));
+    assert(!strcmp(serverRequest->getQueryParam("page"), "2"));
+
+    // And the server params derived from the head, or given.
+    assert(!strcmp(serverRequest->getServerParam("REQUEST_URI"),
+                   "/form?page=2"));
+    assert(!strcmp(serverRequest->getServerParam("QUERY_STRING"), "page=2"));
+    assert(!strcmp(serverRequest->getServerParam("CONTENT_TYPE"),
+                   "application/x-www-form-urlencoded"));
+    assert(!strcmp(serverRequest->getServerParam("REMOTE_ADDR"),
+                   "127.0.0.1"));
+    assert(!strcmp(serverRequest->getServerParam("CONTENT_LENGTH"), ""));
+
+    // Teardown.
+    delete serverRequest;
+}
+
 void testGetServerParam() {
     // Setup.
     ServerRequest* serverRequest = NULL;
@@ -205,6 +253,145 @@ void testGetBodyParam() {
     delete serverRequest;
 }
 
+void testGetJsonBody() {
+    // Setup.
+    char contentType[] = "CONTENT_TYPE=Application/Problem+JSON; charset=utf-8";
+    char* serverParams[] = {contentType, NULL};
+
+    // Given we have a server request with a JSON Content-Type and body.
+    ServerRequest* serverRequest =
+        new ServerRequest("PUT", "/path", serverParams);
+    serverRequest->getBody()->write("{\"id\": 7, \"name\": \"cnek\"}");
+
+    // Then we see the body is JSON.
+    assert(serverRequest->isJson());
+
+    // And we see its values.
+    JsonValue body = serverRequest->getJsonBody();
+    int64_t id = 0;
+    const char* name = NULL;
+    size_t length = 0;
+    assert(body.get("id").getInteger(&id) && id == 7);
+    assert(body.get("name").getString(&name, &length));
+    assert(std::string(name, length) == "cnek");
+
+    // When we reset it with a malformed JSON body.
+    serverRequest->reset("POST", "/path", serverParams);
+    serverRequest->getBody()->write("{\"id\": 7");
+
+    // Then we see every call throws.
+    for (int i = 0; i < 2; i++) {
+        bool isThrown = false;
+        try {
+            serverRequest->getJsonBody();
+        } catch (std::invalid_argument&) {
+            isThrown = true;
+        }
+        assert(isThrown);
+    }
+
+    // When we reset it without a JSON Content-Type.
+    char* formParams[] = {NULL};
+    serverRequest->reset("POST", "/path", formParams);
+    serverRequest->getBody()->write("{}");
+
+    // Then we see the body is not JSON.
+    assert(!serverRequest->isJson());
+    assert(serverRequest->getJsonBody().isMissing());
+
+    // Teardown.
+    delete serverRequest;
+}
+
+void testUtf8() {
+    // Setup.
+    char queryString[] = "QUERY_STRING=q=caf%C3%A9&bad=%C3%28&raw=\xc3\xa9";
+    char cookie[] = "HTTP_COOKIE=id=7; name=\xff";
+    char contentType[] = "CONTENT_TYPE=application/x-www-form-urlencoded";
+    char* serverParams[] = {queryString, cookie, contentType, NULL};
+
+    // Given we have a server request with params that are and are not UTF-8.
+    ServerRequest* serverRequest =
+        new ServerRequest("POST", "/path", serverParams);
+    serverRequest->getBody()->write("a=%E2%82%AC&b=%ED%A0%80");
+
+    // Then we see each param flagged once decoded.
+    assert(serverRequest->isQueryParamUtf8("q"));
+    assert(!serverRequest->isQueryParamUtf8("bad"));
+    assert(serverRequest->isQueryParamUtf8("raw"));
+    assert(serverRequest->isQueryParamUtf8("missing"));
+    assert(serverRequest->isCookieParamUtf8("id"));
+    assert(!serverRequest->isCookieParamUtf8("name"));
+    assert(serverRequest->isBodyParamUtf8("a"));
+    assert(!serverRequest->isBodyParamUtf8("b"));
+    assert(serverRequest->isBodyUtf8());
+    assert(!serverRequest->isUtf8());
+
+    // When we reset it with a text body with a sequence across chunks.
+    char textType[] = "CONTENT_TYPE=text/plain; charset=utf-8";
+    char* textParams[] = {textType, NULL};
+    serverRequest->reset("PUT", "/path", textParams);
+    std::string text(16383, 'a');
+    text += "\xe2\x82\xac";
+    serverRequest->getBody()->write(text.data(), text.size());
+
+    // Then we see the body is valid.
+    assert(serverRequest->isBodyUtf8());
+    assert(serverRequest->isUtf8());
+
+    // When we reset it with a text body cut off in a sequence.
+    serverRequest->reset("PUT", "/path", textParams);
+    serverRequest->getBody()->write("\xe2\x82");
+
+    // Then we see the body is not valid.
+    assert(!serverRequest->isBodyUtf8());
+    assert(!serverRequest->isUtf8());
+
+    // When we reset it with a JSON body.
+    char jsonType[] = "CONTENT_TYPE=application/json";
+    char* jsonParams[] = {jsonType, NULL};
+    serverRequest->reset("POST", "/path", jsonParams);
+    serverRequest->getBody()->write("{\"name\": \"caf\xc3\xa9\"}");
+
+    // Then we see its indexed text is valid.
+    assert(!serverRequest->getJsonBody().isMissing());
+    assert(serverRequest->isBodyUtf8());
+    assert(serverRequest->isUtf8());
+
+    // Teardown.
+    delete serverRequest;
+}
+
+void testSanitizeHeaders() {
+    // Setup.
+    char evil[] = "HTTP_X_EVIL=a\r\nSet-Cookie: id=1\n";
+    char badName[] = "HTTP_X(BAD)=1";
+    std::string longHeader = "HTTP_X_LONG=" + std::string(2000, 'x');
+    std::string original = longHeader;
+    char* serverParams[] = {evil, badName, &longHeader[0], NULL};
+
+    // Given we have a server request with headers that could inject others.
+    ServerRequest* serverRequest =
+        new ServerRequest("GET", "/path", serverParams);
+
+    // Then we see CR and LF were stripped from values.
+    assert(!strcmp(serverRequest->getHeaderLine("X-Evil"),
+                   "aSet-Cookie: id=1"));
+    assert(!serverRequest->hasHeader("Set-Cookie"));
+
+    // And we see a header with an invalid name was skipped.
+    assert(!serverRequest->hasHeader("X(bad)"));
+
+    // And we see a long header was truncated without changing the
+    // environment.
+    assert(serverRequest->getHeaderLine("X-Long")
+           == std::string(1023, 'x'));
+    assert(longHeader == original);
+
+    // Teardown.
+    delete serverRequest;
+}
+
 void testGetSetRemoveAttribute() {
     // Setup.
     ServerRequest* serverRequest = NULL;
@@ -233,16 +420,83 @@ void testGetSetRemoveAttribute() {
     delete serverRequest;
 }
 
+void testReset() {
+    // Setup.
+    char firstCookie[] = "HTTP_COOKIE=theme=dark";
+    char firstQuery[] = "QUERY_STRING=page=2";
+    char* firstParams[] = {firstCookie, firstQuery, NULL};
+    char secondAccept[] = "HTTP_ACCEPT=text/plain";
+    char secondQuery[] = "QUERY_STRING=sort=asc";
+    char* secondParams[] = {secondAccept, secondQuery, NULL};
+
+    // Given we have a server request with a cookie, a query param, a body
+    // and an attribute.
+    ServerRequest* serverRequest =
+        new ServerRequest("POST", "/first?page=2", firstParams);
+    serverRequest->getBody()->write("a=1");
+    serverRequest->setAttribute("Foo", "Bar");
+
+    // When we reset it to another request.
+    serverRequest->reset("GET", "/second?sort=asc", secondParams);
+
+    // Then we see the method, uri and headers of the new request.
+    assert(!strcmp(serverRequest->getMethod(), "GET"));
+    assert(!strcmp(serverRequest->getRequestTarget(), "/second?sort=asc"));
+    assert(!strcmp(serverRequest->getHeaderLine("Accept"), "text/plain"));
+    assert(!strcmp(serverRequest->getQueryParam("sort"), "asc"));
+
+    // And nothing is left of the previous one.
+    assert(!serverRequest->hasHeader("Cookie"));
+    assert(!strcmp(serverRequest->getCookieParam("theme"), ""));
+    assert(!strcmp(serverRequest->getQueryParam("page"), ""));
+    assert(!strcmp(serverRequest->getAttribute("Foo"), ""));
+    assert(serverRequest->getBody()->getSize() == 0);
+
+    // When we reset it to an invalid request.
+    bool isThrown = false;
+    try {
+        serverRequest->reset("BREW", "/coffee", firstParams);
+    } catch (std::invalid_argument& exception) {
+        isThrown = true;
+    }
+
+    // Then we see it failed and the request is unchanged.
+    assert(isThrown);
+    assert(!strcmp(serverRequest->getMethod(), "GET"));
+    assert(!strcmp(serverRequest->getQueryParam("sort"), "asc"));
+
+    // When we reset it from a parsed request head.
+    const char* data = "PUT /third HTTP/1.0\r\nCookie: id=7\r\n\r\n";
+    HttpRequestHead head;
+    assert(HttpParser::parseRequest(data, strlen(data), &head) > 0);
+    serverRequest->reset(head);
+
+    // Then we see the request of the head.
+    assert(!strcmp(serverRequest->getMethod(), "PUT"));
+    assert(!strcmp(serverRequest->getProtocolVersion(), "1.0"));
+    assert(!strcmp(serverRequest->getCookieParam("id"), "7"));
+    assert(!strcmp(serverRequest->getQueryParam("sort"), ""));
+    assert(!strcmp(serverRequest->getServerParam("HTTP_ACCEPT"), ""));
+
+    // Teardown.
+    delete serverRequest;
+}
+
 } // namespace
 
 void ServerRequestTest() {
     testCreateServerRequest();
+    testCreateServerRequestFromHead();
     testGetServerParam();
     testGetCookieParam();
     testGetQueryParam();
     testGetUploadedFile();
     testGetBodyParam();
+    testGetJsonBody();
+    testUtf8();
+    testSanitizeHeaders();
     testGetSetRemoveAttribute();
+    testReset();
     printf("ServerRequestTest passed!\n");
 }
 
@@ -213,6 +213,167 @@ void testGetContents() {
     delete stream;
 }
 
+void testReadResultsStayValid() {
+    // Setup.
+    Stream* stream = new Stream();
+
+    // Given we write "0123456789" to the stream.
+    stream->write("0123456789");
+
+    // When we read 3 bytes from position 2, then 3 more.
+    stream->seek(2);
+    const char* first = stream->read(3);
+    const char* second = stream->read(3);
+
+    // Then we see the previous string read is still intact.
+    assert(!strcmp(first, "234"));
+    assert(!strcmp(second, "567"));
+
+    // And we see it stays intact after reading the rest.
+    const char* contents = stream->getContents();
+    assert(!strcmp(second, "567"));
+    assert(!strcmp(contents, "89"));
+
+    // And we see moving the position keeps the cursor where it is and
+    // strings read after it intact.
+    assert(!strcmp(stream->toString(), "0123456789"));
+    assert(stream->tell() == 10);
+    stream->seek(5);
+    const char* read = stream->read(5);
+    assert(!strcmp(read, "56789"));
+    assert(!strcmp(stream->toString(), "0123456789"));
+
+    // Teardown.
+    stream->close();
+    delete stream;
+}
+
+void testBinaryReadWrite() {
+    // Setup.
+    Stream* stream = new Stream();
+    const char data[] = {'a', '\0', 'b', '\0', 'c'};
+    char buffer[8];
+
+    // Given we write 5 bytes containing null bytes to the stream.
+    size_t bytesWritten = stream->write(data, sizeof(data));
+
+    // Then we see all 5 bytes were written.
+    assert(bytesWritten == sizeof(data));
+    assert(stream->getSize() == (long)sizeof(data));
+
+    // When we rewind and read up to 8 bytes into a buffer.
+    stream->rewind();
+    size_t bytesRead = stream->read(buffer, sizeof(buffer));
+
+    // Then we see the same 5 bytes.
+    assert(bytesRead == sizeof(data));
+    assert(!memcmp(buffer, data, sizeof(data)));
+
+    // And the stream is at end-of-file.
+    assert(!stream->read(buffer, sizeof(buffer)));
+    assert(stream->eof());
+
+    // Teardown.
+    stream->close();
+    delete stream;
+}
+
+void testUnwrittenDefaultStream() {
+    // Given we have a default stream that was never written to.
+    Stream* stream = new Stream();
+
+    // When we inspect it.
+    // Then we see an empty, seekable stream.
+    assert(stream->isSeekable());
+    assert(stream->getSize() == 0);
+    assert(stream->tell() == 0);
+    stream->rewind();
+    stream->seek(0, SEEK_END);
+    assert(!strcmp(stream->toString(), ""));
+    assert(!strcmp(stream->getContents(), ""));
+
+    char buffer[8];
+    assert(!stream->read(buffer, sizeof(buffer)));
+
+    // When we close it.
+    stream->close();
+
+    // Then it is closed like any other stream.
+    assert(!stream->isSeekable());
+    assert(!stream->isReadable());
+    assert(!stream->isWritable());
+    bool isThrown = false;
+    try {
+        stream->getSize();
+    } catch (runtime_error& exception) {
+        isThrown = true;
+    }
+    assert(isThrown);
+    delete stream;
+
+    // Given another unwritten default stream.
+    stream = new Stream();
+
+    // When we detach it.
+    FILE* resource = stream->detach();
+
+    // Then we get an empty, usable resource.
+    assert(resource);
+    assert(fputs("abc", resource) >= 0);
+    rewind(resource);
+    assert(fgetc(resource) == 'a');
+
+    // Teardown.
+    fclose(resource);
+    delete stream;
+}
+
+void testReset() {
+    // Given we have a default stream that was written to and read from.
+    Stream* stream = new Stream();
+    stream->write("Hello, World!");
+    assert(!strcmp(stream->toString(), "Hello, World!"));
+
+    // When we reset it.
+    stream->reset();
+
+    // Then we see it is empty.
+    assert(stream->isReadable());
+    assert(stream->isWritable());
+    assert(stream->getSize() == 0);
+    assert(!strcmp(stream->toString(), ""));
+
+    // And it can be written to and read from again.
+    stream->write("Bye");
+    assert(stream->getSize() == 3);
+    assert(!strcmp(stream->toString(), "Bye"));
+
+    // Given we have a stream over a file, and a closed stream.
+    FILE* file = tmpfile();
+    fputs("File", file);
+    Stream* fileStream = new Stream(file);
+    Stream* closedStream = new Stream();
+    closedStream->close();
+
+    // When we reset them.
+    fileStream->reset();
+    closedStream->reset();
+
+    // Then we see they are empty default streams.
+    assert(fileStream->getSize() == 0);
+    assert(closedStream->isSeekable());
+    closedStream->write("Open");
+    assert(!strcmp(closedStream->toString(), "Open"));
+
+    // Teardown.
+    stream->close();
+    fileStream->close();
+    closedStream->close();
+    delete stream;
+    delete fileStream;
+    delete closedStream;
+}
+
 } // namespace
 
 void StreamTest() {
@@ -226,6 +387,10 @@ void StreamTest() {
     testSeekTellRewind();
     testReadWriteEof();
     testGetContents();
+    testReadResultsStayValid();
+    testBinaryReadWrite();
+    testUnwrittenDefaultStream();
+    testReset();
     printf("StreamTest passed!\n");
 }
 
@@ -0,0 +1,96 @@
+#include "Utf8Validator.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+namespace Csr {
+namespace Http {
+namespace Message {
+
+using std::string;
+
+namespace {
+
+/**
+ * Checks whether or not a string is valid UTF-8.
+ */
+bool isvalid(const string& str) {
+    return Utf8Validator::isValid(str.data(), str.size());
+}
+
+void testValid() {
+    // Given we have well-formed text of every sequence length.
+    // Then we see each is valid.
+    assert(isvalid(""));
+    assert(isvalid("plain ASCII"));
+    assert(isvalid(string("nul \0 byte", 10)));
+    assert(isvalid("caf\xc3\xa9"));
+    assert(isvalid("\xe2\x82\xac 5"));
+    assert(isvalid("\xf0\x9f\x98\x80"));
+    assert(isvalid("\xc2\x80 \xdf\xbf"));
+    assert(isvalid("\xe0\xa0\x80 \xed\x9f\xbf \xee\x80\x80 \xef\xbf\xbf"));
+    assert(isvalid("\xf0\x90\x80\x80 \xf4\x8f\xbf\xbf"));
+    assert(Utf8Validator::isValid(NULL, 0));
+}
+
+void testInvalid() {
+    // Given we have malformed text.
+    // Then we see each is invalid.
+    assert(!isvalid("\x80"));
+    assert(!isvalid("caf\xe9"));
+    assert(!isvalid("\xc0\xaf"));
+    assert(!isvalid("\xc1\xbf"));
+    assert(!isvalid("\xe0\x9f\xbf"));
+    assert(!isvalid("\xed\xa0\x80"));
+    assert(!isvalid("\xf0\x8f\xbf\xbf"));
+    assert(!isvalid("\xf4\x90\x80\x80"));
+    assert(!isvalid("\xf5\x80\x80\x80"));
+    assert(!isvalid("\xff"));
+    assert(!isvalid("\xe2\x82"));
+    assert(!isvalid("\xe2\x82 "));
+    assert(!isvalid("\xc3\xa9\xa9"));
+}
+
+void testBlockBoundaries() {
+    // Given we have a sequence at every offset of the 16-byte blocks.
+    for (size_t offset = 0; offset < 40; offset++) {
+        string padding(offset, 'a');
+
+        // Then we see well-formed sequences are valid.
+        assert(isvalid(padding + "\xf0\x9f\x98\x80" + padding));
+
+        // And we see malformed ones are not.
+        assert(!isvalid(padding + "\xf0\x9f\x98" + padding));
+        assert(!isvalid(padding + "\xbf" + padding));
+    }
+}
+
+void testTruncated() {
+    // Given we have text cut off in the middle of a sequence.
+    string text = "price: \xe2\x82\xac";
+    size_t truncated = 0;
+
+    // When we validate it as a chunk.
+    // Then we see the cut off bytes are carried over.
+    assert(Utf8Validator::isValid(text.data(), text.size() - 1, &truncated));
+    assert(truncated == 2);
+    assert(Utf8Validator::isValid(text.data(), text.size(), &truncated));
+    assert(truncated == 0);
+
+    // And we see malformed bytes before the end are still rejected.
+    assert(!Utf8Validator::isValid("\xe2\x28", 2, &truncated));
+}
+
+} // namespace
+
+void Utf8ValidatorTest() {
+    testValid();
+    testInvalid();
+    testBlockBoundaries();
+    testTruncated();
+    printf("Utf8ValidatorTest passed!\n");
+}
+
+}}} // Csr::Http::Message
@@ -9,12 +9,30 @@ void UriTest();
 void RequestTest();
 void UploadedFileTest();
 void ServerRequestTest();
+void AllocStatsTest();
+void HttpParserTest();
+void JsonDocumentTest();
+void Utf8ValidatorTest();
+void HeaderValidatorTest();
 
 }}} // Csr::Http::Message
 
 namespace Cnek {
 
 void CnekTest();
+void StaticFileTest();
+void ResponseCacheTest();
+void TimingTest();
+void RecorderTest();
+void ScgiServerTest();
+void HttpServerTest();
+void PreforkTest();
+void ThreadPoolTest();
+void AsyncHandlerTest();
+void AccessLogTest();
+void LatencyStatsTest();
+void TemplateTest();
+void JsonWriterTest();
 
 } // Cnek
 
@@ -25,7 +43,25 @@ using Csr::Http::Message::UriTest;
 using Csr::Http::Message::RequestTest;
 using Csr::Http::Message::UploadedFileTest;
 using Csr::Http::Message::ServerRequestTest;
+using Csr::Http::Message::AllocStatsTest;
+using Csr::Http::Message::HttpParserTest;
+using Csr::Http::Message::JsonDocumentTest;
+using Csr::Http::Message::Utf8ValidatorTest;
+using Csr::Http::Message::HeaderValidatorTest;
 using Cnek::CnekTest;
+using Cnek::StaticFileTest;
+using Cnek::ResponseCacheTest;
+using Cnek::TimingTest;
+using Cnek::RecorderTest;
+using Cnek::ScgiServerTest;
+using Cnek::HttpServerTest;
+using Cnek::PreforkTest;
+using Cnek::ThreadPoolTest;
+using Cnek::AsyncHandlerTest;
+using Cnek::AccessLogTest;
+using Cnek::LatencyStatsTest;
+using Cnek::TemplateTest;
+using Cnek::JsonWriterTest;
 
 int main() {
     StreamTest();
@@ -35,5 +71,23 @@ int main() {
     RequestTest();
     UploadedFileTest();
     ServerRequestTest();
+    AllocStatsTest();
+    HttpParserTest();
+    JsonDocumentTest();
+    Utf8ValidatorTest();
+    HeaderValidatorTest();
     CnekTest();
+    StaticFileTest();
+    ResponseCacheTest();
+    TimingTest();
+    RecorderTest();
+    ScgiServerTest();
+    HttpServerTest();
+    PreforkTest();
+    ThreadPoolTest();
+    AsyncHandlerTest();
+    AccessLogTest();
+    LatencyStatsTest();
+    TemplateTest();
+    JsonWriterTest();
 }